@@ -19,10 +19,10 @@ import Foundation
 /// Mutex
 public struct Mutex {
     @usableFromInline let sem = DispatchSemaphore(value: 1)
-    @inlinable public func access<R>(_ body: () -> R) -> R {
+    @inlinable public func access<R>(_ body: () throws -> R) rethrows -> R {
         sem.wait()
         defer { sem.signal() }
-        return body()
+        return try body()
     }
 }
 
@@ -0,0 +1,112 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+/// activation(x:type:reluCeiling:nan:
+/// applies an activation function element wise in a single pass. The
+/// derivative is computed from the saved output, so `sigmoid` and `tanh`
+/// are not evaluated again by the backward pass.
+/// - Parameters:
+///  - x: the activation input
+///  - type: the activation function
+///  - reluCeiling: the upper bound for `clippedRelu`
+///  - nan: `.propagate` keeps NaN inputs of `relu` and `clippedRelu`,
+///    `.noPropagate` clamps them to zero. The other activations always
+///    propagate NaN.
+/// - Returns: a new tensor containing the result
+@differentiable(wrt: x where E.Value: DifferentiableNumeric)
+@inlinable public func activation<S,E>(
+    _ x: Tensor<S,E>,
+    _ type: ActivationType,
+    reluCeiling: E.Value = E.Value(defaultReluCeiling),
+    nan: NanPropagation = .noPropagate
+) -> Tensor<S,E> where E.Value: Real {
+    guard type != .identity else { return x }
+    var result = Tensor(like: x)
+    currentQueue.activation(x, type, reluCeiling, nan, &result)
+    return result
+}
+
+@derivative(of: activation, wrt: x)
+@usableFromInline func _vjpActivation<S,E>(
+    _ x: Tensor<S,E>,
+    _ type: ActivationType,
+    reluCeiling: E.Value = E.Value(defaultReluCeiling),
+    nan: NanPropagation = .noPropagate
+) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> Tensor<S,E>)
+where E.Value: DifferentiableNumeric & Real
+{
+    let value = activation(x, type, reluCeiling: reluCeiling, nan: nan)
+    return (value, {
+        activationGradient(value, $0, type, reluCeiling: reluCeiling, nan: nan)
+    })
+}
+
+//==============================================================================
+/// applyActivation(type:to:reluCeiling:nan:
+/// applies an activation function to `x` in place, which avoids
+/// allocating a result when `x` is uniquely referenced
+/// - Parameters:
+///  - type: the activation function
+///  - x: the tensor to transform
+///  - reluCeiling: the upper bound for `clippedRelu`
+///  - nan: the NaN propagation of `relu` and `clippedRelu`
+@inlinable public func applyActivation<S,E>(
+    _ type: ActivationType,
+    to x: inout Tensor<S,E>,
+    reluCeiling: E.Value = E.Value(defaultReluCeiling),
+    nan: NanPropagation = .noPropagate
+) where E.Value: Real {
+    guard type != .identity else { return }
+    if x.isContiguous {
+        currentQueue.activation(type, reluCeiling, nan, inPlace: &x)
+    } else {
+        x = activation(x, type, reluCeiling: reluCeiling, nan: nan)
+    }
+}
+
+//==============================================================================
+/// relu(x)
+/// computes `max(0, x)` element wise
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func relu<S,E>(
+    _ x: Tensor<S,E>
+) -> Tensor<S,E> where E.Value: Real {
+    activation(x, .relu)
+}
+
+//==============================================================================
+/// clippedRelu(x:ceiling:
+/// computes `min(ceiling, max(0, x))` element wise
+@differentiable(wrt: x where E.Value: DifferentiableNumeric)
+@inlinable public func clippedRelu<S,E>(
+    _ x: Tensor<S,E>,
+    ceiling: E.Value = E.Value(defaultReluCeiling)
+) -> Tensor<S,E> where E.Value: Real {
+    activation(x, .clippedRelu, reluCeiling: ceiling)
+}
+
+//==============================================================================
+/// elu(x)
+/// computes `x` for positive values and `exp(x) - 1` otherwise
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func elu<S,E>(
+    _ x: Tensor<S,E>
+) -> Tensor<S,E> where E.Value: Real {
+    activation(x, .elu)
+}
@@ -0,0 +1,68 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// dropout(x:probability:seed:offset:
+/// sets each element to zero with `probability` and scales the kept
+/// elements by `1 / (1 - probability)`. The keep mask is generated inside
+/// the multiply loop from the Philox counter stream of `seed`, so no
+/// random tensor or mask is allocated, and the result does not depend on
+/// the number of threads. The backward pass regenerates the same mask.
+/// - Parameters:
+///  - x: the input
+///  - probability: the probability of dropping an element in `0..<1`
+///  - seed: the random seed of the mask
+///  - offset: the position of the first element in the counter stream.
+///    Calls that share a seed generate independent masks when their
+///    offsets differ by at least the element count.
+/// - Returns: a new dense row major tensor containing the result
+@differentiable(wrt: x where E.Value: DifferentiableNumeric)
+@inlinable public func dropout<S,E>(
+    _ x: Tensor<S,E>,
+    probability: Double,
+    seed: RandomSeed = Platform.randomSeed,
+    offset: UInt64 = 0
+) -> Tensor<S,E> where E.Value: BinaryFloatingPoint {
+    assert(probability >= 0 && probability < 1,
+           "the dropout probability must be in 0..<1")
+    guard probability > 0 else { return x }
+    var result = Tensor<S,E>(shape: x.shape, order: .row)
+    currentQueue.dropout(denseRow(x), probability,
+                         UInt64(msb: seed.op, lsb: seed.graph), offset,
+                         &result)
+    return result
+}
+
+@derivative(of: dropout, wrt: x)
+@usableFromInline func _vjpDropout<S,E>(
+    _ x: Tensor<S,E>,
+    probability: Double,
+    seed: RandomSeed = Platform.randomSeed,
+    offset: UInt64 = 0
+) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> Tensor<S,E>)
+where E.Value: DifferentiableNumeric & BinaryFloatingPoint
+{
+    // the mask is regenerated from the seed and offset, not stored
+    let value = dropout(x, probability: probability, seed: seed,
+                        offset: offset)
+    let shape = x.shape
+    return (value, {
+        let diff = $0.shape == shape ? $0 : Tensor(repeating: $0, to: shape)
+        return dropout(diff, probability: probability, seed: seed,
+                       offset: offset)
+    })
+}
@@ -17,7 +17,14 @@ import Foundation
 
 //==============================================================================
 /// gather(from:indices:axis:
-/// consolidates the specified slices
+/// consolidates the specified slices. The selected slices are copied in
+/// parallel as contiguous spans.
+/// - Parameters:
+///  - tensor: the tensor to gather from
+///  - indices: the slices of `tensor` to copy
+///  - axis: the gathered axis
+/// - Returns: a dense row major tensor where `shape[axis]` is the number
+///   of indices
 @differentiable(where E.Value: DifferentiableNumeric)
 @inlinable public func gather<S,E>(
     from tensor: Tensor<S,E>,
@@ -29,21 +36,13 @@ where S: TensorShape
     let axis = axis < 0 ? axis + S.rank : axis
     var shape = tensor.shape
     shape[axis] = indices.count
-    var result = Tensor<S,E>(shape: shape, order: tensor.order)
-    var rlower = S.zero, tlower = S.zero
-    var rupper = tensor.shape, tupper = tensor.shape
-    for (ri, ti) in indices.enumerated() {
-        rlower[axis] = Int(ri)
-        rupper[axis] = rlower[axis] + 1
-        tlower[axis] = Int(ti)
-        tupper[axis] = tlower[axis] + 1
-        result[rlower, rupper] = tensor[tlower, tupper]
-    }
+    var result = Tensor<S,E>(shape: shape, order: .row)
+    guard indices.count > 0 else { return result }
+    currentQueue.gather(denseRow(tensor), denseRow(indices), axis, &result)
     return result
 }
 
-// TODO: get this verified
-@derivative(of: gather)
+@derivative(of: gather(from:indices:axis:))
 @usableFromInline func _vjpGather<S,E>(
     from tensor: Tensor<S,E>,
     indices: TensorR1<DeviceIndex>,
@@ -54,21 +53,83 @@ where S: TensorShape, E.Value: DifferentiableNumeric
     let axis = axis < 0 ? axis + S.rank : axis
     let value = gather(from: tensor, indices: indices, axis: axis)
     let shape = tensor.shape
+    let indices = indices.map { Int($0) }
     return (value, {
-        var result = Tensor<S,E>(zeros: shape, order: tensor.order)
-        var rlower = S.zero, tlower = S.zero
-        var rupper = shape, tupper = shape
-        for (ti, ri) in indices.enumerated() {
-            rlower[axis] = Int(ri)
-            rupper[axis] = rlower[axis] + 1
-            tlower[axis] = Int(ti)
-            tupper[axis] = tlower[axis] + 1
-            result[rlower, rupper] = $0[tlower, tupper]
-        }
-        return result
+        // the slices of repeated indices are summed
+        let diff = $0.shape == value.shape ? $0 :
+            Tensor(repeating: $0, to: value.shape)
+        return scatterAdd(diff, indices: indices, axis: axis,
+                          into: Tensor<S,E>(zeros: shape, order: .row))
     })
 }
 
+//==============================================================================
+/// gather(from:indices:axis:into:
+/// consolidates the specified slices into `result`, which is reused when
+/// it is already a dense row major tensor of the gathered shape
+/// - Parameters:
+///  - tensor: the tensor to gather from
+///  - indices: the slices of `tensor` to copy
+///  - axis: the gathered axis
+///  - result: the output, where `shape[axis]` is the number of indices
+@inlinable public func gather<S,E>(
+    from tensor: Tensor<S,E>,
+    indices: [Int],
+    axis: Int = 0,
+    into result: inout Tensor<S,E>
+) where S: TensorShape {
+    let axis = axis < 0 ? axis + S.rank : axis
+    var shape = tensor.shape
+    shape[axis] = indices.count
+    reuseOutput(&result, shape)
+    guard indices.count > 0 else { return }
+    currentQueue.gather(denseRow(tensor), indices, axis, &result)
+}
+
+/// gather(from:indices:axis:into:
+/// consolidates the slices selected by a tensor of indices into `result`.
+/// The indices are read in place, so they are not converted on each call.
+@inlinable public func gather<S,E>(
+    from tensor: Tensor<S,E>,
+    indices: TensorR1<DeviceIndex>,
+    axis: Int = 0,
+    into result: inout Tensor<S,E>
+) where S: TensorShape {
+    let axis = axis < 0 ? axis + S.rank : axis
+    var shape = tensor.shape
+    shape[axis] = indices.count
+    reuseOutput(&result, shape)
+    guard indices.count > 0 else { return }
+    currentQueue.gather(denseRow(tensor), denseRow(indices), axis, &result)
+}
+
+//==============================================================================
+/// scatterAdd(values:indices:axis:into:
+/// adds each slice of `values` along `axis` to the slice of `tensor`
+/// selected by the corresponding index. The slices of repeated indices
+/// are added in order, so the result is deterministic.
+/// - Parameters:
+///  - values: the slices to add, where `shape[axis]` is the number of
+///    indices
+///  - indices: the slice of `tensor` that each slice is added to
+///  - axis: the scattered axis
+///  - tensor: the tensor to add to
+/// - Returns: a dense row major copy of `tensor` with the slices added
+@inlinable public func scatterAdd<S,E>(
+    _ values: Tensor<S,E>,
+    indices: [Int],
+    axis: Int = 0,
+    into tensor: Tensor<S,E>
+) -> Tensor<S,E> where E.Value: Numeric {
+    let axis = axis < 0 ? axis + S.rank : axis
+    assert(values.shape[axis] == indices.count,
+           "there must be one index for each slice")
+    var result = denseRow(tensor)
+    guard indices.count > 0 else { return result }
+    currentQueue.scatterAdd(denseRow(values), indices, axis, &result)
+    return result
+}
+
 public extension Tensor {
     @differentiable(where TensorElement.Value: DifferentiableNumeric)
     @inlinable func gathering(
@@ -808,10 +808,9 @@ public extension Tensor where TensorElement.Value: Comparable & SignedNumeric {
     _ x: Tensor<S,E>
 ) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> Tensor<S,E>)
 where E.Value: DifferentiableNumeric & Real {
-    (sigmoid(x), { v in
-        // Dan
-        fatalError()
-    })
+    // the derivative is computed from the saved output
+    let value = sigmoid(x)
+    return (value, { activationGradient(value, $0, .sigmoid) })
 }
 
 // Tensor extension
@@ -821,7 +820,7 @@ public extension Tensor where TensorElement.Value: Real {
     @inlinable func sigmoid(_ x: Self) -> Self { SwiftRTCore.sigmoid(x) }
     
     @differentiable(where TensorElement.Value: DifferentiableNumeric)
-    @inlinable func sigmoid() -> Self { sign(self) }
+    @inlinable func sigmoid() -> Self { sigmoid(self) }
 }
 
 //==============================================================================
@@ -32,17 +32,26 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
         rhsGrad = matmul(lhs, transposed: true, out, transposed: false)
     case (false, true):
         lhsGrad = matmul(out, rhs)
-        rhsGrad = matmul(lhs, transposed: true, out, transposed: false)
+        rhsGrad = matmul(out, transposed: true, lhs, transposed: false)
     case (true, false):
-        lhsGrad = matmul(out, transposed: false, rhs, transposed: true)
+        lhsGrad = matmul(rhs, transposed: false, out, transposed: true)
         rhsGrad = matmul(lhs, out)
     case (true, true):
-        lhsGrad = matmul(out, transposed: true, rhs, transposed: true)
-        rhsGrad = matmul(lhs, transposed: true, out, transposed: true)
+        lhsGrad = matmul(rhs, transposed: true, out, transposed: true)
+        rhsGrad = matmul(out, transposed: true, lhs, transposed: true)
     }
     return (lhsGrad, rhsGrad)
 }
 
+//==============================================================================
+// biasGradient
+// sums the matmul output gradient over rows to produce the bias gradient
+@usableFromInline func biasGradient<E>(_ out: TensorR2<E>) -> TensorR1<E>
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
+{
+    TensorR1<E>(squeezing: out.sum(alongAxes: 0), axes: Shape1(0))
+}
+
 //==============================================================================
 /// matmul
 /// performs a matrix cross product
@@ -109,12 +118,40 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 
 //==============================================================================
 /// matmul
-/// performs a matrix cross product
+/// performs a mixed precision matrix cross product. The operand storage
+/// types may differ as long as they share the same `Value` type, for
+/// example `Float16` or `BFloat16` weights with `Float` activations.
+/// The operands are converted to `Value` a panel at a time, the products
+/// are accumulated as `Value`, and the result is rounded once when stored.
+/// - Parameters:
+///  - lhs: left hand tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand tensor.
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+/// - Returns: a new tensor with the storage type of `lhs`
+@inlinable public func matmul<LE,RE>(
+    _ lhs: TensorR2<LE>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<RE>, transposed transposeRhs: Bool = false
+) -> TensorR2<LE> where LE.Value: Numeric, RE.Value == LE.Value
+{
+    let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+    let rhsShape = transposeRhs ? rhs.shape.t : rhs.shape
+    assert(lhsShape[1] == rhsShape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<LE>(shape: Shape2(lhsShape[0], rhsShape[1]),
+                              order: lhs.order)
+    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs, &result)
+    return result
+}
+
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with the bias added in the same pass
 /// - Parameters:
 ///  - lhs: left hand tensor
 ///  - transposeLhs: `true` to transpose `lhs`, default is `false`
 ///  - rhs: right hand tensor.
 ///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+///  - bias: a vector added to each row of the result
 /// - Returns: a new tensor containing the result
 // https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
 @differentiable(where E.Value: DifferentiableNumeric)
@@ -130,9 +167,8 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
     assert(lhsShape[1] == rhsShape[0], "matmul inner dimensions must be equal")
     var result = TensorR2<E>(shape: Shape2(lhsShape[0], rhsShape[1]),
                              order: lhs.order)
-//    let op = currentQueue.matmul2(type: E.self)
-//    op.forward(lhs, transposeLhs, rhs, transposeRhs, &result)
-    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs, &result)
+    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs,
+                        bias: bias, &result)
     return result
 }
 
@@ -144,9 +180,13 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 ) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR2<E>, TensorR1<E>))
 where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 {
-    fatalError()
-//    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
-//     { matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs) })
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs,
+            bias: bias),
+     {
+        let (lhsGrad, rhsGrad) =
+            matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs)
+        return (lhsGrad, rhsGrad, biasGradient($0))
+     })
 }
 
 @derivative(of: matmul, wrt: (lhs, bias))
@@ -157,9 +197,12 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 ) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR1<E>))
 where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 {
-    fatalError()
-//    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
-//     { matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs) })
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs,
+            bias: bias),
+     {
+        (matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs).0,
+         biasGradient($0))
+     })
 }
 
 @derivative(of: matmul, wrt: (rhs, bias))
@@ -170,94 +213,395 @@ where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 ) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR1<E>))
 where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
 {
-    fatalError()
-//    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
-//     { matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs) })
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs,
+            bias: bias),
+     {
+        (matmulGradients($0, lhs, transposeLhs, rhs, transposeRhs).1,
+         biasGradient($0))
+     })
 }
 
-////==============================================================================
-///// matmul
-///// performs a batched matrix cross product
-///// - Parameters:
-/////  - lhs: left hand batched tensor
-/////  - transposeLhs: `true` to transpose `lhs`, default is `false`
-/////  - rhs: right hand 2D tensor
-/////  - transposeRhs: `true` to transpose `rhs`, default is `false`
-///// - Returns: a new tensor containing the result
-//// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
-//@differentiable(where E.Value: DifferentiableNumeric)
-//@inlinable public func matmul<S,E>(
-//    _ lhs: Tensor<S,E>, transposed transposeLhs: Bool = false,
-//    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false
-//) -> Tensor<S,E> where S: TensorShape, E.Value: Numeric
-//{
-//    fatalError()
-//}
-//
-//@derivative(of: matmul)
-//@usableFromInline func _vjpMatmul<S,E>(
-//    _ lhs: Tensor<S,E>, transposed transposeLhs: Bool = false,
-//    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false
-//) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> (Tensor<S,E>, TensorR2<E>))
-//where S: TensorShape, E.Value: DifferentiableNumeric
-//{
-//    fatalError()
-//}
-//
-////==============================================================================
-///// matmul
-///// performs a batched matrix cross product
-///// - Parameters:
-/////  - lhs: left hand batched tensor
-/////  - transposeLhs: `true` to transpose `lhs`, default is `false`
-/////  - rhs: right hand 2D tensor
-/////  - transposeRhs: `true` to transpose `rhs`, default is `false`
-///// - Returns: a new tensor containing the result
-//// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
-//@differentiable(where E.Value: DifferentiableNumeric)
-//@inlinable public func matmul<S,E>(
-//    _ lhs: TensorR2<E>, transposed transposeRhs: Bool = false,
-//    _ rhs: Tensor<S,E>, transposed transposeLhs: Bool = false
-//) -> Tensor<S,E> where S: TensorShape, E.Value: Numeric
-//{
-//    fatalError()
-//}
-//
-//@derivative(of: matmul)
-//@usableFromInline func _vjpMatmul<S,E>(
-//    _ lhs: TensorR2<E>, transposed transposeRhs: Bool = false,
-//    _ rhs: Tensor<S,E>, transposed transposeLhs: Bool = false
-//) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> (TensorR2<E>, Tensor<S,E>))
-//where S: TensorShape, E.Value: DifferentiableNumeric
-//{
-//    fatalError()
-//}
-//
-////==============================================================================
-///// matmul
-///// performs a batched matrix cross product
-///// - Parameters:
-/////  - lhs: left hand batched tensor
-/////  - transposeLhs: `true` to transpose `lhs`, default is `false`
-/////  - rhs: right hand batched tensor
-/////  - transposeRhs: `true` to transpose `rhs`, default is `false`
-///// - Returns: a new tensor containing the result
-//// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
-//@differentiable(where E.Value: DifferentiableNumeric)
-//@inlinable public func matmul<S,E>(
-//    _ lhs: Tensor<S,E>, transposed transposeRhs: Bool = false,
-//    _ rhs: Tensor<S,E>, transposed transposeLhs: Bool = false
-//) -> Tensor<S,E> where S: TensorShape, E.Value: Numeric
-//{
-//    fatalError()
-//}
-//
-//@derivative(of: matmul)
-//@usableFromInline func _vjpMatmul<S,E>(
-//    _ lhs: Tensor<S,E>, transposed transposeRhs: Bool = false,
-//    _ rhs: Tensor<S,E>, transposed transposeLhs: Bool = false
-//) -> (value: Tensor<S,E>, pullback: (Tensor<S,E>) -> (Tensor<S,E>, Tensor<S,E>))
-//where S: TensorShape, E.Value: DifferentiableNumeric
-//{
-//    fatalError()
-//}
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with the bias and activation fused
+/// into the output tiles, computing `activation(lhs x rhs + bias)`
+/// - Parameters:
+///  - lhs: left hand tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand tensor.
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+///  - bias: a vector added to each row of the result
+///  - activation: the activation applied to the result. `clippedRelu`
+///    uses `defaultReluCeiling`
+/// - Returns: a new tensor containing the result
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false,
+    bias: TensorR1<E>,
+    activation: ActivationType
+) -> TensorR2<E> where E: StorageElement, E.Value: StorageElement & Real {
+    let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+    let rhsShape = transposeRhs ? rhs.shape.t : rhs.shape
+    assert(lhsShape[1] == rhsShape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<E>(shape: Shape2(lhsShape[0], rhsShape[1]),
+                             order: lhs.order)
+    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs,
+                        bias: bias, residual: nil, activation: activation,
+                        reluCeiling: E.Value(defaultReluCeiling), &result)
+    return result
+}
+
+@derivative(of: matmul)
+@usableFromInline func _vjpMatmul<E>(
+    _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false,
+    bias: TensorR1<E>,
+    activation: ActivationType
+) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR2<E>, TensorR1<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric & Real
+{
+    let value = matmul(lhs, transposed: transposeLhs, rhs,
+                       transposed: transposeRhs, bias: bias,
+                       activation: activation)
+    return (value, {
+        // the activation derivative is computed from the saved output
+        let outGrad = activationGradient(value, $0, activation)
+        let (lhsGrad, rhsGrad) =
+            matmulGradients(outGrad, lhs, transposeLhs, rhs, transposeRhs)
+        return (lhsGrad, rhsGrad, biasGradient(outGrad))
+    })
+}
+
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with the bias, a residual, and the
+/// activation fused into the output tiles, computing
+/// `activation(lhs x rhs + bias + residual)`
+/// - Parameters:
+///  - lhs: left hand tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand tensor.
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+///  - bias: a vector added to each row of the result
+///  - residual: a tensor with the shape of the result that is added
+///  - activation: the activation applied to the result. `clippedRelu`
+///    uses `defaultReluCeiling`
+/// - Returns: a new tensor containing the result
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false,
+    bias: TensorR1<E>,
+    residual: TensorR2<E>,
+    activation: ActivationType = .identity
+) -> TensorR2<E> where E: StorageElement, E.Value: StorageElement & Real {
+    let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+    let rhsShape = transposeRhs ? rhs.shape.t : rhs.shape
+    assert(lhsShape[1] == rhsShape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<E>(shape: Shape2(lhsShape[0], rhsShape[1]),
+                             order: lhs.order)
+    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs,
+                        bias: bias, residual: residual, activation: activation,
+                        reluCeiling: E.Value(defaultReluCeiling), &result)
+    return result
+}
+
+@derivative(of: matmul)
+@usableFromInline func _vjpMatmul<E>(
+    _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false,
+    bias: TensorR1<E>,
+    residual: TensorR2<E>,
+    activation: ActivationType = .identity
+) -> (value: TensorR2<E>, pullback: (TensorR2<E>) ->
+        (TensorR2<E>, TensorR2<E>, TensorR1<E>, TensorR2<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric & Real
+{
+    let value = matmul(lhs, transposed: transposeLhs, rhs,
+                       transposed: transposeRhs, bias: bias,
+                       residual: residual, activation: activation)
+    return (value, {
+        let outGrad = activationGradient(value, $0, activation)
+        let (lhsGrad, rhsGrad) =
+            matmulGradients(outGrad, lhs, transposeLhs, rhs, transposeRhs)
+        return (lhsGrad, rhsGrad, biasGradient(outGrad), outGrad)
+    })
+}
+
+//==============================================================================
+/// dense
+/// computes `activation(x x weight + bias)` with a single gemm, where the
+/// bias and activation are fused into the output tiles. This is the
+/// forward pass of a fully connected layer.
+/// - Parameters:
+///  - x: the input rows
+///  - weight: the `[input features, output features]` weights
+///  - bias: a vector added to each row of the result
+///  - activation: the activation applied to the result. `clippedRelu`
+///    uses `defaultReluCeiling`
+///  - plan: the execution plan key of the weights returned by
+///    `denseExecutionPlan`. The key is combined with the layout of `x`
+///    to find the tuned gemm partition, instead of hashing the operand
+///    types and layouts on every call.
+/// - Returns: a new tensor containing the result
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func dense<E>(
+    _ x: TensorR2<E>,
+    _ weight: TensorR2<E>,
+    bias: TensorR1<E>,
+    activation: ActivationType = .identity,
+    plan: Int? = nil
+) -> TensorR2<E> where E: StorageElement, E.Value: StorageElement & Real {
+    assert(x.shape[1] == weight.shape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<E>(shape: Shape2(x.shape[0], weight.shape[1]),
+                             order: x.order)
+    currentQueue.matmul(x, false, weight, false,
+                        bias: bias, residual: nil, activation: activation,
+                        reluCeiling: E.Value(defaultReluCeiling),
+                        plan: plan, &result)
+    return result
+}
+
+@derivative(of: dense(_:_:bias:activation:plan:))
+@usableFromInline func _vjpDense<E>(
+    _ x: TensorR2<E>,
+    _ weight: TensorR2<E>,
+    bias: TensorR1<E>,
+    activation: ActivationType = .identity,
+    plan: Int? = nil
+) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR2<E>, TensorR1<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric & Real
+{
+    let value = dense(x, weight, bias: bias, activation: activation, plan: plan)
+    return (value, {
+        // the activation derivative is computed from the saved output
+        let outGrad = activationGradient(value, $0, activation)
+        let (xGrad, weightGrad) =
+            matmulGradients(outGrad, x, false, weight, false)
+        return (xGrad, weightGrad, biasGradient(outGrad))
+    })
+}
+
+//==============================================================================
+/// dense(x:weight:bias:residual:activation:plan:into:
+/// computes `activation(x x weight + bias + residual)` into `result`.
+/// The result storage is reused when it is already a dense row major
+/// tensor of the output shape, so repeated inference calls with the same
+/// batch size do not allocate an output.
+/// - Parameters:
+///  - x: the input rows
+///  - weight: the `[input features, output features]` weights, which
+///    are used in place when stored in the `colTiled32` order
+///  - bias: an optional vector added to each row of the result
+///  - residual: an optional tensor with the shape of the result that
+///    is added. It must not share storage with `result`.
+///  - activation: the activation applied to the result
+///  - plan: the execution plan key returned by `denseExecutionPlan`
+///  - scratch: optional kernel scratch kept by the caller, so repeated
+///    calls with the same batch size do not allocate it or look up the
+///    plan again
+///  - result: the output
+@inlinable public func dense<E>(
+    _ x: TensorR2<E>,
+    _ weight: TensorR2<E>,
+    bias: TensorR1<E>? = nil,
+    residual: TensorR2<E>? = nil,
+    activation: ActivationType = .identity,
+    plan: Int? = nil,
+    scratch: CpuScratch? = nil,
+    into result: inout TensorR2<E>
+) where E: StorageElement, E.Value: StorageElement & Real {
+    assert(x.shape[1] == weight.shape[0], "matmul inner dimensions must be equal")
+    reuseOutput(&result, Shape2(x.shape[0], weight.shape[1]))
+    currentQueue.matmul(x, false, weight, false,
+                        bias: bias, residual: residual, activation: activation,
+                        reluCeiling: E.Value(defaultReluCeiling),
+                        plan: plan, scratch: scratch, &result)
+}
+
+//==============================================================================
+/// denseExecutionPlan
+/// - Parameters:
+///  - weight: the dense layer weights
+///  - activation: the fused activation
+/// - Returns: the execution plan key of a dense layer, which is computed
+///   once when the layer is created and passed to `dense`
+@inlinable public func denseExecutionPlan<E>(
+    _ weight: TensorR2<E>,
+    _ activation: ActivationType
+) -> Int {
+    var key = ExecutionPlanKey("dense")
+    key.combine(weight)
+    key.combine(activation.rawValue)
+    return key.key
+}
+
+//==============================================================================
+/// activationGradient
+/// scales `yDiff` by the derivative of `activation`, which is computed
+/// from the saved activation output `y`
+/// - Parameters:
+///  - y: the saved activation output
+///  - yDiff: the incoming gradient
+///  - activation: the activation type
+///  - reluCeiling: the upper bound for `clippedRelu`
+///  - nan: the NaN propagation of `relu` and `clippedRelu`
+/// - Returns: the gradient with respect to the activation input
+@inlinable public func activationGradient<S,E>(
+    _ y: Tensor<S,E>,
+    _ yDiff: Tensor<S,E>,
+    _ activation: ActivationType,
+    reluCeiling: E.Value = E.Value(defaultReluCeiling),
+    nan: NanPropagation = .noPropagate
+) -> Tensor<S,E> where E.Value: Real {
+    assert(y.shape == yDiff.shape, _messageTensorShapeMismatch)
+    guard activation != .identity else { return yDiff }
+    var result = Tensor(like: yDiff)
+    currentQueue.activationGradient(y, yDiff, activation, reluCeiling, nan,
+                                    &result)
+    return result
+}
+
+//==============================================================================
+// batchedMatmulGradients
+// _vjpMatmul helper function for batched tensors. The gradient of a
+// broadcast operand is summed over the batch.
+@usableFromInline func batchedMatmulGradients<E>(
+    _ out: TensorR3<E>,
+    _ lhs: TensorR3<E>, _ transposeLhs: Bool,
+    _ rhs: TensorR3<E>, _ transposeRhs: Bool
+) -> (TensorR3<E>, TensorR3<E>)
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
+{
+    var (lhsGrad, rhsGrad): (TensorR3<E>, TensorR3<E>)
+    switch (transposeLhs, transposeRhs) {
+    case (false, false):
+        lhsGrad = matmul(out, transposed: false, rhs, transposed: true)
+        rhsGrad = matmul(lhs, transposed: true, out, transposed: false)
+    case (false, true):
+        lhsGrad = matmul(out, rhs)
+        rhsGrad = matmul(out, transposed: true, lhs, transposed: false)
+    case (true, false):
+        lhsGrad = matmul(rhs, transposed: false, out, transposed: true)
+        rhsGrad = matmul(lhs, out)
+    case (true, true):
+        lhsGrad = matmul(rhs, transposed: true, out, transposed: true)
+        rhsGrad = matmul(out, transposed: true, lhs, transposed: true)
+    }
+    if lhs.shape[0] == 1 && lhsGrad.shape[0] > 1 {
+        lhsGrad = lhsGrad.sum(alongAxes: 0)
+    }
+    if rhs.shape[0] == 1 && rhsGrad.shape[0] > 1 {
+        rhsGrad = rhsGrad.sum(alongAxes: 0)
+    }
+    return (lhsGrad, rhsGrad)
+}
+
+//==============================================================================
+/// matmul
+/// performs a batched matrix cross product. The batch items are
+/// distributed across the available cores.
+/// - Parameters:
+///  - lhs: left hand batched tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand batched tensor
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+/// - Returns: a new tensor containing the result. If the `lhs` or `rhs`
+///   batch size is 1, it is broadcast across the batch of the other.
+// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
+@differentiable(where E.Value: DifferentiableNumeric)
+@differentiable(wrt: lhs where E.Value: DifferentiableNumeric)
+@differentiable(wrt: rhs where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: TensorR3<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR3<E>, transposed transposeRhs: Bool = false
+) -> TensorR3<E> where E: StorageElement, E.Value: StorageElement & Numeric
+{
+    let lhsShape = transposeLhs ? lhs.shape.t : lhs.shape
+    let rhsShape = transposeRhs ? rhs.shape.t : rhs.shape
+    assert(lhsShape[2] == rhsShape[1], "matmul inner dimensions must be equal")
+    assert(lhsShape[0] == rhsShape[0] || lhsShape[0] == 1 || rhsShape[0] == 1,
+           "matmul batch dimensions must be equal or 1")
+    let batchCount = Swift.max(lhsShape[0], rhsShape[0])
+    var result = TensorR3<E>(
+        shape: Shape3(batchCount, lhsShape[1], rhsShape[2]),
+        order: lhs.order)
+
+    currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs, &result)
+    return result
+}
+
+@derivative(of: matmul)
+@usableFromInline func _vjpMatmul<E>(
+    _ lhs: TensorR3<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR3<E>, transposed transposeRhs: Bool = false
+) -> (value: TensorR3<E>, pullback: (TensorR3<E>) -> (TensorR3<E>, TensorR3<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
+{
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
+     { batchedMatmulGradients($0, lhs, transposeLhs, rhs, transposeRhs) })
+}
+
+@derivative(of: matmul, wrt: lhs)
+@usableFromInline func _vjpMatmulWrtLhs<E>(
+    _ lhs: TensorR3<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR3<E>, transposed transposeRhs: Bool = false
+) -> (value: TensorR3<E>, pullback: (TensorR3<E>) -> (TensorR3<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
+{
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
+     { batchedMatmulGradients($0, lhs, transposeLhs, rhs, transposeRhs).0 })
+}
+
+@derivative(of: matmul, wrt: rhs)
+@usableFromInline func _vjpMatmulWrtRhs<E>(
+    _ lhs: TensorR3<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR3<E>, transposed transposeRhs: Bool = false
+) -> (value: TensorR3<E>, pullback: (TensorR3<E>) -> (TensorR3<E>))
+where E: StorageElement, E.Value: StorageElement & DifferentiableNumeric
+{
+    (matmul(lhs, transposed: transposeLhs, rhs, transposed: transposeRhs),
+     { batchedMatmulGradients($0, lhs, transposeLhs, rhs, transposeRhs).1 })
+}
+
+//==============================================================================
+/// matmul
+/// performs a batched matrix cross product
+/// - Parameters:
+///  - lhs: left hand batched tensor
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand 2D tensor that is broadcast across the batch
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+/// - Returns: a new tensor containing the result
+// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: TensorR3<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR2<E>, transposed transposeRhs: Bool = false
+) -> TensorR3<E> where E: StorageElement, E.Value: StorageElement & Numeric
+{
+    matmul(lhs, transposed: transposeLhs,
+           TensorR3<E>(expanding: rhs, axes: Shape1(0)),
+           transposed: transposeRhs)
+}
+
+//==============================================================================
+/// matmul
+/// performs a batched matrix cross product
+/// - Parameters:
+///  - lhs: left hand 2D tensor that is broadcast across the batch
+///  - transposeLhs: `true` to transpose `lhs`, default is `false`
+///  - rhs: right hand batched tensor
+///  - transposeRhs: `true` to transpose `rhs`, default is `false`
+/// - Returns: a new tensor containing the result
+// https://docs.nvidia.com/cuda/cublas/index.html#cublas-lt-t-gt-gemmbatched
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>, transposed transposeLhs: Bool = false,
+    _ rhs: TensorR3<E>, transposed transposeRhs: Bool = false
+) -> TensorR3<E> where E: StorageElement, E.Value: StorageElement & Numeric
+{
+    matmul(TensorR3<E>(expanding: lhs, axes: Shape1(0)),
+           transposed: transposeLhs, rhs, transposed: transposeRhs)
+}
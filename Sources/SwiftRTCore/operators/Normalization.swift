@@ -0,0 +1,260 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+// normalization
+// The features are the last dimension of a `row` order tensor, or the
+// channels of a `NHWC` or `NDHWC` tensor. The kernels operate on a dense
+// `[rows, features]` view of the input, so channels last tensors are
+// used in place.
+
+/// featureMatrix
+/// - Returns: a dense `[rows, features]` view of `x`
+@inlinable func featureMatrix<S,E>(_ x: Tensor<S,E>) -> TensorR2<E> {
+    let rows = x.order.isChannelsLast ? Tensor(channelsLast: x) : denseRow(x)
+    return TensorR2(reshaping: rows, to: Shape2(-1, rows.shape[S.rank - 1]))
+}
+
+/// featureTensor(like:
+/// - Returns: a view of the `[rows, features]` matrix `y` with the shape
+///   and order of `x`
+@inlinable func featureTensor<S,E>(
+    _ y: TensorR2<E>,
+    like x: Tensor<S,E>
+) -> Tensor<S,E> {
+    guard x.order.isChannelsLast else { return Tensor(reshaping: y, to: x.shape) }
+    return Tensor(channelsFirst: Tensor(reshaping: y, to: x.shape.channelsLast),
+                  order: x.order)
+}
+
+/// featureCount
+/// - Returns: the number of normalized features of `x`
+@inlinable func featureCount<S,E>(_ x: Tensor<S,E>) -> Int {
+    x.order.isChannelsLast ? x.shape[1] : x.shape[S.rank - 1]
+}
+
+//==============================================================================
+/// batchNormTraining(x:scale:offset:epsilon:activation:
+/// normalizes each feature of `x` with the batch statistics
+///
+///     y = activation((x - mean) / sqrt(variance + epsilon) * scale + offset)
+///
+/// The statistics are computed in one pass, and the scale, offset, and
+/// activation are applied in a second pass.
+/// - Parameters:
+///  - x: the input
+///  - scale: the feature scales
+///  - offset: the feature offsets
+///  - epsilon: a small value added to the variance
+///  - activation: the activation applied to the output
+/// - Returns: the output, and the batch mean and biased variance of
+///   each feature
+@inlinable public func batchNormTraining<S,E>(
+    _ x: Tensor<S,E>,
+    scale: TensorR1<E>,
+    offset: TensorR1<E>,
+    epsilon: E.Value,
+    activation: ActivationType = .identity
+) -> (y: Tensor<S,E>, mean: TensorR1<E>, variance: TensorR1<E>)
+where E.Value: Real
+{
+    assert(scale.count == featureCount(x) && offset.count == scale.count,
+           "scale and offset must have one value per feature")
+    let x2 = featureMatrix(x)
+    var y = TensorR2<E>(shape: x2.shape, order: .row)
+    var mean = TensorR1<E>(shape: Shape1(x2.shape[1]), order: .row)
+    var variance = TensorR1<E>(shape: Shape1(x2.shape[1]), order: .row)
+    currentQueue.batchNorm(x2, scale, offset, &mean, &variance,
+                           computeStatistics: true, epsilon: epsilon,
+                           activation: activation,
+                           ceiling: E.Value(defaultReluCeiling), &y)
+    return (featureTensor(y, like: x), mean, variance)
+}
+
+//==============================================================================
+/// batchNormInference(x:scale:offset:mean:variance:epsilon:activation:
+/// normalizes each feature of `x` with the specified statistics, which
+/// are typically running averages collected during training
+/// - Parameters:
+///  - x: the input
+///  - scale: the feature scales
+///  - offset: the feature offsets
+///  - mean: the feature means
+///  - variance: the feature variances
+///  - epsilon: a small value added to the variance
+///  - activation: the activation applied to the output
+/// - Returns: the output
+@inlinable public func batchNormInference<S,E>(
+    _ x: Tensor<S,E>,
+    scale: TensorR1<E>,
+    offset: TensorR1<E>,
+    mean: TensorR1<E>,
+    variance: TensorR1<E>,
+    epsilon: E.Value,
+    activation: ActivationType = .identity
+) -> Tensor<S,E> where E.Value: Real {
+    assert(scale.count == featureCount(x) && offset.count == scale.count &&
+            mean.count == scale.count && variance.count == scale.count,
+           "scale, offset, and statistics must have one value per feature")
+    let x2 = featureMatrix(x)
+    var y = TensorR2<E>(shape: x2.shape, order: .row)
+    var mean = mean, variance = variance
+    currentQueue.batchNorm(x2, scale, offset, &mean, &variance,
+                           computeStatistics: false, epsilon: epsilon,
+                           activation: activation,
+                           ceiling: E.Value(defaultReluCeiling), &y)
+    return featureTensor(y, like: x)
+}
+
+//==============================================================================
+/// batchNormGradient(x:y:yDiff:scale:mean:variance:epsilon:activation:
+/// computes the gradients of `batchNormTraining` or `batchNormInference`
+/// - Parameters:
+///  - x: the input
+///  - y: the output of the forward pass
+///  - yDiff: the output gradient
+///  - scale: the feature scales
+///  - mean: the means used by the forward pass
+///  - variance: the variances used by the forward pass
+///  - epsilon: a small value added to the variance
+///  - activation: the activation applied to the output
+///  - usesBatchStatistics: `true` if the forward pass computed the
+///    statistics from `x`
+/// - Returns: the input, scale, and offset gradients
+@inlinable public func batchNormGradient<S,E>(
+    _ x: Tensor<S,E>,
+    _ y: Tensor<S,E>,
+    _ yDiff: Tensor<S,E>,
+    scale: TensorR1<E>,
+    mean: TensorR1<E>,
+    variance: TensorR1<E>,
+    epsilon: E.Value,
+    activation: ActivationType = .identity,
+    usesBatchStatistics: Bool = true
+) -> (x: Tensor<S,E>, scale: TensorR1<E>, offset: TensorR1<E>)
+where E.Value: Real
+{
+    let yDiff = yDiff.shape == y.shape ? yDiff :
+        Tensor(repeating: yDiff, to: y.shape)
+    let x2 = featureMatrix(x)
+    var xDiff = TensorR2<E>(shape: x2.shape, order: .row)
+    var scaleDiff = TensorR1<E>(shape: scale.shape, order: .row)
+    var offsetDiff = TensorR1<E>(shape: scale.shape, order: .row)
+    currentQueue.batchNormGradient(
+        x2, featureMatrix(y), featureMatrix(yDiff), scale, mean, variance,
+        usesBatchStatistics: usesBatchStatistics, epsilon: epsilon,
+        activation: activation, ceiling: E.Value(defaultReluCeiling),
+        &xDiff, &scaleDiff, &offsetDiff)
+    return (featureTensor(xDiff, like: x), scaleDiff, offsetDiff)
+}
+
+//==============================================================================
+/// batchNormFolding(scale:offset:mean:variance:epsilon:
+/// batch normalization with fixed statistics is the per feature affine
+/// transform `y = x * scale + shift`, which can be folded into the
+/// weights and bias of a preceding linear layer
+/// - Returns: the per feature scale and shift
+@inlinable public func batchNormFolding<E>(
+    scale: TensorR1<E>,
+    offset: TensorR1<E>,
+    mean: TensorR1<E>,
+    variance: TensorR1<E>,
+    epsilon: E.Value
+) -> (scale: TensorR1<E>, shift: TensorR1<E>) where E.Value: Real {
+    let a = scale / sqrt(variance + epsilon)
+    return (a, offset - mean * a)
+}
+
+//==============================================================================
+/// layerNorm(x:scale:offset:epsilon:activation:
+/// normalizes the features of each item of `x`
+///
+///     y = activation((x - mean) / sqrt(variance + epsilon) * scale + offset)
+///
+/// Each row is normalized, scaled, and activated in a single pass while
+/// it is in cache.
+/// - Parameters:
+///  - x: the input
+///  - scale: the feature scales
+///  - offset: the feature offsets
+///  - epsilon: a small value added to the variance
+///  - activation: the activation applied to the output
+/// - Returns: the output
+@differentiable(wrt: (x, scale, offset) where E.Value: DifferentiableNumeric)
+@inlinable public func layerNorm<S,E>(
+    _ x: Tensor<S,E>,
+    scale: TensorR1<E>,
+    offset: TensorR1<E>,
+    epsilon: E.Value,
+    activation: ActivationType = .identity
+) -> Tensor<S,E> where E.Value: Real {
+    layerNormWithStatistics(x, scale, offset, epsilon, activation).y
+}
+
+@derivative(of: layerNorm, wrt: (x, scale, offset))
+@usableFromInline func _vjpLayerNorm<S,E>(
+    _ x: Tensor<S,E>,
+    scale: TensorR1<E>,
+    offset: TensorR1<E>,
+    epsilon: E.Value,
+    activation: ActivationType
+) -> (value: Tensor<S,E>,
+      pullback: (Tensor<S,E>) -> (Tensor<S,E>, TensorR1<E>, TensorR1<E>))
+where E.Value: DifferentiableNumeric & Real
+{
+    // the normalized values are recomputed from the saved statistics
+    let (y, mean, invStd) =
+        layerNormWithStatistics(x, scale, offset, epsilon, activation)
+    return (y, {
+        let yDiff = $0.shape == y.shape ? $0 : Tensor(repeating: $0, to: y.shape)
+        let x2 = featureMatrix(x)
+        var xDiff = TensorR2<E>(shape: x2.shape, order: .row)
+        var scaleDiff = TensorR1<E>(shape: scale.shape, order: .row)
+        var offsetDiff = TensorR1<E>(shape: scale.shape, order: .row)
+        currentQueue.layerNormGradient(
+            x2, featureMatrix(y), featureMatrix(yDiff), scale, mean, invStd,
+            activation: activation, ceiling: E.Value(defaultReluCeiling),
+            &xDiff, &scaleDiff, &offsetDiff)
+        return (featureTensor(xDiff, like: x), scaleDiff, offsetDiff)
+    })
+}
+
+/// layerNormWithStatistics
+/// - Returns: the `layerNorm` output, and the mean and inverse standard
+///   deviation of each row
+@inlinable func layerNormWithStatistics<S,E>(
+    _ x: Tensor<S,E>,
+    _ scale: TensorR1<E>,
+    _ offset: TensorR1<E>,
+    _ epsilon: E.Value,
+    _ activation: ActivationType
+) -> (y: Tensor<S,E>, mean: TensorR1<E>, invStd: TensorR1<E>)
+where E.Value: Real
+{
+    assert(scale.count == featureCount(x) && offset.count == scale.count,
+           "scale and offset must have one value per feature")
+    let x2 = featureMatrix(x)
+    var y = TensorR2<E>(shape: x2.shape, order: .row)
+    var mean = TensorR1<E>(shape: Shape1(x2.shape[0]), order: .row)
+    var invStd = TensorR1<E>(shape: Shape1(x2.shape[0]), order: .row)
+    currentQueue.layerNorm(x2, scale, offset, epsilon: epsilon,
+                           activation: activation,
+                           ceiling: E.Value(defaultReluCeiling),
+                           &y, &mean, &invStd)
+    return (featureTensor(y, like: x), mean, invStd)
+}
@@ -0,0 +1,163 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// OptimizerRule
+/// the fused element wise update applied to each parameter by
+/// `optimizerUpdate`. Each element of the weights, the gradient and the
+/// moments is read once and written once.
+public enum OptimizerRule<Value: BinaryFloatingPoint> {
+    /// `w -= learningRate * g`
+    case sgd(learningRate: Value)
+    /// `m = momentum * m + g`, then `w -= learningRate * m`, or
+    /// `w -= learningRate * (g + momentum * m)` with nesterov momentum
+    case momentum(learningRate: Value, momentum: Value, nesterov: Bool)
+    /// `m = beta1 * m + (1 - beta1) * g`,
+    /// `v = beta2 * v + (1 - beta2) * g * g`, then
+    /// `w -= stepSize * m / (sqrt(v) + epsilon)`, where `stepSize` is the
+    /// bias corrected learning rate of the step
+    case adam(stepSize: Value, beta1: Value, beta2: Value, epsilon: Value)
+
+    /// the number of moment tensors kept for each parameter
+    @inlinable public var momentCount: Int {
+        switch self {
+        case .sgd: return 0
+        case .momentum: return 1
+        case .adam: return 2
+        }
+    }
+}
+
+//==============================================================================
+/// OptimizerParameter
+/// a parameter updated by `optimizerUpdate`. The tensors are rank 1
+/// views of the stored elements, so parameters of any shape and storage
+/// order are updated by the same element wise kernel.
+public struct OptimizerParameter<E: StorageElement> {
+    /// the stored elements of the weights
+    public var weight: TensorR1<E>
+    /// the gradient in the storage order of the weights. A sparse gradient
+    /// stores only the rows selected by `rows`.
+    public var gradient: TensorR1<E>
+    /// the distinct weight rows updated by a sparse gradient, or `nil`
+    /// for a dense gradient
+    public var rows: [Int]?
+    /// the number of elements in each row of a sparse gradient
+    public var rowSize: Int
+    /// the first moment, which has the weight element count when it is
+    /// used by the rule
+    public var first: TensorR1<E>
+    /// the second moment, which has the weight element count when it is
+    /// used by the rule
+    public var second: TensorR1<E>
+
+    //--------------------------------------------------------------------------
+    /// init(weight:gradient:rows:rowSize:first:second:
+    /// - Parameters:
+    ///  - weight: the stored elements of the weights
+    ///  - gradient: the dense gradient, or the stored rows of a sparse one
+    ///  - rows: the distinct weight rows of a sparse gradient
+    ///  - rowSize: the number of elements in each sparse row
+    ///  - first: the first moment
+    ///  - second: the second moment
+    @inlinable public init(
+        weight: TensorR1<E>,
+        gradient: TensorR1<E>,
+        rows: [Int]? = nil,
+        rowSize: Int = 1,
+        first: TensorR1<E> = TensorR1<E>(),
+        second: TensorR1<E> = TensorR1<E>()
+    ) {
+        precondition(
+            rows == nil && gradient.count == weight.count ||
+                rows != nil && gradient.count == rows!.count * rowSize,
+            "the gradient must match the updated weights")
+        self.weight = weight
+        self.gradient = gradient
+        self.rows = rows
+        self.rowSize = rowSize
+        self.first = first
+        self.second = second
+    }
+}
+
+//==============================================================================
+/// optimizerUpdate(rule:parameters:
+/// applies a fused update to a set of parameters with a single launch.
+/// The elements of all parameters, or of the stored rows of sparse
+/// gradients, are treated as one work list that is split evenly across
+/// the available cores, so a model with many small tensors and a few
+/// large ones keeps every core busy. The weights and moments are updated
+/// in place when they are uniquely referenced.
+/// - Parameters:
+///  - rule: the update rule
+///  - parameters: the parameters to update
+@inlinable public func optimizerUpdate<E>(
+    _ rule: OptimizerRule<E.Value>,
+    _ parameters: inout [OptimizerParameter<E>]
+) where E.Value: BinaryFloatingPoint {
+    guard !parameters.isEmpty else { return }
+    currentQueue.optimizerUpdate(rule, &parameters)
+}
+
+//==============================================================================
+// storage views
+public extension Tensor where Shape == Shape1 {
+    //--------------------------------------------------------------------------
+    /// init(storageOf:
+    /// creates a rank 1 view of the stored elements of a dense tensor, in
+    /// storage order, that shares its storage
+    @inlinable init<S>(storageOf other: Tensor<S,TensorElement>) {
+        assert(other.isContiguous, "the tensor must be dense")
+        self.init(shape: Shape1(other.count),
+                  strides: Shape1.one,
+                  count: other.count,
+                  storage: other.storage,
+                  storageBase: other.storageBase,
+                  spanCount: other.spanCount,
+                  order: .row,
+                  shared: other.isShared)
+    }
+}
+
+public extension Tensor {
+    //--------------------------------------------------------------------------
+    /// init(storageOf:shape:strides:order:
+    /// creates a dense tensor view of the storage of `flat`, which is
+    /// typically a view created by `init(storageOf:)` that was updated
+    /// - Parameters:
+    ///  - flat: the rank 1 view of the stored elements
+    ///  - shape: the shape of the view
+    ///  - strides: the strides of the view
+    ///  - order: the storage order of the view
+    @inlinable init(
+        storageOf flat: TensorR1<TensorElement>,
+        shape: Shape,
+        strides: Shape,
+        order: Order
+    ) {
+        assert(shape.elementCount() == flat.count && flat.isContiguous)
+        self.init(shape: shape,
+                  strides: strides,
+                  count: flat.count,
+                  storage: flat.storage,
+                  storageBase: flat.storageBase,
+                  spanCount: flat.spanCount,
+                  order: order,
+                  shared: flat.isShared)
+    }
+}
@@ -0,0 +1,424 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// QuantizedTensor
+/// A tensor of integer values with an affine mapping to real values
+/// `real = scale * (value - zeroPoint)`. The scale and zero point are
+/// either a single pair for the whole tensor, or one pair per channel
+/// along `axis`.
+public struct QuantizedTensor<Shape, Q>
+where Shape: TensorShape, Q: StorageElement, Q.Value: FixedWidthInteger
+{
+    /// the quantized values
+    public var values: Tensor<Shape,Q>
+    /// the scale for the tensor, or for each channel along `axis`
+    public let scales: [Float]
+    /// the zero point for the tensor, or for each channel along `axis`
+    public let zeroPoints: [Int32]
+    /// the channel axis, or `nil` for per tensor quantization
+    public let axis: Int?
+
+    /// the shape of the tensor
+    @inlinable public var shape: Shape { values.shape }
+    /// the name of the tensor
+    @inlinable public var name: String { values.name }
+    /// `true` if there is a single scale and zero point
+    @inlinable public var isPerTensor: Bool { axis == nil }
+
+    //--------------------------------------------------------------------------
+    /// init(values:scales:zeroPoints:axis:
+    /// creates a quantized tensor from existing values and parameters
+    @inlinable public init(
+        values: Tensor<Shape,Q>,
+        scales: [Float],
+        zeroPoints: [Int32],
+        axis: Int? = nil
+    ) {
+        assert(scales.count == zeroPoints.count &&
+               scales.count == (axis == nil ? 1 : values.shape[axis!]),
+               "there must be one scale and zero point per channel")
+        self.values = values
+        self.scales = scales
+        self.zeroPoints = zeroPoints
+        self.axis = axis
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(quantizing:axis:type:
+    /// quantizes a real valued tensor. The scale and zero point are
+    /// calibrated from the value range of `x` per tensor or per channel.
+    /// Signed types are quantized symmetrically with a zero point of 0,
+    /// which is the usual choice for weights. Unsigned types use the full
+    /// range asymmetrically, which is the usual choice for activations.
+    /// - Parameters:
+    ///  - x: the tensor to quantize
+    ///  - axis: the channel axis for per channel quantization, or `nil`
+    ///  - type: the quantized storage type
+    @inlinable public init<E>(
+        quantizing x: Tensor<Shape,E>,
+        axis: Int? = nil,
+        type: Q.Type = Q.self
+    ) where E.Value == Float {
+        let (scales, zeroPoints) =
+            quantizationParameters(x, axis: axis, type: Q.self)
+        self.init(values: quantize(x, scales: scales, zeroPoints: zeroPoints,
+                                   axis: axis, type: Q.self),
+                  scales: scales, zeroPoints: zeroPoints, axis: axis)
+    }
+
+    //--------------------------------------------------------------------------
+    /// dequantized(type:
+    /// - Returns: the real valued tensor
+    @inlinable public func dequantized<E>(
+        type: E.Type = Float.self
+    ) -> Tensor<Shape,E> where E.Value == Float {
+        dequantize(self, type: E.self)
+    }
+}
+
+//==============================================================================
+// QuantizedTensor convolution filters
+public extension QuantizedTensor where Shape == Shape2 {
+    //--------------------------------------------------------------------------
+    /// init(quantizingFilter:mode:type:
+    /// quantizes a convolution filter per output channel as a
+    /// `[filterCount, outChannels]` matrix, with the rows in the order of
+    /// the `im2col` windows. The taps are flipped for `.convolution`.
+    /// - Parameters:
+    ///  - filter: the filter, with the spatial dimensions followed by the
+    ///    input and output channels
+    ///  - mode: convolution or cross correlation
+    ///  - type: the quantized storage type
+    @inlinable init<S,E>(
+        quantizingFilter filter: Tensor<S,E>,
+        mode: ConvolutionMode,
+        type: Q.Type = Q.self
+    ) where E.Value == Float {
+        let Cig = filter.shape[S.rank - 2], Cout = filter.shape[S.rank - 1]
+        let taps = filter.count / (Cig * Cout)
+        var f = TensorR3<E>(reshaping: denseRow(filter),
+                            to: Shape3(taps, Cig, Cout))
+        if mode == .convolution {
+            var flipped = TensorR3<E>(shape: f.shape, order: .row)
+            gather(from: f, indices: Array((0..<taps).reversed()),
+                   into: &flipped)
+            f = flipped
+        }
+        self.init(quantizing: TensorR2<E>(reshaping: f,
+                                          to: Shape2(taps * Cig, Cout)),
+                  axis: 1)
+    }
+}
+
+//==============================================================================
+/// quantizationParameters(x:axis:type:
+/// calibrates the scale and zero point from the value range of `x`
+/// - Parameters:
+///  - x: the tensor to calibrate
+///  - axis: the channel axis for per channel parameters, or `nil`
+///  - type: the quantized storage type
+/// - Returns: the scales and zero points
+@inlinable public func quantizationParameters<S,E,Q>(
+    _ x: Tensor<S,E>,
+    axis: Int? = nil,
+    type: Q.Type
+) -> (scales: [Float], zeroPoints: [Int32])
+where E.Value == Float, Q: StorageElement, Q.Value: FixedWidthInteger
+{
+    let (lower, upper) = currentQueue.quantizationRange(x, axis: axis)
+    let qmin = Float(Q.Value.min), qmax = Float(Q.Value.max)
+    var scales = [Float](repeating: 1, count: lower.count)
+    var zeroPoints = [Int32](repeating: 0, count: lower.count)
+
+    for i in 0..<lower.count {
+        // the range must include 0 so it is exactly representable
+        let lo = Swift.min(lower[i], 0), hi = Swift.max(upper[i], 0)
+        if Q.Value.isSigned {
+            let maxAbs = Swift.max(-lo, hi)
+            scales[i] = maxAbs > 0 ? maxAbs / qmax : 1
+        } else {
+            scales[i] = hi > lo ? (hi - lo) / (qmax - qmin) : 1
+            zeroPoints[i] = Int32(Swift.min(qmax, Swift.max(qmin,
+                                    (qmin - lo / scales[i]).rounded())))
+        }
+    }
+    return (scales, zeroPoints)
+}
+
+//==============================================================================
+/// quantize(x:scales:zeroPoints:axis:type:
+/// computes `clamp(round(x / scale) + zeroPoint)` element wise
+/// - Parameters:
+///  - x: the tensor to quantize
+///  - scales: the scale for the tensor, or for each channel along `axis`
+///  - zeroPoints: the zero point for the tensor, or for each channel
+///  - axis: the channel axis, or `nil` for per tensor quantization
+///  - type: the quantized storage type
+/// - Returns: the quantized values
+@inlinable public func quantize<S,E,Q>(
+    _ x: Tensor<S,E>,
+    scales: [Float],
+    zeroPoints: [Int32],
+    axis: Int? = nil,
+    type: Q.Type
+) -> Tensor<S,Q>
+where E.Value == Float, Q: StorageElement, Q.Value: FixedWidthInteger
+{
+    var result = Tensor<S,Q>(shape: x.shape, order: x.order)
+    currentQueue.quantize(x, scales, zeroPoints, axis, &result)
+    return result
+}
+
+//==============================================================================
+/// dequantize(x:type:
+/// computes `scale * (x - zeroPoint)` element wise
+/// - Parameters:
+///  - x: the quantized tensor
+///  - type: the real storage type of the result
+/// - Returns: the real valued tensor
+@inlinable public func dequantize<S,Q,E>(
+    _ x: QuantizedTensor<S,Q>,
+    type: E.Type = Float.self
+) -> Tensor<S,E> where E.Value == Float {
+    var result = Tensor<S,E>(shape: x.shape, order: x.values.order)
+    currentQueue.dequantize(x.values, x.scales, x.zeroPoints, x.axis, &result)
+    return result
+}
+
+//==============================================================================
+/// matmul
+/// performs a quantized matrix cross product. The integer products are
+/// accumulated as `Int32` and converted back to real values in the gemm
+/// epilogue, where the bias and activation are also applied.
+/// - Parameters:
+///  - lhs: left hand tensor quantized per tensor, typically activations
+///  - rhs: right hand tensor quantized per tensor or per column
+///    (`axis` 1), typically weights
+///  - bias: optional bias added to each row of the result
+///  - activation: the activation applied to the result
+/// - Returns: a new real valued tensor containing the result
+@inlinable public func matmul<LQ,RQ>(
+    _ lhs: QuantizedTensor<Shape2,LQ>,
+    _ rhs: QuantizedTensor<Shape2,RQ>,
+    bias: TensorR1<Float>? = nil,
+    activation: ActivationType = .identity
+) -> TensorR2<Float> {
+    assert(lhs.shape[1] == rhs.shape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<Float>(shape: Shape2(lhs.shape[0], rhs.shape[1]),
+                                 order: lhs.values.order)
+    currentQueue.matmul(lhs, rhs, bias: bias, activation: activation,
+                        reluCeiling: Float(defaultReluCeiling), &result)
+    return result
+}
+
+//==============================================================================
+/// matmul
+/// performs a quantized matrix cross product with the result requantized
+/// in the gemm epilogue, so the real valued result is never stored.
+/// - Parameters:
+///  - lhs: left hand tensor quantized per tensor, typically activations
+///  - rhs: right hand tensor quantized per tensor or per column
+///    (`axis` 1), typically weights
+///  - bias: optional bias added to each row of the result
+///  - activation: the activation applied to the result
+///  - scale: the scale of the quantized result
+///  - zeroPoint: the zero point of the quantized result
+///  - type: the quantized storage type of the result
+/// - Returns: a new quantized tensor containing the result
+@inlinable public func matmul<LQ,RQ,OQ>(
+    _ lhs: QuantizedTensor<Shape2,LQ>,
+    _ rhs: QuantizedTensor<Shape2,RQ>,
+    bias: TensorR1<Float>? = nil,
+    activation: ActivationType = .identity,
+    scale: Float,
+    zeroPoint: Int32,
+    type: OQ.Type
+) -> QuantizedTensor<Shape2,OQ> {
+    assert(lhs.shape[1] == rhs.shape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<OQ>(shape: Shape2(lhs.shape[0], rhs.shape[1]),
+                              order: lhs.values.order)
+    currentQueue.matmul(lhs, rhs, bias: bias, activation: activation,
+                        reluCeiling: Float(defaultReluCeiling),
+                        scale: scale, zeroPoint: zeroPoint, &result)
+    return QuantizedTensor(values: result, scales: [scale],
+                           zeroPoints: [zeroPoint])
+}
+
+//==============================================================================
+/// convolution
+/// performs a quantized convolution. The input windows are gathered as
+/// the rows of a matrix (im2col), which is quantized per tensor to
+/// `UInt8` and multiplied by the filter with the quantized gemm.
+/// - Parameters:
+///  - x: the real valued input, NWC, NHWC, or NDHWC
+///  - filter: the filter quantized by `init(quantizingFilter:mode:type:)`
+///  - geometry: the convolution geometry, which must have one group
+///  - bias: optional bias added to each output position
+///  - activation: the activation applied to the result
+/// - Returns: a new real valued tensor containing the result
+@inlinable public func convolution<S,Q>(
+    _ x: Tensor<S,Float>,
+    _ filter: QuantizedTensor<Shape2,Q>,
+    _ geometry: ConvolutionGeometry,
+    bias: TensorR1<Float>? = nil,
+    activation: ActivationType = .identity
+) -> Tensor<S,Float> {
+    let g = geometry
+    precondition(g.groups == 1, "quantized convolutions must have one group")
+    assert(filter.shape == Shape2(g.filterCount, g.outChannels),
+           "the filter does not match the geometry")
+    var windows = TensorR2<Float>(
+        shape: Shape2(g.batchCount * g.outputCount, g.filterCount),
+        order: .row)
+    currentQueue.im2col(denseRow(x), g, &windows)
+    let y = matmul(QuantizedTensor<Shape2,UInt8>(quantizing: windows),
+                   filter, bias: bias, activation: activation)
+    return Tensor<S,Float>(reshaping: y, to: g.outputShape())
+}
+
+//==============================================================================
+/// GroupQuantizedTensor
+/// A matrix of 4 bit values stored in `UInt4` elements, where each row is
+/// divided into groups of `groupSize` consecutive values that share a
+/// scale and offset, `real = scale * value + offset`. Groups of 32, 64,
+/// or 128 keep the error low while using a little over 4 bits per value.
+/// When the row size is not a multiple of `groupSize`, the last group of
+/// each row is shorter and has its own scale and offset. The row size
+/// must be a multiple of 16, so every row starts on a 64 bit word.
+///
+/// For weights the rows are the output features, so a `Dense` weight of
+/// shape `[inputs, outputs]` is quantized from its transpose. This keeps
+/// each group contiguous, so the matmul kernel can read a whole 64 bit
+/// word of 16 values at a time.
+public struct GroupQuantizedTensor {
+    /// the quantized values
+    public var values: TensorR2<UInt4>
+    /// the number of consecutive row values sharing a scale and offset
+    public let groupSize: Int
+    /// the scale for each group in row major order
+    public let scales: [Float]
+    /// the offset for each group in row major order
+    public let offsets: [Float]
+
+    /// the shape of the matrix
+    @inlinable public var shape: Shape2 { values.shape }
+    /// the name of the tensor
+    @inlinable public var name: String { values.name }
+    /// the number of groups in each row, including a shorter last group
+    @inlinable public var groupsPerRow: Int {
+        (shape[1] + groupSize - 1) / groupSize
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(values:groupSize:scales:offsets:
+    /// creates a quantized tensor from existing values and parameters
+    @inlinable public init(
+        values: TensorR2<UInt4>,
+        groupSize: Int,
+        scales: [Float],
+        offsets: [Float]
+    ) {
+        precondition(groupSize > 0 && groupSize % 16 == 0 &&
+                     values.shape[1] % 16 == 0,
+                     "groupSize and the row size must be multiples of 16")
+        precondition(values.isContiguous && values.storageBase % 16 == 0,
+                     "values must be contiguous and word aligned")
+        let groups = (values.shape[1] + groupSize - 1) / groupSize
+        precondition(scales.count == values.shape[0] * groups &&
+                     offsets.count == scales.count,
+                     "there must be one scale and offset per group")
+        self.values = values
+        self.groupSize = groupSize
+        self.scales = scales
+        self.offsets = offsets
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(quantizing:groupSize:
+    /// quantizes the rows of `x` in groups, using the range of each group
+    /// to calibrate its scale and offset. This function blocks until the
+    /// result is available.
+    /// - Parameters:
+    ///  - x: the matrix to quantize
+    ///  - groupSize: the number of values per group. Typically 32, 64, or 128
+    @inlinable public init<E>(
+        quantizing x: TensorR2<E>,
+        groupSize: Int = 64
+    ) where E.Value == Float {
+        precondition(groupSize > 0 && groupSize % 16 == 0 &&
+                     x.shape[1] % 16 == 0,
+                     "groupSize and the row size must be multiples of 16")
+        var values = TensorR2<UInt4>(shape: x.shape, order: .row)
+        let (scales, offsets) =
+            currentQueue.groupQuantize(x, groupSize, &values)
+        self.init(values: values, groupSize: groupSize,
+                  scales: scales, offsets: offsets)
+    }
+
+    //--------------------------------------------------------------------------
+    /// dequantized(type:
+    /// - Returns: the real valued matrix
+    @inlinable public func dequantized<E>(
+        type: E.Type = Float.self
+    ) -> TensorR2<E> where E.Value == Float {
+        var result = TensorR2<E>(shape: shape, order: .row)
+        currentQueue.groupDequantize(self, nil, &result)
+        return result
+    }
+
+    //--------------------------------------------------------------------------
+    /// gathering(indices:type:
+    /// dequantizes only the selected rows, which is used for embedding
+    /// tables that are too large to keep as real values
+    /// - Parameter indices: the rows to gather
+    /// - Returns: the real valued rows
+    @inlinable public func gathering<E>(
+        indices: TensorR1<DeviceIndex>,
+        type: E.Type = Float.self
+    ) -> TensorR2<E> where E.Value == Float {
+        var result = TensorR2<E>(shape: Shape2(indices.count, shape[1]),
+                                 order: .row)
+        currentQueue.groupDequantize(self, indices.map { Int($0) }, &result)
+        return result
+    }
+}
+
+//==============================================================================
+/// matmul
+/// performs a matrix cross product with 4 bit group quantized weights,
+/// computing `lhs x rhs^T`. The weights are unpacked a word at a time
+/// and dequantized on the fly, so they are never expanded in memory.
+/// - Parameters:
+///  - lhs: the real valued left hand tensor of shape `[M, K]`
+///  - rhs: the quantized weights of shape `[N, K]`, grouped along `K`
+///  - bias: an optional bias of shape `[N]` added to each row
+///  - activation: the activation applied to the result
+/// - Returns: a new tensor of shape `[M, N]` containing the result
+@inlinable public func matmul<E>(
+    _ lhs: TensorR2<E>,
+    _ rhs: GroupQuantizedTensor,
+    bias: TensorR1<E>? = nil,
+    activation: ActivationType = .identity
+) -> TensorR2<E> where E.Value == Float {
+    assert(lhs.shape[1] == rhs.shape[1], "matmul inner dimensions must be equal")
+    var result = TensorR2<E>(shape: Shape2(lhs.shape[0], rhs.shape[0]),
+                             order: lhs.order)
+    currentQueue.matmul(lhs, rhs, bias: bias, activation: activation,
+                        reluCeiling: Float(defaultReluCeiling), &result)
+    return result
+}
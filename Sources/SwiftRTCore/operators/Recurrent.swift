@@ -0,0 +1,203 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+/// lstmPointwise(gates:cell:
+/// computes the pointwise part of an LSTM cell in a single pass, after the
+/// gate pre-activations have been computed by one fused gemm
+///
+///     i = sigmoid(a_i), g = tanh(a_g), f = sigmoid(a_f), o = sigmoid(a_o)
+///     cell = f * previousCell + i * g
+///     hidden = o * tanh(cell)
+///
+/// - Parameters:
+///  - gates: the `[batch, 4 * hidden]` gate pre-activations, ordered as
+///    input, update, forget, and output
+///  - cell: the `[batch, hidden]` previous cell state
+/// - Returns: the new cell and hidden states
+@inlinable public func lstmPointwise<E>(
+    gates: TensorR2<E>,
+    cell: TensorR2<E>
+) -> (cell: TensorR2<E>, hidden: TensorR2<E>) where E.Value: Real {
+    assert(gates.shape == Shape2(cell.shape[0], 4 * cell.shape[1]),
+           "gates must have the shape [batch, 4 * hidden]")
+    let gates = denseRow(gates), cell = denseRow(cell)
+    var newCell = TensorR2<E>(shape: cell.shape, order: .row)
+    var hidden = TensorR2<E>(shape: cell.shape, order: .row)
+    currentQueue.lstmPointwise(gates, cell, &newCell, &hidden)
+    return (newCell, hidden)
+}
+
+//==============================================================================
+/// lstmPointwise(gates:cell:newCell:hidden:
+/// computes `lstmPointwise` into existing states, which are reused when
+/// they are dense row major tensors of the state shape
+/// - Parameters:
+///  - gates: the `[batch, 4 * hidden]` gate pre-activations
+///  - cell: the `[batch, hidden]` previous cell state. It must not share
+///    storage with `newCell`.
+///  - newCell: the new cell state
+///  - hidden: the new hidden state
+@inlinable public func lstmPointwise<E>(
+    gates: TensorR2<E>,
+    cell: TensorR2<E>,
+    newCell: inout TensorR2<E>,
+    hidden: inout TensorR2<E>
+) where E.Value: Real {
+    assert(gates.shape == Shape2(cell.shape[0], 4 * cell.shape[1]),
+           "gates must have the shape [batch, 4 * hidden]")
+    reuseOutput(&newCell, cell.shape)
+    reuseOutput(&hidden, cell.shape)
+    currentQueue.lstmPointwise(denseRow(gates), denseRow(cell),
+                               &newCell, &hidden)
+}
+
+//==============================================================================
+/// lstmPointwiseGradient(gates:cell:newCell:hiddenDiff:cellDiff:
+/// computes the gradients of `lstmPointwise`. The gate activations are
+/// recomputed from the pre-activations, so only the inputs and the new
+/// cell state need to be saved by the forward pass.
+/// - Parameters:
+///  - gates: the gate pre-activations
+///  - cell: the previous cell state
+///  - newCell: the cell state returned by `lstmPointwise`
+///  - hiddenDiff: the gradient of the new hidden state
+///  - cellDiff: the gradient of the new cell state. A gradient that is
+///    a `zero` tangent is repeated to the shape of the state.
+/// - Returns: the gradients of the gate pre-activations and the previous
+///   cell state
+@inlinable public func lstmPointwiseGradient<E>(
+    gates: TensorR2<E>,
+    cell: TensorR2<E>,
+    newCell: TensorR2<E>,
+    hiddenDiff: TensorR2<E>,
+    cellDiff: TensorR2<E>
+) -> (gates: TensorR2<E>, cell: TensorR2<E>) where E.Value: Real {
+    assert(newCell.shape == cell.shape, _messageTensorShapeMismatch)
+    let hiddenDiff = hiddenDiff.shape == cell.shape ? hiddenDiff :
+        TensorR2(repeating: hiddenDiff, to: cell.shape)
+    let cellDiff = cellDiff.shape == cell.shape ? cellDiff :
+        TensorR2(repeating: cellDiff, to: cell.shape)
+    var gatesDiff = TensorR2<E>(shape: gates.shape, order: .row)
+    var cellDiffPrevious = TensorR2<E>(shape: cell.shape, order: .row)
+    currentQueue.lstmPointwiseGradient(
+        denseRow(gates), denseRow(cell), denseRow(newCell),
+        denseRow(hiddenDiff), denseRow(cellDiff),
+        &gatesDiff, &cellDiffPrevious)
+    return (gatesDiff, cellDiffPrevious)
+}
+
+//==============================================================================
+/// gruPointwise(inputGates:stateGates:state:
+/// computes the pointwise part of a GRU cell in a single pass, after the
+/// input and state projections have been computed by one gemm each
+///
+///     z = sigmoid(x_z + h_z), r = sigmoid(x_r + h_r)
+///     n = tanh(x_n + r * h_n)
+///     newState = (1 - z) * state + z * n
+///
+/// The reset gate is applied after the state projection, so all three
+/// state projections are computed by a single gemm.
+/// - Parameters:
+///  - inputGates: the `[batch, 3 * hidden]` input projections, including
+///    the biases, ordered as update, reset, and output
+///  - stateGates: the `[batch, 3 * hidden]` state projections
+///  - state: the `[batch, hidden]` previous state
+/// - Returns: the new state
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func gruPointwise<E>(
+    inputGates: TensorR2<E>,
+    stateGates: TensorR2<E>,
+    state: TensorR2<E>
+) -> TensorR2<E> where E.Value: Real {
+    assert(inputGates.shape == Shape2(state.shape[0], 3 * state.shape[1]) &&
+            stateGates.shape == inputGates.shape,
+           "gates must have the shape [batch, 3 * hidden]")
+    var newState = TensorR2<E>(shape: state.shape, order: .row)
+    currentQueue.gruPointwise(denseRow(inputGates), denseRow(stateGates),
+                              denseRow(state), &newState)
+    return newState
+}
+
+@derivative(of: gruPointwise(inputGates:stateGates:state:))
+@usableFromInline func _vjpGruPointwise<E>(
+    inputGates: TensorR2<E>,
+    stateGates: TensorR2<E>,
+    state: TensorR2<E>
+) -> (value: TensorR2<E>,
+      pullback: (TensorR2<E>) -> (TensorR2<E>, TensorR2<E>, TensorR2<E>))
+where E.Value: DifferentiableNumeric & Real
+{
+    // the gates are recomputed from the saved projections
+    let inputGates = denseRow(inputGates)
+    let stateGates = denseRow(stateGates)
+    let state = denseRow(state)
+    let value = gruPointwise(inputGates: inputGates, stateGates: stateGates,
+                             state: state)
+    return (value, {
+        var inputGatesDiff = Tensor(like: inputGates)
+        var stateGatesDiff = Tensor(like: stateGates)
+        var stateDiff = Tensor(like: state)
+        currentQueue.gruPointwiseGradient(
+            inputGates, stateGates, state, denseRow($0),
+            &inputGatesDiff, &stateGatesDiff, &stateDiff)
+        return (inputGatesDiff, stateGatesDiff, stateDiff)
+    })
+}
+
+//==============================================================================
+/// gruPointwise(inputGates:stateGates:state:newState:
+/// computes `gruPointwise` into an existing state, which is reused when
+/// it is a dense row major tensor of the state shape
+/// - Parameters:
+///  - inputGates: the `[batch, 3 * hidden]` input projections
+///  - stateGates: the `[batch, 3 * hidden]` state projections
+///  - state: the `[batch, hidden]` previous state. It must not share
+///    storage with `newState`.
+///  - newState: the new state
+@inlinable public func gruPointwise<E>(
+    inputGates: TensorR2<E>,
+    stateGates: TensorR2<E>,
+    state: TensorR2<E>,
+    newState: inout TensorR2<E>
+) where E.Value: Real {
+    assert(inputGates.shape == Shape2(state.shape[0], 3 * state.shape[1]) &&
+            stateGates.shape == inputGates.shape,
+           "gates must have the shape [batch, 3 * hidden]")
+    reuseOutput(&newState, state.shape)
+    currentQueue.gruPointwise(denseRow(inputGates), denseRow(stateGates),
+                              denseRow(state), &newState)
+}
+
+//==============================================================================
+/// denseRow
+/// - Returns: `x` if it is dense and row major, otherwise a row major copy
+@inlinable func denseRow<S,E>(_ x: Tensor<S,E>) -> Tensor<S,E> {
+    x.isContiguous && x.order == .row ? x : Tensor(copying: x, order: .row)
+}
+
+//==============================================================================
+/// reuseOutput
+/// replaces `result` with a new dense row major tensor of `shape`, unless
+/// it already is one, so the output of an `into:` operator is reused
+/// across calls with the same shapes
+@inlinable func reuseOutput<S,E>(_ result: inout Tensor<S,E>, _ shape: S) {
+    if result.shape != shape || result.order != .row || !result.isContiguous {
+        result = Tensor(shape: shape, order: .row)
+    }
+}
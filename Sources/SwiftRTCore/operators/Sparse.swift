@@ -0,0 +1,522 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// CsrMatrix
+/// A rank 2 sparse matrix in compressed sparse row format. The column and
+/// value of each nonzero are stored in row major order, and the nonzeros
+/// of row `r` are at positions `rowOffsets[r]..<rowOffsets[r + 1]`.
+/// The columns of each row are in increasing order. A column can be
+/// repeated, and repeated nonzeros are summed.
+///
+/// Only the `values` are differentiable. Their tangent is a dense vector
+/// with one element per nonzero.
+public struct CsrMatrix<E: StorageElement> {
+    /// the dense shape of the matrix
+    public let shape: Shape2
+    /// the position of the first nonzero of each row, followed by the
+    /// number of nonzeros
+    public let rowOffsets: [Int]
+    /// the column of each nonzero
+    public let columns: [Int]
+    /// the value of each nonzero
+    public var values: TensorR1<E>
+
+    /// the number of stored nonzero values
+    @inlinable public var nonzeroCount: Int { columns.count }
+    /// the fraction of the elements that are nonzero
+    @inlinable public var density: Double {
+        Double(nonzeroCount) / Double(Swift.max(1, shape.elementCount()))
+    }
+    /// the name of the matrix
+    @inlinable public var name: String { values.name }
+
+    //--------------------------------------------------------------------------
+    /// init(shape:rowOffsets:columns:values:
+    /// creates a matrix from existing CSR data
+    /// - Parameters:
+    ///  - shape: the dense shape
+    ///  - rowOffsets: the position of the first nonzero of each row,
+    ///    followed by the number of nonzeros
+    ///  - columns: the column of each nonzero, in increasing order
+    ///    within each row
+    ///  - values: the value of each nonzero
+    @inlinable public init(
+        shape: Shape2,
+        rowOffsets: [Int],
+        columns: [Int],
+        values: TensorR1<E>
+    ) {
+        precondition(rowOffsets.count == shape[0] + 1 &&
+                     rowOffsets.first == 0 &&
+                     rowOffsets.last == columns.count &&
+                     values.count == columns.count, "invalid CSR data")
+        // cpu_scatter binary searches the sorted nonzero positions
+        for r in 0..<shape[0] {
+            precondition(rowOffsets[r] <= rowOffsets[r + 1], "invalid CSR data")
+            for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                let c = columns[p]
+                precondition(c >= 0 && c < shape[1] &&
+                             (p == rowOffsets[r] || columns[p - 1] <= c),
+                             "CSR columns must be in range and sorted by row")
+            }
+        }
+        self.init(unchecked: shape, rowOffsets, columns, values)
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(unchecked:
+    /// creates a matrix from CSR data that is known to be valid, such as
+    /// the structure of an existing matrix, without validating it
+    @inlinable init(
+        unchecked shape: Shape2,
+        _ rowOffsets: [Int],
+        _ columns: [Int],
+        _ values: TensorR1<E>
+    ) {
+        assert(values.count == columns.count, "invalid CSR data")
+        self.shape = shape
+        self.rowOffsets = rowOffsets
+        self.columns = columns
+        self.values = values
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(dense:
+    /// creates a sparse matrix from the nonzero elements of a dense matrix.
+    /// This function blocks until the result is available.
+    @inlinable public init(_ dense: TensorR2<E>) where E.Value: Numeric {
+        let (positions, values) = currentQueue.nonzeros(dense)
+        let cols = dense.shape[1]
+        var rowOffsets = [Int](repeating: 0, count: dense.shape[0] + 1)
+        for p in positions { rowOffsets[p / cols + 1] += 1 }
+        for r in 0..<dense.shape[0] { rowOffsets[r + 1] += rowOffsets[r] }
+        // the positions are in row major order, so the columns are sorted
+        self.init(unchecked: dense.shape, rowOffsets,
+                  positions.map { $0 % cols }, values)
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(coo:
+    /// creates a CSR matrix from a rank 2 COO tensor. Duplicate
+    /// coordinates are kept as separate nonzeros, which are summed.
+    @inlinable public init(_ coo: CooTensor<Shape2,E>) {
+        // order the nonzeros by row and then column
+        let order = coo.indices.indices.sorted {
+            let a = coo.indices[$0], b = coo.indices[$1]
+            return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1])
+        }
+        var rowOffsets = [Int](repeating: 0, count: coo.shape[0] + 1)
+        for i in coo.indices { rowOffsets[i[0] + 1] += 1 }
+        for r in 0..<coo.shape[0] { rowOffsets[r + 1] += rowOffsets[r] }
+
+        let isSorted = order.elementsEqual(0..<order.count)
+        let values = isSorted ? coo.values : coo.values.gathering(
+            indices: array(order, type: DeviceIndex.self))
+        self.init(shape: coo.shape, rowOffsets: rowOffsets,
+                  columns: order.map { coo.indices[$0][1] }, values: values)
+    }
+
+    //--------------------------------------------------------------------------
+    /// dense
+    /// - Returns: the dense matrix, where repeated nonzeros are summed
+    @differentiable(where E.Value: DifferentiableNumeric)
+    @inlinable public func dense() -> TensorR2<E> where E.Value: Numeric {
+        var result = TensorR2<E>(shape: shape, order: .row)
+        currentQueue.scatter(values, positions, &result)
+        return result
+    }
+
+    @derivative(of: dense)
+    @usableFromInline func _vjpDense() -> (
+        value: TensorR2<E>, pullback: (TensorR2<E>) -> TensorR1<E>
+    ) where E.Value: DifferentiableNumeric {
+        (dense(), { sampling($0) })
+    }
+
+    //--------------------------------------------------------------------------
+    /// the linear position of each nonzero in the dense row major matrix
+    @inlinable public var positions: [Int] {
+        var positions = [Int]()
+        positions.reserveCapacity(nonzeroCount)
+        for r in 0..<shape[0] {
+            for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                positions.append(r * shape[1] + columns[p])
+            }
+        }
+        return positions
+    }
+
+    //--------------------------------------------------------------------------
+    /// sampling(dense:
+    /// - Parameter dense: a dense matrix with the same shape
+    /// - Returns: the elements of `dense` at the nonzero positions
+    @inlinable public func sampling(_ dense: TensorR2<E>) -> TensorR1<E> {
+        assert(dense.shape == shape, _messageTensorShapeMismatch)
+        var result = TensorR1<E>(shape: Shape1(nonzeroCount), order: .row)
+        currentQueue.sample(self, dense, &result)
+        return result
+    }
+
+    //--------------------------------------------------------------------------
+    /// replacingValues(with:
+    /// - Returns: a matrix with the same structure and new values
+    @inlinable public func replacingValues(
+        with values: TensorR1<E>
+    ) -> CsrMatrix<E> {
+        precondition(values.count == nonzeroCount,
+                     "there must be one value for each nonzero")
+        return CsrMatrix(unchecked: shape, rowOffsets, columns, values)
+    }
+}
+
+//==============================================================================
+// CsrMatrix Differentiable conformance
+extension CsrMatrix: Differentiable where E.Value: DifferentiableNumeric {
+    public typealias TangentVector = TensorR1<E>
+
+    @inlinable public mutating func move(along direction: TensorR1<E>) {
+        guard !direction.isZero else { return }
+        precondition(direction.count == values.count,
+                     "the direction must have one element per nonzero")
+        values = values + direction
+    }
+}
+
+//==============================================================================
+/// CooTensor
+/// A sparse tensor of any rank in coordinate format, which stores the
+/// coordinates and value of each nonzero. It is mainly used to build and
+/// exchange sparse data, and is converted to `CsrMatrix` for math.
+public struct CooTensor<Shape: TensorShape, E: StorageElement> {
+    /// the dense shape of the tensor
+    public let shape: Shape
+    /// the coordinates of each nonzero
+    public let indices: [Shape]
+    /// the value of each nonzero
+    public var values: TensorR1<E>
+
+    /// the number of stored nonzero values
+    @inlinable public var nonzeroCount: Int { indices.count }
+    /// the name of the tensor
+    @inlinable public var name: String { values.name }
+
+    //--------------------------------------------------------------------------
+    /// init(shape:indices:values:
+    /// creates a tensor from existing COO data
+    @inlinable public init(shape: Shape, indices: [Shape], values: TensorR1<E>) {
+        assert(indices.count == values.count, "invalid COO data")
+        self.shape = shape
+        self.indices = indices
+        self.values = values
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(dense:
+    /// creates a sparse tensor from the nonzero elements of a dense tensor.
+    /// This function blocks until the result is available.
+    @inlinable public init(_ dense: Tensor<Shape,E>) where E.Value: Numeric {
+        let (positions, values) = currentQueue.nonzeros(dense)
+        let strides = dense.shape.strides(for: .row)
+        let indices: [Shape] = positions.map {
+            var remainder = $0
+            var index = Shape(Shape.zeroTuple)
+            for i in 0..<Shape.rank {
+                index[i] = remainder / strides[i]
+                remainder %= strides[i]
+            }
+            return index
+        }
+        self.init(shape: dense.shape, indices: indices, values: values)
+    }
+
+    //--------------------------------------------------------------------------
+    /// dense
+    /// - Returns: the dense tensor, where the values of duplicate
+    ///   coordinates are summed, in the same way as `CsrMatrix`
+    @inlinable public func dense() -> Tensor<Shape,E> where E.Value: Numeric {
+        let strides = shape.strides(for: .row)
+        let positions = indices.map { $0.index(stridedBy: strides) }
+        let order = positions.indices.sorted { positions[$0] < positions[$1] }
+        var result = Tensor<Shape,E>(shape: shape, order: .row)
+        currentQueue.scatter(
+            values.gathering(indices: array(order, type: DeviceIndex.self)),
+            order.map { positions[$0] }, &result)
+        return result
+    }
+}
+
+extension CooTensor where Shape == Shape2 {
+    //--------------------------------------------------------------------------
+    /// init(csr:
+    /// creates a COO tensor from a CSR matrix
+    @inlinable public init(_ csr: CsrMatrix<E>) {
+        var indices = [Shape2]()
+        indices.reserveCapacity(csr.nonzeroCount)
+        for r in 0..<csr.shape[0] {
+            for p in csr.rowOffsets[r]..<csr.rowOffsets[r + 1] {
+                indices.append(Shape2(r, csr.columns[p]))
+            }
+        }
+        self.init(shape: csr.shape, indices: indices, values: csr.values)
+    }
+}
+
+//==============================================================================
+/// SparseRows
+/// A rank 2 tensor that stores only some of its rows, which is the
+/// gradient of a row gather such as an embedding lookup. Each stored row
+/// is added to the dense row of its index, so an index can be repeated
+/// and the sum of two values is the concatenation of their rows.
+/// A value without stored rows is the additive identity.
+public struct SparseRows<E: StorageElement> {
+    /// the number of rows of the dense tensor
+    public let rowCount: Int
+    /// the dense row of each stored row
+    public let indices: [Int]
+    /// the stored rows, with the shape `[indices.count, columns]`
+    public let values: TensorR2<E>
+
+    /// `true` if there are no stored rows
+    @inlinable public var isEmpty: Bool { indices.isEmpty }
+    /// the name of the tensor
+    @inlinable public var name: String { values.name }
+
+    //--------------------------------------------------------------------------
+    /// init(rowCount:indices:values:
+    /// creates a tensor from the stored rows
+    @inlinable public init(rowCount: Int, indices: [Int], values: TensorR2<E>) {
+        assert(indices.isEmpty || values.shape[0] == indices.count,
+               "there must be one index for each stored row")
+        self.rowCount = rowCount
+        self.indices = indices
+        self.values = values
+    }
+}
+
+extension SparseRows where E.Value: Numeric {
+    //--------------------------------------------------------------------------
+    /// dense
+    /// - Returns: the dense tensor, where the rows of repeated indices
+    ///   are summed
+    @inlinable public func dense() -> TensorR2<E> {
+        assert(!isEmpty, "the dense shape of an empty value is unknown")
+        return adding(to: TensorR2<E>(zeros: Shape2(rowCount, values.shape[1]),
+                                      order: .row))
+    }
+
+    //--------------------------------------------------------------------------
+    /// adding(to:
+    /// - Returns: `tensor` with the stored rows added to the rows of
+    ///   their indices
+    @inlinable public func adding(to tensor: TensorR2<E>) -> TensorR2<E> {
+        var result = tensor
+        add(to: &result)
+        return result
+    }
+
+    //--------------------------------------------------------------------------
+    /// add(to:
+    /// adds the stored rows to the rows of their indices. Only the stored
+    /// rows are written, and a uniquely referenced dense row major
+    /// `tensor` is updated in place.
+    @inlinable public func add(to tensor: inout TensorR2<E>) {
+        guard !isEmpty else { return }
+        assert(tensor.shape == Shape2(rowCount, values.shape[1]),
+               _messageTensorShapeMismatch)
+        if !(tensor.isContiguous && tensor.order == .row) {
+            tensor = TensorR2(copying: tensor, order: .row)
+        }
+        currentQueue.scatterAdd(denseRow(values), indices, 0, &tensor)
+    }
+
+    //--------------------------------------------------------------------------
+    /// coalesced
+    /// - Returns: an equal value that stores one row for each distinct
+    ///   index, in increasing index order
+    @inlinable public func coalesced() -> Self {
+        guard !isEmpty else { return self }
+        let unique = Array(Set(indices)).sorted()
+        var slot = [Int: Int]()
+        for (i, index) in unique.enumerated() { slot[index] = i }
+        let rows = scatterAdd(
+            values, indices: indices.map { slot[$0]! },
+            into: TensorR2<E>(zeros: Shape2(unique.count, values.shape[1]),
+                              order: .row))
+        return SparseRows(rowCount: rowCount, indices: unique, values: rows)
+    }
+}
+
+//==============================================================================
+// SparseRows vector space conformances
+extension SparseRows: Equatable where E.Value: Numeric {
+    @inlinable public static func == (lhs: Self, rhs: Self) -> Bool {
+        lhs.indices == rhs.indices && (lhs.isEmpty ||
+            lhs.rowCount == rhs.rowCount && lhs.values == rhs.values)
+    }
+}
+
+extension SparseRows: AdditiveArithmetic where E.Value: Numeric {
+    @inlinable public static var zero: Self {
+        SparseRows(rowCount: 0, indices: [], values: TensorR2<E>.zero)
+    }
+
+    @inlinable public static func + (lhs: Self, rhs: Self) -> Self {
+        if lhs.isEmpty { return rhs }
+        if rhs.isEmpty { return lhs }
+        assert(lhs.rowCount == rhs.rowCount, _messageTensorShapeMismatch)
+        return SparseRows(rowCount: lhs.rowCount,
+                          indices: lhs.indices + rhs.indices,
+                          values: concatenate(lhs.values, rhs.values))
+    }
+
+    @inlinable public static func - (lhs: Self, rhs: Self) -> Self {
+        if rhs.isEmpty { return lhs }
+        let negated = TensorR2<E>(zeros: rhs.values.shape, order: .row) -
+            rhs.values
+        return lhs + SparseRows(rowCount: rhs.rowCount, indices: rhs.indices,
+                                values: negated)
+    }
+}
+
+extension SparseRows: Differentiable where E.Value: DifferentiableNumeric {
+    public typealias TangentVector = Self
+
+    @inlinable public mutating func move(along direction: Self) {
+        self = self + direction
+    }
+}
+
+//==============================================================================
+/// matmul
+/// sparse x dense matrix multiply
+/// - Parameters:
+///  - lhs: the sparse left hand matrix of shape `[M, K]`
+///  - rhs: the dense right hand matrix of shape `[K, N]`
+/// - Returns: a new dense matrix of shape `[M, N]`
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: CsrMatrix<E>,
+    _ rhs: TensorR2<E>
+) -> TensorR2<E> where E.Value: Numeric {
+    assert(lhs.shape[1] == rhs.shape[0], "matmul inner dimensions must be equal")
+    var result = TensorR2<E>(shape: Shape2(lhs.shape[0], rhs.shape[1]),
+                             order: .row)
+    currentQueue.matmul(lhs, rhs, &result)
+    return result
+}
+
+@derivative(of: matmul)
+@usableFromInline func _vjpMatmul<E>(
+    _ lhs: CsrMatrix<E>,
+    _ rhs: TensorR2<E>
+) -> (value: TensorR2<E>, pullback: (TensorR2<E>) -> (TensorR1<E>, TensorR2<E>))
+where E.Value: DifferentiableNumeric
+{
+    (matmul(lhs, rhs), {
+        var lhsGrad = TensorR1<E>(shape: Shape1(lhs.nonzeroCount), order: .row)
+        currentQueue.sampledMatmul(lhs, $0, rhs, &lhsGrad)
+        var rhsGrad = TensorR2<E>(shape: rhs.shape, order: .row)
+        currentQueue.matmulTransposed(lhs, $0, &rhsGrad)
+        return (lhsGrad, rhsGrad)
+    })
+}
+
+//==============================================================================
+/// matmul
+/// sparse matrix x dense vector multiply
+/// - Parameters:
+///  - lhs: the sparse left hand matrix of shape `[M, K]`
+///  - rhs: the dense vector of shape `[K]`
+/// - Returns: a new dense vector of shape `[M]`
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func matmul<E>(
+    _ lhs: CsrMatrix<E>,
+    _ rhs: TensorR1<E>
+) -> TensorR1<E> where E.Value: Numeric {
+    let column = TensorR2<E>(reshaping: rhs, to: Shape2(rhs.count, 1))
+    return TensorR1<E>(reshaping: matmul(lhs, column),
+                       to: Shape1(lhs.shape[0]))
+}
+
+//==============================================================================
+/// multiply
+/// sparse x dense element wise multiply. The result keeps the sparsity
+/// of `lhs`, so only the dense elements at its nonzero positions are read.
+/// - Parameters:
+///  - lhs: the sparse matrix
+///  - rhs: a dense matrix with the same shape
+/// - Returns: a sparse matrix with the same structure as `lhs`
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func multiply<E>(
+    _ lhs: CsrMatrix<E>,
+    _ rhs: TensorR2<E>
+) -> CsrMatrix<E> where E.Value: Numeric {
+    lhs.replacingValues(with: lhs.values * lhs.sampling(rhs))
+}
+
+@derivative(of: multiply)
+@usableFromInline func _vjpMultiply<E>(
+    _ lhs: CsrMatrix<E>,
+    _ rhs: TensorR2<E>
+) -> (value: CsrMatrix<E>, pullback: (TensorR1<E>) -> (TensorR1<E>, TensorR2<E>))
+where E.Value: DifferentiableNumeric
+{
+    let sampled = lhs.sampling(rhs)
+    return (lhs.replacingValues(with: lhs.values * sampled), {
+        // the rhs gradient is dense with zeros outside the lhs structure
+        ($0 * sampled, lhs.replacingValues(with: $0 * lhs.values).dense())
+    })
+}
+
+//==============================================================================
+/// sum(rows:
+/// sums the elements of each row of a sparse matrix
+/// - Parameter x: the sparse matrix
+/// - Returns: a dense vector of row sums
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func sum<E>(rowsOf x: CsrMatrix<E>) -> TensorR1<E>
+where E.Value: Numeric
+{
+    var result = TensorR1<E>(shape: Shape1(x.shape[0]), order: .row)
+    currentQueue.rowSum(x, &result)
+    return result
+}
+
+@derivative(of: sum(rowsOf:))
+@usableFromInline func _vjpSum<E>(rowsOf x: CsrMatrix<E>) -> (
+    value: TensorR1<E>, pullback: (TensorR1<E>) -> TensorR1<E>
+) where E.Value: DifferentiableNumeric {
+    (sum(rowsOf: x), {
+        var result = TensorR1<E>(shape: Shape1(x.nonzeroCount), order: .row)
+        currentQueue.expandRows(x, $0, &result)
+        return result
+    })
+}
+
+//==============================================================================
+/// mean(rows:
+/// averages each row of a sparse matrix, where the elements that are not
+/// stored count as zeros
+/// - Parameter x: the sparse matrix
+/// - Returns: a dense vector of row means
+@differentiable(where E.Value: DifferentiableNumeric)
+@inlinable public func mean<E>(rowsOf x: CsrMatrix<E>) -> TensorR1<E>
+where E.Value: AlgebraicField
+{
+    sum(rowsOf: x) / E.Value(exactly: x.shape[1])!
+}
@@ -780,6 +780,35 @@ public struct BufferElements<Shape, TensorElement>: MutableCollection
         endIndex = startIndex + tensor.count
     }
     
+    //--------------------------------------------------------------------------
+    /// init(spanning:
+    /// creates a storage buffer iterator for reading all of the storage
+    /// elements spanned by a tensor, including the padding of tiled orders.
+    /// This is used for element wise operations on tensors that have
+    /// the same shape and tiled order, and so the same layout.
+    ///
+    /// - Parameters:
+    ///  - tensor: the tensor that will be read
+    @inlinable public init(spanning tensor: Tensor<Shape, TensorElement>) {
+        let buffer = tensor.read(using: currentQueue)
+        let p = UnsafeMutablePointer(mutating: buffer.baseAddress)
+        hostBuffer = UnsafeMutableBufferPointer(start: p, count: buffer.count)
+        startIndex = TensorElement.alignment(tensor.storageBase)
+        endIndex = startIndex + tensor.spanCount
+    }
+
+    /// init(spanning:
+    /// creates a storage buffer iterator for reading/writing all of the
+    /// storage elements spanned by a tensor
+    ///
+    /// - Parameters:
+    ///  - tensor: the tensor that will be written
+    @inlinable public init(spanning tensor: inout Tensor<Shape, TensorElement>) {
+        hostBuffer = tensor.readWrite(using: currentQueue)
+        startIndex = TensorElement.alignment(tensor.storageBase)
+        endIndex = startIndex + tensor.spanCount
+    }
+
     //--------------------------------------------------------------------------
     // index(after:
     @inlinable public func index(after i: Int) -> Int { i + 1 }
@@ -903,27 +932,35 @@ where Shape: TensorShape, TensorElement: StorageElement
     @inlinable public subscript(position: Index) -> TensorElement.Value {
         get {
             switch order {
-            case .row, .col:
+            case .row, .col, .NHWC, .NDHWC:
                 // get logical strided linear element position
                 let i = position.linearIndex(strides) + alignment
                 
                 // convert to stored index which might be less for packed elements
                 let si = TensorElement.storedIndex(i)
                 return TensorElement.value(at: i, from: hostBuffer[si])
-            default: fatalError("not implemented yet")
+            case .colTiled32, .colTiledTC32x8, .colTiledTC32x32:
+                let i = endIndex.position.tiledOffset(position.position, order)
+                        + alignment
+                let si = TensorElement.storedIndex(i)
+                return TensorElement.value(at: i, from: hostBuffer[si])
             }
         }
         
         set {
             switch order {
-            case .row, .col:
+            case .row, .col, .NHWC, .NDHWC:
                 // get logical strided linear element position
                 let i = position.linearIndex(strides) + alignment
                 
                 // convert to stored index which might be less for packed elements
                 let si = TensorElement.storedIndex(i)
                 TensorElement.store(value: newValue, at: i, to: &hostBuffer[si])
-            default: fatalError("not implemented yet")
+            case .colTiled32, .colTiledTC32x8, .colTiledTC32x32:
+                let i = endIndex.position.tiledOffset(position.position, order)
+                        + alignment
+                let si = TensorElement.storedIndex(i)
+                TensorElement.store(value: newValue, at: i, to: &hostBuffer[si])
             }
         }
     }
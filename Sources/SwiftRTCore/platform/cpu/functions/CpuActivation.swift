@@ -0,0 +1,335 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+/// the `clippedRelu` ceiling used when one is not specified
+public let defaultReluCeiling = 6
+
+//==============================================================================
+// ActivationType cpu block functions
+// These operate on small blocks of values that are already in cache,
+// such as a gemm output tile, so they can be fused into other kernels.
+// The `switch` is hoisted out of the element loops.
+extension ActivationType {
+    //--------------------------------------------------------------------------
+    /// apply(x:ceiling:nan:
+    /// applies the activation function in place
+    /// - Parameters:
+    ///  - x: the values to transform
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - nan: `.propagate` keeps NaN inputs of `relu` and `clippedRelu`,
+    ///    `.noPropagate` clamps them to zero. The other activations
+    ///    always propagate NaN.
+    @inlinable public func apply<T: Real>(
+        _ x: UnsafeMutableBufferPointer<T>,
+        ceiling: T,
+        nan: NanPropagation = .noPropagate
+    ) {
+        switch self {
+        case .identity: break
+        case .sigmoid:
+            for i in x.indices { x[i] = 1 / (1 + .exp(-x[i])) }
+        case .relu:
+            if nan == .propagate {
+                for i in x.indices where x[i] < 0 { x[i] = 0 }
+            } else {
+                for i in x.indices { x[i] = Swift.max(0, x[i]) }
+            }
+        case .tanh:
+            for i in x.indices { x[i] = .tanh(x[i]) }
+        case .clippedRelu:
+            if nan == .propagate {
+                for i in x.indices {
+                    if x[i] < 0 { x[i] = 0 } else if x[i] > ceiling { x[i] = ceiling }
+                }
+            } else {
+                for i in x.indices { x[i] = Swift.min(ceiling, Swift.max(0, x[i])) }
+            }
+        case .elu:
+            for i in x.indices { if x[i] < 0 { x[i] = .expMinusOne(x[i]) } }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// gradient(y:yDiff:ceiling:nan:
+    /// scales `yDiff` in place by the derivative of the activation, which
+    /// is computed from the activation output `y`
+    /// - Parameters:
+    ///  - y: the activation outputs
+    ///  - yDiff: the incoming gradients
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - nan: `.propagate` gives a NaN gradient for NaN outputs of `relu`
+    ///    and `clippedRelu`, `.noPropagate` gives zero
+    @inlinable public func gradient<T: Real>(
+        _ y: UnsafeMutableBufferPointer<T>,
+        _ yDiff: UnsafeMutableBufferPointer<T>,
+        ceiling: T,
+        nan: NanPropagation = .noPropagate
+    ) {
+        switch self {
+        case .identity: break
+        case .sigmoid:
+            for i in y.indices { yDiff[i] *= y[i] * (1 - y[i]) }
+        case .relu:
+            if nan == .propagate {
+                for i in y.indices where !(y[i] > 0) {
+                    yDiff[i] = y[i].isNaN ? y[i] : 0
+                }
+            } else {
+                for i in y.indices where !(y[i] > 0) { yDiff[i] = 0 }
+            }
+        case .tanh:
+            for i in y.indices { yDiff[i] *= 1 - y[i] * y[i] }
+        case .clippedRelu:
+            if nan == .propagate {
+                for i in y.indices where !(y[i] > 0 && y[i] < ceiling) {
+                    yDiff[i] = y[i].isNaN ? y[i] : 0
+                }
+            } else {
+                for i in y.indices where !(y[i] > 0 && y[i] < ceiling) {
+                    yDiff[i] = 0
+                }
+            }
+        case .elu:
+            for i in y.indices where y[i] < 0 { yDiff[i] *= y[i] + 1 }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// value(x:ceiling:nan:
+    /// - Returns: the activation of a single value, which is used when
+    ///   the operands are not dense
+    @inlinable public func value<T: Real>(
+        _ x: T,
+        ceiling: T,
+        nan: NanPropagation
+    ) -> T {
+        switch self {
+        case .identity: return x
+        case .sigmoid: return 1 / (1 + .exp(-x))
+        case .relu:
+            return nan == .propagate ? (x < 0 ? 0 : x) : Swift.max(0, x)
+        case .tanh: return .tanh(x)
+        case .clippedRelu:
+            return nan == .propagate ?
+                (x < 0 ? 0 : x > ceiling ? ceiling : x) :
+                Swift.min(ceiling, Swift.max(0, x))
+        case .elu: return x < 0 ? .expMinusOne(x) : x
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// derivative(y:yDiff:ceiling:nan:
+    /// - Returns: `yDiff` scaled by the derivative of the activation at
+    ///   the output `y`, which is used when the operands are not dense
+    @inlinable public func derivative<T: Real>(
+        _ y: T,
+        _ yDiff: T,
+        ceiling: T,
+        nan: NanPropagation
+    ) -> T {
+        switch self {
+        case .identity: return yDiff
+        case .sigmoid: return yDiff * y * (1 - y)
+        case .relu:
+            return y > 0 ? yDiff : nan == .propagate && y.isNaN ? y : 0
+        case .tanh: return yDiff * (1 - y * y)
+        case .clippedRelu:
+            return y > 0 && y < ceiling ? yDiff :
+                nan == .propagate && y.isNaN ? y : 0
+        case .elu: return y < 0 ? yDiff * (y + 1) : yDiff
+        }
+    }
+}
+
+//==============================================================================
+// cpu activation kernels
+// Dense operands are processed as blocks of values that are converted to
+// `Value`, transformed by the block functions above, and stored, so the
+// activation `switch` is hoisted out of simple loops that the compiler
+// vectorizes. Blocks are distributed across the cores for large tensors.
+// Operands that are not dense, or have different layouts, are mapped one
+// element at a time.
+@usableFromInline let _activationBlockSize = 1024
+
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_activation
+    /// computes `out = activation(x)`
+    /// - Parameters:
+    ///  - x: the activation input
+    ///  - activation: the activation type
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - nan: the NaN propagation of `relu` and `clippedRelu`
+    ///  - out: the activation output
+    @inlinable func cpu_activation<S,E>(
+        _ x: Tensor<S,E>,
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "activation(\(x.name), \(activation)) on \(name)",
+                   categories: .queueCpu)
+        if x.isContiguous && out.isContiguous && x.order == out.order {
+            let count = x.count
+            let xs = CpuMatrix(dense: x, 1, 1, count)
+            let ys = CpuMatrix(mutatingDense: &out, 1, 1, count)
+            cpu_activationBlocks(xs, ys, count) {
+                activation.apply($0, ceiling: ceiling, nan: nan)
+            }
+        } else {
+            mapOp(x, &out) { activation.value($0, ceiling: ceiling, nan: nan) }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_activation(inPlace:
+    /// computes `x = activation(x)` for a dense tensor
+    @inlinable func cpu_activation<S,E>(
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        inPlace x: inout Tensor<S,E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "activation(\(x.name), \(activation)) " +
+                    "in place on \(name)", categories: .queueCpu)
+        let count = x.count
+        let xs = CpuMatrix(mutatingDense: &x, 1, 1, count)
+        cpu_activationBlocks(xs, xs, count) {
+            activation.apply($0, ceiling: ceiling, nan: nan)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_activationBlocks
+    /// transforms blocks of `count` dense values from `xs` to `ys`, which
+    /// may be the same matrix
+    @inlinable func cpu_activationBlocks<E>(
+        _ xs: CpuMatrix<E>,
+        _ ys: CpuMatrix<E>,
+        _ count: Int,
+        _ body: @escaping (UnsafeMutableBufferPointer<E.Value>) -> Void
+    ) {
+        cpu_parallel(count: count) { range in
+            let block = UnsafeMutableBufferPointer<E.Value>.allocate(
+                capacity: Swift.min(range.count, _activationBlockSize))
+            defer { block.deallocate() }
+            for start in Swift.stride(from: range.lowerBound,
+                                      to: range.upperBound, by: block.count) {
+                let n = Swift.min(block.count, range.upperBound - start)
+                let values = UnsafeMutableBufferPointer(rebasing: block[0..<n])
+                for j in 0..<n { values[j] = xs[0, 0, start &+ j] }
+                body(values)
+                for j in 0..<n { ys[0, 0, start &+ j] = values[j] }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_activationGradient
+    /// computes `yDiff` scaled by the derivative of the activation.
+    /// The derivative is computed from the saved output `y`, so the
+    /// activation input does not need to be kept for the backward pass,
+    /// and `sigmoid` and `tanh` do not evaluate any transcendentals.
+    /// - Parameters:
+    ///  - y: the activation output
+    ///  - yDiff: the incoming gradient
+    ///  - activation: the activation type
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - nan: the NaN propagation of `relu` and `clippedRelu`
+    ///  - out: the gradient with respect to the activation input
+    @inlinable func cpu_activationGradient<S,E>(
+        _ y: Tensor<S,E>,
+        _ yDiff: Tensor<S,E>,
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "activationGradient(\(activation)) on \(name)",
+                   categories: .queueCpu)
+        if y.isContiguous && yDiff.isContiguous && out.isContiguous &&
+            y.order == yDiff.order && yDiff.order == out.order {
+            let count = y.count
+            let ys = CpuMatrix(dense: y, 1, 1, count)
+            let dys = CpuMatrix(dense: yDiff, 1, 1, count)
+            let dxs = CpuMatrix(mutatingDense: &out, 1, 1, count)
+            cpu_parallel(count: count) { range in
+                let capacity = Swift.min(range.count, _activationBlockSize)
+                let block = UnsafeMutableBufferPointer<E.Value>
+                    .allocate(capacity: 2 * capacity)
+                defer { block.deallocate() }
+                for start in Swift.stride(from: range.lowerBound,
+                                          to: range.upperBound, by: capacity) {
+                    let n = Swift.min(capacity, range.upperBound - start)
+                    let yb = UnsafeMutableBufferPointer(rebasing: block[0..<n])
+                    let db = UnsafeMutableBufferPointer(
+                        rebasing: block[capacity..<(capacity + n)])
+                    for j in 0..<n {
+                        yb[j] = ys[0, 0, start &+ j]
+                        db[j] = dys[0, 0, start &+ j]
+                    }
+                    activation.gradient(yb, db, ceiling: ceiling, nan: nan)
+                    for j in 0..<n { dxs[0, 0, start &+ j] = db[j] }
+                }
+            }
+        } else {
+            mapOp(y, yDiff, &out) {
+                activation.derivative($0, $1, ceiling: ceiling, nan: nan)
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue cpu activation delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func activation<S,E>(
+        _ x: Tensor<S,E>,
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Real {
+        cpu_activation(x, activation, ceiling, nan, &out)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func activation<S,E>(
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        inPlace x: inout Tensor<S,E>
+    ) where E.Value: Real {
+        cpu_activation(activation, ceiling, nan, inPlace: &x)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func activationGradient<S,E>(
+        _ y: Tensor<S,E>,
+        _ yDiff: Tensor<S,E>,
+        _ activation: ActivationType,
+        _ ceiling: E.Value,
+        _ nan: NanPropagation,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Real {
+        cpu_activationGradient(y, yDiff, activation, ceiling, nan, &out)
+    }
+}
@@ -14,6 +14,7 @@
 // limitations under the License.
 //
 import Foundation
+import Numerics
 
 
 //==============================================================================
@@ -27,6 +28,11 @@ public struct ConvolutionProperties: Codable {
     public var backwardFilterWorkspaceLimit: Int
     public var forwardAlgorithm: ConvolutionFwdAlgorithm
     public var forwardWorkspaceLimit: Int
+    /// the number of channel groups. The input and output channels are
+    /// split into `groups` groups, and each output group is only connected
+    /// to the corresponding input group. When `groups` is the number of
+    /// input channels the convolution is depthwise.
+    public var groups: Int
     public var mode: ConvolutionMode
     
     @inlinable public init() {
@@ -38,6 +44,7 @@ public struct ConvolutionProperties: Codable {
         backwardFilterWorkspaceLimit = 10.MB
         forwardAlgorithm = .fastest
         forwardWorkspaceLimit = 10.MB
+        groups = 1
         mode = .crossCorrelation
     }
 }
@@ -112,7 +119,9 @@ extension DeviceQueue where Self: CpuFunctions
     ) -> DeviceConvolution<Shape, Element, FilterElement>
     where Shape: TensorShape,
           Element: StorageElement,
-          FilterElement: StorageElement
+          Element.Value: Real & BinaryFloatingPoint,
+          FilterElement: StorageElement,
+          FilterElement.Value == Element.Value
     {
         CpuConvolution<Shape, Element, FilterElement>(
             activation: activation,
@@ -123,6 +132,15 @@ extension DeviceQueue where Self: CpuFunctions
             deviceId: deviceId,
             filterBiasBackpropQueueIndex: filterBiasBackpropQueueIndex)
     }
+
+    //--------------------------------------------------------------------------
+    @inlinable func im2col<S,E>(
+        _ x: Tensor<S,E>,
+        _ geometry: ConvolutionGeometry,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        cpu_im2col(x, geometry, &out)
+    }
 }
 
 //==============================================================================
@@ -131,7 +149,9 @@ public final class CpuConvolution<Shape, Element, FilterElement>:
     DeviceConvolution<Shape, Element, FilterElement>
 where Shape: TensorShape,
       Element: StorageElement,
-      FilterElement: StorageElement {}
+      Element.Value: Real & BinaryFloatingPoint,
+      FilterElement: StorageElement,
+      FilterElement.Value == Element.Value {}
 
 //==============================================================================
 /// DeviceConvolution
@@ -142,8 +162,18 @@ where Shape: TensorShape,
 /// [filter width, input channels, output channels]
 /// [filter width, filter width, input channels, output channels]
 /// [filter depth, filter width, filter width, input channels, output channels]
+///
+/// The spatial strides and dilations are taken from the dimensions of
+/// `strides` and `dilations` that correspond to the spatial dimensions
+/// of the input. The filter and data element types may differ, for example
+/// `Float16` filters can be used with `Float` data, but they must have the
+/// same `Value` type, which is used to accumulate the result.
 public class DeviceConvolution<Shape, Element, FilterElement>: Logging
-where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint,
+      FilterElement: StorageElement,
+      FilterElement.Value == Element.Value
 {
     // types
     public typealias Data = Tensor<Shape, Element>
@@ -151,11 +181,49 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
     public typealias Bias = TensorR1<FilterElement>
     
     // properties
+    public let activation: ActivationType
     public let properties: ConvolutionProperties
     public let padding: Padding
     public let strides: Shape
     public let dilations: Shape
     public var inputShape: Shape
+    public var filterShape: Shape
+    public let logCategories: LogCategories = [.setup]
+
+    // forward
+    public var geometry: ConvolutionGeometry!
+    public var forwardAlgorithm: ConvolutionFwdAlgorithm
+    public var forwardWorkspaceSize = 0
+    /// the number of output positions, or winograd tiles, computed by
+    /// each work item
+    public var forwardTileRows = 1
+    /// the winograd output tile size
+    public var winogradTileSize = 2
+    /// the transformed filter used for inference by the `winograd`
+    /// algorithm when `filterIsConstant` is `true`
+    public let winogradFilter = CpuWinogradFilter<Element.Value>()
+    /// the packed filter used for inference by the `direct` and `gemm`
+    /// algorithms when `filterIsConstant` is `true`
+    public let packedFilter = CpuPackedFilter<Element.Value>()
+    /// `true` if the filter is never modified in place, such as the
+    /// filter of a frozen layer, so its packing can be cached
+    public var filterIsConstant = false
+    /// the kernel scratch kept between inference calls when
+    /// `filterIsConstant` is `true`
+    public let scratch = CpuScratch()
+
+    // backward
+    public var backwardGeometry: ConvolutionGeometry?
+    public var backwardDataAlgorithm: ConvolutionBwdDataAlgorithm
+    public var backwardDataWorkspaceSize = 0
+    /// the number of input positions computed by each work item
+    public var backwardDataTileRows = 1
+    public var backwardFilterAlgorithm: ConvolutionBwdFilterAlgorithm
+    public var backwardFilterWorkspaceSize = 0
+    /// the number of partial filter gradients that are reduced
+    public var backwardFilterParts = 1
+    /// the number of output positions gathered for each partial update
+    public var backwardFilterTileRows = 1
 
     //--------------------------------------------------------------------------
     /// init
@@ -179,11 +247,16 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
     ) {
         //----------------------------------
         // save properties
+        self.activation = activation
         self.properties = properties
         self.padding = padding
         self.strides = strides
         self.dilations = dilations
         self.inputShape = Shape.zero
+        self.filterShape = Shape.zero
+        self.forwardAlgorithm = .direct
+        self.backwardDataAlgorithm = .algo0
+        self.backwardFilterAlgorithm = .algo0
     }
     
     //--------------------------------------------------------------------------
@@ -199,11 +272,86 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
         bias: Bias,
         mode: EvaluationMode
     ) -> Data {
-        fatalError("abstract not implemented")
+        var y = Data()
+        forward(x: x, filter: filter, bias: bias, mode: mode, into: &y)
+        return y
+    }
+
+    //--------------------------------------------------------------------------
+    /// forward(x:filter:bias:mode:into:
+    /// computes the forward convolution into `y`. The storage of `y` is
+    /// reused when it already has the output shape and layout, so repeated
+    /// inference calls with the same input shape do not allocate an output.
+    /// - Parameter y: the output tensor
+    /// - Parameter x: the input tensor
+    /// - Parameter filter: the convolution filter
+    /// - Parameter bias: the filter bias
+    @inlinable public func forward(
+        x: Data,
+        filter: Filter,
+        bias: Bias,
+        mode: EvaluationMode,
+        into y: inout Data
+    ) {
+        // channels last tensors are convolved in place through a row order
+        // (N, spatial..., C) view, and the result is in the same order
+        if x.order.isChannelsLast {
+            var yRow = y.order == x.order && y.isContiguous ?
+                Data(channelsLast: y) : Data()
+            // release `y` so the view is the only reference to its storage
+            y = Data()
+            forward(x: Data(channelsLast: channelsLast(x, x.order)),
+                    filter: filter, bias: bias, mode: mode, into: &yRow)
+            y = Data(channelsFirst: yRow, order: x.order)
+            return
+        }
+
+        // setup any time the input or filter shape changes
+        if x.shape != inputShape || filter.shape != filterShape {
+            setupForward(x, filter)
+        }
+        assert(bias.count == geometry.outChannels, _messageTensorShapeMismatch)
+
+        // the kernels index dense row major tensors
+        let x = x.isContiguous && x.order == .row ? x :
+            Data(copying: x, order: .row)
+        let filter = filter.isContiguous && filter.order == .row ? filter :
+            Filter(copying: filter, order: .row)
+        reuseOutput(&y, geometry.outputShape())
+
+        let ceiling = Element.Value(properties.activationReluCeiling)
+        let isConstant = mode == .inferring && filterIsConstant
+        if forwardAlgorithm == .winograd {
+            // filters only change between calls while training
+            currentQueue.cpu_winogradConvolution(
+                x, filter, bias, geometry,
+                tileSize: winogradTileSize,
+                blockTiles: forwardTileRows,
+                cache: isConstant ? winogradFilter : nil,
+                scratch: isConstant ? scratch : nil,
+                activation: activation,
+                reluCeiling: ceiling,
+                nan: properties.activationNan,
+                &y)
+        } else {
+            currentQueue.cpu_convolution(
+                x, filter, bias, geometry,
+                algorithm: forwardAlgorithm,
+                tileRows: forwardTileRows,
+                cache: isConstant ? packedFilter : nil,
+                scratch: isConstant ? scratch : nil,
+                activation: activation,
+                reluCeiling: ceiling,
+                nan: properties.activationNan,
+                &y)
+        }
     }
 
     //--------------------------------------------------------------------------
     /// backward
+    /// computes the gradients of `x`, `filter`, and `bias`. The output
+    /// gradient is first scaled by the derivative of the fused activation,
+    /// which is computed from the saved output `y`.
     /// - Parameter y: the output tensor
     /// - Parameter yDiff: the output differential
     /// - Parameter filter: the convolution filter
@@ -223,6 +371,895 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
         xDiff: inout Data,
         mode: EvaluationMode
     ) {
-        fatalError("abstract not implemented")
+        if x.order.isChannelsLast {
+            let order = x.order
+            var dx = Data(shape: x.shape.channelsLast, order: .row)
+            backward(y: Data(channelsLast: channelsLast(y, order)),
+                     yDiff: Data(channelsLast: channelsLast(yDiff, order)),
+                     filter: filter, filterDiff: &filterDiff,
+                     bias: bias, biasDiff: &biasDiff,
+                     x: Data(channelsLast: channelsLast(x, order)),
+                     xDiff: &dx, mode: mode)
+            copy(from: Data(channelsFirst: dx, order: order), to: &xDiff)
+            return
+        }
+
+        if x.shape != inputShape || filter.shape != filterShape {
+            setupForward(x, filter)
+        }
+        if backwardGeometry != geometry { selectBackwardAlgorithms() }
+        assert(y.shape == geometry.outputShape() && yDiff.shape == y.shape &&
+                xDiff.shape == x.shape && filterDiff.shape == filter.shape &&
+                biasDiff.count == geometry.outChannels,
+               _messageTensorShapeMismatch)
+
+        // the kernels index dense row major tensors
+        func dense<S,E>(_ t: Tensor<S,E>) -> Tensor<S,E> {
+            t.isContiguous && t.order == .row ? t :
+                Tensor<S,E>(copying: t, order: .row)
+        }
+
+        func withDense<S,E>(
+            _ t: inout Tensor<S,E>,
+            _ body: (inout Tensor<S,E>) -> Void
+        ) {
+            if t.isContiguous && t.order == .row {
+                body(&t)
+            } else {
+                var result = Tensor<S,E>(shape: t.shape, order: .row)
+                body(&result)
+                copy(from: result, to: &t)
+            }
+        }
+
+        let x = dense(x), filter = dense(filter)
+
+        // the gradient with respect to the activation input
+        var dy = dense(yDiff)
+        if activation != .identity {
+            var gradient = Data(shape: dy.shape, order: .row)
+            currentQueue.cpu_activationGradient(
+                dense(y), dy, activation,
+                Element.Value(properties.activationReluCeiling),
+                properties.activationNan, &gradient)
+            dy = gradient
+        }
+
+        withDense(&xDiff) {
+            currentQueue.cpu_convolutionBackwardData(
+                dy, filter, geometry,
+                algorithm: backwardDataAlgorithm,
+                tileRows: backwardDataTileRows,
+                &$0)
+        }
+
+        withDense(&filterDiff) { filterDiff in
+            withDense(&biasDiff) {
+                currentQueue.cpu_convolutionBackwardFilter(
+                    x, dy, geometry,
+                    algorithm: backwardFilterAlgorithm,
+                    parts: backwardFilterParts,
+                    tileRows: backwardFilterTileRows,
+                    &filterDiff, &$0)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // channelsLast
+    // - Returns: `t` as a dense tensor in the channels last `order`
+    @inlinable public func channelsLast(_ t: Data, _ order: Order) -> Data {
+        t.isContiguous && t.order == order ? t : Data(copying: t, order: order)
+    }
+
+    //--------------------------------------------------------------------------
+    // setupForward
+    @inlinable public func setupForward(_ x: Data, _ filter: Filter) {
+        inputShape = x.shape
+        filterShape = filter.shape
+        geometry = ConvolutionGeometry(
+            input: x.shape, filter: filter.shape, strides: strides,
+            padding: padding, dilations: dilations, mode: properties.mode,
+            groups: properties.groups)
+        selectForwardAlgorithm()
+    }
+
+    //--------------------------------------------------------------------------
+    // selectForwardAlgorithm
+    // The im2col `gemm` algorithm gathers the input windows for a tile of
+    // output positions into a workspace, so it is limited by the workspace
+    // size. The `direct` algorithm reads the windows in place and needs
+    // no workspace, which is faster for small filters where there is
+    // little reuse of the gathered rows. `winograd` is used for 3x3 stride
+    // 1 filters, and its workspace includes the transformed filter.
+    // The selection is cached in the shared execution plan cache, so it
+    // can be preloaded with the other plans.
+    @inlinable public func selectForwardAlgorithm() {
+        var key = planKey("convolutionForward")
+        key.combine(properties.forwardAlgorithm.rawValue)
+        key.combine(properties.forwardWorkspaceLimit)
+        let plan = CpuExecutionPlanCache.shared.plan(
+            CpuConvolutionForwardPlan.self, key: key.key
+        ) { forwardPlan() } ?? forwardPlan()
+        forwardAlgorithm = plan.algorithm
+        forwardTileRows = plan.tileRows
+        winogradTileSize = plan.winogradTileSize
+        forwardWorkspaceSize = plan.workspaceSize
+
+        if willLog(level: .diagnostic) &&
+            properties.forwardAlgorithm != forwardAlgorithm {
+            diagnostic(.setup, "using forward algorithm: " +
+                "\(forwardAlgorithm)  workspace size: \(forwardWorkspaceSize)",
+                categories: logCategories)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // forwardPlan
+    // - Returns: the heuristic forward algorithm selection
+    @inlinable public func forwardPlan() -> CpuConvolutionForwardPlan {
+        let g = geometry!
+        let threads = ProcessInfo.processInfo.activeProcessorCount
+        let valueSize = MemoryLayout<Element.Value>.size
+        let limit = properties.forwardWorkspaceLimit
+
+        // split the output positions so all cores are kept busy
+        let rowSize = threads * g.filterCount * valueSize
+        let rows = Swift.max(1, Swift.min(_convolutionTileRows,
+            (g.batchCount * g.outputCount + threads - 1) / threads))
+        let fittingRows = Swift.min(rows, limit / rowSize)
+
+        // split the winograd tiles in the same way
+        let m = g.winogradTileSize, alpha2 = (m + 2) * (m + 2)
+        let tileSize = threads * valueSize *
+            (alpha2 * (g.inChannels + g.outChannels) + m * m * g.outChannels)
+        let filterSize = alpha2 * g.inChannels * g.outChannels * valueSize
+        let tiles = Swift.max(1, Swift.min(_winogradBlockTiles,
+            (g.winogradTiles(m) + threads - 1) / threads))
+        let fittingTiles = Swift.min(
+            tiles, Swift.max(0, limit - filterSize) / tileSize)
+
+        // the heuristic selection
+        var fastest: ConvolutionFwdAlgorithm {
+            if g.filterCount <= _convolutionDirectFilterCount { return .direct }
+            if g.isWinogradCompatible && fittingTiles > 0 { return .winograd }
+            return fittingRows > 0 ? .gemm : .direct
+        }
+
+        var algorithm: ConvolutionFwdAlgorithm
+        switch properties.forwardAlgorithm {
+        case .gemm:
+            algorithm = .gemm
+
+        case .direct, .implicitGEMM, .implicitPrecompGEMM, .noWorkspace:
+            algorithm = .direct
+
+        case .winograd, .winogradNonFused:
+            if g.isWinogradCompatible {
+                algorithm = .winograd
+            } else {
+                writeLog("winograd requires a 3x3 stride 1 filter without " +
+                         "dilation. 'fastest' used instead")
+                algorithm = fastest
+            }
+
+        case .workspaceLimit:
+            algorithm = fittingRows > 0 ? .gemm : .direct
+
+        default:
+            algorithm = fastest
+        }
+
+        // depthwise convolutions always use the sliding window kernel,
+        // because there is no reuse of gathered rows
+        if g.isDepthwise { algorithm = .direct }
+
+        // an algorithm that can't fit one tile in the workspace limit
+        // falls back to `direct`, which needs no workspace
+        if algorithm == .winograd && fittingTiles == 0 ||
+            algorithm == .gemm && fittingRows == 0 {
+            writeLog("the workspace limit is too small for the \(algorithm) " +
+                     "algorithm. 'direct' used instead")
+            algorithm = .direct
+        }
+
+        switch algorithm {
+        case .gemm:
+            return CpuConvolutionForwardPlan(
+                algorithm: algorithm, tileRows: fittingRows,
+                winogradTileSize: m, workspaceSize: fittingRows * rowSize)
+        case .winograd:
+            return CpuConvolutionForwardPlan(
+                algorithm: algorithm, tileRows: fittingTiles,
+                winogradTileSize: m,
+                workspaceSize: fittingTiles * tileSize + filterSize)
+        default:
+            return CpuConvolutionForwardPlan(
+                algorithm: algorithm, tileRows: rows,
+                winogradTileSize: m, workspaceSize: 0)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // selectBackwardAlgorithms
+    // The backward data `algo1` gathers the output gradient windows that
+    // read a tile of input positions into a workspace, and `algo0` reads
+    // them in place. The backward filter `algo1` and `algo3` accumulate
+    // per thread partial gradients that are reduced at the end, where
+    // `algo1` also gathers the input windows (im2col). The partials are
+    // limited by the workspace size, and `algo0` needs no workspace.
+    // The selection is cached in the shared execution plan cache.
+    @inlinable public func selectBackwardAlgorithms() {
+        backwardGeometry = geometry
+        var key = planKey("convolutionBackward")
+        key.combine(properties.backwardDataAlgorithm.rawValue)
+        key.combine(properties.backwardDataWorkspaceLimit)
+        key.combine(properties.backwardFilterAlgorithm.rawValue)
+        key.combine(properties.backwardFilterWorkspaceLimit)
+        let plan = CpuExecutionPlanCache.shared.plan(
+            CpuConvolutionBackwardPlan.self, key: key.key
+        ) { backwardPlan() } ?? backwardPlan()
+        backwardDataAlgorithm = plan.dataAlgorithm
+        backwardDataTileRows = plan.dataTileRows
+        backwardDataWorkspaceSize = plan.dataWorkspaceSize
+        backwardFilterAlgorithm = plan.filterAlgorithm
+        backwardFilterParts = plan.filterParts
+        backwardFilterTileRows = plan.filterTileRows
+        backwardFilterWorkspaceSize = plan.filterWorkspaceSize
+
+        if willLog(level: .diagnostic) {
+            if properties.backwardDataAlgorithm != backwardDataAlgorithm {
+                diagnostic(.setup, "using backward data algorithm: " +
+                    "\(backwardDataAlgorithm)  workspace size: " +
+                    "\(backwardDataWorkspaceSize)", categories: logCategories)
+            }
+            if properties.backwardFilterAlgorithm != backwardFilterAlgorithm {
+                diagnostic(.setup, "using backward filter algorithm: " +
+                    "\(backwardFilterAlgorithm)  workspace size: " +
+                    "\(backwardFilterWorkspaceSize)", categories: logCategories)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // backwardPlan
+    // - Returns: the heuristic backward algorithm selection
+    @inlinable public func backwardPlan() -> CpuConvolutionBackwardPlan {
+        let g = geometry!
+        let threads = ProcessInfo.processInfo.activeProcessorCount
+        let valueSize = MemoryLayout<Element.Value>.size
+        let isLarge = g.filterCount > _convolutionDirectFilterCount
+
+        //----------------------------------
+        // data
+        let dataLimit = properties.backwardDataWorkspaceLimit
+        let dataRowSize = threads * g.taps * g.groupOutChannels * valueSize
+        let dataRows = Swift.max(1, Swift.min(_convolutionTileRows,
+            (g.batchCount * g.inputCount + threads - 1) / threads))
+        let dataFittingRows = Swift.min(dataRows, dataLimit / dataRowSize)
+
+        var fastestData: ConvolutionBwdDataAlgorithm {
+            isLarge && dataFittingRows > 0 ? .algo1 : .algo0
+        }
+
+        var dataAlgorithm: ConvolutionBwdDataAlgorithm
+        switch properties.backwardDataAlgorithm {
+        case .algo0, .noWorkspace:
+            dataAlgorithm = .algo0
+        case .algo1:
+            dataAlgorithm = .algo1
+        case .workspaceLimit:
+            dataAlgorithm = dataFittingRows > 0 ? .algo1 : .algo0
+        case .fastest, .deterministic:
+            dataAlgorithm = fastestData
+        default:
+            writeLog("\(properties.backwardDataAlgorithm) backward data " +
+                     "algorithm is not supported. 'fastest' used instead")
+            dataAlgorithm = fastestData
+        }
+
+        // a tile that doesn't fit the workspace limit falls back to
+        // `algo0`, which needs no workspace
+        if dataAlgorithm == .algo1 && dataFittingRows == 0 {
+            writeLog("the workspace limit is too small for the algo1 " +
+                     "backward data algorithm. 'algo0' used instead")
+            dataAlgorithm = .algo0
+        }
+
+        let dataTileRows = dataAlgorithm == .algo1 ? dataFittingRows : dataRows
+        let dataWorkspaceSize = dataAlgorithm == .algo1 ?
+            dataTileRows * dataRowSize : 0
+
+        //----------------------------------
+        // filter
+        let filterLimit = properties.backwardFilterWorkspaceLimit
+        let batchRows = g.batchCount * g.outputCount
+        let filterRows = Swift.max(1, Swift.min(_convolutionTileRows,
+            (batchRows + threads - 1) / threads))
+        let parts = Swift.min(threads,
+                              (batchRows + filterRows - 1) / filterRows)
+        let partialSize = (g.filterCount + 1) * g.outChannels * valueSize
+        let gemmPartSize = partialSize +
+            filterRows * (g.filterCount + g.outChannels) * valueSize
+        let directPartSize = partialSize + g.outChannels * valueSize
+        let gemmParts = Swift.min(parts, filterLimit / gemmPartSize)
+        let directParts = Swift.min(parts, filterLimit / directPartSize)
+
+        var fastestFilter: ConvolutionBwdFilterAlgorithm {
+            if isLarge && gemmParts > 0 { return .algo1 }
+            return directParts > 0 ? .algo3 : .algo0
+        }
+
+        var filterAlgorithm: ConvolutionBwdFilterAlgorithm
+        switch properties.backwardFilterAlgorithm {
+        case .algo0, .noWorkspace:
+            filterAlgorithm = .algo0
+        case .algo1:
+            filterAlgorithm = .algo1
+        case .algo3:
+            filterAlgorithm = .algo3
+        case .fastest, .deterministic, .workspaceLimit:
+            filterAlgorithm = fastestFilter
+        default:
+            writeLog("\(properties.backwardFilterAlgorithm) backward filter " +
+                     "algorithm is not supported. 'fastest' used instead")
+            filterAlgorithm = fastestFilter
+        }
+
+        if filterAlgorithm == .algo1 && gemmParts == 0 ||
+            filterAlgorithm == .algo3 && directParts == 0 {
+            writeLog("the workspace limit is too small for the " +
+                     "\(filterAlgorithm) backward filter algorithm. " +
+                     "'algo0' used instead")
+            filterAlgorithm = .algo0
+        }
+
+        var filterParts = 1, filterTileRows = 1, filterWorkspaceSize = 0
+        switch filterAlgorithm {
+        case .algo1:
+            filterParts = gemmParts
+            filterTileRows = filterRows
+            filterWorkspaceSize = filterParts * gemmPartSize
+        case .algo3:
+            filterParts = directParts
+            filterWorkspaceSize = filterParts * directPartSize
+        default:
+            break
+        }
+
+        return CpuConvolutionBackwardPlan(
+            dataAlgorithm: dataAlgorithm,
+            dataTileRows: dataTileRows,
+            dataWorkspaceSize: dataWorkspaceSize,
+            filterAlgorithm: filterAlgorithm,
+            filterParts: filterParts,
+            filterTileRows: filterTileRows,
+            filterWorkspaceSize: filterWorkspaceSize)
+    }
+
+    //--------------------------------------------------------------------------
+    // planKey
+    // - Returns: the execution plan key of `op` for the element types
+    //   and the current geometry
+    @inlinable public func planKey(_ op: String) -> ExecutionPlanKey {
+        let g = geometry!
+        var key = ExecutionPlanKey(op)
+        key.combine(Element.self)
+        key.combine(FilterElement.self)
+        for value in [g.batchCount, g.inChannels, g.outChannels, g.groups,
+                      g.inD, g.inH, g.inW, g.outD, g.outH, g.outW,
+                      g.fD, g.fH, g.fW, g.sD, g.sH, g.sW,
+                      g.dD, g.dH, g.dW, g.pD, g.pH, g.pW] {
+            key.combine(value)
+        }
+        return key
+    }
+}
+
+//==============================================================================
+/// the maximum number of output positions computed by a work item
+@usableFromInline let _convolutionTileRows = 64
+
+/// filters with at most this many values per output channel use the
+/// direct algorithm when the fastest algorithm is requested
+@usableFromInline let _convolutionDirectFilterCount = 64
+
+/// the maximum number of winograd tiles computed by a work item
+@usableFromInline let _winogradBlockTiles = 32
+
+//==============================================================================
+/// ConvolutionGeometry
+/// The sizes of a 1D, 2D, or 3D convolution. Every convolution is treated
+/// as 3D, with missing leading spatial dimensions having a size of 1, so
+/// the same kernels are used for all ranks.
+public struct ConvolutionGeometry: Equatable {
+    /// the number of items in the batch
+    public let batchCount: Int
+    /// the number of input and output channels
+    public let inChannels, outChannels: Int
+    /// the number of channel groups
+    public let groups: Int
+    /// the input spatial sizes
+    public let inD, inH, inW: Int
+    /// the output spatial sizes
+    public let outD, outH, outW: Int
+    /// the filter spatial sizes
+    public let fD, fH, fW: Int
+    /// the window strides
+    public let sD, sH, sW: Int
+    /// the filter dilations
+    public let dD, dH, dW: Int
+    /// the padding before the first input element
+    public let pD, pH, pW: Int
+    /// `true` if the filter is flipped, which is the case for
+    /// `ConvolutionMode.convolution`
+    public let isFlipped: Bool
+
+    //--------------------------------------------------------------------------
+    /// init
+    /// - Parameters:
+    ///  - input: the shape of the input, NWC, NHWC, or NDHWC
+    ///  - filter: the shape of the filter, with the spatial dimensions
+    ///    followed by the input and output channels
+    ///  - strides: the window strides
+    ///  - padding: `.valid` uses no padding, and `.same` pads the input
+    ///    so the output size is the input size divided by the stride
+    ///  - dilations: the filter dilations
+    ///  - mode: convolution or cross correlation
+    ///  - groups: the number of channel groups. The filter input channels
+    ///    are the number of input channels in each group.
+    @inlinable public init<S: TensorShape>(
+        input: S,
+        filter: S,
+        strides: S,
+        padding: Padding,
+        dilations: S,
+        mode: ConvolutionMode,
+        groups: Int = 1
+    ) {
+        let spatial = S.rank - 2
+        assert(spatial >= 1 && spatial <= 3,
+               "only 1D, 2D, and 3D convolutions are supported")
+        assert(input[S.rank - 1] == filter[S.rank - 2] * groups,
+               "input channels must match the filter input channels " +
+                "times the number of groups")
+        assert(filter[S.rank - 1] % groups == 0,
+               "output channels must be divisible by the number of groups")
+        batchCount = input[0]
+        inChannels = input[S.rank - 1]
+        outChannels = filter[S.rank - 1]
+        self.groups = groups
+        isFlipped = mode == .convolution
+
+        // the (depth, height, width) values for each property
+        func dims(_ value: (Int) -> Int, _ missing: Int) -> (Int, Int, Int) {
+            func dim(_ i: Int) -> Int {
+                let j = i - (3 - spatial)
+                return j < 0 ? missing : value(j)
+            }
+            return (dim(0), dim(1), dim(2))
+        }
+        (inD, inH, inW) = dims({ input[$0 + 1] }, 1)
+        (fD, fH, fW) = dims({ filter[$0] }, 1)
+        (sD, sH, sW) = dims({ strides[$0 + 1] }, 1)
+        (dD, dH, dW) = dims({ dilations[$0 + 1] }, 1)
+
+        // the output sizes and leading padding for each dimension
+        func output(_ i: Int, _ f: Int, _ s: Int, _ d: Int) -> (Int, Int) {
+            let window = (f - 1) * d + 1
+            switch padding {
+            case .valid:
+                return (Swift.max(0, (i - window) / s + 1), 0)
+            case .same:
+                let o = (i + s - 1) / s
+                let total = Swift.max(0, (o - 1) * s + window - i)
+                return (o, total / 2)
+            }
+        }
+        (outD, pD) = output(inD, fD, sD, dD)
+        (outH, pH) = output(inH, fH, sH, dH)
+        (outW, pW) = output(inW, fW, sW, dW)
+    }
+
+    //--------------------------------------------------------------------------
+    /// the number of input spatial positions
+    @inlinable public var inputCount: Int { inD * inH * inW }
+    /// the number of output spatial positions
+    @inlinable public var outputCount: Int { outD * outH * outW }
+    /// the number of filter taps
+    @inlinable public var taps: Int { fD * fH * fW }
+    /// the number of filter values for each output channel
+    @inlinable public var filterCount: Int { taps * groupInChannels }
+    /// the number of input channels in each group
+    @inlinable public var groupInChannels: Int { inChannels / groups }
+    /// the number of output channels in each group
+    @inlinable public var groupOutChannels: Int { outChannels / groups }
+    /// `true` if each group has one input channel
+    @inlinable public var isDepthwise: Bool {
+        groups > 1 && groupInChannels == 1
+    }
+
+    //--------------------------------------------------------------------------
+    /// - Returns: the output shape, NWC, NHWC, or NDHWC
+    @inlinable public func outputShape<S: TensorShape>() -> S {
+        var shape = S.zero
+        shape[0] = batchCount
+        shape[S.rank - 1] = outChannels
+        let out = [outD, outH, outW]
+        for i in 1..<(S.rank - 1) { shape[i] = out[i + 4 - S.rank] }
+        return shape
+    }
+}
+
+//==============================================================================
+// CpuMatrix dense tensor views
+extension CpuMatrix {
+    //--------------------------------------------------------------------------
+    /// init(dense:batchCount:rows:cols:
+    /// creates a read only view of a dense row major tensor as a batch
+    /// of matrices
+    @inlinable init<S>(
+        dense x: Tensor<S,E>,
+        _ batchCount: Int, _ rows: Int, _ cols: Int
+    ) {
+        assert(x.isContiguous && batchCount * rows * cols == x.count)
+        let p = x.read(using: currentQueue)
+        let buffer = UnsafeMutableBufferPointer(
+            start: UnsafeMutablePointer(mutating: p.baseAddress),
+            count: p.count)
+        self.init(buffer, x.storageBase, batchCount, rows * cols,
+                  rows, cols, cols, 1, transposed: false)
+    }
+
+    /// init(mutatingDense:batchCount:rows:cols:
+    /// creates a writable view of a dense row major tensor as a batch
+    /// of matrices
+    @inlinable init<S>(
+        mutatingDense x: inout Tensor<S,E>,
+        _ batchCount: Int, _ rows: Int, _ cols: Int
+    ) {
+        assert(x.isContiguous && batchCount * rows * cols == x.count)
+        let buffer = x.readWrite(using: currentQueue)
+        self.init(buffer, x.storageBase, batchCount, rows * cols,
+                  rows, cols, cols, 1, transposed: false)
+    }
+}
+
+//==============================================================================
+/// CpuPackedFilter
+/// A cache of a filter packed by `cpu_convolution`. The filter is packed
+/// again when the filter storage or size changes. It is only used for
+/// inference with a constant filter, because in place updates keep the
+/// storage id. A packing is never modified once it is cached, so a call
+/// keeps the packing it uses alive while another call replaces it.
+public final class CpuPackedFilter<T> {
+    /// serializes the updates of the cache
+    public let mutex = Mutex()
+    /// the current packing
+    public var packing: Packing?
+
+    @inlinable public init() {}
+
+    //--------------------------------------------------------------------------
+    /// Packing
+    /// a packed filter, `filterCount x outChannels`
+    public final class Packing {
+        /// the id of the packed filter storage
+        public let storageId: Int
+        /// the storage base of the packed filter
+        public let storageBase: Int
+        /// the packed values
+        public let values: UnsafeMutableBufferPointer<T>
+
+        @inlinable public init(_ storageId: Int, _ storageBase: Int,
+                               count: Int) {
+            self.storageId = storageId
+            self.storageBase = storageBase
+            values = .allocate(capacity: count)
+        }
+        deinit { values.deallocate() }
+    }
+}
+
+//==============================================================================
+/// cpu_convolution
+/// The forward convolution with the bias and activation applied to each
+/// accumulated output segment before it is stored. The filter is first
+/// packed as a `filterCount x outChannels` matrix of `Value`, flipped
+/// for `ConvolutionMode.convolution`. When a `cache` is specified the
+/// packing is kept and reused until the filter changes.
+///
+/// The work is split into (batch, output position tile, output channel
+/// block) items that are distributed across the available cores. Each
+/// core has its own accumulators and workspace, which are kept in the
+/// `scratch` between calls when it is specified.
+/// - `gemm` gathers the input windows of each position tile into a
+///   `tileRows x filterCount` workspace (im2col) that is multiplied by
+///   the packed filter, so each output channel block reuses the rows.
+///   Grouped convolutions gather the windows of each group separately
+///   and multiply them by the group's filter columns.
+/// - `direct` reads the input windows in place, skipping the padding,
+///   and needs no workspace.
+/// - depthwise convolutions, where each group has one input channel, use
+///   a sliding window over all channels of a position, so the inner loop
+///   is over contiguous channels of both the input and the filter.
+/// Otherwise the inner loop is over contiguous output channels.
+extension DeviceQueue {
+    @inlinable func cpu_convolution<S,E,FE>(
+        _ x: Tensor<S,E>,
+        _ filter: Tensor<S,FE>,
+        _ bias: TensorR1<FE>,
+        _ geometry: ConvolutionGeometry,
+        algorithm: ConvolutionFwdAlgorithm,
+        tileRows: Int,
+        cache: CpuPackedFilter<E.Value>? = nil,
+        scratch: CpuScratch? = nil,
+        activation: ActivationType,
+        reluCeiling: E.Value,
+        nan: NanPropagation = .noPropagate,
+        _ y: inout Tensor<S,E>
+    ) where E.Value: Real & BinaryFloatingPoint, FE.Value == E.Value {
+        typealias T = E.Value
+        let g = geometry
+        let isDepthwise = g.isDepthwise
+        let isGemm = algorithm == .gemm && !isDepthwise
+        let kernel = isDepthwise ? "depthwise" : "\(algorithm)"
+        diagnostic(.queueCpu, "convolution(\(x.name), \(filter.name)) " +
+                    "\(kernel) on \(name)", categories: .queueCpu)
+        let K = g.filterCount, Cin = g.inChannels, Cout = g.outChannels
+        let Cig = g.groupInChannels, Cog = g.groupOutChannels
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, Cin)
+        let fs = CpuMatrix(dense: filter, 1, K, Cout)
+        let bs = CpuMatrix(bias)
+        let ys = CpuMatrix(mutatingDense: &y, g.batchCount, g.outputCount, Cout)
+
+        // work items, where channel blocks do not span groups
+        let positionTiles = (g.outputCount + tileRows - 1) / tileRows
+        let coTile = Swift.min(isDepthwise ? Cout : Cog, _gemmColumnTile)
+        let groupBlocks = (Cog + coTile - 1) / coTile
+        // the im2col rows are reused for all output channel blocks
+        // of a group, and depthwise items compute all channels
+        let itemBlocks = isDepthwise ? 1 : isGemm ? g.groups :
+            g.groups * groupBlocks
+        let items = g.batchCount * positionTiles * itemBlocks
+
+        let filterId = filter.storage.id, filterBase = filter.storageBase
+
+        func pack(_ w: UnsafeMutableBufferPointer<T>) {
+            for tap in 0..<g.taps {
+                let src = (g.isFlipped ? g.taps - 1 - tap : tap) * Cig
+                for ci in 0..<Cig {
+                    let wk = (tap * Cig + ci) * Cout
+                    for co in 0..<Cout { w[wk + co] = fs[0, src + ci, co] }
+                }
+            }
+        }
+
+        func execute() {
+            // pack the filter, unless the cached packing is current
+            let w: UnsafeMutableBufferPointer<T>
+            var packing: CpuPackedFilter<T>.Packing?
+            if let cache = cache {
+                packing = cache.mutex.access {
+                    if let p = cache.packing, p.storageId == filterId,
+                       p.storageBase == filterBase,
+                       p.values.count == K * Cout {
+                        return p
+                    }
+                    let p = CpuPackedFilter<T>.Packing(
+                        filterId, filterBase, count: K * Cout)
+                    pack(p.values)
+                    cache.packing = p
+                    return p
+                }
+                w = packing!.values
+            } else {
+                w = .allocate(capacity: K * Cout)
+                pack(w)
+            }
+            defer {
+                if cache == nil { w.deallocate() }
+                withExtendedLifetime(packing) {}
+            }
+
+            // applies the epilogue and stores an output segment
+            func store(_ acc: UnsafeMutableBufferPointer<T>,
+                       _ n: Int, _ pos: Int, _ coStart: Int) {
+                for j in acc.indices { acc[j] += bs[0, 0, coStart + j] }
+                activation.apply(acc, ceiling: reluCeiling, nan: nan)
+                for j in acc.indices { ys[n, pos, coStart + j] = acc[j] }
+            }
+
+            // computes one (batch, position tile, channel block) item
+            func item(_ i: Int, _ memory: UnsafeMutableBufferPointer<T>) {
+                let block = i % itemBlocks
+                let tile = (i / itemBlocks) % positionTiles
+                let n = i / (itemBlocks * positionTiles)
+                let posStart = tile * tileRows
+                let posEnd = Swift.min(posStart + tileRows, g.outputCount)
+
+                if isDepthwise {
+                    // output channel co reads input channel co / Cog
+                    let out = UnsafeMutableBufferPointer(
+                        rebasing: memory[0..<Cout])
+                    let v = UnsafeMutableBufferPointer(
+                        rebasing: memory[Cout..<(Cout + Cin)])
+                    for pos in posStart..<posEnd {
+                        for j in 0..<Cout { out[j] = 0 }
+                        g.forEachTap(pos) { tap, p in
+                            for ci in 0..<Cin { v[ci] = xs[n, p, ci] }
+                            let wk = tap &* Cout
+                            if Cog == 1 {
+                                for co in 0..<Cout {
+                                    out[co] += v[co] * w[wk &+ co]
+                                }
+                            } else {
+                                for co in 0..<Cout {
+                                    out[co] += v[co / Cog] * w[wk &+ co]
+                                }
+                            }
+                        }
+                        store(out, n, pos, 0)
+                    }
+                    return
+                }
+
+                let acc = UnsafeMutableBufferPointer(
+                    rebasing: memory[0..<coTile])
+
+                if isGemm {
+                    let group = block
+                    let rows = posEnd - posStart
+                    let cols = UnsafeMutableBufferPointer(
+                        rebasing: memory[coTile..<(coTile + rows * K)])
+                    cpu_im2col(xs, n, g, posStart, posEnd, group * Cig, cols)
+
+                    let coEnd = (group + 1) * Cog
+                    for coStart in Swift.stride(from: group * Cog, to: coEnd,
+                                                by: coTile) {
+                        let count = Swift.min(coTile, coEnd - coStart)
+                        let out = UnsafeMutableBufferPointer(
+                            rebasing: acc[0..<count])
+                        for r in 0..<rows {
+                            for j in 0..<count { out[j] = 0 }
+                            let row = r &* K
+                            for k in 0..<K {
+                                let v = cols[row &+ k]
+                                let wk = k &* Cout &+ coStart
+                                for j in 0..<count { out[j] += v * w[wk &+ j] }
+                            }
+                            store(out, n, posStart + r, coStart)
+                        }
+                    }
+                } else {
+                    let group = block / groupBlocks
+                    let ciStart = group * Cig
+                    let coStart = group * Cog + (block % groupBlocks) * coTile
+                    let count = Swift.min(coTile, (group + 1) * Cog - coStart)
+                    let out = UnsafeMutableBufferPointer(rebasing: acc[0..<count])
+                    for pos in posStart..<posEnd {
+                        for j in 0..<count { out[j] = 0 }
+                        g.forEachTap(pos) { tap, p in
+                            for ci in 0..<Cig {
+                                let v = xs[n, p, ciStart &+ ci]
+                                let wk = (tap &* Cig &+ ci) &* Cout &+ coStart
+                                for j in 0..<count { out[j] += v * w[wk &+ j] }
+                            }
+                        }
+                        store(out, n, pos, coStart)
+                    }
+                }
+            }
+
+            // the scratch values of a worker, which are the accumulators
+            // and the im2col rows of a position tile
+            let size = isDepthwise ? Cout + Cin :
+                coTile + (isGemm ? tileRows * K : 0)
+            _withScratch(scratch, T.self,
+                         count: _workerCount(items) * size) { memory in
+                _forEachWorker(items, size: size, memory, item)
+            }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_im2col
+    /// gathers the input windows of a range of output positions as rows
+    /// of `filterCount` values, with zeros for the padding
+    /// - Parameters:
+    ///  - ciStart: the first input channel of the group to gather
+    @inlinable func cpu_im2col<E>(
+        _ xs: CpuMatrix<E>,
+        _ n: Int,
+        _ g: ConvolutionGeometry,
+        _ posStart: Int, _ posEnd: Int,
+        _ ciStart: Int,
+        _ cols: UnsafeMutableBufferPointer<E.Value>
+    ) where E.Value: Numeric {
+        let K = g.filterCount, Cig = g.groupInChannels
+        for i in 0..<(posEnd - posStart) * K { cols[i] = 0 }
+        for r in 0..<(posEnd - posStart) {
+            let row = r &* K
+            g.forEachTap(posStart + r) { tap, p in
+                let k = row &+ tap &* Cig
+                for ci in 0..<Cig { cols[k &+ ci] = xs[n, p, ciStart &+ ci] }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_im2col
+    /// gathers the input windows of every output position of `x` as the
+    /// rows of a `[batchCount * outputCount, filterCount]` matrix, with
+    /// zeros for the padding, so the convolution can be computed by a
+    /// gemm that has no convolution form, such as the quantized gemm.
+    /// The rows are distributed across the available cores.
+    @inlinable func cpu_im2col<S,E>(
+        _ x: Tensor<S,E>,
+        _ g: ConvolutionGeometry,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "im2col(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(g.groups == 1, "im2col gathers the windows of one group")
+        let rows = g.batchCount * g.outputCount, K = g.filterCount
+        assert(out.shape == Shape2(rows, K), "output shape mismatch")
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, g.inChannels)
+        let os = CpuMatrix(mutatingDense: &out, 1, rows, K)
+        let chunks = _sliceChunks(rows, K)
+
+        cpu_parallel(chunks.count) { c in
+            let start = c &* chunks.size
+            let end = Swift.min(rows, start &+ chunks.size)
+            guard start < end else { return }
+            let cols = UnsafeMutableBufferPointer<E.Value>.allocate(capacity: K)
+            defer { cols.deallocate() }
+            for r in start..<end {
+                let n = r / g.outputCount, pos = r &- n &* g.outputCount
+                self.cpu_im2col(xs, n, g, pos, pos &+ 1, 0, cols)
+                for k in 0..<K { os[0, r, k] = cols[k] }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// ConvolutionGeometry window iteration
+extension ConvolutionGeometry {
+    //--------------------------------------------------------------------------
+    /// forEachTap(position:body:
+    /// calls `body` with the filter tap index and input position of each
+    /// filter tap of an output position's window that is inside the input.
+    /// Taps that fall in the padding are skipped.
+    @inlinable public func forEachTap(
+        _ position: Int,
+        _ body: (Int, Int) -> Void
+    ) {
+        let ow = position % outW
+        let t = position / outW
+        let oh = t % outH, od = t / outH
+        let d0 = od &* sD &- pD, h0 = oh &* sH &- pH, w0 = ow &* sW &- pW
+
+        var tap = 0
+        for a in 0..<fD {
+            let id = d0 &+ a &* dD
+            guard id >= 0 && id < inD else { tap &+= fH &* fW; continue }
+            for b in 0..<fH {
+                let ih = h0 &+ b &* dH
+                guard ih >= 0 && ih < inH else { tap &+= fW; continue }
+                let rowBase = (id &* inH &+ ih) &* inW
+                for c in 0..<fW {
+                    let iw = w0 &+ c &* dW
+                    if iw >= 0 && iw < inW { body(tap, rowBase &+ iw) }
+                    tap &+= 1
+                }
+            }
+        }
     }
 }
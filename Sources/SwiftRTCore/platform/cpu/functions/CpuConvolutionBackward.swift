@@ -0,0 +1,472 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+/// the number of input channels of the filter gradient accumulated by a
+/// work item of the `algo0` backward filter algorithm
+@usableFromInline let _convolutionFilterChannelTile = 16
+
+//==============================================================================
+/// cpu_convolutionBackwardData
+/// The input gradient is the transposed convolution of the output gradient.
+/// Rather than scattering each output window back into the input, which
+/// would require synchronizing overlapping windows, the output gradient
+/// windows that read each input position are gathered, so the work items
+/// write disjoint input positions and the result is deterministic.
+/// The filter of each group is first packed as a `taps * groupOutChannels
+/// x groupInChannels` matrix of `Value`, flipped for
+/// `ConvolutionMode.convolution`.
+///
+/// The work is split into (batch, input position tile, input channel
+/// block) items that are distributed across the available cores, where
+/// the channel blocks do not span groups.
+/// - `algo1` gathers the output gradient windows of each position tile
+///   and group into a `tileRows x taps * groupOutChannels` workspace
+///   (col2im) that is multiplied by the packed filter of the group, so
+///   each channel block reuses the rows.
+/// - `algo0` reads the output gradient windows in place and needs
+///   no workspace.
+extension DeviceQueue {
+    @inlinable func cpu_convolutionBackwardData<S,E,FE>(
+        _ yDiff: Tensor<S,E>,
+        _ filter: Tensor<S,FE>,
+        _ geometry: ConvolutionGeometry,
+        algorithm: ConvolutionBwdDataAlgorithm,
+        tileRows: Int,
+        _ xDiff: inout Tensor<S,E>
+    ) where E.Value: Real & BinaryFloatingPoint, FE.Value == E.Value {
+        typealias T = E.Value
+        diagnostic(.queueCpu, "convolutionBackwardData(\(yDiff.name), " +
+                    "\(filter.name)) \(algorithm) on \(name)",
+                   categories: .queueCpu)
+        let g = geometry
+        let Cin = g.inChannels, Cout = g.outChannels
+        let Cig = g.groupInChannels, Cog = g.groupOutChannels
+        let K = g.taps * Cog
+        let dys = CpuMatrix(dense: yDiff, g.batchCount, g.outputCount, Cout)
+        let fs = CpuMatrix(dense: filter, 1, g.filterCount, Cout)
+        let dxs = CpuMatrix(mutatingDense: &xDiff, g.batchCount,
+                            g.inputCount, Cin)
+        let isGemm = algorithm == .algo1
+
+        // work items
+        let positionTiles = (g.inputCount + tileRows - 1) / tileRows
+        let ciTile = Swift.min(Cig, _gemmColumnTile)
+        let groupBlocks = (Cig + ciTile - 1) / ciTile
+        // the gathered rows are reused for all input channel blocks
+        let itemBlocks = isGemm ? g.groups : g.groups * groupBlocks
+        let items = g.batchCount * positionTiles * itemBlocks
+
+        func execute() {
+            // pack the transposed filter of each group
+            let w = UnsafeMutableBufferPointer<T>
+                .allocate(capacity: g.groups * K * Cig)
+            defer { w.deallocate() }
+            for group in 0..<g.groups {
+                for tap in 0..<g.taps {
+                    let src = (g.isFlipped ? g.taps - 1 - tap : tap) * Cig
+                    for col in 0..<Cog {
+                        let wk = ((group * g.taps + tap) * Cog + col) * Cig
+                        let co = group * Cog + col
+                        for ci in 0..<Cig { w[wk + ci] = fs[0, src + ci, co] }
+                    }
+                }
+            }
+
+            // computes one (batch, position tile, channel block) item
+            func item(_ i: Int) {
+                let block = i % itemBlocks
+                let tile = (i / itemBlocks) % positionTiles
+                let n = i / (itemBlocks * positionTiles)
+                let posStart = tile * tileRows
+                let posEnd = Swift.min(posStart + tileRows, g.inputCount)
+                let acc = UnsafeMutableBufferPointer<T>.allocate(capacity: ciTile)
+                defer { acc.deallocate() }
+
+                if isGemm {
+                    let group = block
+                    let coStart = group * Cog
+                    let rows = posEnd - posStart
+                    let cols = UnsafeMutableBufferPointer<T>
+                        .allocate(capacity: rows * K)
+                    defer { cols.deallocate() }
+                    for j in 0..<rows * K { cols[j] = 0 }
+                    for r in 0..<rows {
+                        let row = r &* K
+                        g.forEachOutputTap(posStart + r) { tap, q in
+                            let k = row &+ tap &* Cog
+                            for col in 0..<Cog {
+                                cols[k &+ col] = dys[n, q, coStart &+ col]
+                            }
+                        }
+                    }
+
+                    let wg = group * K * Cig
+                    for cs in Swift.stride(from: 0, to: Cig, by: ciTile) {
+                        let count = Swift.min(ciTile, Cig - cs)
+                        let ciStart = group * Cig + cs
+                        for r in 0..<rows {
+                            for j in 0..<count { acc[j] = 0 }
+                            let row = r &* K
+                            for k in 0..<K {
+                                let v = cols[row &+ k]
+                                let wk = wg &+ k &* Cig &+ cs
+                                for j in 0..<count { acc[j] += v * w[wk &+ j] }
+                            }
+                            for j in 0..<count {
+                                dxs[n, posStart + r, ciStart + j] = acc[j]
+                            }
+                        }
+                    }
+                } else {
+                    let group = block / groupBlocks
+                    let cs = (block % groupBlocks) * ciTile
+                    let count = Swift.min(ciTile, Cig - cs)
+                    let ciStart = group * Cig + cs, coStart = group * Cog
+                    for pos in posStart..<posEnd {
+                        for j in 0..<count { acc[j] = 0 }
+                        g.forEachOutputTap(pos) { tap, q in
+                            let wt = (group &* g.taps &+ tap) &* Cog
+                            for col in 0..<Cog {
+                                let v = dys[n, q, coStart &+ col]
+                                let wk = (wt &+ col) &* Cig &+ cs
+                                for j in 0..<count { acc[j] += v * w[wk &+ j] }
+                            }
+                        }
+                        for j in 0..<count { dxs[n, pos, ciStart + j] = acc[j] }
+                    }
+                }
+            }
+
+            if items == 1 {
+                item(0)
+            } else {
+                DispatchQueue.concurrentPerform(iterations: items, execute: item)
+            }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_convolutionBackwardFilter
+    /// Computes the filter gradient and the bias gradient in one pass over
+    /// the output gradient. The filter gradient is written in the filter
+    /// layout, flipped back for `ConvolutionMode.convolution`.
+    /// - `algo1` splits the batch output positions into `parts` ranges.
+    ///   Each part gathers the input windows of a tile of positions
+    ///   (im2col) and accumulates a private partial filter and bias
+    ///   gradient, then the partials are reduced in parallel. The
+    ///   reduction order is fixed, so the result is deterministic.
+    /// - `algo3` is the same without the im2col workspace, reading the
+    ///   input windows in place.
+    /// - `algo0` needs no workspace. Each work item owns a (filter tap,
+    ///   input channel block) slice of the filter gradient or a block of
+    ///   the bias gradient, and accumulates it over the whole batch.
+    /// - Parameters:
+    ///  - x: the forward input
+    ///  - yDiff: the output gradient with respect to the activation input
+    ///  - geometry: the convolution geometry
+    ///  - algorithm: `algo0`, `algo1`, or `algo3`
+    ///  - parts: the number of partial gradients for `algo1` and `algo3`
+    ///  - tileRows: the number of positions gathered by `algo1`
+    ///  - filterDiff: the filter gradient
+    ///  - biasDiff: the bias gradient
+    @inlinable func cpu_convolutionBackwardFilter<S,E,FE>(
+        _ x: Tensor<S,E>,
+        _ yDiff: Tensor<S,E>,
+        _ geometry: ConvolutionGeometry,
+        algorithm: ConvolutionBwdFilterAlgorithm,
+        parts: Int,
+        tileRows: Int,
+        _ filterDiff: inout Tensor<S,FE>,
+        _ biasDiff: inout TensorR1<FE>
+    ) where E.Value: Real & BinaryFloatingPoint, FE.Value == E.Value {
+        typealias T = E.Value
+        diagnostic(.queueCpu, "convolutionBackwardFilter(\(x.name), " +
+                    "\(yDiff.name)) \(algorithm) on \(name)",
+                   categories: .queueCpu)
+        let g = geometry
+        let K = g.filterCount, Cin = g.inChannels, Cout = g.outChannels
+        let Cig = g.groupInChannels, Cog = g.groupOutChannels
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, Cin)
+        let dys = CpuMatrix(dense: yDiff, g.batchCount, g.outputCount, Cout)
+        let dfs = CpuMatrix(mutatingDense: &filterDiff, 1, K, Cout)
+        let dbs = CpuMatrix(mutatingDense: &biasDiff, 1, 1, Cout)
+        let batchRows = g.batchCount * g.outputCount
+
+        // the filter gradient row of a packed row
+        @inline(__always) func filterRow(_ k: Int) -> Int {
+            guard g.isFlipped else { return k }
+            return (g.taps - 1 - k / Cig) * Cig + k % Cig
+        }
+
+        //----------------------------------
+        // no workspace
+        func executeAlgo0() {
+            let ciTile = Swift.min(Cig, _convolutionFilterChannelTile)
+            let ciBlocks = (Cig + ciTile - 1) / ciTile
+            let filterItems = g.taps * ciBlocks
+            let coTile = Swift.min(Cout, _gemmColumnTile)
+            let biasItems = (Cout + coTile - 1) / coTile
+
+            func item(_ i: Int) {
+                if i >= filterItems {
+                    // a block of the bias gradient
+                    let coStart = (i - filterItems) * coTile
+                    let count = Swift.min(coTile, Cout - coStart)
+                    for j in 0..<count {
+                        var sum = T.zero
+                        for n in 0..<g.batchCount {
+                            for pos in 0..<g.outputCount {
+                                sum += dys[n, pos, coStart + j]
+                            }
+                        }
+                        dbs[0, 0, coStart + j] = sum
+                    }
+                    return
+                }
+
+                // a (tap, input channel block) slice of the filter gradient
+                let tap = i / ciBlocks
+                let ciStart = (i % ciBlocks) * ciTile
+                let count = Swift.min(ciTile, Cig - ciStart)
+                let acc = UnsafeMutableBufferPointer<T>
+                    .allocate(capacity: count * Cout + Cout)
+                defer { acc.deallocate() }
+                acc.initialize(repeating: 0)
+                let dy = UnsafeMutableBufferPointer(
+                    rebasing: acc[(count * Cout)...])
+
+                for n in 0..<g.batchCount {
+                    for pos in 0..<g.outputCount {
+                        let p = g.tapPosition(pos, tap)
+                        guard p >= 0 else { continue }
+                        for co in 0..<Cout { dy[co] = dys[n, pos, co] }
+                        for group in 0..<g.groups {
+                            let gi = group &* Cig &+ ciStart
+                            let go = group &* Cog
+                            for j in 0..<count {
+                                let v = xs[n, p, gi &+ j]
+                                let row = j &* Cout &+ go
+                                for col in 0..<Cog {
+                                    acc[row &+ col] += v * dy[go &+ col]
+                                }
+                            }
+                        }
+                    }
+                }
+
+                for j in 0..<count {
+                    let k = filterRow(tap * Cig + ciStart + j)
+                    for co in 0..<Cout { dfs[0, k, co] = acc[j * Cout + co] }
+                }
+            }
+            DispatchQueue.concurrentPerform(
+                iterations: filterItems + biasItems, execute: item)
+        }
+
+        //----------------------------------
+        // per part partial gradients
+        func executePartials() {
+            let isGemm = algorithm == .algo1
+            let partCount = Swift.max(1, Swift.min(parts, batchRows))
+            let partRows = (batchRows + partCount - 1) / partCount
+            // each partial is a K x Cout filter gradient and a bias row
+            let partSize = (K + 1) * Cout
+            let partials = UnsafeMutableBufferPointer<T>
+                .allocate(capacity: partCount * partSize)
+            defer { partials.deallocate() }
+
+            func part(_ i: Int) {
+                let acc = UnsafeMutableBufferPointer(
+                    rebasing: partials[(i * partSize)..<((i + 1) * partSize)])
+                acc.initialize(repeating: 0)
+                let bias = K * Cout
+                let rowEnd = Swift.min(batchRows, (i + 1) * partRows)
+                let tile = isGemm ? tileRows : 1
+                let cols = UnsafeMutableBufferPointer<T>
+                    .allocate(capacity: isGemm ? tile * K : 0)
+                let dy = UnsafeMutableBufferPointer<T>
+                    .allocate(capacity: tile * Cout)
+                defer {
+                    cols.deallocate()
+                    dy.deallocate()
+                }
+
+                // process tiles of positions within one batch item
+                var r = i * partRows
+                while r < rowEnd {
+                    let n = r / g.outputCount
+                    let posStart = r % g.outputCount
+                    let posEnd = Swift.min(g.outputCount,
+                                           posStart + tile, posStart + rowEnd - r)
+                    let rows = posEnd - posStart
+                    r += rows
+
+                    for t in 0..<rows {
+                        let row = t &* Cout
+                        for co in 0..<Cout {
+                            let v = dys[n, posStart + t, co]
+                            dy[row &+ co] = v
+                            acc[bias &+ co] += v
+                        }
+                    }
+
+                    if isGemm {
+                        for group in 0..<g.groups {
+                            let go = group &* Cog
+                            cpu_im2col(xs, n, g, posStart, posEnd,
+                                       group * Cig, cols)
+                            for t in 0..<rows {
+                                let row = t &* K, dyRow = t &* Cout &+ go
+                                for k in 0..<K {
+                                    let v = cols[row &+ k]
+                                    // skip the padding
+                                    guard v != 0 else { continue }
+                                    let ak = k &* Cout &+ go
+                                    for col in 0..<Cog {
+                                        acc[ak &+ col] += v * dy[dyRow &+ col]
+                                    }
+                                }
+                            }
+                        }
+                    } else {
+                        g.forEachTap(posStart) { tap, p in
+                            for group in 0..<g.groups {
+                                let gi = group &* Cig, go = group &* Cog
+                                for ci in 0..<Cig {
+                                    let v = xs[n, p, gi &+ ci]
+                                    let ak = (tap &* Cig &+ ci) &* Cout &+ go
+                                    for col in 0..<Cog {
+                                        acc[ak &+ col] += v * dy[go &+ col]
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            // the reduction of each block of rows, where row K is the bias
+            let blockRows = Swift.max(1, (K + 1 + partCount - 1) / partCount)
+            let blocks = (K + 1 + blockRows - 1) / blockRows
+            func reduce(_ block: Int) {
+                let sum = UnsafeMutableBufferPointer<T>.allocate(capacity: Cout)
+                defer { sum.deallocate() }
+                let rowStart = block * blockRows
+                for k in rowStart..<Swift.min(K + 1, rowStart + blockRows) {
+                    for co in 0..<Cout { sum[co] = 0 }
+                    for i in 0..<partCount {
+                        let pk = i &* partSize &+ k &* Cout
+                        for co in 0..<Cout { sum[co] += partials[pk &+ co] }
+                    }
+                    if k == K {
+                        for co in 0..<Cout { dbs[0, 0, co] = sum[co] }
+                    } else {
+                        let fk = filterRow(k)
+                        for co in 0..<Cout { dfs[0, fk, co] = sum[co] }
+                    }
+                }
+            }
+
+            if partCount == 1 {
+                part(0)
+                for b in 0..<blocks { reduce(b) }
+            } else {
+                DispatchQueue.concurrentPerform(iterations: partCount,
+                                                execute: part)
+                DispatchQueue.concurrentPerform(iterations: blocks,
+                                                execute: reduce)
+            }
+        }
+
+        func execute() {
+            if algorithm == .algo0 { executeAlgo0() } else { executePartials() }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+}
+
+//==============================================================================
+// ConvolutionGeometry backward window iteration
+extension ConvolutionGeometry {
+    //--------------------------------------------------------------------------
+    /// tapPosition(position:tap:
+    /// - Returns: the input position read by a filter tap of an output
+    ///   position's window, or -1 if it falls in the padding
+    @inlinable public func tapPosition(_ position: Int, _ tap: Int) -> Int {
+        let ow = position % outW
+        let t = position / outW
+        let oh = t % outH, od = t / outH
+        let c = tap % fW
+        let u = tap / fW
+        let b = u % fH, a = u / fH
+        let id = od &* sD &- pD &+ a &* dD
+        let ih = oh &* sH &- pH &+ b &* dH
+        let iw = ow &* sW &- pW &+ c &* dW
+        guard id >= 0 && id < inD && ih >= 0 && ih < inH &&
+                iw >= 0 && iw < inW else { return -1 }
+        return (id &* inH &+ ih) &* inW &+ iw
+    }
+
+    //--------------------------------------------------------------------------
+    /// forEachOutputTap(position:body:
+    /// calls `body` with the filter tap index and output position of each
+    /// output window that reads an input position. This is the transpose
+    /// of `forEachTap`.
+    @inlinable public func forEachOutputTap(
+        _ position: Int,
+        _ body: (Int, Int) -> Void
+    ) {
+        let iw = position % inW
+        let t = position / inW
+        let ih = t % inH, id = t / inH
+
+        var tap = 0
+        for a in 0..<fD {
+            let zd = id &+ pD &- a &* dD
+            guard zd >= 0 && zd % sD == 0 && zd / sD < outD else {
+                tap &+= fH &* fW; continue
+            }
+            for b in 0..<fH {
+                let zh = ih &+ pH &- b &* dH
+                guard zh >= 0 && zh % sH == 0 && zh / sH < outH else {
+                    tap &+= fW; continue
+                }
+                let rowBase = (zd / sD &* outH &+ zh / sH) &* outW
+                for c in 0..<fW {
+                    let zw = iw &+ pW &- c &* dW
+                    if zw >= 0 && zw % sW == 0 && zw / sW < outW {
+                        body(tap, rowBase &+ zw / sW)
+                    }
+                    tap &+= 1
+                }
+            }
+        }
+    }
+}
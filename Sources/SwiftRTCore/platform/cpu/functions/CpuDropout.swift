@@ -0,0 +1,94 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// _dropoutThreshold
+/// - Returns: the smallest 32-bit random value that keeps an element, so an
+///   element is dropped with `probability`
+@inlinable func _dropoutThreshold(_ probability: Double) -> UInt32 {
+    UInt32(Swift.min(probability * 4294967296.0, Double(UInt32.max)))
+}
+
+//==============================================================================
+// cpu dropout kernels
+// The keep mask is not stored. Element `i` is kept when lane `i % 4` of
+// the Philox block `(offset + i) / 4` is at least the threshold, so each
+// thread generates the blocks of its own range inside the multiply loop,
+// and the mask depends only on the seed and the offset. The backward pass
+// regenerates the same mask from the same seed and offset.
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_dropout
+    /// computes `out = x * mask / (1 - probability)`, where the mask is
+    /// generated from the counter stream of `seed`
+    /// - Parameters:
+    ///  - x: the dense row major input, or the incoming gradient
+    ///  - probability: the probability of dropping an element
+    ///  - seed: the Philox key
+    ///  - offset: the position of the first element in the counter stream
+    ///  - out: the dense row major result
+    @inlinable func cpu_dropout<S,E>(
+        _ x: Tensor<S,E>,
+        _ probability: Double,
+        _ seed: UInt64,
+        _ offset: UInt64,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: BinaryFloatingPoint {
+        diagnostic(.queueCpu, "dropout(\(x.name), \(probability)) on \(name)",
+                   categories: .queueCpu)
+        let count = x.count
+        let threshold = _dropoutThreshold(probability)
+        let scale = E.Value(1 / (1 - probability))
+        let xs = CpuMatrix(dense: x, 1, 1, count)
+        let ys = CpuMatrix(mutatingDense: &out, 1, 1, count)
+
+        cpu_parallel(count: count) { range in
+            var block: (UInt32, UInt32, UInt32, UInt32) = (0, 0, 0, 0)
+            for i in range {
+                let position = offset &+ UInt64(i)
+                let lane = position & 3
+                if lane == 0 || i == range.lowerBound {
+                    block = PhiloxRandomNumberGenerator.block(
+                        counter: position >> 2, key: seed)
+                }
+                let r: UInt32
+                switch lane {
+                case 0: r = block.0
+                case 1: r = block.1
+                case 2: r = block.2
+                default: r = block.3
+                }
+                ys[0, 0, i] = r >= threshold ? xs[0, 0, i] * scale : 0
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue cpu dropout delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func dropout<S,E>(
+        _ x: Tensor<S,E>,
+        _ probability: Double,
+        _ seed: UInt64,
+        _ offset: UInt64,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: BinaryFloatingPoint {
+        cpu_dropout(x, probability, seed, offset, &out)
+    }
+}
@@ -0,0 +1,522 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// ExecutionPlanKey
+/// Builds a plan cache key from the properties of an operation that affect
+/// which kernel configuration is fastest. The key is computed with FNV-1a
+/// rather than `Hasher`, because `Hasher` is seeded differently in each
+/// process and the keys must be stable to be saved and preloaded.
+public struct ExecutionPlanKey {
+    public var hash: UInt64 = 0xcbf29ce484222325
+
+    //--------------------------------------------------------------------------
+    /// init(op:
+    /// - Parameter op: the name of the operation. The number of available
+    ///   cores is included, because it changes how the work is split.
+    @inlinable public init(_ op: String) {
+        combine(op)
+        combine(ProcessInfo.processInfo.activeProcessorCount)
+    }
+
+    /// an empty key, used to hash type names
+    @usableFromInline init() {}
+
+    //--------------------------------------------------------------------------
+    /// the cache key
+    @inlinable public var key: Int { Int(truncatingIfNeeded: hash) }
+
+    //--------------------------------------------------------------------------
+    @inlinable public mutating func combine(_ value: Int) {
+        var v = UInt64(bitPattern: Int64(value))
+        for _ in 0..<8 {
+            hash = (hash ^ (v & 0xFF)) &* 0x100000001b3
+            v >>= 8
+        }
+    }
+
+    @inlinable public mutating func combine(_ value: String) {
+        for byte in value.utf8 {
+            hash = (hash ^ UInt64(byte)) &* 0x100000001b3
+        }
+    }
+
+    /// combines the name of a type, which is only formatted the first
+    /// time the type is combined
+    @inlinable public mutating func combine(_ type: Any.Type) {
+        combine(_ExecutionPlanTypeIds.shared.id(type))
+    }
+
+    /// combines the shape, strides, and element type of a tensor
+    @inlinable public mutating func combine<S,E>(_ tensor: Tensor<S,E>) {
+        combine(E.self)
+        for i in 0..<S.rank {
+            combine(tensor.shape[i])
+            combine(tensor.strides[i])
+        }
+    }
+}
+
+//==============================================================================
+/// _ExecutionPlanTypeIds
+/// The plan key ids of types, which are the hashes of the type names.
+/// Formatting a type name is much slower than hashing an `Int`, so each
+/// name is formatted once. `ObjectIdentifier` is not used as the id,
+/// because it changes between processes.
+@usableFromInline final class _ExecutionPlanTypeIds {
+    @usableFromInline static let shared = _ExecutionPlanTypeIds()
+    @usableFromInline let mutex = Mutex()
+    @usableFromInline var ids: [ObjectIdentifier: Int] = [:]
+
+    @usableFromInline init() {}
+
+    /// - Returns: the id of `type`
+    @usableFromInline func id(_ type: Any.Type) -> Int {
+        let typeId = ObjectIdentifier(type)
+        return mutex.access {
+            if let id = ids[typeId] { return id }
+            var name = ExecutionPlanKey()
+            name.combine("\(type)")
+            ids[typeId] = name.key
+            return name.key
+        }
+    }
+}
+
+//==============================================================================
+/// CpuExecutionPlanCache
+/// A thread safe cache of tuned cpu kernel configurations. Plans that are
+/// `Codable` can be saved to a file and preloaded by another process with
+/// the same core count, so production processes can skip tuning.
+///
+/// The shared cache is preloaded from the file named by the
+/// `SWIFTRT_PLAN_CACHE` environment variable if it exists.
+public final class CpuExecutionPlanCache: ExecutionPlanCache, Logging {
+    /// the shared cache used by the cpu kernels
+    public static let shared: CpuExecutionPlanCache = {
+        let cache = CpuExecutionPlanCache()
+        if let path = ProcessInfo.processInfo.environment["SWIFTRT_PLAN_CACHE"],
+           FileManager.default.fileExists(atPath: path) {
+            do {
+                try cache.load(from: URL(fileURLWithPath: path))
+            } catch {
+                cache.writeLog("failed to load plan cache '\(path)': \(error)")
+            }
+        }
+        return cache
+    }()
+
+    /// when `false`, missing plans use the default heuristics and
+    /// are not tuned
+    @inlinable public var isTuningEnabled: Bool {
+        get { mutex.access { _isTuningEnabled } }
+        set { mutex.access { _isTuningEnabled = newValue } }
+    }
+
+    @usableFromInline let mutex = Mutex()
+    @usableFromInline var _isTuningEnabled = true
+    /// serializes tuning, so each plan is tuned once
+    @usableFromInline let tuningMutex = Mutex()
+    /// plans that have been added or decoded, keyed by type and key
+    @usableFromInline var plans: [String: Any] = [:]
+    /// the encoded form of each `Codable` plan
+    @usableFromInline var encoded: [String: String] = [:]
+
+    //--------------------------------------------------------------------------
+    @inlinable public init() {}
+
+    //--------------------------------------------------------------------------
+    @inlinable public var count: Int { mutex.access { plans.count } }
+
+    @inlinable func name<Plan>(_ type: Plan.Type, _ key: Int) -> String {
+        "\(Plan.self):\(key)"
+    }
+
+    //--------------------------------------------------------------------------
+    /// query(type:key:
+    /// - Returns: the plan if it has been added or preloaded
+    @inlinable public func query<Plan>(_ type: Plan.Type, key: Int) -> Plan? {
+        let name = self.name(type, key)
+        return mutex.access {
+            if let plan = plans[name] as? Plan { return plan }
+
+            // decode a preloaded plan on first use
+            guard let text = encoded[name],
+                  let decodable = Plan.self as? Decodable.Type,
+                  let plan = try? decodable.decoded(from: Data(text.utf8))
+                    as? Plan else { return nil }
+            plans[name] = plan
+            return plan
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// add(plan:type:key:
+    /// adds or replaces a plan
+    @inlinable public func add<Plan>(plan: Plan, _ type: Plan.Type, key: Int) {
+        let name = self.name(type, key)
+        let text = (plan as? Encodable).flatMap {
+            try? String(decoding: $0.encoded(), as: UTF8.self)
+        }
+        mutex.access {
+            plans[name] = plan
+            if let text = text { encoded[name] = text }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// plan(type:key:tune:
+    /// - Returns: the cached plan for `key`, otherwise the plan returned
+    ///   by `tune`, which is added to the cache, or `nil` if tuning is
+    ///   disabled. Concurrent first calls for a key wait for the first
+    ///   caller to tune, instead of each tuning the same plan.
+    @inlinable public func plan<Plan>(
+        _ type: Plan.Type,
+        key: Int,
+        tune: () -> Plan
+    ) -> Plan? {
+        if let plan = query(type, key: key) { return plan }
+        return tuningMutex.access {
+            if let plan = query(type, key: key) { return plan }
+            guard isTuningEnabled else { return nil }
+            let plan = tune()
+            add(plan: plan, type, key: key)
+            return plan
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// removeAll
+    @inlinable public func removeAll() {
+        mutex.access {
+            plans.removeAll()
+            encoded.removeAll()
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// save(to:
+    /// writes all `Codable` plans to a file
+    @inlinable public func save(to url: URL) throws {
+        let data = try mutex.access { try JSONEncoder().encode(encoded) }
+        try data.write(to: url, options: .atomic)
+    }
+
+    //--------------------------------------------------------------------------
+    /// load(from:
+    /// merges plans from a file written by `save(to:)`, replacing
+    /// existing plans with the same key
+    @inlinable public func load(from url: URL) throws {
+        let loaded = try JSONDecoder().decode([String: String].self,
+                                              from: Data(contentsOf: url))
+        mutex.access {
+            for (name, text) in loaded {
+                encoded[name] = text
+                plans[name] = nil
+            }
+        }
+    }
+}
+
+extension Encodable {
+    @inlinable func encoded() throws -> Data { try JSONEncoder().encode(self) }
+}
+
+extension Decodable {
+    @inlinable static func decoded(from data: Data) throws -> Self {
+        try JSONDecoder().decode(Self.self, from: data)
+    }
+}
+
+//==============================================================================
+/// CpuGemmPlan
+/// the tuned partition of a gemm
+public struct CpuGemmPlan: Codable, Equatable {
+    /// the number of row tiles per batch item
+    public let tilesPerBatch: Int
+    /// the number of rows in each tile
+    public let tileRows: Int
+    /// the number of columns in each packed `rhs` panel
+    public let tileCols: Int
+
+    @inlinable public init(tilesPerBatch: Int, tileRows: Int, tileCols: Int) {
+        self.tilesPerBatch = tilesPerBatch
+        self.tileRows = tileRows
+        self.tileCols = tileCols
+    }
+}
+
+//==============================================================================
+/// CpuGemmPlanner
+/// Selects the partition for a gemm. Problems too small to run in
+/// parallel use the default heuristic. Otherwise the first call times
+/// each candidate partition on the real data using `measure`, and the
+/// fastest one is added to the cache for subsequent calls.
+///
+/// The gemm plan is used by `matmul`, `dense`, and the ops built on them.
+/// The convolution algorithms are cached by `CpuConvolution`, and full
+/// reductions are planned by `CpuReductionPlanner`.
+public struct CpuGemmPlanner: ExecutionPlanner {
+    public typealias Plan = CpuGemmPlan
+    /// the cache to query and update
+    public let cache: CpuExecutionPlanCache
+    /// the key describing the operands
+    public let operands: ExecutionPlanKey
+    /// the problem size
+    public let batchCount, M, N, K: Int
+    /// runs the gemm with a plan and returns the elapsed time
+    public let measure: ((CpuGemmPlan) -> Double)?
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        cache: CpuExecutionPlanCache = .shared,
+        operands: ExecutionPlanKey,
+        batchCount: Int, M: Int, N: Int, K: Int,
+        measure: ((CpuGemmPlan) -> Double)?
+    ) {
+        self.cache = cache
+        self.operands = operands
+        self.batchCount = batchCount
+        self.M = M
+        self.N = N
+        self.K = K
+        self.measure = measure
+    }
+
+    //--------------------------------------------------------------------------
+    /// the default heuristic plan
+    @inlinable public var defaultPlan: CpuGemmPlan {
+        let p = _gemmPartition(batchCount, M, N, K)
+        return CpuGemmPlan(tilesPerBatch: p.tilesPerBatch,
+                           tileRows: p.tileRows, tileCols: p.tileCols)
+    }
+
+    //--------------------------------------------------------------------------
+    /// candidates
+    /// variations of the default row split and panel width
+    @inlinable public var candidates: [CpuGemmPlan] {
+        let base = defaultPlan
+        var plans = [base]
+        for tiles in [base.tilesPerBatch, Swift.min(M, base.tilesPerBatch * 2)] {
+            for cols in [base.tileCols / 2, base.tileCols, base.tileCols * 2] {
+                let plan = CpuGemmPlan(
+                    tilesPerBatch: tiles,
+                    tileRows: (M + tiles - 1) / tiles,
+                    tileCols: Swift.min(N, Swift.max(16, cols)))
+                if !plans.contains(plan) { plans.append(plan) }
+            }
+        }
+        return plans
+    }
+
+    //--------------------------------------------------------------------------
+    /// getPlan(tensor:workspaceLimit:
+    /// - Parameters:
+    ///  - tensor: the gemm output
+    ///  - workspaceLimit: unused, the gemm only uses per thread buffers
+    /// - Returns: the cached, tuned, or default plan
+    @inlinable public func getPlan<S,E>(
+        for tensor: Tensor<S,E>,
+        workspaceLimit: Int?
+    ) -> CpuGemmPlan {
+        var key = operands
+        key.combine(tensor)
+        return plan(key.key)
+    }
+
+    //--------------------------------------------------------------------------
+    /// plan(key:
+    /// - Returns: the cached, tuned, or default plan for `key`
+    @inlinable public func plan(_ key: Int) -> CpuGemmPlan {
+        let workload = batchCount &* M &* N &* K
+        guard workload >= _gemmParallelThreshold else { return defaultPlan }
+        guard let measure = measure else {
+            return cache.query(Plan.self, key: key) ?? defaultPlan
+        }
+
+        return cache.plan(Plan.self, key: key) {
+            var best = defaultPlan, bestTime = Double.infinity
+            for plan in candidates {
+                let time = measure(plan)
+                if time < bestTime { (best, bestTime) = (plan, time) }
+            }
+            cache.diagnostic(.queueCpu, "gemm plan \(best)",
+                             categories: .queueCpu)
+            return best
+        } ?? defaultPlan
+    }
+}
+
+//==============================================================================
+/// CpuReductionPlan
+/// the tuned strategy of a reduction of all elements
+public struct CpuReductionPlan: Codable, Equatable {
+    /// the number of contiguous chunks that are reduced in parallel
+    /// before their results are combined, where 1 is a serial reduction
+    public let chunks: Int
+
+    @inlinable public init(chunks: Int) {
+        self.chunks = chunks
+    }
+}
+
+//==============================================================================
+/// CpuReductionPlanner
+/// Selects whether a reduction of all elements is split into parallel
+/// chunks, and how many. Reductions too small to run in parallel are
+/// serial. Otherwise the first call times each candidate on the real
+/// data using `measure`, and the fastest one is cached.
+public struct CpuReductionPlanner: ExecutionPlanner {
+    public typealias Plan = CpuReductionPlan
+    /// the cache to query and update
+    public let cache: CpuExecutionPlanCache
+    /// the key describing the operation
+    public let operands: ExecutionPlanKey
+    /// the number of elements that are reduced
+    public let count: Int
+    /// runs the reduction with a plan and returns the elapsed time
+    public let measure: ((CpuReductionPlan) -> Double)?
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        cache: CpuExecutionPlanCache = .shared,
+        operands: ExecutionPlanKey,
+        count: Int,
+        measure: ((CpuReductionPlan) -> Double)?
+    ) {
+        self.cache = cache
+        self.operands = operands
+        self.count = count
+        self.measure = measure
+    }
+
+    //--------------------------------------------------------------------------
+    /// the default heuristic plan
+    @inlinable public var defaultPlan: CpuReductionPlan {
+        CpuReductionPlan(chunks: Swift.max(1, Swift.min(
+            ProcessInfo.processInfo.activeProcessorCount,
+            count / _parallelMinimumElements)))
+    }
+
+    //--------------------------------------------------------------------------
+    /// candidates
+    /// a serial reduction and fewer chunks than the default
+    @inlinable public var candidates: [CpuReductionPlan] {
+        let base = defaultPlan
+        var plans = [base]
+        for chunks in [1, base.chunks / 2] where chunks > 0 {
+            let plan = CpuReductionPlan(chunks: chunks)
+            if !plans.contains(plan) { plans.append(plan) }
+        }
+        return plans
+    }
+
+    //--------------------------------------------------------------------------
+    /// getPlan(tensor:workspaceLimit:
+    /// - Parameters:
+    ///  - tensor: the reduced tensor
+    ///  - workspaceLimit: unused, a reduction only needs its partials
+    /// - Returns: the cached, tuned, or default plan
+    @inlinable public func getPlan<S,E>(
+        for tensor: Tensor<S,E>,
+        workspaceLimit: Int?
+    ) -> CpuReductionPlan {
+        var key = operands
+        key.combine(tensor)
+        return plan(key.key)
+    }
+
+    //--------------------------------------------------------------------------
+    /// plan(key:
+    /// - Returns: the cached, tuned, or default plan for `key`
+    @inlinable public func plan(_ key: Int) -> CpuReductionPlan {
+        guard defaultPlan.chunks > 1 else { return defaultPlan }
+        guard let measure = measure else {
+            return cache.query(Plan.self, key: key) ?? defaultPlan
+        }
+
+        return cache.plan(Plan.self, key: key) {
+            var best = defaultPlan, bestTime = Double.infinity
+            for plan in candidates {
+                let time = measure(plan)
+                if time < bestTime { (best, bestTime) = (plan, time) }
+            }
+            cache.diagnostic(.queueCpu, "reduction plan \(best)",
+                             categories: .queueCpu)
+            return best
+        } ?? defaultPlan
+    }
+}
+
+//==============================================================================
+/// CpuConvolutionForwardPlan
+/// the selected forward algorithm and work partition of a convolution
+public struct CpuConvolutionForwardPlan: Codable, Equatable {
+    public let algorithm: ConvolutionFwdAlgorithm
+    /// the number of output positions, or winograd tiles, computed by
+    /// each work item
+    public let tileRows: Int
+    /// the winograd output tile size
+    public let winogradTileSize: Int
+    public let workspaceSize: Int
+
+    @inlinable public init(
+        algorithm: ConvolutionFwdAlgorithm,
+        tileRows: Int,
+        winogradTileSize: Int,
+        workspaceSize: Int
+    ) {
+        self.algorithm = algorithm
+        self.tileRows = tileRows
+        self.winogradTileSize = winogradTileSize
+        self.workspaceSize = workspaceSize
+    }
+}
+
+//==============================================================================
+/// CpuConvolutionBackwardPlan
+/// the selected backward algorithms and work partitions of a convolution
+public struct CpuConvolutionBackwardPlan: Codable, Equatable {
+    public let dataAlgorithm: ConvolutionBwdDataAlgorithm
+    /// the number of input positions computed by each work item
+    public let dataTileRows: Int
+    public let dataWorkspaceSize: Int
+    public let filterAlgorithm: ConvolutionBwdFilterAlgorithm
+    /// the number of partial filter gradients that are reduced
+    public let filterParts: Int
+    /// the number of output positions gathered for each partial update
+    public let filterTileRows: Int
+    public let filterWorkspaceSize: Int
+
+    @inlinable public init(
+        dataAlgorithm: ConvolutionBwdDataAlgorithm,
+        dataTileRows: Int,
+        dataWorkspaceSize: Int,
+        filterAlgorithm: ConvolutionBwdFilterAlgorithm,
+        filterParts: Int,
+        filterTileRows: Int,
+        filterWorkspaceSize: Int
+    ) {
+        self.dataAlgorithm = dataAlgorithm
+        self.dataTileRows = dataTileRows
+        self.dataWorkspaceSize = dataWorkspaceSize
+        self.filterAlgorithm = filterAlgorithm
+        self.filterParts = filterParts
+        self.filterTileRows = filterTileRows
+        self.filterWorkspaceSize = filterWorkspaceSize
+    }
+}
@@ -0,0 +1,206 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// _sliceChunks
+/// - Returns: the number of chunks and the slices in each chunk used to
+///   process `slices` spans of `length` elements across the available cores
+@inlinable func _sliceChunks(
+    _ slices: Int, _ length: Int
+) -> (count: Int, size: Int) {
+    let count = Swift.max(1, Swift.min(
+        ProcessInfo.processInfo.activeProcessorCount, slices,
+        slices &* length / _parallelMinimumElements))
+    return (count, (slices + count - 1) / count)
+}
+
+/// _gatherGeometry
+/// - Returns: the number of elements before and after `axis`, so a dense
+///   row major tensor can be viewed as `[outer, shape[axis], inner]`
+@inlinable func _gatherGeometry<S: TensorShape>(
+    _ shape: S, _ axis: Int
+) -> (outer: Int, inner: Int) {
+    var outer = 1, inner = 1
+    for i in 0..<axis { outer &*= shape[i] }
+    for i in (axis + 1)..<S.rank { inner &*= shape[i] }
+    return (outer, inner)
+}
+
+//==============================================================================
+// cpu gather kernels
+// The tensors are dense and row major, and are viewed as
+// `[outer, shape[axis], inner]`. Selecting an index along `axis` selects
+// `outer` contiguous spans of `inner` elements, so any axis is handled
+// as a set of span copies.
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_gather
+    /// copies the slices of `x` selected by `indices` along `axis`. The
+    /// spans are distributed across the available cores, and the elements
+    /// of types that are not packed are copied with `memcpy`.
+    /// - Parameters:
+    ///  - x: the dense row major tensor to gather from
+    ///  - indices: the zero based collection of slices of `x` to copy,
+    ///    such as an `[Int]` or the buffer of a `DeviceIndex` tensor
+    ///  - axis: the gathered axis
+    ///  - out: the dense row major result, where `shape[axis]` is the
+    ///    number of indices
+    @inlinable func cpu_gather<S,E,I>(
+        _ x: Tensor<S,E>,
+        _ indices: I,
+        _ axis: Int,
+        _ out: inout Tensor<S,E>
+    ) where I: RandomAccessCollection, I.Index == Int,
+            I.Element: BinaryInteger {
+        diagnostic(.queueCpu, "gather(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        let (outer, inner) = _gatherGeometry(x.shape, axis)
+        let dim = x.shape[axis], n = indices.count
+        // the copy loops do not check the indices
+        precondition(indices.allSatisfy { $0 >= 0 && $0 < dim },
+                     "gather index is out of range")
+        let xs = CpuMatrix(dense: x, outer, dim, inner)
+        let os = CpuMatrix(mutatingDense: &out, outer, n, inner)
+        let spans = outer &* n
+        let chunks = _sliceChunks(spans, inner)
+
+        if E.storedCount(8) == 8 {
+            // each span is a contiguous block of stored elements
+            let src = UnsafeRawPointer(xs.buffer.baseAddress!)
+            let dst = UnsafeMutableRawPointer(os.buffer.baseAddress!)
+            let stride = MemoryLayout<E.Stored>.stride
+            let bytes = inner &* stride
+            cpu_parallel(chunks.count) { c in
+                let start = c &* chunks.size
+                let end = Swift.min(spans, start &+ chunks.size)
+                guard start < end else { return }
+                for s in start..<end {
+                    let o = s / n, i = Int(indices[s &- o &* n])
+                    dst.advanced(by: s &* bytes).copyMemory(
+                        from: src.advanced(by: (o &* dim &+ i) &* bytes),
+                        byteCount: bytes)
+                }
+            }
+        } else {
+            // packed elements are copied one at a time
+            cpu_parallel(chunks.count) { c in
+                let start = c &* chunks.size
+                let end = Swift.min(spans, start &+ chunks.size)
+                guard start < end else { return }
+                for s in start..<end {
+                    let o = s / n, r = s &- o &* n, i = Int(indices[r])
+                    for j in 0..<inner { os[o, r, j] = xs[o, i, j] }
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_scatterAdd
+    /// adds each slice of `values` along `axis` to the slice of `out`
+    /// selected by the corresponding index. The slices are grouped by
+    /// destination with a counting sort, and each destination is owned by
+    /// one thread that adds its slices in increasing source order. There
+    /// are no write conflicts, and the result does not depend on the
+    /// number of threads when indices are repeated.
+    /// - Parameters:
+    ///  - values: the dense row major slices to add, where `shape[axis]`
+    ///    is the number of indices
+    ///  - indices: the slice of `out` that each slice is added to
+    ///  - axis: the scattered axis
+    ///  - out: the dense row major tensor to update
+    @inlinable func cpu_scatterAdd<S,E>(
+        _ values: Tensor<S,E>,
+        _ indices: [Int],
+        _ axis: Int,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "scatterAdd(\(values.name)) on \(name)",
+                   categories: .queueCpu)
+        let (outer, inner) = _gatherGeometry(out.shape, axis)
+        let dim = out.shape[axis], n = indices.count
+
+        // group the source slices by destination. The indices are
+        // checked once here, and the add loops do not check them.
+        var offsets = [Int](repeating: 0, count: dim + 1)
+        for i in indices {
+            precondition(i >= 0 && i < dim, "scatter index is out of range")
+            offsets[i &+ 1] &+= 1
+        }
+        for i in 0..<dim { offsets[i &+ 1] &+= offsets[i] }
+        var sources = [Int](repeating: 0, count: n)
+        var next = offsets
+        for (p, i) in indices.enumerated() {
+            sources[next[i]] = p
+            next[i] &+= 1
+        }
+        let targets = (0..<dim).filter { offsets[$0] < offsets[$0 &+ 1] }
+
+        let vs = CpuMatrix(dense: values, outer, n, inner)
+        let os = CpuMatrix(mutatingDense: &out, outer, dim, inner)
+        let slices = outer &* targets.count
+        let chunks = _sliceChunks(slices, inner &* Swift.max(1, n / dim))
+
+        cpu_parallel(chunks.count) { c in
+            let start = c &* chunks.size
+            let end = Swift.min(slices, start &+ chunks.size)
+            guard start < end else { return }
+            for s in start..<end {
+                let o = s / targets.count, t = targets[s &- o &* targets.count]
+                for k in offsets[t]..<offsets[t &+ 1] {
+                    let p = sources[k]
+                    for j in 0..<inner { os[o, t, j] += vs[o, p, j] }
+                }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue cpu gather delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func gather<S,E>(
+        _ x: Tensor<S,E>,
+        _ indices: [Int],
+        _ axis: Int,
+        _ out: inout Tensor<S,E>
+    ) {
+        cpu_gather(x, indices, axis, &out)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func gather<S,E>(
+        _ x: Tensor<S,E>,
+        _ indices: TensorR1<DeviceIndex>,
+        _ axis: Int,
+        _ out: inout Tensor<S,E>
+    ) {
+        assert(indices.isContiguous, "indices must be contiguous")
+        cpu_gather(x, indices.read(using: currentQueue), axis, &out)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func scatterAdd<S,E>(
+        _ values: Tensor<S,E>,
+        _ indices: [Int],
+        _ axis: Int,
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Numeric {
+        cpu_scatterAdd(values, indices, axis, &out)
+    }
+}
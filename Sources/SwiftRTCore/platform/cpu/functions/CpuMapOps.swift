@@ -161,7 +161,10 @@ extension DeviceQueue {
         }
         
         // check order because they will not match for order conversion ops
-        if a.order == output.order {
+        if a.hasSameTiledLayout(as: output) {
+            execute(BufferElements(spanning: a),
+                    BufferElements(spanning: &output), op)
+        } else if a.order == output.order {
             if a.isContiguous {
                 if output.isContiguous {
                     execute(a.buffer, output.mutableBuffer, op)
@@ -203,7 +206,10 @@ extension DeviceQueue {
         }
 
         // check order because they will not match for order conversion ops
-        if a.order == output.order {
+        if a.hasSameTiledLayout(as: output) {
+            execute(BufferElements(spanning: a),
+                    BufferElements(spanning: &output), op)
+        } else if a.order == output.order {
             if a.isContiguous {
                 if output.isContiguous {
                     execute(a.buffer, output.mutableBuffer, op)
@@ -231,7 +237,8 @@ extension DeviceQueue {
         _ op: @escaping (AE.Value, BE.Value) -> RE.Value
     ) {
         assert(a.order == b.order && a.order == output.order &&
-               output.isContiguous, _messageOrdersMustMatch)
+               (output.isContiguous || output.order.isTiled),
+               _messageOrdersMustMatch)
 
         func execute<A: Collection, B: Collection, O: MutableCollection>(
             _ a: A, _ b: B, _ out: O,
@@ -251,6 +258,18 @@ extension DeviceQueue {
             }
         }
         
+        // tiled tensors with the same layout are processed in storage order
+        if output.order.isTiled {
+            if a.hasSameTiledLayout(as: output) &&
+                b.hasSameTiledLayout(as: output) {
+                execute(BufferElements(spanning: a), BufferElements(spanning: b),
+                        BufferElements(spanning: &output), op)
+            } else {
+                execute(a.elements, b.elements, output.mutableElements, op)
+            }
+            return
+        }
+
         let out = output.mutableBuffer
         if a.isContiguous {
             if b.isContiguous {
@@ -277,7 +296,8 @@ extension DeviceQueue {
         _ op: @escaping (E.Value, E.Value, E.Value) -> RE.Value
     ) {
         assert(a.order == b.order && a.order == output.order &&
-               output.isContiguous, _messageOrdersMustMatch)
+               (output.isContiguous || output.order.isTiled),
+               _messageOrdersMustMatch)
 
         func execute<A: Collection, B: Collection, O: MutableCollection>(
             _ a: A, _ b: B, _ c: A.Element, _ out: O,
@@ -297,6 +317,18 @@ extension DeviceQueue {
             }
         }
         
+        // tiled tensors with the same layout are processed in storage order
+        if output.order.isTiled {
+            if a.hasSameTiledLayout(as: output) &&
+                b.hasSameTiledLayout(as: output) {
+                execute(BufferElements(spanning: a), BufferElements(spanning: b),
+                        c, BufferElements(spanning: &output), op)
+            } else {
+                execute(a.elements, b.elements, c, output.mutableElements, op)
+            }
+            return
+        }
+
         let out = output.mutableBuffer
         if a.isContiguous {
             if b.isContiguous {
@@ -335,7 +367,12 @@ extension DeviceQueue {
             }
         }
         
-        if a.isContiguous {
+        if a.hasSameTiledLayout(as: output) {
+            execute(BufferElements(spanning: a), element,
+                    BufferElements(spanning: &output), op)
+        } else if output.order.isTiled {
+            execute(a.elements, element, output.mutableElements, op)
+        } else if a.isContiguous {
             execute(a.buffer, element, output.mutableBuffer, op)
         } else {
             execute(a.elements, element, output.mutableBuffer, op)
@@ -364,7 +401,12 @@ extension DeviceQueue {
             }
         }
         
-        if a.isContiguous {
+        if a.hasSameTiledLayout(as: output) {
+            execute(element, BufferElements(spanning: a),
+                    BufferElements(spanning: &output), op)
+        } else if output.order.isTiled {
+            execute(element, a.elements, output.mutableElements, op)
+        } else if a.isContiguous {
             execute(element, a.buffer, output.mutableBuffer, op)
         } else {
             execute(element, a.elements, output.mutableBuffer, op)
@@ -515,3 +557,63 @@ extension DeviceQueue {
                 output1.mutableBuffer, output2.mutableBuffer, op)
     }
 }
+
+//==============================================================================
+/// the minimum number of elements processed by each parallel work item.
+/// Smaller element counts are not worth the dispatch overhead.
+@usableFromInline let _parallelMinimumElements = 16 * 1024
+
+//==============================================================================
+// parallel work items
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_parallel(items:body:
+    /// executes `body` for each work item in `0..<items` distributed across
+    /// the available cores. For an async queue the whole set of items is
+    /// scheduled as a single queue operation, so it is ordered with respect
+    /// to the other operations on the queue.
+    /// - Parameters:
+    ///  - items: the number of work items
+    ///  - body: the function to execute for each work item index
+    @inlinable func cpu_parallel(
+        _ items: Int,
+        _ body: @escaping (Int) -> Void
+    ) {
+        func execute() {
+            if items == 1 {
+                body(0)
+            } else if items > 1 {
+                DispatchQueue.concurrentPerform(iterations: items,
+                                                execute: body)
+            }
+        }
+        
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_parallel(count:body:
+    /// splits the range `0..<count` into contiguous chunks and executes
+    /// `body` for each chunk distributed across the available cores
+    /// - Parameters:
+    ///  - count: the number of elements to process
+    ///  - body: the function to execute for each chunk range
+    @inlinable func cpu_parallel(
+        count: Int,
+        _ body: @escaping (Range<Int>) -> Void
+    ) {
+        let chunks = Swift.max(1, Swift.min(
+            ProcessInfo.processInfo.activeProcessorCount,
+            count / _parallelMinimumElements))
+        let chunkSize = (count + chunks - 1) / chunks
+        cpu_parallel(chunks) {
+            let start = $0 * chunkSize
+            let end = Swift.min(start + chunkSize, count)
+            if start < end { body(start..<end) }
+        }
+    }
+}
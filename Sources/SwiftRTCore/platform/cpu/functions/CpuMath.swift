@@ -171,7 +171,102 @@ extension DeviceQueue {
     ) where S: TensorShape {
         diagnostic(.queueCpu, "copy(form: \(a.name), to: \(out.name) on \(name)",
                    categories: .queueCpu)
-        mapOp(a, &out) { $0 }
+        if a.order != out.order && (a.order.isTiled || out.order.isTiled) &&
+            (S.rank == 2 || S.rank == 3) {
+            cpu_convertOrder(from: a, to: &out)
+        } else if a.order.isChannelsLast != out.order.isChannelsLast &&
+                    (a.order == .row || out.order == .row) &&
+                    a.isContiguous && out.isContiguous {
+            cpu_convertChannelOrder(from: a, to: &out)
+        } else {
+            mapOp(a, &out) { $0 }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_convertChannelOrder
+    /// converts a dense tensor between `row` order, which is NCHW or NCDHW,
+    /// and the equivalent channels last order. Each batch item is a
+    /// `channels x positions` matrix in one order and its transpose in the
+    /// other, so it is converted in parallel 32 x 32 blocks, which read and
+    /// write a few cache lines of both buffers.
+    @inlinable func cpu_convertChannelOrder<S,E>(
+        from a: Tensor<S,E>,
+        to out: inout Tensor<S,E>
+    ) where S: TensorShape {
+        let N = a.shape[0], C = a.shape[1]
+        let P = a.count / Swift.max(1, N * C)
+        func matrix(_ x: Tensor<S,E>, _ buffer: UnsafeMutableBufferPointer<E.Stored>)
+            -> CpuMatrix<E>
+        {
+            x.order.isChannelsLast ?
+                CpuMatrix(buffer, x.storageBase, N, C * P, C, 1, P, C,
+                          transposed: false) :
+                CpuMatrix(buffer, x.storageBase, N, C * P, C, P, P, 1,
+                          transposed: false)
+        }
+        let src = matrix(a, UnsafeMutableBufferPointer(
+                            mutating: a.read(using: currentQueue)))
+        let dst = matrix(out, out.readWrite(using: currentQueue))
+        let cTiles = (C + 31) / 32, pTiles = (P + 31) / 32
+        let blocks = N * cTiles * pTiles
+
+        func convert(_ block: Int) {
+            let pStart = (block % pTiles) * 32
+            let cStart = (block / pTiles % cTiles) * 32
+            let n = block / (pTiles * cTiles)
+            let pEnd = Swift.min(pStart + 32, P)
+            for c in cStart..<Swift.min(cStart + 32, C) {
+                for p in pStart..<pEnd { dst[n, c, p] = src[n, c, p] }
+            }
+        }
+
+        if a.count < _parallelMinimumElements {
+            cpu_parallel(1) { _ in (0..<blocks).forEach(convert) }
+        } else {
+            cpu_parallel(blocks, convert)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_convertOrder
+    /// converts between a tiled order and any other order. The work is
+    /// split into (batch, 32 column) blocks that are converted in parallel,
+    /// so each block reads and writes a small range of both buffers.
+    @inlinable func cpu_convertOrder<S,E>(
+        from a: Tensor<S,E>,
+        to out: inout Tensor<S,E>
+    ) where S: TensorShape {
+        func matrix(_ x: Tensor<S,E>, _ buffer: UnsafeMutableBufferPointer<E.Stored>)
+            -> CpuMatrix<E>
+        {
+            let r = S.rank
+            return CpuMatrix(buffer, x.storageBase,
+                             r == 3 ? x.shape[0] : 1, r == 3 ? x.strides[0] : 0,
+                             x.shape[r - 2], x.strides[r - 2],
+                             x.shape[r - 1], x.strides[r - 1],
+                             order: x.order, transposed: false)
+        }
+        let src = matrix(a, UnsafeMutableBufferPointer(
+                            mutating: a.read(using: currentQueue)))
+        let dst = matrix(out, out.readWrite(using: currentQueue))
+        let tiles = (dst.cols + 31) / 32
+        let blocks = dst.batchCount * tiles
+
+        func convert(_ block: Int) {
+            let batch = block / tiles
+            let colStart = (block % tiles) * 32
+            let colEnd = Swift.min(colStart + 32, dst.cols)
+            for r in 0..<dst.rows {
+                for c in colStart..<colEnd { dst[batch, r, c] = src[batch, r, c] }
+            }
+        }
+
+        if a.count < _parallelMinimumElements {
+            cpu_parallel(1) { _ in (0..<blocks).forEach(convert) }
+        } else {
+            cpu_parallel(blocks, convert)
+        }
     }
     
     //--------------------------------------------------------------------------
@@ -458,47 +553,27 @@ extension DeviceQueue {
         _ rhs: TensorR2<E>, _ transposeRhs: Bool,
         _ out: inout TensorR2<E>
     ) where E.Value: Numeric {
-        diagnostic(.queueCpu, "matmul on \(name)", categories: .queueCpu)
-        let lhs = transposeLhs ? lhs.t : lhs
-        let rhs = transposeRhs ? rhs.t : rhs
-        assert(out.shape[0] == lhs.shape[0] &&
-                out.shape[1] == rhs.shape[1],
-               "matmul inner dimensions must be equal")
-        //-------------------------------
-        // simple place holder
-        for r in 0..<out.shape[0] {
-            let row = lhs[r, ...]
-            for c in 0..<out.shape[1] {
-                let col = rhs[..., c]
-                out[r, c] = zip(row, col).reduce(into: 0) { $0 += $1.0 * $1.1 }
-            }
-        }
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        cpu_gemm(CpuMatrix(lhs, transposed: transposeLhs),
+                 CpuMatrix(rhs, transposed: transposeRhs),
+                 CpuMatrix(mutating: &out))
     }
     
     //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// batched matmul. A `lhs` or `rhs` batch size of 1 is broadcast
+    /// across the `out` batch
     @inlinable func cpu_matmul<E>(
         _ lhs: TensorR3<E>, _ transposeLhs: Bool,
         _ rhs: TensorR3<E>, _ transposeRhs: Bool,
         _ out: inout TensorR3<E>
     ) where E.Value: Numeric {
-        diagnostic(.queueCpu, "matmul on \(name)", categories: .queueCpu)
-        let lhs = transposeLhs ? lhs.t : lhs
-        let rhs = transposeRhs ? rhs.t : rhs
-        assert(out.shape[0] == lhs.shape[0] &&
-                out.shape[1] == lhs.shape[1] &&
-                out.shape[2] == rhs.shape[2],
-               "matmul inner dimensions must be equal")
-        //-------------------------------
-        // simple place holder
-        for n in 0..<out.shape[0] {
-            for r in 0..<out.shape[1] {
-                let row = lhs[n, r, ...]
-                for c in 0..<out.shape[2] {
-                    let col = rhs[n, ..., c]
-                    out[n, r, c] = zip(row, col).reduce(into: 0) { $0 += $1.0 * $1.1 }
-                }
-            }
-        }
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        cpu_gemm(CpuMatrix(lhs, transposed: transposeLhs),
+                 CpuMatrix(rhs, transposed: transposeRhs),
+                 CpuMatrix(mutating: &out))
     }
     
     //--------------------------------------------------------------------------
@@ -34,20 +34,7 @@ where E: StorageElement, E.Value: StorageElement & Numeric
         _ rhs: TensorR2<E>, _ transposeRhs: Bool,
         _ result: inout TensorR2<E>
     ) {
-        let lhs = transposeLhs ? lhs.t : lhs
-        let rhs = transposeRhs ? rhs.t : rhs
-        assert(result.shape[0] == lhs.shape[0] &&
-                result.shape[1] == rhs.shape[1],
-               "matmul inner dimensions must be equal")
-        //-------------------------------
-        // simple place holder
-        for r in 0..<result.shape[0] {
-            let row = lhs[r, ...]
-            for c in 0..<result.shape[1] {
-                let col = rhs[..., c]
-                result[r, c] = zip(row, col).reduce(into: 0) { $0 += $1.0 * $1.1 }
-            }
-        }
+        currentQueue.matmul(lhs, transposeLhs, rhs, transposeRhs, &result)
     }
     
     //--------------------------------------------------------------------------
@@ -57,3 +44,794 @@ where E: StorageElement, E.Value: StorageElement & Numeric
         fatalError("abstract not implemented")
     }
 }
+
+//==============================================================================
+/// CpuMatrix
+/// An unsafe strided view of a batch of matrices in host memory. The gemm
+/// kernels capture this instead of the tensor to avoid ARC and copy on
+/// write during asynchronous execution. Batch, row, and column positions
+/// are mapped to storage using the tensor strides, so transposed and
+/// broadcast operands are read in place without being copied.
+/// Tensors stored in a tiled order are mapped using the tiled index math.
+public struct CpuMatrix<E: StorageElement> {
+    /// the host buffer beginning at the stored index of `storageBase`
+    public let buffer: UnsafeMutableBufferPointer<E.Stored>
+    /// the logical position of the first element within `buffer`
+    public let base: Int
+    /// the number of matrices in the batch
+    public let batchCount: Int
+    /// the distance between matrices. It is 0 for a broadcast batch
+    public let batchStride: Int
+    /// the number of rows in each matrix
+    public let rows: Int
+    /// the number of columns in each matrix
+    public let cols: Int
+    /// the distance between rows
+    public let rowStride: Int
+    /// the distance between columns
+    public let colStride: Int
+    /// the storage order of the matrices
+    public let order: Order
+    /// `true` if the view is transposed. This is only used to map tiled
+    /// positions, because strided positions are mapped by swapping strides
+    public let isTransposed: Bool
+    /// the padded number of stored rows of a tiled matrix
+    public let tiledRows: Int
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        _ buffer: UnsafeMutableBufferPointer<E.Stored>,
+        _ storageBase: Int,
+        _ batchCount: Int, _ batchStride: Int,
+        _ rows: Int, _ rowStride: Int,
+        _ cols: Int, _ colStride: Int,
+        order: Order = .row,
+        transposed: Bool
+    ) {
+        self.buffer = buffer
+        self.base = E.alignment(storageBase)
+        self.batchCount = batchCount
+        self.order = order
+        self.isTransposed = transposed
+        self.tiledRows = order.tiledRows(rows)
+        if order.isTiled {
+            // tiled matrices are stored one after another
+            self.batchStride = batchCount == 1 ? 0 :
+                order.tiledSpan(rows: rows, cols: cols)
+        } else {
+            self.batchStride = batchCount == 1 ? 0 : batchStride
+        }
+        if transposed {
+            self.rows = cols
+            self.rowStride = colStride
+            self.cols = rows
+            self.colStride = rowStride
+        } else {
+            self.rows = rows
+            self.rowStride = rowStride
+            self.cols = cols
+            self.colStride = colStride
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(x:transposed:
+    /// creates a read only view of a matrix
+    @inlinable public init(_ x: TensorR2<E>, transposed: Bool = false) {
+        let p = x.read(using: currentQueue)
+        let buffer = UnsafeMutableBufferPointer(
+            start: UnsafeMutablePointer(mutating: p.baseAddress),
+            count: p.count)
+        self.init(buffer, x.storageBase, 1, 0,
+                  x.shape[0], x.strides[0], x.shape[1], x.strides[1],
+                  order: x.order, transposed: transposed)
+    }
+
+    /// init(x:transposed:
+    /// creates a read only view of a batch of matrices
+    @inlinable public init(_ x: TensorR3<E>, transposed: Bool = false) {
+        let p = x.read(using: currentQueue)
+        let buffer = UnsafeMutableBufferPointer(
+            start: UnsafeMutablePointer(mutating: p.baseAddress),
+            count: p.count)
+        self.init(buffer, x.storageBase, x.shape[0], x.strides[0],
+                  x.shape[1], x.strides[1], x.shape[2], x.strides[2],
+                  order: x.order, transposed: transposed)
+    }
+
+    /// init(x:
+    /// creates a read only view of a vector as a single row matrix
+    @inlinable public init(_ x: TensorR1<E>) {
+        let p = x.read(using: currentQueue)
+        let buffer = UnsafeMutableBufferPointer(
+            start: UnsafeMutablePointer(mutating: p.baseAddress),
+            count: p.count)
+        self.init(buffer, x.storageBase, 1, 0, 1, 0, x.shape[0], x.strides[0],
+                  transposed: false)
+    }
+
+    /// init(mutating:
+    /// creates a writable view of a matrix
+    @inlinable public init(mutating x: inout TensorR2<E>) {
+        let buffer = x.readWrite(using: currentQueue)
+        self.init(buffer, x.storageBase, 1, 0,
+                  x.shape[0], x.strides[0], x.shape[1], x.strides[1],
+                  order: x.order, transposed: false)
+    }
+
+    /// init(mutating:
+    /// creates a writable view of a vector as a single row matrix
+    @inlinable public init(mutating x: inout TensorR1<E>) {
+        let buffer = x.readWrite(using: currentQueue)
+        self.init(buffer, x.storageBase, 1, 0, 1, 0, x.shape[0], x.strides[0],
+                  transposed: false)
+    }
+
+    /// init(mutating:
+    /// creates a writable view of a batch of matrices
+    @inlinable public init(mutating x: inout TensorR3<E>) {
+        let buffer = x.readWrite(using: currentQueue)
+        self.init(buffer, x.storageBase, x.shape[0], x.strides[0],
+                  x.shape[1], x.strides[1], x.shape[2], x.strides[2],
+                  order: x.order, transposed: false)
+    }
+
+    //--------------------------------------------------------------------------
+    /// offset
+    /// - Returns: the logical buffer position of the specified element
+    @inlinable public func offset(_ batch: Int, _ row: Int, _ col: Int) -> Int {
+        if order.isTiled {
+            let (r, c) = isTransposed ? (col, row) : (row, col)
+            return base &+ batch &* batchStride &+
+                order.tiledOffset(r, c, tiledRows: tiledRows)
+        } else {
+            return base &+ batch &* batchStride &+
+                row &* rowStride &+ col &* colStride
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// tiledPanel
+    /// - Returns: a pointer to the storage of `colTiled32` matrices when
+    ///   it can be used directly as the `rhs` panel of a gemm. Each 32
+    ///   column tile is a contiguous `K x 32` panel.
+    @inlinable public func tiledPanel<T>(_ type: T.Type) -> UnsafePointer<T>? {
+        guard order == .colTiled32 && !isTransposed &&
+                E.self == T.self && E.Stored.self == T.self,
+              let p = buffer.baseAddress else { return nil }
+        return UnsafeRawPointer(p).assumingMemoryBound(to: T.self)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public subscript(batch: Int, row: Int, col: Int) -> E.Value {
+        get {
+            let i = offset(batch, row, col)
+            return E.value(at: i, from: buffer[E.storedIndex(i)])
+        }
+        nonmutating set {
+            let i = offset(batch, row, col)
+            E.store(value: newValue, at: i, to: &buffer[E.storedIndex(i)])
+        }
+    }
+}
+
+extension ExecutionPlanKey {
+    /// combines the element type, dimensions, and strides of a matrix
+    @inlinable public mutating func combine<E>(_ m: CpuMatrix<E>) {
+        combine(E.self)
+        combine(m.batchCount)
+        combine(m.batchStride)
+        combine(m.rows)
+        combine(m.rowStride)
+        combine(m.cols)
+        combine(m.colStride)
+        combine(m.order.rawValue)
+        combine(m.isTransposed ? 1 : 0)
+    }
+}
+
+//==============================================================================
+// gemm tiling
+/// the maximum number of output columns accumulated together
+@usableFromInline let _gemmColumnTile = 256
+
+/// the target size in values of a packed `rhs` panel, which is
+/// `K x columns`. It bounds the column tile so the panel stays in L2
+@usableFromInline let _gemmPanelSize = 64 * 1024
+
+/// problems with fewer multiply adds than this run on a single thread
+@usableFromInline let _gemmParallelThreshold = 64 * 64 * 64
+
+//==============================================================================
+/// _gemmPartition
+/// determines how a batched gemm is split into (batch, row tile) work items.
+/// When there are at least as many batch items as cores each item is a whole
+/// matrix, otherwise each matrix is split into row tiles so all cores are
+/// kept busy.
+/// - Returns: the number of row tiles per batch item, the number of rows
+///   in each tile, and the number of columns in each packed `rhs` panel
+@inlinable func _gemmPartition(
+    _ batchCount: Int, _ M: Int, _ N: Int, _ K: Int
+) -> (tilesPerBatch: Int, tileRows: Int, tileCols: Int) {
+    let threads = ProcessInfo.processInfo.activeProcessorCount
+    let workload = batchCount &* M &* N &* K
+    let tilesPerBatch = workload < _gemmParallelThreshold ||
+        batchCount >= threads ? 1 :
+        Swift.min(M, (threads + batchCount - 1) / batchCount)
+    let tileRows = (M + tilesPerBatch - 1) / tilesPerBatch
+    let tileCols = Swift.min(N, Swift.max(16, Swift.min(
+        _gemmColumnTile, _gemmPanelSize / Swift.max(1, K))))
+    return (tilesPerBatch, tileRows, tileCols)
+}
+
+//==============================================================================
+/// CpuMatrixLayout
+/// the dimensions, strides, and order of a `CpuMatrix`, which select its
+/// gemm execution plan
+public struct CpuMatrixLayout: Equatable {
+    public let batchCount, batchStride, rows, rowStride, cols, colStride: Int
+    public let order: Int
+    public let isTransposed: Bool
+
+    @inlinable public init<E>(_ m: CpuMatrix<E>) {
+        batchCount = m.batchCount
+        batchStride = m.batchStride
+        rows = m.rows
+        rowStride = m.rowStride
+        cols = m.cols
+        colStride = m.colStride
+        order = m.order.rawValue
+        isTransposed = m.isTransposed
+    }
+}
+
+//==============================================================================
+/// CpuScratch
+/// The work item scratch memory of the cpu kernels, which is kept by a
+/// caller with fixed shapes, such as a frozen layer, so its calls do not
+/// allocate it. The memory grows to the largest request and is used by
+/// one call at a time. A call that finds it in use allocates its own.
+/// The last gemm plan is also kept with the operand layout it was
+/// selected for, so it is not looked up again until the layout changes.
+public final class CpuScratch {
+    /// serializes the use of the scratch
+    public let mutex = Mutex()
+    /// the number of times memory was allocated for a call, because the
+    /// scratch was too small or in use
+    public private(set) var allocationCount = 0
+    /// the scratch memory
+    private var memory = UnsafeMutableRawBufferPointer(start: nil, count: 0)
+    /// `true` while a call is using `memory`
+    private var isBusy = false
+    /// the last gemm plan and the operands it was selected for
+    private var gemmPlan: (operands: Int, lhs: CpuMatrixLayout,
+                           plan: CpuGemmPlan)?
+
+    public init() {}
+    deinit { memory.deallocate() }
+
+    //--------------------------------------------------------------------------
+    /// borrow(type:count:
+    /// - Returns: `count` values of the scratch memory, which are held
+    ///   until `release` is called, or `nil` if the memory is in use
+    @usableFromInline func borrow<T>(
+        _ type: T.Type, count: Int
+    ) -> UnsafeMutableBufferPointer<T>? {
+        mutex.access {
+            guard !isBusy else {
+                allocationCount += 1
+                return nil
+            }
+            let bytes = count * MemoryLayout<T>.stride
+            if memory.count < bytes {
+                memory.deallocate()
+                memory = .allocate(byteCount: bytes, alignment: 64)
+                allocationCount += 1
+            }
+            isBusy = true
+            return UnsafeMutableBufferPointer(
+                start: memory.baseAddress?.bindMemory(to: T.self,
+                                                      capacity: count),
+                count: count)
+        }
+    }
+
+    /// release
+    /// ends the use of the memory returned by `borrow`
+    @usableFromInline func release() {
+        mutex.access { isBusy = false }
+    }
+
+    //--------------------------------------------------------------------------
+    /// gemmPlan(operands:lhs:select:
+    /// - Returns: the kept plan if it was selected for the same operands,
+    ///   otherwise the plan returned by `select`, which is kept
+    @usableFromInline func gemmPlan(
+        _ operands: Int, _ lhs: CpuMatrixLayout,
+        _ select: () -> CpuGemmPlan
+    ) -> CpuGemmPlan {
+        if let kept = mutex.access({ gemmPlan }),
+           kept.operands == operands && kept.lhs == lhs {
+            return kept.plan
+        }
+        // selecting may tune, which borrows the memory
+        let plan = select()
+        mutex.access { gemmPlan = (operands, lhs, plan) }
+        return plan
+    }
+}
+
+//==============================================================================
+/// _withScratch
+/// calls `body` with `count` values of memory, which is borrowed from
+/// `scratch` when it is available and allocated otherwise
+@inlinable func _withScratch<T>(
+    _ scratch: CpuScratch?, _ type: T.Type, count: Int,
+    _ body: (UnsafeMutableBufferPointer<T>) -> Void
+) {
+    if let scratch = scratch,
+       let memory = scratch.borrow(T.self, count: count) {
+        defer { scratch.release() }
+        body(memory)
+    } else {
+        let memory = UnsafeMutableBufferPointer<T>.allocate(capacity: count)
+        defer { memory.deallocate() }
+        body(memory)
+    }
+}
+
+//==============================================================================
+/// _forEachWorker
+/// splits `items` across up to one worker per core, where each worker
+/// computes every `workers`th item with its own `size` values of `memory`
+@inlinable func _forEachWorker<T>(
+    _ items: Int, size: Int,
+    _ memory: UnsafeMutableBufferPointer<T>,
+    _ body: (Int, UnsafeMutableBufferPointer<T>) -> Void
+) {
+    let workers = _workerCount(items)
+    func worker(_ w: Int) {
+        let start = w &* size
+        let m = UnsafeMutableBufferPointer(
+            rebasing: memory[start..<(start &+ size)])
+        for item in Swift.stride(from: w, to: items, by: workers) {
+            body(item, m)
+        }
+    }
+    if workers == 1 {
+        worker(0)
+    } else {
+        DispatchQueue.concurrentPerform(iterations: workers, execute: worker)
+    }
+}
+
+/// _workerCount
+/// - Returns: the number of workers `_forEachWorker` uses for `items`
+@inlinable func _workerCount(_ items: Int) -> Int {
+    Swift.max(1, Swift.min(items, ProcessInfo.processInfo.activeProcessorCount))
+}
+
+//==============================================================================
+/// CpuGemmEpilogue
+/// A function applied to each accumulated row segment of an output tile
+/// while it is still in L1, before it is stored. This is used to fuse bias,
+/// residual, and activation functions into the gemm.
+/// The arguments are the accumulated values, and the batch, row, and column
+/// of the first value.
+public typealias CpuGemmEpilogue<T> =
+    (UnsafeMutableBufferPointer<T>, Int, Int, Int) -> Void
+
+//==============================================================================
+/// cpu_gemm
+/// A batched general matrix multiply `out[b] = lhs[b] x rhs[b]`.
+/// The work is split into (batch, row tile) items that are distributed
+/// across the available cores. A `lhs` or `rhs` batch count of 1
+/// is broadcast across the batch using a zero batch stride.
+///
+/// Each `K x columns` panel of `rhs` and each `lhs` row are packed into
+/// contiguous buffers of the common `Value` type before use. For storage
+/// types such as `Float16` and `BFloat16` this means each element is
+/// converted to `Float` once per panel rather than on every multiply,
+/// the products are accumulated in `Float`, and the result is rounded
+/// once when it is stored. The operand storage types may differ, so
+/// for example `Float16` weights can be used with `Float` activations.
+///
+/// If an `epilogue` is specified, it is applied to each output row segment
+/// before it is stored.
+///
+/// The execution plan key is built from the operand types and layouts. A
+/// caller with fixed `rhs` operands, such as a layer, can instead pass
+/// a `plan` key computed once from them, which is combined with the
+/// `lhs` layout. A caller can also pass a `scratch`, which keeps the
+/// per worker buffers and the selected plan between calls.
+extension DeviceQueue {
+    @inlinable func cpu_gemm<LE,RE,OE>(
+        _ lhs: CpuMatrix<LE>,
+        _ rhs: CpuMatrix<RE>,
+        _ out: CpuMatrix<OE>,
+        plan planKey: Int? = nil,
+        scratch: CpuScratch? = nil,
+        epilogue: CpuGemmEpilogue<OE.Value>? = nil
+    ) where LE.Value: Numeric, RE.Value == LE.Value, OE.Value == LE.Value {
+        typealias T = LE.Value
+        let batchCount = out.batchCount
+        let M = out.rows, N = out.cols, K = lhs.cols
+        assert(lhs.rows == M && rhs.cols == N && rhs.rows == K,
+               "matmul inner dimensions must be equal")
+        assert((lhs.batchCount == 1 || lhs.batchCount == batchCount) &&
+               (rhs.batchCount == 1 || rhs.batchCount == batchCount),
+               "matmul batch dimensions must be equal or 1")
+
+        // matrix vector products don't benefit from packing
+        if M == 1 || N == 1 {
+            cpu_gemv(lhs, rhs, out, scratch: scratch, epilogue: epilogue)
+            return
+        }
+
+        // pre-tiled `colTiled32` weights are already stored as contiguous
+        // `K x 32` panels, so full tiles are used in place without packing
+        let tiledPanel = rhs.tiledPanel(T.self)
+
+        // the scratch values of a worker, which are an accumulator row,
+        // a packed lhs row, and a packed rhs panel
+        func workerSize(_ plan: CpuGemmPlan) -> Int {
+            let tileCols = tiledPanel == nil ? plan.tileCols : 32
+            return tileCols + K + K * tileCols
+        }
+
+        // computes one (batch, row tile) item
+        func tile(_ item: Int, _ plan: CpuGemmPlan, _ out: CpuMatrix<OE>,
+                  _ memory: UnsafeMutableBufferPointer<T>) {
+            let tilesPerBatch = plan.tilesPerBatch
+            let tileRows = plan.tileRows
+            let tileCols = tiledPanel == nil ? plan.tileCols : 32
+            let batch = item / tilesPerBatch
+            let rowStart = (item % tilesPerBatch) * tileRows
+            let rowEnd = Swift.min(rowStart + tileRows, M)
+            guard rowStart < rowEnd else { return }
+            
+            // scratch buffers
+            let acc = UnsafeMutableBufferPointer(rebasing: memory[0..<tileCols])
+            let row = UnsafeMutableBufferPointer(
+                rebasing: memory[tileCols..<(tileCols + K)])
+            let packed = UnsafeMutableBufferPointer(
+                rebasing: memory[(tileCols + K)...])
+
+            var colStart = 0
+            while colStart < N {
+                let colEnd = Swift.min(colStart + tileCols, N)
+                let cols = colEnd - colStart
+                let panel: UnsafePointer<T>
+
+                if let tiled = tiledPanel, cols == 32 {
+                    panel = tiled + rhs.offset(batch, 0, colStart)
+                } else {
+                    // pack the rhs panel as contiguous rows of `cols` values
+                    for k in 0..<K {
+                        let pk = k &* cols
+                        for j in 0..<cols {
+                            packed[pk &+ j] = rhs[batch, k, colStart &+ j]
+                        }
+                    }
+                    panel = UnsafePointer(packed.baseAddress!)
+                }
+
+                for r in rowStart..<rowEnd {
+                    for k in 0..<K { row[k] = lhs[batch, r, k] }
+                    for j in 0..<cols { acc[j] = 0 }
+                    for k in 0..<K {
+                        let a = row[k]
+                        let pk = k &* cols
+                        for j in 0..<cols { acc[j] += a * panel[pk &+ j] }
+                    }
+                    if let epilogue = epilogue {
+                        epilogue(UnsafeMutableBufferPointer(
+                                    rebasing: acc[0..<cols]),
+                                 batch, r, colStart)
+                    }
+                    for j in 0..<cols { out[batch, r, colStart &+ j] = acc[j] }
+                }
+                colStart = colEnd
+            }
+        }
+
+        // computes all items with the plan
+        func run(_ plan: CpuGemmPlan, _ out: CpuMatrix<OE>) {
+            let items = batchCount * plan.tilesPerBatch
+            let size = workerSize(plan)
+            _withScratch(scratch, T.self,
+                         count: _workerCount(items) * size) { memory in
+                _forEachWorker(items, size: size, memory) {
+                    tile($0, plan, out, $1)
+                }
+            }
+        }
+
+        // the plan is selected when the operation executes, so tuning
+        // runs in queue order on the real data. The candidates write to
+        // a scratch output, because an epilogue residual may be the
+        // output itself, and each run would add it again.
+        func select() -> CpuGemmPlan {
+            var key = ExecutionPlanKey("gemm")
+            if let planKey = planKey {
+                key.combine(planKey)
+                key.combine(lhs)
+            } else {
+                key.combine(lhs)
+                key.combine(rhs)
+                key.combine(out)
+            }
+            var tuningBuffer: UnsafeMutableBufferPointer<OE.Stored>?
+            defer { tuningBuffer?.deallocate() }
+            let planner = CpuGemmPlanner(
+                operands: key, batchCount: batchCount, M: M, N: N, K: K
+            ) { plan in
+                if tuningBuffer == nil {
+                    let buffer = UnsafeMutableBufferPointer<OE.Stored>
+                        .allocate(capacity: OE.storedCount(batchCount * M * N))
+                    UnsafeMutableRawBufferPointer(buffer)
+                        .initializeMemory(as: UInt8.self, repeating: 0)
+                    tuningBuffer = buffer
+                }
+                let tuningOut = CpuMatrix<OE>(
+                    tuningBuffer!, 0, batchCount, M * N,
+                    M, N, N, 1, transposed: false)
+                let start = DispatchTime.now().uptimeNanoseconds
+                run(plan, tuningOut)
+                return Double(DispatchTime.now().uptimeNanoseconds - start)
+            }
+            return planner.plan(key.key)
+        }
+
+        // a kept plan is reused while the `lhs` layout does not change
+        func execute() {
+            if let planKey = planKey, let scratch = scratch {
+                run(scratch.gemmPlan(planKey, CpuMatrixLayout(lhs), select),
+                    out)
+            } else {
+                run(select(), out)
+            }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+}
+
+//==============================================================================
+/// cpu_gemv
+/// A batched matrix vector product, used by `cpu_gemm` when `M` or `N`
+/// is 1, such as batch 1 inference of recurrent and dense layers. The
+/// vector is converted to `Value` once, and the matrix is streamed once
+/// without packing. The outputs are split into contiguous chunks that
+/// are distributed across the available cores.
+///
+/// When the matrix is laid out so the values for one output are
+/// contiguous, each output is a dot product. Otherwise each vector value
+/// is scaled and added to the whole chunk of outputs (axpy), so the matrix
+/// is still read sequentially.
+extension DeviceQueue {
+    @inlinable func cpu_gemv<LE,RE,OE>(
+        _ lhs: CpuMatrix<LE>,
+        _ rhs: CpuMatrix<RE>,
+        _ out: CpuMatrix<OE>,
+        scratch: CpuScratch? = nil,
+        epilogue: CpuGemmEpilogue<OE.Value>?
+    ) where LE.Value: Numeric, RE.Value == LE.Value, OE.Value == LE.Value {
+        typealias T = LE.Value
+        let batchCount = out.batchCount
+        let M = out.rows, N = out.cols, K = lhs.cols
+
+        // `y[i] = sum(A[i, k] * x[k])` where for a row vector `x` is the
+        // lhs row and `A` is rhs transposed, otherwise `x` is the rhs column
+        let isRow = M == 1
+        let outputs = isRow ? N : M
+        let isDot = isRow ? rhs.rowStride == 1 : lhs.colStride == 1
+        let chunks = batchCount &* outputs &* K < _gemmParallelThreshold ? 1 :
+            Swift.max(1, Swift.min(ProcessInfo.processInfo.activeProcessorCount,
+                                   outputs / 16))
+        let chunkSize = (outputs + chunks - 1) / chunks
+
+        // computes one (batch, output chunk) item, with scratch values
+        // for the vector and the chunk accumulators
+        func chunk(_ item: Int, _ memory: UnsafeMutableBufferPointer<T>) {
+            let batch = item / chunks
+            let start = (item % chunks) * chunkSize
+            let end = Swift.min(start + chunkSize, outputs)
+            guard start < end else { return }
+            let count = end - start
+
+            let x = UnsafeMutableBufferPointer(rebasing: memory[0..<K])
+            let acc = UnsafeMutableBufferPointer(
+                rebasing: memory[K..<(K + count)])
+            if isRow {
+                for k in 0..<K { x[k] = lhs[batch, 0, k] }
+            } else {
+                for k in 0..<K { x[k] = rhs[batch, k, 0] }
+            }
+
+            if isDot {
+                for j in 0..<count {
+                    let i = start &+ j
+                    var sum = T.zero
+                    if isRow {
+                        for k in 0..<K { sum += x[k] * rhs[batch, k, i] }
+                    } else {
+                        for k in 0..<K { sum += lhs[batch, i, k] * x[k] }
+                    }
+                    acc[j] = sum
+                }
+            } else {
+                for j in 0..<count { acc[j] = T.zero }
+                for k in 0..<K {
+                    let a = x[k]
+                    if isRow {
+                        for j in 0..<count {
+                            acc[j] += a * rhs[batch, k, start &+ j]
+                        }
+                    } else {
+                        for j in 0..<count {
+                            acc[j] += lhs[batch, start &+ j, k] * a
+                        }
+                    }
+                }
+            }
+
+            if isRow {
+                epilogue?(UnsafeMutableBufferPointer(rebasing: acc[0..<count]),
+                          batch, 0, start)
+                for j in 0..<count { out[batch, 0, start &+ j] = acc[j] }
+            } else {
+                for j in 0..<count {
+                    epilogue?(UnsafeMutableBufferPointer(rebasing: acc[j..<j+1]),
+                              batch, start &+ j, 0)
+                    out[batch, start &+ j, 0] = acc[j]
+                }
+            }
+        }
+
+        func execute() {
+            let items = batchCount * chunks, size = K + chunkSize
+            _withScratch(scratch, T.self,
+                         count: _workerCount(items) * size) { memory in
+                _forEachWorker(items, size: size, memory, chunk)
+            }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+}
+
+//==============================================================================
+// mixed precision matmul
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// matmul where the operand storage types differ but share a `Value`
+    /// type, such as `Float16` or `BFloat16` weights with `Float` data.
+    @inlinable func cpu_matmul<LE,RE,OE>(
+        _ lhs: TensorR2<LE>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<RE>, _ transposeRhs: Bool,
+        _ out: inout TensorR2<OE>
+    ) where LE.Value: Numeric, RE.Value == LE.Value, OE.Value == LE.Value {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        cpu_gemm(CpuMatrix(lhs, transposed: transposeLhs),
+                 CpuMatrix(rhs, transposed: transposeRhs),
+                 CpuMatrix(mutating: &out))
+    }
+}
+
+//==============================================================================
+// fused matmul
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_matmul(bias:
+    /// matmul with the bias added in the gemm epilogue
+    @inlinable func cpu_matmul<E>(
+        _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<E>, _ transposeRhs: Bool,
+        bias: TensorR1<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name), " +
+                    "bias: \(bias.name)) on \(name)", categories: .queueCpu)
+        assert(bias.count == out.shape[1], _messageTensorShapeMismatch)
+        let b = CpuMatrix(bias)
+        cpu_gemm(CpuMatrix(lhs, transposed: transposeLhs),
+                 CpuMatrix(rhs, transposed: transposeRhs),
+                 CpuMatrix(mutating: &out)) { acc, _, _, col in
+            for j in acc.indices { acc[j] += b[0, 0, col &+ j] }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_matmul(bias:residual:activation:
+    /// matmul with the optional bias, optional residual, and activation
+    /// applied in the gemm epilogue as `activation(lhs x rhs + bias + residual)`
+    /// - Parameters:
+    ///  - plan: an optional execution plan key for `rhs`, see `cpu_gemm`
+    ///  - scratch: optional scratch kept between calls, see `cpu_gemm`
+    @inlinable func cpu_matmul<E>(
+        _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<E>, _ transposeRhs: Bool,
+        bias: TensorR1<E>?,
+        residual: TensorR2<E>?,
+        activation: ActivationType,
+        reluCeiling: E.Value,
+        plan: Int? = nil,
+        scratch: CpuScratch? = nil,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name), " +
+                    "activation: \(activation)) on \(name)",
+                   categories: .queueCpu)
+        assert(bias == nil || bias!.count == out.shape[1],
+               _messageTensorShapeMismatch)
+        assert(residual == nil || residual!.shape == out.shape,
+               _messageTensorShapeMismatch)
+        let b = bias.map { CpuMatrix($0) }
+        let res = residual.map { CpuMatrix($0) }
+
+        cpu_gemm(CpuMatrix(lhs, transposed: transposeLhs),
+                 CpuMatrix(rhs, transposed: transposeRhs),
+                 CpuMatrix(mutating: &out), plan: plan,
+                 scratch: scratch) { acc, batch, row, col in
+            if let b = b {
+                for j in acc.indices { acc[j] += b[0, 0, col &+ j] }
+            }
+            if let res = res {
+                for j in acc.indices { acc[j] += res[batch, row, col &+ j] }
+            }
+            activation.apply(acc, ceiling: reluCeiling)
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue fused matmul delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<E>(
+        _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<E>, _ transposeRhs: Bool,
+        bias: TensorR1<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        cpu_matmul(lhs, transposeLhs, rhs, transposeRhs, bias: bias, &out)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<E>(
+        _ lhs: TensorR2<E>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<E>, _ transposeRhs: Bool,
+        bias: TensorR1<E>?,
+        residual: TensorR2<E>?,
+        activation: ActivationType,
+        reluCeiling: E.Value,
+        plan: Int? = nil,
+        scratch: CpuScratch? = nil,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_matmul(lhs, transposeLhs, rhs, transposeRhs, bias: bias,
+                   residual: residual, activation: activation,
+                   reluCeiling: reluCeiling, plan: plan, scratch: scratch,
+                   &out)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<LE,RE,OE>(
+        _ lhs: TensorR2<LE>, _ transposeLhs: Bool,
+        _ rhs: TensorR2<RE>, _ transposeRhs: Bool,
+        _ out: inout TensorR2<OE>
+    ) where LE.Value: Numeric, RE.Value == LE.Value, OE.Value == LE.Value {
+        cpu_matmul(lhs, transposeLhs, rhs, transposeRhs, &out)
+    }
+}
@@ -0,0 +1,552 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+// cpu normalization kernels
+// The inputs are dense `[rows, features]` matrices. Batch normalization
+// computes the statistics of each feature column over all of the rows,
+// and layer normalization computes the statistics of each row.
+//
+// The forward kernels make one pass to compute the statistics and a second
+// pass that applies the scale, offset, and activation to each row while
+// it is in cache. The backward kernels recompute the normalized values
+// from the saved statistics, so only the input, the output, and the
+// statistics are kept for the backward pass.
+
+/// _normalizationParts
+/// - Returns: the number of row parts and the rows in each part used to
+///   distribute a `rows x cols` problem across the available cores
+@inlinable func _normalizationParts(
+    _ rows: Int, _ cols: Int
+) -> (count: Int, rows: Int) {
+    let count = Swift.max(1, Swift.min(
+        ProcessInfo.processInfo.activeProcessorCount, rows,
+        rows &* cols / _parallelMinimumElements))
+    return (count, (rows + count - 1) / count)
+}
+
+//==============================================================================
+/// _NormalizationScratch
+/// the zero initialized partial sums and coefficients of a normalization
+/// kernel. Each pass of the kernel is a separate `cpu_parallel` call that
+/// captures the scratch, so it is released after the last pass runs.
+@usableFromInline final class _NormalizationScratch<T: Numeric> {
+    @usableFromInline let values: UnsafeMutableBufferPointer<T>
+
+    @inlinable init(count: Int) {
+        values = .allocate(capacity: count)
+        values.initialize(repeating: T.zero)
+    }
+    deinit { values.deallocate() }
+}
+
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_batchNorm
+    /// normalizes each feature column of `x`
+    ///
+    ///     y = activation((x - mean) / sqrt(variance + epsilon) * scale + offset)
+    ///
+    /// - Parameters:
+    ///  - x: the dense `[rows, features]` input, which must have at least
+    ///    one row when `computeStatistics` is `true`
+    ///  - scale: the feature scales
+    ///  - offset: the feature offsets
+    ///  - mean: the feature means, which are computed from `x` when
+    ///    `computeStatistics` is `true`
+    ///  - variance: the feature variances, which are computed from `x` when
+    ///    `computeStatistics` is `true`
+    ///  - computeStatistics: `true` to use the batch statistics
+    ///  - epsilon: a small value added to the variance
+    ///  - activation: the activation applied to the output
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - y: the output
+    @inlinable func cpu_batchNorm<E>(
+        _ x: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ offset: TensorR1<E>,
+        _ mean: inout TensorR1<E>,
+        _ variance: inout TensorR1<E>,
+        computeStatistics: Bool,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ y: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "batchNorm(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        typealias T = E.Value
+        let M = x.shape[0], C = x.shape[1]
+        precondition(M > 0 || !computeStatistics,
+                     "batch statistics require at least one row")
+        let xs = CpuMatrix(dense: x, 1, M, C)
+        let ys = CpuMatrix(mutatingDense: &y, 1, M, C)
+        let scales = CpuMatrix(scale), offsets = CpuMatrix(offset)
+        let means = CpuMatrix(mutating: &mean)
+        let variances = CpuMatrix(mutating: &variance)
+        let parts = _normalizationParts(M, C)
+
+        // the partial sums of each part followed by the scale and shift
+        // of each feature
+        let abBase = parts.count &* 2 &* C
+        let scratch = _NormalizationScratch<T>(count: abBase + 2 * C)
+
+        if computeStatistics {
+            // each part sums the values and their squares, shifted by
+            // the first row to avoid cancellation
+            cpu_parallel(parts.count) { i in
+                let start = i * parts.rows
+                let end = Swift.min(M, start + parts.rows)
+                guard start < end else { return }
+                let acc = UnsafeMutableBufferPointer(rebasing:
+                    scratch.values[(i * 2 * C)..<((i + 1) * 2 * C)])
+                for r in start..<end {
+                    for c in 0..<C {
+                        let d = xs[0, r, c] - xs[0, 0, c]
+                        acc[c] += d
+                        acc[C &+ c] += d * d
+                    }
+                }
+            }
+        }
+
+        cpu_parallel(1) { _ in
+            let partials = scratch.values
+            if computeStatistics {
+                let n = T(M)
+                for c in 0..<C {
+                    var sum = T.zero, squares = T.zero
+                    for i in 0..<parts.count {
+                        sum += partials[i &* 2 &* C &+ c]
+                        squares += partials[i &* 2 &* C &+ C &+ c]
+                    }
+                    let m = sum / n
+                    means[0, 0, c] = xs[0, 0, c] + m
+                    variances[0, 0, c] = Swift.max(0, squares / n - m * m)
+                }
+            }
+
+            // the scale and shift of each feature
+            for c in 0..<C {
+                let a = scales[0, 0, c] / .sqrt(variances[0, 0, c] + epsilon)
+                partials[abBase &+ c] = a
+                partials[abBase &+ C &+ c] = offsets[0, 0, c] -
+                    means[0, 0, c] * a
+            }
+        }
+
+        cpu_parallel(parts.count) { i in
+            let start = i * parts.rows
+            let end = Swift.min(M, start + parts.rows)
+            guard start < end else { return }
+            let ab = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[abBase...])
+            let row = UnsafeMutableBufferPointer<T>.allocate(capacity: C)
+            defer { row.deallocate() }
+            for r in start..<end {
+                for c in 0..<C { row[c] = xs[0, r, c] * ab[c] + ab[C &+ c] }
+                activation.apply(row, ceiling: ceiling)
+                for c in 0..<C { ys[0, r, c] = row[c] }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_batchNormGradient
+    /// computes the input, scale, and offset gradients of `cpu_batchNorm`.
+    /// The first pass applies the activation derivative, storing the
+    /// result in `xDiff`, and sums the scale and offset gradients. The
+    /// second pass computes the input gradients. An empty `x` has zero
+    /// scale and offset gradients.
+    /// - Parameters:
+    ///  - x: the dense `[rows, features]` input
+    ///  - y: the output, which is used for the activation derivative
+    ///  - yDiff: the output gradient
+    ///  - scale: the feature scales
+    ///  - mean: the means used by the forward pass
+    ///  - variance: the variances used by the forward pass
+    ///  - usesBatchStatistics: `true` if the statistics were computed
+    ///    from `x`, so they contribute to the input gradient
+    ///  - epsilon: a small value added to the variance
+    ///  - activation: the activation applied to the output
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - xDiff: the input gradient
+    ///  - scaleDiff: the scale gradient
+    ///  - offsetDiff: the offset gradient
+    @inlinable func cpu_batchNormGradient<E>(
+        _ x: TensorR2<E>,
+        _ y: TensorR2<E>,
+        _ yDiff: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ mean: TensorR1<E>,
+        _ variance: TensorR1<E>,
+        usesBatchStatistics: Bool,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ xDiff: inout TensorR2<E>,
+        _ scaleDiff: inout TensorR1<E>,
+        _ offsetDiff: inout TensorR1<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "batchNormGradient(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        typealias T = E.Value
+        let M = x.shape[0], C = x.shape[1]
+        let xs = CpuMatrix(dense: x, 1, M, C)
+        let ys = CpuMatrix(dense: y, 1, M, C)
+        let dys = CpuMatrix(dense: yDiff, 1, M, C)
+        let dxs = CpuMatrix(mutatingDense: &xDiff, 1, M, C)
+        let scales = CpuMatrix(scale), means = CpuMatrix(mean)
+        let variances = CpuMatrix(variance)
+        let dscales = CpuMatrix(mutating: &scaleDiff)
+        let doffsets = CpuMatrix(mutating: &offsetDiff)
+        let parts = _normalizationParts(M, C)
+
+        // the partial sums of each part followed by the inverse standard
+        // deviations and the input gradient coefficients of each feature
+        let invStdBase = parts.count &* 2 &* C
+        let coefficientBase = invStdBase &+ C
+        let scratch = _NormalizationScratch<T>(count: coefficientBase + 3 * C)
+
+        cpu_parallel(1) { _ in
+            let invStd = scratch.values
+            for c in 0..<C {
+                invStd[invStdBase &+ c] =
+                    1 / .sqrt(variances[0, 0, c] + epsilon)
+            }
+        }
+
+        // each part sums the gradients and their products with the
+        // normalized values
+        cpu_parallel(parts.count) { i in
+            let start = i * parts.rows
+            let end = Swift.min(M, start + parts.rows)
+            guard start < end else { return }
+            let acc = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[(i * 2 * C)..<((i + 1) * 2 * C)])
+            let invStd = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[invStdBase..<coefficientBase])
+            let rows = UnsafeMutableBufferPointer<T>.allocate(capacity: 2 * C)
+            defer { rows.deallocate() }
+            let yRow = UnsafeMutableBufferPointer(rebasing: rows[0..<C])
+            let dyRow = UnsafeMutableBufferPointer(rebasing: rows[C...])
+            for r in start..<end {
+                for c in 0..<C {
+                    yRow[c] = ys[0, r, c]
+                    dyRow[c] = dys[0, r, c]
+                }
+                activation.gradient(yRow, dyRow, ceiling: ceiling)
+                for c in 0..<C {
+                    let d = dyRow[c]
+                    let xhat = (xs[0, r, c] - means[0, 0, c]) * invStd[c]
+                    acc[c] += d
+                    acc[C &+ c] += d * xhat
+                    dxs[0, r, c] = d
+                }
+            }
+        }
+
+        cpu_parallel(1) { _ in
+            let partials = scratch.values
+            let n = T(Swift.max(1, M))
+            for c in 0..<C {
+                var sum = T.zero, dot = T.zero
+                for i in 0..<parts.count {
+                    sum += partials[i &* 2 &* C &+ c]
+                    dot += partials[i &* 2 &* C &+ C &+ c]
+                }
+                doffsets[0, 0, c] = sum
+                dscales[0, 0, c] = dot
+                let k = coefficientBase &+ c
+                partials[k] = scales[0, 0, c] * partials[invStdBase &+ c]
+                partials[k &+ C] = usesBatchStatistics ? sum / n : 0
+                partials[k &+ 2 &* C] = usesBatchStatistics ? dot / n : 0
+            }
+        }
+
+        cpu_parallel(parts.count) { i in
+            let start = i * parts.rows
+            let end = Swift.min(M, start + parts.rows)
+            guard start < end else { return }
+            let invStd = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[invStdBase..<coefficientBase])
+            let coefficients = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[coefficientBase...])
+            for r in start..<end {
+                for c in 0..<C {
+                    let xhat = (xs[0, r, c] - means[0, 0, c]) * invStd[c]
+                    dxs[0, r, c] = coefficients[c] * (dxs[0, r, c] -
+                        coefficients[C &+ c] - xhat * coefficients[2 &* C &+ c])
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_layerNorm
+    /// normalizes each row of `x`
+    ///
+    ///     y = activation((x - mean) / sqrt(variance + epsilon) * scale + offset)
+    ///
+    /// Each row is read once to compute the mean and variance while it is
+    /// in cache, then normalized and stored.
+    /// - Parameters:
+    ///  - x: the dense `[rows, features]` input
+    ///  - scale: the feature scales
+    ///  - offset: the feature offsets
+    ///  - epsilon: a small value added to the variance
+    ///  - activation: the activation applied to the output
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - y: the output
+    ///  - mean: the mean of each row
+    ///  - invStd: the inverse standard deviation of each row
+    @inlinable func cpu_layerNorm<E>(
+        _ x: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ offset: TensorR1<E>,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ y: inout TensorR2<E>,
+        _ mean: inout TensorR1<E>,
+        _ invStd: inout TensorR1<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "layerNorm(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        typealias T = E.Value
+        let M = x.shape[0], C = x.shape[1]
+        let xs = CpuMatrix(dense: x, 1, M, C)
+        let ys = CpuMatrix(mutatingDense: &y, 1, M, C)
+        let scales = CpuMatrix(scale), offsets = CpuMatrix(offset)
+        let means = CpuMatrix(mutating: &mean)
+        let invStds = CpuMatrix(mutating: &invStd)
+        let parts = _normalizationParts(M, C)
+
+        cpu_parallel(parts.count) { i in
+            let start = i * parts.rows
+            let end = Swift.min(M, start + parts.rows)
+            guard start < end else { return }
+            let row = UnsafeMutableBufferPointer<T>.allocate(capacity: C)
+            defer { row.deallocate() }
+            let n = T(C)
+            for r in start..<end {
+                var sum = T.zero
+                for c in 0..<C {
+                    row[c] = xs[0, r, c]
+                    sum += row[c]
+                }
+                let m = sum / n
+                var squares = T.zero
+                for c in 0..<C {
+                    let d = row[c] - m
+                    squares += d * d
+                }
+                let s = 1 / T.sqrt(squares / n + epsilon)
+                for c in 0..<C {
+                    row[c] = (row[c] - m) * s * scales[0, 0, c] +
+                        offsets[0, 0, c]
+                }
+                activation.apply(row, ceiling: ceiling)
+                for c in 0..<C { ys[0, r, c] = row[c] }
+                means[0, 0, r] = m
+                invStds[0, 0, r] = s
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_layerNormGradient
+    /// computes the input, scale, and offset gradients of `cpu_layerNorm`.
+    /// The input gradients of each row are computed in one pass, and each
+    /// part accumulates partial scale and offset gradients that are summed
+    /// at the end.
+    /// - Parameters:
+    ///  - x: the dense `[rows, features]` input
+    ///  - y: the output, which is used for the activation derivative
+    ///  - yDiff: the output gradient
+    ///  - scale: the feature scales
+    ///  - mean: the row means saved by the forward pass
+    ///  - invStd: the row inverse standard deviations saved by the
+    ///    forward pass
+    ///  - activation: the activation applied to the output
+    ///  - ceiling: the upper bound for `clippedRelu`
+    ///  - xDiff: the input gradient
+    ///  - scaleDiff: the scale gradient
+    ///  - offsetDiff: the offset gradient
+    @inlinable func cpu_layerNormGradient<E>(
+        _ x: TensorR2<E>,
+        _ y: TensorR2<E>,
+        _ yDiff: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ mean: TensorR1<E>,
+        _ invStd: TensorR1<E>,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ xDiff: inout TensorR2<E>,
+        _ scaleDiff: inout TensorR1<E>,
+        _ offsetDiff: inout TensorR1<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "layerNormGradient(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        typealias T = E.Value
+        let M = x.shape[0], C = x.shape[1]
+        let xs = CpuMatrix(dense: x, 1, M, C)
+        let ys = CpuMatrix(dense: y, 1, M, C)
+        let dys = CpuMatrix(dense: yDiff, 1, M, C)
+        let dxs = CpuMatrix(mutatingDense: &xDiff, 1, M, C)
+        let scales = CpuMatrix(scale), means = CpuMatrix(mean)
+        let invStds = CpuMatrix(invStd)
+        let dscales = CpuMatrix(mutating: &scaleDiff)
+        let doffsets = CpuMatrix(mutating: &offsetDiff)
+        let parts = _normalizationParts(M, C)
+        let scratch = _NormalizationScratch<T>(count: parts.count * 2 * C)
+
+        cpu_parallel(parts.count) { i in
+            let start = i * parts.rows
+            let end = Swift.min(M, start + parts.rows)
+            guard start < end else { return }
+            let acc = UnsafeMutableBufferPointer(rebasing:
+                scratch.values[(i * 2 * C)..<((i + 1) * 2 * C)])
+            let rows = UnsafeMutableBufferPointer<T>.allocate(capacity: 3 * C)
+            defer { rows.deallocate() }
+            let yRow = UnsafeMutableBufferPointer(rebasing: rows[0..<C])
+            let dyRow = UnsafeMutableBufferPointer(rebasing: rows[C..<(2 * C)])
+            let xhat = UnsafeMutableBufferPointer(rebasing: rows[(2 * C)...])
+            let n = T(C)
+            for r in start..<end {
+                let m = means[0, 0, r], s = invStds[0, 0, r]
+                for c in 0..<C {
+                    yRow[c] = ys[0, r, c]
+                    dyRow[c] = dys[0, r, c]
+                }
+                activation.gradient(yRow, dyRow, ceiling: ceiling)
+
+                // the sums of the scaled gradients
+                var sum = T.zero, dot = T.zero
+                for c in 0..<C {
+                    let d = dyRow[c]
+                    xhat[c] = (xs[0, r, c] - m) * s
+                    acc[c] += d * xhat[c]
+                    acc[C &+ c] += d
+                    let g = d * scales[0, 0, c]
+                    sum += g
+                    dot += g * xhat[c]
+                }
+                sum /= n
+                dot /= n
+                for c in 0..<C {
+                    let g = dyRow[c] * scales[0, 0, c]
+                    dxs[0, r, c] = s * (g - sum - xhat[c] * dot)
+                }
+            }
+        }
+
+        cpu_parallel(1) { _ in
+            let partials = scratch.values
+            for c in 0..<C {
+                var sum = T.zero, dot = T.zero
+                for i in 0..<parts.count {
+                    dot += partials[i &* 2 &* C &+ c]
+                    sum += partials[i &* 2 &* C &+ C &+ c]
+                }
+                dscales[0, 0, c] = dot
+                doffsets[0, 0, c] = sum
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue cpu normalization delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func batchNorm<E>(
+        _ x: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ offset: TensorR1<E>,
+        _ mean: inout TensorR1<E>,
+        _ variance: inout TensorR1<E>,
+        computeStatistics: Bool,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ y: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_batchNorm(x, scale, offset, &mean, &variance,
+                      computeStatistics: computeStatistics, epsilon: epsilon,
+                      activation: activation, ceiling: ceiling, &y)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func batchNormGradient<E>(
+        _ x: TensorR2<E>,
+        _ y: TensorR2<E>,
+        _ yDiff: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ mean: TensorR1<E>,
+        _ variance: TensorR1<E>,
+        usesBatchStatistics: Bool,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ xDiff: inout TensorR2<E>,
+        _ scaleDiff: inout TensorR1<E>,
+        _ offsetDiff: inout TensorR1<E>
+    ) where E.Value: Real {
+        cpu_batchNormGradient(x, y, yDiff, scale, mean, variance,
+                              usesBatchStatistics: usesBatchStatistics,
+                              epsilon: epsilon, activation: activation,
+                              ceiling: ceiling, &xDiff, &scaleDiff, &offsetDiff)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func layerNorm<E>(
+        _ x: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ offset: TensorR1<E>,
+        epsilon: E.Value,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ y: inout TensorR2<E>,
+        _ mean: inout TensorR1<E>,
+        _ invStd: inout TensorR1<E>
+    ) where E.Value: Real {
+        cpu_layerNorm(x, scale, offset, epsilon: epsilon,
+                      activation: activation, ceiling: ceiling,
+                      &y, &mean, &invStd)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func layerNormGradient<E>(
+        _ x: TensorR2<E>,
+        _ y: TensorR2<E>,
+        _ yDiff: TensorR2<E>,
+        _ scale: TensorR1<E>,
+        _ mean: TensorR1<E>,
+        _ invStd: TensorR1<E>,
+        activation: ActivationType,
+        ceiling: E.Value,
+        _ xDiff: inout TensorR2<E>,
+        _ scaleDiff: inout TensorR1<E>,
+        _ offsetDiff: inout TensorR1<E>
+    ) where E.Value: Real {
+        cpu_layerNormGradient(x, y, yDiff, scale, mean, invStd,
+                              activation: activation, ceiling: ceiling,
+                              &xDiff, &scaleDiff, &offsetDiff)
+    }
+}
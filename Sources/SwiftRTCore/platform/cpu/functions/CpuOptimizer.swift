@@ -0,0 +1,177 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// _OptimizerSegment
+/// a contiguous span of elements of one parameter. A dense gradient is one
+/// segment, and each stored row of a sparse gradient is a segment.
+@usableFromInline struct _OptimizerSegment {
+    /// the parameter index
+    @usableFromInline let parameter: Int
+    /// the first weight and moment element
+    @usableFromInline let weight: Int
+    /// the first gradient element
+    @usableFromInline let gradient: Int
+    /// the number of elements
+    @usableFromInline let count: Int
+
+    @inlinable init(_ parameter: Int, _ weight: Int, _ gradient: Int,
+                    _ count: Int) {
+        self.parameter = parameter
+        self.weight = weight
+        self.gradient = gradient
+        self.count = count
+    }
+}
+
+//==============================================================================
+// cpu multi tensor optimizer kernel
+// The segments of all parameters are concatenated into a single element
+// range that is split into equal chunks by `cpu_parallel(count:)`. A chunk
+// can start and end inside a segment, and covers several segments when
+// they are small, so the work is balanced independently of the sizes of
+// the parameters. The rule `switch` is hoisted out of the element loops.
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_optimizerUpdate
+    /// - Parameters:
+    ///  - rule: the update rule
+    ///  - parameters: the parameters to update
+    @inlinable func cpu_optimizerUpdate<E>(
+        _ rule: OptimizerRule<E.Value>,
+        _ parameters: inout [OptimizerParameter<E>]
+    ) where E.Value: BinaryFloatingPoint {
+        diagnostic(.queueCpu, "optimizerUpdate(\(parameters.count) " +
+                    "parameters) on \(name)", categories: .queueCpu)
+        let moments = rule.momentCount
+        var segments = [_OptimizerSegment]()
+        var ws = [CpuMatrix<E>](), gs = [CpuMatrix<E>]()
+        var ms = [CpuMatrix<E>](), vs = [CpuMatrix<E>]()
+
+        for p in parameters.indices {
+            let count = parameters[p].weight.count
+            precondition(moments < 1 || parameters[p].first.count == count,
+                         "the first moment must match the weights")
+            precondition(moments < 2 || parameters[p].second.count == count,
+                         "the second moment must match the weights")
+            precondition(parameters[p].rows != nil ||
+                            parameters[p].gradient.count == count,
+                         "the gradient must match the weights")
+            ws.append(CpuMatrix(mutatingDense: &parameters[p].weight,
+                                1, 1, count))
+            gs.append(CpuMatrix(dense: parameters[p].gradient, 1, 1,
+                                parameters[p].gradient.count))
+            if moments > 0 {
+                ms.append(CpuMatrix(mutatingDense: &parameters[p].first,
+                                    1, 1, count))
+            }
+            if moments > 1 {
+                vs.append(CpuMatrix(mutatingDense: &parameters[p].second,
+                                    1, 1, count))
+            }
+
+            if let rows = parameters[p].rows {
+                let size = parameters[p].rowSize
+                for (i, row) in rows.enumerated() {
+                    precondition(row >= 0 && (row + 1) * size <= count,
+                                 "sparse gradient row is out of range")
+                    segments.append(_OptimizerSegment(p, row * size,
+                                                      i * size, size))
+                }
+            } else if count > 0 {
+                segments.append(_OptimizerSegment(p, 0, 0, count))
+            }
+        }
+
+        // the first element of each segment in the work list
+        var starts = [Int](repeating: 0, count: segments.count + 1)
+        for s in segments.indices {
+            starts[s + 1] = starts[s] + segments[s].count
+        }
+        let total = starts[segments.count]
+        guard total > 0 else { return }
+
+        cpu_parallel(count: total) { range in
+            // find the segment containing the first element of the chunk
+            var lo = 0, hi = segments.count - 1
+            while lo < hi {
+                let mid = (lo + hi + 1) / 2
+                if starts[mid] <= range.lowerBound {
+                    lo = mid
+                } else {
+                    hi = mid - 1
+                }
+            }
+
+            var s = lo
+            while s < segments.count && starts[s] < range.upperBound {
+                let segment = segments[s]
+                let begin = Swift.max(range.lowerBound, starts[s]) &- starts[s]
+                let end = Swift.min(range.upperBound, starts[s + 1]) &-
+                    starts[s]
+                let w = ws[segment.parameter], g = gs[segment.parameter]
+                let wi = segment.weight, gi = segment.gradient
+
+                switch rule {
+                case let .sgd(learningRate):
+                    for j in begin..<end {
+                        let step = learningRate * g[0, 0, gi &+ j]
+                        w[0, 0, wi &+ j] = w[0, 0, wi &+ j] - step
+                    }
+
+                case let .momentum(learningRate, momentum, nesterov):
+                    let m = ms[segment.parameter]
+                    for j in begin..<end {
+                        let grad = g[0, 0, gi &+ j]
+                        let mj = momentum * m[0, 0, wi &+ j] + grad
+                        let step = nesterov ? grad + momentum * mj : mj
+                        m[0, 0, wi &+ j] = mj
+                        let weight = w[0, 0, wi &+ j]
+                        w[0, 0, wi &+ j] = weight - learningRate * step
+                    }
+
+                case let .adam(stepSize, beta1, beta2, epsilon):
+                    let m = ms[segment.parameter], v = vs[segment.parameter]
+                    for j in begin..<end {
+                        let grad = g[0, 0, gi &+ j]
+                        let mj = beta1 * m[0, 0, wi &+ j] + (1 - beta1) * grad
+                        let vj = beta2 * v[0, 0, wi &+ j] +
+                            (1 - beta2) * grad * grad
+                        m[0, 0, wi &+ j] = mj
+                        v[0, 0, wi &+ j] = vj
+                        let weight = w[0, 0, wi &+ j]
+                        w[0, 0, wi &+ j] = weight -
+                            stepSize * mj / (vj.squareRoot() + epsilon)
+                    }
+                }
+                s += 1
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue cpu optimizer delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func optimizerUpdate<E>(
+        _ rule: OptimizerRule<E.Value>,
+        _ parameters: inout [OptimizerParameter<E>]
+    ) where E.Value: BinaryFloatingPoint {
+        cpu_optimizerUpdate(rule, &parameters)
+    }
+}
@@ -0,0 +1,425 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+// DeviceQueue functions with default cpu delegation
+extension DeviceQueue where Self: CpuFunctions
+{
+    public func pooling<Shape, Element>(
+        mode: PoolingMode,
+        windowSize: Shape?,
+        strides: Shape,
+        padding: Padding
+    ) -> DevicePooling<Shape, Element>
+    where Shape: TensorShape,
+          Element: StorageElement,
+          Element.Value: Real & BinaryFloatingPoint
+    {
+        CpuPooling<Shape, Element>(
+            mode: mode,
+            windowSize: windowSize,
+            strides: strides,
+            padding: padding)
+    }
+}
+
+//==============================================================================
+/// CpuPooling
+public final class CpuPooling<Shape, Element>: DevicePooling<Shape, Element>
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint {}
+
+//==============================================================================
+/// DevicePooling
+/// A max or average pooling base class with a cpu default implementation.
+/// The input/output tensor type is of the form NWC, NHWC, or NDHWC, and
+/// channels last tensors are pooled in place in the same way as
+/// convolutions. The window is described by a `ConvolutionGeometry` with
+/// one unit filter per channel, so pooling shares the window iteration
+/// and padding rules of depthwise convolution.
+///
+/// Training forward passes of max pooling return the input position of
+/// each output element with the output. The operator keeps no per call
+/// state, so the caller passes the indices back to `backward`, which is
+/// then a single scatter of the output gradient instead of a
+/// recomputation of the windows.
+public class DevicePooling<Shape, Element>: Logging
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint
+{
+    // types
+    public typealias Data = Tensor<Shape, Element>
+    public typealias Indices = Tensor<Shape, Int32>
+
+    // properties
+    public let mode: PoolingMode
+    /// the spatial window size, or `nil` to pool the whole input
+    public let windowSize: Shape?
+    public let strides: Shape
+    public let padding: Padding
+    public var inputShape: Shape
+    public let logCategories: LogCategories = [.setup]
+
+    public var geometry: ConvolutionGeometry!
+    /// the reciprocal of the number of elements averaged by each
+    /// output position
+    public var averageScale: [Element.Value]
+
+    //--------------------------------------------------------------------------
+    /// init
+    /// - Parameters:
+    ///  - mode: the pooling function
+    ///  - windowSize: the window size of the spatial dimensions, or `nil`
+    ///    to pool the whole spatial extent of the input
+    ///  - strides: the window strides
+    ///  - padding: the padding surrounding `x`
+    @inlinable public init(
+        mode: PoolingMode,
+        windowSize: Shape?,
+        strides: Shape,
+        padding: Padding
+    ) {
+        self.mode = mode
+        self.windowSize = windowSize
+        self.strides = strides
+        self.padding = padding
+        self.inputShape = Shape.zero
+        self.averageScale = []
+    }
+
+    /// `true` if the mode is max pooling
+    @inlinable public var isMax: Bool {
+        mode == .max || mode == .maxDeterministic
+    }
+
+    //--------------------------------------------------------------------------
+    /// forward
+    /// - Parameters:
+    ///  - x: the input tensor
+    ///  - mode: `.training` returns the max pooling indices for `backward`
+    /// - Returns: the pooled output, and the input position of each
+    ///   output element for training max pooling, otherwise `nil`
+    @inlinable public func forward(
+        x: Data,
+        mode: EvaluationMode
+    ) -> (y: Data, indices: Indices?) {
+        if x.order.isChannelsLast {
+            // the indices are positions in the row major channels last
+            // data, which `backward` converts to in the same way
+            let r = forward(x: Data(channelsLast: channelsLast(x, x.order)),
+                            mode: mode)
+            return (Data(channelsFirst: r.y, order: x.order), r.indices)
+        }
+
+        if x.shape != inputShape { setup(x) }
+        let x = x.isContiguous && x.order == .row ? x :
+            Data(copying: x, order: .row)
+        var y = Data(shape: geometry.outputShape(), order: .row)
+        var indices: Indices? = isMax && mode == .training ?
+            Indices(shape: y.shape, order: .row) : nil
+        currentQueue.cpu_pooling(x, geometry, self.mode,
+                                 averageScale, &y, &indices)
+        return (y, indices)
+    }
+
+    //--------------------------------------------------------------------------
+    /// backward
+    /// computes the gradient of `x`. Max pooling scatters the output
+    /// gradient to the `indices` returned by the training forward pass
+    /// of `x`, or finds the window maximums again if there are none.
+    /// - Parameters:
+    ///  - y: the output tensor
+    ///  - yDiff: the output differential
+    ///  - x: the input tensor
+    ///  - indices: the max pooling indices returned by `forward`
+    ///  - xDiff: the input tensor differential
+    @inlinable public func backward(
+        y: Data,
+        yDiff: Data,
+        x: Data,
+        indices: Indices? = nil,
+        xDiff: inout Data
+    ) {
+        if x.order.isChannelsLast {
+            let order = x.order
+            var dx = Data(shape: x.shape.channelsLast, order: .row)
+            backward(y: Data(channelsLast: channelsLast(y, order)),
+                     yDiff: Data(channelsLast: channelsLast(yDiff, order)),
+                     x: Data(channelsLast: channelsLast(x, order)),
+                     indices: indices, xDiff: &dx)
+            copy(from: Data(channelsFirst: dx, order: order), to: &xDiff)
+            return
+        }
+
+        if x.shape != inputShape { setup(x) }
+        assert(y.shape == geometry.outputShape() && yDiff.shape == y.shape &&
+                xDiff.shape == x.shape, _messageTensorShapeMismatch)
+        let x = x.isContiguous && x.order == .row ? x :
+            Data(copying: x, order: .row)
+        let dy = yDiff.isContiguous && yDiff.order == .row ? yDiff :
+            Data(copying: yDiff, order: .row)
+
+        if xDiff.isContiguous && xDiff.order == .row {
+            currentQueue.cpu_poolingBackward(
+                x, dy, geometry, mode, averageScale, indices, &xDiff)
+        } else {
+            var dx = Data(shape: xDiff.shape, order: .row)
+            currentQueue.cpu_poolingBackward(
+                x, dy, geometry, mode, averageScale, indices, &dx)
+            copy(from: dx, to: &xDiff)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // channelsLast
+    // - Returns: `t` as a dense tensor in the channels last `order`
+    @inlinable public func channelsLast(_ t: Data, _ order: Order) -> Data {
+        t.isContiguous && t.order == order ? t : Data(copying: t, order: order)
+    }
+
+    //--------------------------------------------------------------------------
+    // setup
+    @inlinable public func setup(_ x: Data) {
+        inputShape = x.shape
+        let channels = x.shape[Shape.rank - 1]
+
+        // one unit filter per channel
+        var filter = Shape.one
+        for i in 0..<(Shape.rank - 2) {
+            filter[i] = windowSize?[i + 1] ?? x.shape[i + 1]
+        }
+        filter[Shape.rank - 1] = channels
+
+        geometry = ConvolutionGeometry(
+            input: x.shape,
+            filter: filter,
+            strides: windowSize == nil ? Shape.one : strides,
+            padding: windowSize == nil ? .valid : padding,
+            dilations: Shape.one,
+            mode: .crossCorrelation,
+            groups: channels)
+
+        // the divisor of each output position
+        averageScale = (0..<geometry.outputCount).map { pos in
+            var count = geometry.taps
+            if mode == .averageExcludePadding {
+                count = 0
+                geometry.forEachTap(pos) { _, _ in count += 1 }
+            }
+            return 1 / Element.Value(Swift.max(1, count))
+        }
+
+        if willLog(level: .diagnostic) {
+            diagnostic(.setup, "pooling \(mode) window: " +
+                "\(geometry.fD)x\(geometry.fH)x\(geometry.fW)  output: " +
+                "\(geometry.outputShape() as Shape)", categories: logCategories)
+        }
+    }
+}
+
+//==============================================================================
+/// the number of channels processed by each pooling work item
+@usableFromInline let _poolingChannelTile = 64
+
+//==============================================================================
+/// cpu_pooling
+/// pools dense row major NWC, NHWC, or NDHWC data. The work is split into
+/// (batch, output position tile, channel block) items that are
+/// distributed across the available cores, and the inner loops are over
+/// contiguous channels so they vectorize.
+extension DeviceQueue {
+    @inlinable func cpu_pooling<S,E>(
+        _ x: Tensor<S,E>,
+        _ geometry: ConvolutionGeometry,
+        _ function: PoolingMode,
+        _ averageScale: [E.Value],
+        _ y: inout Tensor<S,E>,
+        _ indices: inout Tensor<S,Int32>?
+    ) where E.Value: Real & BinaryFloatingPoint {
+        typealias T = E.Value
+        let g = geometry
+        diagnostic(.queueCpu, "pooling(\(x.name)) \(function) on \(name)",
+                   categories: .queueCpu)
+        let C = g.inChannels
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, C)
+        let ys = CpuMatrix(mutatingDense: &y, g.batchCount, g.outputCount, C)
+        let ids: CpuMatrix<Int32>? = indices == nil ? nil :
+            CpuMatrix(mutatingDense: &indices!, g.batchCount, g.outputCount, C)
+        let isMax = function == .max || function == .maxDeterministic
+
+        // work items
+        let cTile = Swift.min(C, _poolingChannelTile)
+        let cBlocks = (C + cTile - 1) / cTile
+        let tileRows = Swift.max(1, _parallelMinimumElements /
+                                    Swift.max(1, g.taps * cTile))
+        let positionTiles = (g.outputCount + tileRows - 1) / tileRows
+        let items = g.batchCount * positionTiles * cBlocks
+
+        cpu_parallel(items) { i in
+            let cStart = (i % cBlocks) * cTile
+            let tile = (i / cBlocks) % positionTiles
+            let n = i / (cBlocks * positionTiles)
+            let count = Swift.min(cTile, C - cStart)
+            let posStart = tile * tileRows
+            let posEnd = Swift.min(posStart + tileRows, g.outputCount)
+
+            let acc = UnsafeMutableBufferPointer<T>.allocate(capacity: count)
+            let arg = UnsafeMutableBufferPointer<Int32>.allocate(capacity: count)
+            defer { acc.deallocate(); arg.deallocate() }
+
+            for pos in posStart..<posEnd {
+                if isMax {
+                    g.windowMax(xs, n, pos, cStart, acc, arg)
+                    if let ids = ids {
+                        for j in 0..<count { ids[n, pos, cStart &+ j] = arg[j] }
+                    }
+                } else {
+                    for j in 0..<count { acc[j] = 0 }
+                    g.forEachTap(pos) { _, p in
+                        for j in 0..<count { acc[j] += xs[n, p, cStart &+ j] }
+                    }
+                    let scale = averageScale[pos]
+                    for j in 0..<count { acc[j] *= scale }
+                }
+                for j in 0..<count { ys[n, pos, cStart &+ j] = acc[j] }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_poolingBackward
+    /// - max pooling scatters each output gradient to the input position
+    ///   of its window maximum. The items are (batch, channel block), so
+    ///   overlapping windows never write the same element concurrently.
+    ///   The positions are read from `indices` when it is available.
+    /// - average pooling gathers the scaled output gradients of every
+    ///   window that reads an input position, split into (batch, input
+    ///   position tile, channel block) items.
+    @inlinable func cpu_poolingBackward<S,E>(
+        _ x: Tensor<S,E>,
+        _ yDiff: Tensor<S,E>,
+        _ geometry: ConvolutionGeometry,
+        _ function: PoolingMode,
+        _ averageScale: [E.Value],
+        _ indices: Tensor<S,Int32>?,
+        _ xDiff: inout Tensor<S,E>
+    ) where E.Value: Real & BinaryFloatingPoint {
+        typealias T = E.Value
+        let g = geometry
+        let useIndices = indices?.shape == yDiff.shape
+        diagnostic(.queueCpu, "poolingBackward(\(x.name)) \(function)" +
+                    "\(useIndices ? " saved indices" : "") on \(name)",
+                   categories: .queueCpu)
+        let C = g.inChannels
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, C)
+        let dys = CpuMatrix(dense: yDiff, g.batchCount, g.outputCount, C)
+        let dxs = CpuMatrix(mutatingDense: &xDiff, g.batchCount,
+                            g.inputCount, C)
+        let cTile = Swift.min(C, _poolingChannelTile)
+        let cBlocks = (C + cTile - 1) / cTile
+
+        if function == .max || function == .maxDeterministic {
+            let ids: CpuMatrix<Int32>? = useIndices ?
+                CpuMatrix(dense: indices!, g.batchCount, g.outputCount, C) : nil
+
+            cpu_parallel(g.batchCount * cBlocks) { i in
+                let cStart = (i % cBlocks) * cTile
+                let n = i / cBlocks
+                let count = Swift.min(cTile, C - cStart)
+                for p in 0..<g.inputCount {
+                    for j in 0..<count { dxs[n, p, cStart &+ j] = 0 }
+                }
+
+                let max = UnsafeMutableBufferPointer<T>.allocate(capacity: count)
+                let arg = UnsafeMutableBufferPointer<Int32>.allocate(capacity: count)
+                defer { max.deallocate(); arg.deallocate() }
+
+                for pos in 0..<g.outputCount {
+                    if let ids = ids {
+                        for j in 0..<count { arg[j] = ids[n, pos, cStart &+ j] }
+                    } else {
+                        g.windowMax(xs, n, pos, cStart, max, arg)
+                    }
+                    for j in 0..<count {
+                        let c = cStart &+ j, p = Int(arg[j])
+                        dxs[n, p, c] += dys[n, pos, c]
+                    }
+                }
+            }
+        } else {
+            let tileRows = Swift.max(1, _parallelMinimumElements /
+                                        Swift.max(1, g.taps * cTile))
+            let positionTiles = (g.inputCount + tileRows - 1) / tileRows
+
+            cpu_parallel(g.batchCount * positionTiles * cBlocks) { i in
+                let cStart = (i % cBlocks) * cTile
+                let tile = (i / cBlocks) % positionTiles
+                let n = i / (cBlocks * positionTiles)
+                let count = Swift.min(cTile, C - cStart)
+                let pStart = tile * tileRows
+                let pEnd = Swift.min(pStart + tileRows, g.inputCount)
+
+                let acc = UnsafeMutableBufferPointer<T>.allocate(capacity: count)
+                defer { acc.deallocate() }
+                for p in pStart..<pEnd {
+                    for j in 0..<count { acc[j] = 0 }
+                    g.forEachOutputTap(p) { _, pos in
+                        let scale = averageScale[pos]
+                        for j in 0..<count {
+                            acc[j] += dys[n, pos, cStart &+ j] * scale
+                        }
+                    }
+                    for j in 0..<count { dxs[n, p, cStart &+ j] = acc[j] }
+                }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// ConvolutionGeometry pooling windows
+extension ConvolutionGeometry {
+    //--------------------------------------------------------------------------
+    /// windowMax
+    /// finds the maximum of a window for a block of channels, and the
+    /// input position of the first maximum of each channel
+    @inlinable public func windowMax<E>(
+        _ xs: CpuMatrix<E>,
+        _ n: Int, _ pos: Int, _ cStart: Int,
+        _ max: UnsafeMutableBufferPointer<E.Value>,
+        _ index: UnsafeMutableBufferPointer<Int32>
+    ) where E.Value: BinaryFloatingPoint {
+        var first = true
+        forEachTap(pos) { _, p in
+            if first {
+                for j in max.indices {
+                    max[j] = xs[n, p, cStart &+ j]
+                    index[j] = Int32(p)
+                }
+                first = false
+            } else {
+                for j in max.indices {
+                    let v = xs[n, p, cStart &+ j]
+                    if v > max[j] { max[j] = v; index[j] = Int32(p) }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,610 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// _channelLayout
+/// - Returns: the number of channels along `axis` and the number of
+///   contiguous elements in each channel run for a row major tensor
+@inlinable func _channelLayout<S: TensorShape>(
+    _ shape: S, _ axis: Int?
+) -> (channels: Int, inner: Int) {
+    guard let axis = axis else { return (1, Int.max) }
+    var inner = 1
+    for i in (axis + 1)..<S.rank { inner &*= shape[i] }
+    return (shape[axis], inner)
+}
+
+//==============================================================================
+// cpu quantization kernels
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_quantizationRange
+    /// finds the minimum and maximum values per tensor or per channel.
+    /// The elements are split into chunks that are reduced in parallel
+    /// and the partial results are combined. This function blocks until
+    /// the result is available.
+    /// - Parameters:
+    ///  - x: the tensor to examine
+    ///  - axis: the channel axis, or `nil` for the whole tensor
+    /// - Returns: the minimum and maximum value for each channel
+    @inlinable func cpu_quantizationRange<S,E>(
+        _ x: Tensor<S,E>,
+        axis: Int?
+    ) -> (lower: [Float], upper: [Float]) where E.Value == Float {
+        diagnostic(.queueCpu, "quantizationRange(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(x.isContiguous && x.order == .row,
+               "quantization requires contiguous row major data")
+        let (channels, inner) = _channelLayout(x.shape, axis)
+        let count = x.count
+        let chunks = Swift.max(1, Swift.min(
+            ProcessInfo.processInfo.activeProcessorCount,
+            count / _parallelMinimumElements))
+        let chunkSize = (count + chunks - 1) / chunks
+        var lower = [Float](repeating: .infinity, count: chunks * channels)
+        var upper = [Float](repeating: -.infinity, count: chunks * channels)
+        let p = x.read()
+
+        lower.withUnsafeMutableBufferPointer { lower in
+            upper.withUnsafeMutableBufferPointer { upper in
+                DispatchQueue.concurrentPerform(iterations: chunks) { chunk in
+                    let base = chunk * channels
+                    let end = Swift.min((chunk + 1) * chunkSize, count)
+                    var i = chunk * chunkSize
+                    while i < end {
+                        let c = (i / inner) % channels
+                        let v = E.value(at: i, from: p[i])
+                        lower[base + c] = Swift.min(lower[base + c], v)
+                        upper[base + c] = Swift.max(upper[base + c], v)
+                        i += 1
+                    }
+                }
+            }
+        }
+        
+        // combine the chunk partials
+        for chunk in 1..<Swift.max(1, chunks) {
+            for c in 0..<channels {
+                lower[c] = Swift.min(lower[c], lower[chunk * channels + c])
+                upper[c] = Swift.max(upper[c], upper[chunk * channels + c])
+            }
+        }
+        return (Array(lower[0..<channels]), Array(upper[0..<channels]))
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_quantize
+    /// computes `clamp(round(x / scale) + zeroPoint)` element wise
+    /// in parallel chunks
+    @inlinable func cpu_quantize<S,E,Q>(
+        _ x: Tensor<S,E>,
+        _ scales: [Float],
+        _ zeroPoints: [Int32],
+        _ axis: Int?,
+        _ out: inout Tensor<S,Q>
+    ) where E.Value == Float, Q.Value: FixedWidthInteger {
+        diagnostic(.queueCpu, "quantize(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(x.isContiguous && out.isContiguous && x.order == .row,
+               "quantization requires contiguous row major data")
+        let (channels, inner) = _channelLayout(x.shape, axis)
+        let inverseScales = scales.map { 1 / $0 }
+        let zeros = zeroPoints.map { Float($0) }
+        let qmin = Float(Q.Value.min), qmax = Float(Q.Value.max)
+        let xBase = E.alignment(x.storageBase)
+        let outBase = Q.alignment(out.storageBase)
+        let src = x.read(using: currentQueue)
+        let dst = out.readWrite(using: currentQueue)
+
+        cpu_parallel(count: x.count) { range in
+            for i in range {
+                let c = (i / inner) % channels
+                let xi = xBase &+ i, oi = outBase &+ i
+                let v = E.value(at: xi, from: src[E.storedIndex(xi)])
+                let q = Swift.min(qmax, Swift.max(qmin,
+                            (v * inverseScales[c]).rounded() + zeros[c]))
+                Q.store(value: Q.Value(q), at: oi, to: &dst[Q.storedIndex(oi)])
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_dequantize
+    /// computes `scale * (x - zeroPoint)` element wise in parallel chunks
+    @inlinable func cpu_dequantize<S,Q,E>(
+        _ x: Tensor<S,Q>,
+        _ scales: [Float],
+        _ zeroPoints: [Int32],
+        _ axis: Int?,
+        _ out: inout Tensor<S,E>
+    ) where Q.Value: FixedWidthInteger, E.Value == Float {
+        diagnostic(.queueCpu, "dequantize(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(x.isContiguous && out.isContiguous && x.order == .row,
+               "quantization requires contiguous row major data")
+        let (channels, inner) = _channelLayout(x.shape, axis)
+        let zeros = zeroPoints.map { Float($0) }
+        let xBase = Q.alignment(x.storageBase)
+        let outBase = E.alignment(out.storageBase)
+        let src = x.read(using: currentQueue)
+        let dst = out.readWrite(using: currentQueue)
+
+        cpu_parallel(count: x.count) { range in
+            for i in range {
+                let c = (i / inner) % channels
+                let xi = xBase &+ i, oi = outBase &+ i
+                let q = Q.value(at: xi, from: src[Q.storedIndex(xi)])
+                let v = scales[c] * (Float(q) - zeros[c])
+                E.store(value: v, at: oi, to: &dst[E.storedIndex(oi)])
+            }
+        }
+    }
+}
+
+//==============================================================================
+/// cpu_gemmInt32
+/// A quantized general matrix multiply. The zero points are subtracted as
+/// the `lhs` rows and `rhs` panels are packed into `Int32` buffers, and the
+/// products are accumulated as `Int32` in blocks along `K` that are short
+/// enough not to overflow, which are added to `Int64` totals. For 8 bit
+/// values a block is over 30,000 deep, so most problems have one block.
+/// Each accumulated row segment is scaled back to `Float` by `lhsScale * rhsScales[column]` and passed to
+/// the `epilogue`, which applies any bias and activation and stores it.
+/// The work is split into row tiles that are distributed across the
+/// available cores in the same way as `cpu_gemm`.
+extension DeviceQueue {
+    @inlinable func cpu_gemmInt32<LE,RE>(
+        _ lhs: CpuMatrix<LE>, _ lhsScale: Float, _ lhsZero: Int32,
+        _ rhs: CpuMatrix<RE>, _ rhsScales: [Float], _ rhsZeros: [Int32],
+        epilogue: @escaping CpuGemmEpilogue<Float>
+    ) where LE.Value: FixedWidthInteger, RE.Value: FixedWidthInteger {
+        let M = lhs.rows, N = rhs.cols, K = lhs.cols
+        assert(rhs.rows == K, "matmul inner dimensions must be equal")
+        assert(rhsScales.count == 1 || rhsScales.count == N,
+               "rhs must be quantized per tensor or per column")
+        let perColumn = rhsScales.count == N && N > 1
+        let (tilesPerBatch, tileRows, tileCols) = _gemmPartition(1, M, N, K)
+        let scales = rhsScales.map { $0 * lhsScale }
+
+        // the largest magnitudes of the values with the zero points removed
+        func magnitude<T: FixedWidthInteger>(
+            _: T.Type, _ zero: Int32
+        ) -> Int64 {
+            Swift.max(Int64(T.max) - Int64(zero), Int64(zero) - Int64(T.min))
+        }
+        let lhsMagnitude = magnitude(LE.Value.self, lhsZero)
+        let rhsMagnitude = rhsZeros.map { magnitude(RE.Value.self, $0) }.max()!
+        let depth = Swift.max(1, Int(Int64(Int32.max) /
+            Swift.max(1, lhsMagnitude * rhsMagnitude)))
+
+        func tile(_ item: Int) {
+            let rowStart = item * tileRows
+            let rowEnd = Swift.min(rowStart + tileRows, M)
+            guard rowStart < rowEnd else { return }
+
+            let acc = UnsafeMutableBufferPointer<Int32>
+                .allocate(capacity: tileCols)
+            let total = UnsafeMutableBufferPointer<Int64>
+                .allocate(capacity: tileCols)
+            let real = UnsafeMutableBufferPointer<Float>
+                .allocate(capacity: tileCols)
+            let row = UnsafeMutableBufferPointer<Int32>.allocate(capacity: K)
+            let panel = UnsafeMutableBufferPointer<Int32>
+                .allocate(capacity: K * tileCols)
+            defer {
+                acc.deallocate()
+                total.deallocate()
+                real.deallocate()
+                row.deallocate()
+                panel.deallocate()
+            }
+
+            var colStart = 0
+            while colStart < N {
+                let colEnd = Swift.min(colStart + tileCols, N)
+                let cols = colEnd - colStart
+
+                // pack the rhs panel with the zero points removed
+                for k in 0..<K {
+                    let pk = k &* cols
+                    for j in 0..<cols {
+                        let zero = rhsZeros[perColumn ? colStart &+ j : 0]
+                        panel[pk &+ j] = Int32(truncatingIfNeeded:
+                            rhs[0, k, colStart &+ j]) &- zero
+                    }
+                }
+
+                for r in rowStart..<rowEnd {
+                    for k in 0..<K {
+                        row[k] = Int32(truncatingIfNeeded: lhs[0, r, k]) &- lhsZero
+                    }
+                    for j in 0..<cols { total[j] = 0 }
+                    var kStart = 0
+                    while kStart < K {
+                        let kEnd = Swift.min(kStart &+ depth, K)
+                        for j in 0..<cols { acc[j] = 0 }
+                        for k in kStart..<kEnd {
+                            let a = row[k]
+                            let pk = k &* cols
+                            for j in 0..<cols { acc[j] &+= a &* panel[pk &+ j] }
+                        }
+                        for j in 0..<cols { total[j] &+= Int64(acc[j]) }
+                        kStart = kEnd
+                    }
+                    for j in 0..<cols {
+                        real[j] = Float(total[j]) *
+                            scales[perColumn ? colStart &+ j : 0]
+                    }
+                    epilogue(UnsafeMutableBufferPointer(rebasing: real[0..<cols]),
+                             0, r, colStart)
+                }
+                colStart = colEnd
+            }
+        }
+
+        cpu_parallel(tilesPerBatch, tile)
+    }
+}
+
+//==============================================================================
+// quantized matmul
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// quantized matmul with the result dequantized, and the optional
+    /// bias and activation applied in the epilogue
+    @inlinable func cpu_matmul<LQ,RQ,E>(
+        _ lhs: QuantizedTensor<Shape2,LQ>,
+        _ rhs: QuantizedTensor<Shape2,RQ>,
+        bias: TensorR1<Float>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(lhs.isPerTensor && (rhs.isPerTensor || rhs.axis == 1),
+               "lhs must be quantized per tensor, and rhs per tensor or column")
+        let b = bias.map { CpuMatrix($0) }
+        let o = CpuMatrix(mutating: &out)
+
+        cpu_gemmInt32(CpuMatrix(lhs.values), lhs.scales[0], lhs.zeroPoints[0],
+                      CpuMatrix(rhs.values), rhs.scales, rhs.zeroPoints)
+        { real, _, row, col in
+            if let b = b {
+                for j in real.indices { real[j] += b[0, 0, col &+ j] }
+            }
+            activation.apply(real, ceiling: reluCeiling)
+            for j in real.indices { o[0, row, col &+ j] = real[j] }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// quantized matmul with the result requantized in the epilogue
+    @inlinable func cpu_matmul<LQ,RQ,OQ>(
+        _ lhs: QuantizedTensor<Shape2,LQ>,
+        _ rhs: QuantizedTensor<Shape2,RQ>,
+        bias: TensorR1<Float>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        scale: Float,
+        zeroPoint: Int32,
+        _ out: inout TensorR2<OQ>
+    ) where OQ.Value: FixedWidthInteger {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(lhs.isPerTensor && (rhs.isPerTensor || rhs.axis == 1),
+               "lhs must be quantized per tensor, and rhs per tensor or column")
+        let b = bias.map { CpuMatrix($0) }
+        let o = CpuMatrix(mutating: &out)
+        let inverseScale = 1 / scale, zero = Float(zeroPoint)
+        let qmin = Float(OQ.Value.min), qmax = Float(OQ.Value.max)
+
+        cpu_gemmInt32(CpuMatrix(lhs.values), lhs.scales[0], lhs.zeroPoints[0],
+                      CpuMatrix(rhs.values), rhs.scales, rhs.zeroPoints)
+        { real, _, row, col in
+            if let b = b {
+                for j in real.indices { real[j] += b[0, 0, col &+ j] }
+            }
+            activation.apply(real, ceiling: reluCeiling)
+            for j in real.indices {
+                let q = Swift.min(qmax, Swift.max(qmin,
+                            (real[j] * inverseScale).rounded() + zero))
+                o[0, row, col &+ j] = OQ.Value(q)
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue quantization delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func quantizationRange<S,E>(
+        _ x: Tensor<S,E>,
+        axis: Int?
+    ) -> (lower: [Float], upper: [Float]) where E.Value == Float {
+        cpu_quantizationRange(x, axis: axis)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func quantize<S,E,Q>(
+        _ x: Tensor<S,E>,
+        _ scales: [Float],
+        _ zeroPoints: [Int32],
+        _ axis: Int?,
+        _ out: inout Tensor<S,Q>
+    ) where E.Value == Float, Q.Value: FixedWidthInteger {
+        cpu_quantize(x, scales, zeroPoints, axis, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func dequantize<S,Q,E>(
+        _ x: Tensor<S,Q>,
+        _ scales: [Float],
+        _ zeroPoints: [Int32],
+        _ axis: Int?,
+        _ out: inout Tensor<S,E>
+    ) where Q.Value: FixedWidthInteger, E.Value == Float {
+        cpu_dequantize(x, scales, zeroPoints, axis, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<LQ,RQ,E>(
+        _ lhs: QuantizedTensor<Shape2,LQ>,
+        _ rhs: QuantizedTensor<Shape2,RQ>,
+        bias: TensorR1<Float>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        cpu_matmul(lhs, rhs, bias: bias, activation: activation,
+                   reluCeiling: reluCeiling, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<LQ,RQ,OQ>(
+        _ lhs: QuantizedTensor<Shape2,LQ>,
+        _ rhs: QuantizedTensor<Shape2,RQ>,
+        bias: TensorR1<Float>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        scale: Float,
+        zeroPoint: Int32,
+        _ out: inout TensorR2<OQ>
+    ) where OQ.Value: FixedWidthInteger {
+        cpu_matmul(lhs, rhs, bias: bias, activation: activation,
+                   reluCeiling: reluCeiling, scale: scale,
+                   zeroPoint: zeroPoint, &out)
+    }
+}
+
+//==============================================================================
+// cpu 4 bit group quantization kernels
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_groupQuantize
+    /// quantizes each row of `x` in groups of `groupSize` values to 4 bits.
+    /// The last group of a row is shorter when the row size is not a
+    /// multiple of `groupSize`. Rows are distributed across the available
+    /// cores, and pairs of values are written as whole bytes. This
+    /// function blocks until the result is available.
+    /// - Returns: the scale and offset for each group
+    @inlinable func cpu_groupQuantize<E>(
+        _ x: TensorR2<E>,
+        _ groupSize: Int,
+        _ out: inout TensorR2<UInt4>
+    ) -> (scales: [Float], offsets: [Float]) where E.Value == Float {
+        diagnostic(.queueCpu, "groupQuantize(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(out.isContiguous && out.storageBase % 2 == 0)
+        waitForCompletion()
+        let rows = x.shape[0], cols = x.shape[1]
+        let groups = (cols + groupSize - 1) / groupSize
+        let src = CpuMatrix(x)
+        let dst = out.readWrite(using: currentQueue)
+        var scales = [Float](repeating: 0, count: rows * groups)
+        var offsets = [Float](repeating: 0, count: rows * groups)
+        
+        scales.withUnsafeMutableBufferPointer { scales in
+            offsets.withUnsafeMutableBufferPointer { offsets in
+                DispatchQueue.concurrentPerform(iterations: rows) { r in
+                    for g in 0..<groups {
+                        let start = g * groupSize, gi = r * groups + g
+                        let end = Swift.min(start + groupSize, cols)
+                        var lo = Float.infinity, hi = -Float.infinity
+                        for c in start..<end {
+                            lo = Swift.min(lo, src[0, r, c])
+                            hi = Swift.max(hi, src[0, r, c])
+                        }
+                        let scale: Float = hi > lo ? (hi - lo) / 15 : 1
+                        let inverse = 1 / scale
+                        scales[gi] = scale
+                        offsets[gi] = lo
+
+                        // write two values per byte, low nibble first
+                        var c = start
+                        while c < end {
+                            let q0 = UInt8(Swift.min(15, Swift.max(0,
+                                ((src[0, r, c] - lo) * inverse).rounded())))
+                            let q1 = UInt8(Swift.min(15, Swift.max(0,
+                                ((src[0, r, c + 1] - lo) * inverse).rounded())))
+                            dst[(r * cols + c) >> 1] = q0 | (q1 << 4)
+                            c += 2
+                        }
+                    }
+                }
+            }
+        }
+        return (scales, offsets)
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_groupDequantize
+    /// expands all rows, or the selected `rows`, of a 4 bit group
+    /// quantized matrix to real values
+    @inlinable func cpu_groupDequantize<E>(
+        _ x: GroupQuantizedTensor,
+        _ rows: [Int]?,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        diagnostic(.queueCpu, "groupDequantize(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        let cols = x.shape[1], groupSize = x.groupSize
+        let groups = x.groupsPerRow
+        let scales = x.scales, offsets = x.offsets
+        let src = x.values.read(using: currentQueue)
+        let o = CpuMatrix(mutating: &out)
+
+        cpu_parallel(rows?.count ?? x.shape[0]) { i in
+            let r = rows?[i] ?? i
+            assert(r >= 0 && r < x.shape[0], "row index is out of range")
+            for c in stride(from: 0, to: cols, by: 2) {
+                let gi = r * groups + c / groupSize
+                let byte = src[(r * cols + c) >> 1]
+                o[0, i, c] = Float(byte & 0x0F) * scales[gi] + offsets[gi]
+                o[0, i, c + 1] = Float(byte >> 4) * scales[gi] + offsets[gi]
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// computes `lhs x rhs^T` where `rhs` is 4 bit group quantized.
+    /// The output columns are distributed across the available cores.
+    /// Each group of `rhs` values is loaded 16 at a time as a 64 bit word
+    /// and unpacked into an L1 buffer, then applied to every `lhs` row.
+    /// Because `real = scale * q + offset`, each group contributes
+    /// `scale * dot(x, q) + offset * sum(x)`, so the offset is applied
+    /// once per group using the precomputed group sums of `lhs`.
+    /// The optional bias and activation are applied to each finished column.
+    @inlinable func cpu_matmul<E>(
+        _ lhs: TensorR2<E>,
+        _ rhs: GroupQuantizedTensor,
+        bias: TensorR1<E>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        let M = lhs.shape[0], K = lhs.shape[1], N = rhs.shape[0]
+        let groupSize = rhs.groupSize, groups = rhs.groupsPerRow
+        let scales = rhs.scales, offsets = rhs.offsets
+        let x = CpuMatrix(lhs)
+        let b = bias.map { CpuMatrix($0) }
+        let o = CpuMatrix(mutating: &out)
+        let w = UnsafeRawPointer(rhs.values.read(using: currentQueue).baseAddress!)
+        let chunks = Swift.max(1, Swift.min(
+            ProcessInfo.processInfo.activeProcessorCount, N / 8))
+        let chunkSize = (N + chunks - 1) / chunks
+
+        cpu_parallel(chunks) { chunk in
+            let n0 = chunk * chunkSize, n1 = Swift.min(n0 + chunkSize, N)
+            guard n0 < n1 else { return }
+
+            // pack lhs and compute the group sums
+            let xs = UnsafeMutableBufferPointer<Float>.allocate(capacity: M * K)
+            let sums = UnsafeMutableBufferPointer<Float>
+                .allocate(capacity: M * groups)
+            let q = UnsafeMutableBufferPointer<Float>.allocate(capacity: groupSize)
+            let acc = UnsafeMutableBufferPointer<Float>.allocate(capacity: M)
+            defer {
+                xs.deallocate()
+                sums.deallocate()
+                q.deallocate()
+                acc.deallocate()
+            }
+            for m in 0..<M {
+                for g in 0..<groups {
+                    var sum: Float = 0
+                    let end = Swift.min((g + 1) * groupSize, K)
+                    for k in (g * groupSize)..<end {
+                        let v = x[0, m, k]
+                        xs[m * K + k] = v
+                        sum += v
+                    }
+                    sums[m * groups + g] = sum
+                }
+            }
+
+            for n in n0..<n1 {
+                for m in 0..<M { acc[m] = 0 }
+                let rowBytes = n * K / 2
+                for g in 0..<groups {
+                    // unpack the group a word at a time. The last group
+                    // of a row can be shorter, but is whole words.
+                    let size = Swift.min(groupSize, K - g * groupSize)
+                    let groupBytes = rowBytes + g * groupSize / 2
+                    for wi in 0..<(size / 16) {
+                        var bits = w.load(fromByteOffset: groupBytes + wi * 8,
+                                          as: UInt64.self).littleEndian
+                        for t in 0..<16 {
+                            q[wi * 16 + t] = Float(bits & 0x0F)
+                            bits >>= 4
+                        }
+                    }
+                    
+                    let gi = n * groups + g
+                    let scale = scales[gi], offset = offsets[gi]
+                    for m in 0..<M {
+                        let xg = m * K + g * groupSize
+                        var dot: Float = 0
+                        for k in 0..<size { dot += xs[xg + k] * q[k] }
+                        acc[m] += scale * dot + offset * sums[m * groups + g]
+                    }
+                }
+                if let b = b {
+                    let bn = b[0, 0, n]
+                    for m in 0..<M { acc[m] += bn }
+                }
+                activation.apply(acc, ceiling: reluCeiling)
+                for m in 0..<M { o[0, m, n] = acc[m] }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue 4 bit group quantization delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func groupQuantize<E>(
+        _ x: TensorR2<E>,
+        _ groupSize: Int,
+        _ out: inout TensorR2<UInt4>
+    ) -> (scales: [Float], offsets: [Float]) where E.Value == Float {
+        cpu_groupQuantize(x, groupSize, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func groupDequantize<E>(
+        _ x: GroupQuantizedTensor,
+        _ rows: [Int]?,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        cpu_groupDequantize(x, rows, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<E>(
+        _ lhs: TensorR2<E>,
+        _ rhs: GroupQuantizedTensor,
+        bias: TensorR1<E>?,
+        activation: ActivationType,
+        reluCeiling: Float,
+        _ out: inout TensorR2<E>
+    ) where E.Value == Float {
+        cpu_matmul(lhs, rhs, bias: bias, activation: activation,
+                   reluCeiling: reluCeiling, &out)
+    }
+}
@@ -0,0 +1,282 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+// cpu recurrent cell kernels
+// The pointwise part of a recurrent cell follows the gate projection
+// gemm. Computing it with separate element wise ops creates a temporary
+// and a pass over memory for every slice, activation, multiply, and add.
+// These kernels read the gate pre-activations and the previous state once
+// and write the new state in a single pass. The backward kernels recompute
+// the gate activations from the pre-activations instead of saving them.
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_lstmPointwise
+    /// computes the new LSTM cell and hidden states
+    ///
+    ///     i = sigmoid(a_i), g = tanh(a_g), f = sigmoid(a_f), o = sigmoid(a_o)
+    ///     cell = f * previousCell + i * g
+    ///     hidden = o * tanh(cell)
+    ///
+    /// - Parameters:
+    ///  - gates: the `[batch, 4 * hidden]` gate pre-activations, ordered as
+    ///    input, update, forget, and output
+    ///  - cell: the previous cell state
+    ///  - newCell: the new cell state
+    ///  - hidden: the new hidden state
+    @inlinable func cpu_lstmPointwise<E>(
+        _ gates: TensorR2<E>,
+        _ cell: TensorR2<E>,
+        _ newCell: inout TensorR2<E>,
+        _ hidden: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "lstmPointwise(\(gates.name)) on \(name)",
+                   categories: .queueCpu)
+        let B = cell.shape[0], H = cell.shape[1]
+        let a = CpuMatrix(dense: gates, 1, B, 4 * H)
+        let c0 = CpuMatrix(dense: cell, 1, B, H)
+        let c1 = CpuMatrix(mutatingDense: &newCell, 1, B, H)
+        let h1 = CpuMatrix(mutatingDense: &hidden, 1, B, H)
+
+        cpu_parallel(count: B * H) { range in
+            var b = range.lowerBound / H, j = range.lowerBound % H
+            for _ in range {
+                let i = _sigmoid(a[0, b, j])
+                let g = E.Value.tanh(a[0, b, H &+ j])
+                let f = _sigmoid(a[0, b, 2 &* H &+ j])
+                let o = _sigmoid(a[0, b, 3 &* H &+ j])
+                let c = f * c0[0, b, j] + i * g
+                c1[0, b, j] = c
+                h1[0, b, j] = o * .tanh(c)
+                j &+= 1
+                if j == H { j = 0; b &+= 1 }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_lstmPointwiseGradient
+    /// computes the gradients of the gate pre-activations and the previous
+    /// cell state. Only the inputs and the new cell state are needed.
+    /// - Parameters:
+    ///  - gates: the gate pre-activations
+    ///  - cell: the previous cell state
+    ///  - newCell: the new cell state
+    ///  - hiddenDiff: the gradient of the new hidden state
+    ///  - cellDiff: the gradient of the new cell state
+    ///  - gatesDiff: the gradient of the gate pre-activations
+    ///  - cellPreviousDiff: the gradient of the previous cell state
+    @inlinable func cpu_lstmPointwiseGradient<E>(
+        _ gates: TensorR2<E>,
+        _ cell: TensorR2<E>,
+        _ newCell: TensorR2<E>,
+        _ hiddenDiff: TensorR2<E>,
+        _ cellDiff: TensorR2<E>,
+        _ gatesDiff: inout TensorR2<E>,
+        _ cellPreviousDiff: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "lstmPointwiseGradient(\(gates.name)) " +
+                    "on \(name)", categories: .queueCpu)
+        let B = cell.shape[0], H = cell.shape[1]
+        let a = CpuMatrix(dense: gates, 1, B, 4 * H)
+        let c0 = CpuMatrix(dense: cell, 1, B, H)
+        let c1 = CpuMatrix(dense: newCell, 1, B, H)
+        let dh = CpuMatrix(dense: hiddenDiff, 1, B, H)
+        let dc = CpuMatrix(dense: cellDiff, 1, B, H)
+        let da = CpuMatrix(mutatingDense: &gatesDiff, 1, B, 4 * H)
+        let dc0 = CpuMatrix(mutatingDense: &cellPreviousDiff, 1, B, H)
+
+        cpu_parallel(count: B * H) { range in
+            var b = range.lowerBound / H, j = range.lowerBound % H
+            for _ in range {
+                let i = _sigmoid(a[0, b, j])
+                let g = E.Value.tanh(a[0, b, H &+ j])
+                let f = _sigmoid(a[0, b, 2 &* H &+ j])
+                let o = _sigmoid(a[0, b, 3 &* H &+ j])
+                let tc = E.Value.tanh(c1[0, b, j])
+                let dhj = dh[0, b, j]
+
+                // the total gradient of the new cell state
+                let dcj = dc[0, b, j] + dhj * o * (1 - tc * tc)
+                da[0, b, j] = dcj * g * i * (1 - i)
+                da[0, b, H &+ j] = dcj * i * (1 - g * g)
+                da[0, b, 2 &* H &+ j] = dcj * c0[0, b, j] * f * (1 - f)
+                da[0, b, 3 &* H &+ j] = dhj * tc * o * (1 - o)
+                dc0[0, b, j] = dcj * f
+                j &+= 1
+                if j == H { j = 0; b &+= 1 }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_gruPointwise
+    /// computes the new GRU state from the input and state projections
+    ///
+    ///     z = sigmoid(x_z + h_z), r = sigmoid(x_r + h_r)
+    ///     n = tanh(x_n + r * h_n)
+    ///     newState = (1 - z) * state + z * n
+    ///
+    /// - Parameters:
+    ///  - inputGates: the `[batch, 3 * hidden]` input projections, including
+    ///    the biases, ordered as update, reset, and output
+    ///  - stateGates: the `[batch, 3 * hidden]` state projections
+    ///  - state: the previous state
+    ///  - newState: the new state
+    @inlinable func cpu_gruPointwise<E>(
+        _ inputGates: TensorR2<E>,
+        _ stateGates: TensorR2<E>,
+        _ state: TensorR2<E>,
+        _ newState: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "gruPointwise(\(inputGates.name)) on \(name)",
+                   categories: .queueCpu)
+        let B = state.shape[0], H = state.shape[1]
+        let x = CpuMatrix(dense: inputGates, 1, B, 3 * H)
+        let h = CpuMatrix(dense: stateGates, 1, B, 3 * H)
+        let h0 = CpuMatrix(dense: state, 1, B, H)
+        let h1 = CpuMatrix(mutatingDense: &newState, 1, B, H)
+
+        cpu_parallel(count: B * H) { range in
+            var b = range.lowerBound / H, j = range.lowerBound % H
+            for _ in range {
+                let z = _sigmoid(x[0, b, j] + h[0, b, j])
+                let r = _sigmoid(x[0, b, H &+ j] + h[0, b, H &+ j])
+                let n = E.Value.tanh(x[0, b, 2 &* H &+ j] +
+                                        r * h[0, b, 2 &* H &+ j])
+                h1[0, b, j] = (1 - z) * h0[0, b, j] + z * n
+                j &+= 1
+                if j == H { j = 0; b &+= 1 }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_gruPointwiseGradient
+    /// computes the gradients of the input and state projections and the
+    /// direct gradient of the previous state. The gradient through the
+    /// state projection is added by the caller.
+    /// - Parameters:
+    ///  - inputGates: the input projections
+    ///  - stateGates: the state projections
+    ///  - state: the previous state
+    ///  - newStateDiff: the gradient of the new state
+    ///  - inputGatesDiff: the gradient of the input projections
+    ///  - stateGatesDiff: the gradient of the state projections
+    ///  - stateDiff: the direct gradient of the previous state
+    @inlinable func cpu_gruPointwiseGradient<E>(
+        _ inputGates: TensorR2<E>,
+        _ stateGates: TensorR2<E>,
+        _ state: TensorR2<E>,
+        _ newStateDiff: TensorR2<E>,
+        _ inputGatesDiff: inout TensorR2<E>,
+        _ stateGatesDiff: inout TensorR2<E>,
+        _ stateDiff: inout TensorR2<E>
+    ) where E.Value: Real {
+        diagnostic(.queueCpu, "gruPointwiseGradient(\(inputGates.name)) " +
+                    "on \(name)", categories: .queueCpu)
+        let B = state.shape[0], H = state.shape[1]
+        let x = CpuMatrix(dense: inputGates, 1, B, 3 * H)
+        let h = CpuMatrix(dense: stateGates, 1, B, 3 * H)
+        let h0 = CpuMatrix(dense: state, 1, B, H)
+        let dh1 = CpuMatrix(dense: newStateDiff, 1, B, H)
+        let dx = CpuMatrix(mutatingDense: &inputGatesDiff, 1, B, 3 * H)
+        let dh = CpuMatrix(mutatingDense: &stateGatesDiff, 1, B, 3 * H)
+        let dh0 = CpuMatrix(mutatingDense: &stateDiff, 1, B, H)
+
+        cpu_parallel(count: B * H) { range in
+            var b = range.lowerBound / H, j = range.lowerBound % H
+            for _ in range {
+                let hn = h[0, b, 2 &* H &+ j]
+                let z = _sigmoid(x[0, b, j] + h[0, b, j])
+                let r = _sigmoid(x[0, b, H &+ j] + h[0, b, H &+ j])
+                let n = E.Value.tanh(x[0, b, 2 &* H &+ j] + r * hn)
+                let d = dh1[0, b, j]
+
+                let dz = d * (n - h0[0, b, j]) * z * (1 - z)
+                let dn = d * z * (1 - n * n)
+                let dr = dn * hn * r * (1 - r)
+                dx[0, b, j] = dz
+                dx[0, b, H &+ j] = dr
+                dx[0, b, 2 &* H &+ j] = dn
+                dh[0, b, j] = dz
+                dh[0, b, H &+ j] = dr
+                dh[0, b, 2 &* H &+ j] = dn * r
+                dh0[0, b, j] = d * (1 - z)
+                j &+= 1
+                if j == H { j = 0; b &+= 1 }
+            }
+        }
+    }
+}
+
+//==============================================================================
+/// _sigmoid
+@inlinable func _sigmoid<T: Real>(_ x: T) -> T { 1 / (1 + .exp(-x)) }
+
+//==============================================================================
+// DeviceQueue cpu recurrent delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func lstmPointwise<E>(
+        _ gates: TensorR2<E>,
+        _ cell: TensorR2<E>,
+        _ newCell: inout TensorR2<E>,
+        _ hidden: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_lstmPointwise(gates, cell, &newCell, &hidden)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func lstmPointwiseGradient<E>(
+        _ gates: TensorR2<E>,
+        _ cell: TensorR2<E>,
+        _ newCell: TensorR2<E>,
+        _ hiddenDiff: TensorR2<E>,
+        _ cellDiff: TensorR2<E>,
+        _ gatesDiff: inout TensorR2<E>,
+        _ cellPreviousDiff: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_lstmPointwiseGradient(gates, cell, newCell, hiddenDiff, cellDiff,
+                                  &gatesDiff, &cellPreviousDiff)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func gruPointwise<E>(
+        _ inputGates: TensorR2<E>,
+        _ stateGates: TensorR2<E>,
+        _ state: TensorR2<E>,
+        _ newState: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_gruPointwise(inputGates, stateGates, state, &newState)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable func gruPointwiseGradient<E>(
+        _ inputGates: TensorR2<E>,
+        _ stateGates: TensorR2<E>,
+        _ state: TensorR2<E>,
+        _ newStateDiff: TensorR2<E>,
+        _ inputGatesDiff: inout TensorR2<E>,
+        _ stateGatesDiff: inout TensorR2<E>,
+        _ stateDiff: inout TensorR2<E>
+    ) where E.Value: Real {
+        cpu_gruPointwiseGradient(inputGates, stateGates, state, newStateDiff,
+                                 &inputGatesDiff, &stateGatesDiff, &stateDiff)
+    }
+}
@@ -21,26 +21,78 @@ import Numerics
 extension CpuFunctions where Self: DeviceQueue {
     
     //--------------------------------------------------------------------------
+    /// mapReduce
+    /// reduces all elements of `a` into the first element of `out`.
+    /// Large tensors are split into contiguous chunks that are reduced in
+    /// parallel, where the number of chunks is selected by
+    /// `CpuReductionPlanner` on the first call for each `opId` and
+    /// tensor layout.
+    /// - Parameters:
+    ///  - a: the tensor to reduce
+    ///  - out: the output
+    ///  - opName: the operation name used for logging
+    ///  - opId: the reduction operation, used to key the plan
+    ///  - op: combines two values
+    ///  - opFinal: an optional final operation on the result
     @inlinable public func mapReduce<S,E>(
         _ a: Tensor<S,E>,
         _ out: inout Tensor<S,E>,
         _ opName: String,
-        _ op: @escaping (E.Value, E.Value) -> E.Value
+        _ opId: ReductionOp,
+        _ op: @escaping (E.Value, E.Value) -> E.Value,
+        _ opFinal: ((E.Value) -> E.Value)?
     ) {
         diagnostic(.queueCpu, "\(opName) on \(name)", categories: .queueCpu)
+        var key = ExecutionPlanKey("reduce")
+        key.combine(opId.rawValue)
+        key.combine(a)
+        let count = a.count
         let a = a.buffer
         var out = out.mutableBuffer
-        
-        if mode == .sync {
-            out[out.startIndex] = a.reduce(into: a[a.startIndex]) {
-                $0 = op($0, $1)
+
+        // reduces the elements `a.startIndex + range`
+        func reduce(_ range: Range<Int>) -> E.Value {
+            var i = a.startIndex &+ range.lowerBound
+            let end = a.startIndex &+ range.upperBound
+            var result = a[i]
+            i &+= 1
+            while i < end {
+                result = op(result, a[i])
+                i &+= 1
             }
-        } else {
-            queue.async(group: group) {
-                out[out.startIndex] = a.reduce(into: a[a.startIndex]) {
-                    $0 = op($0, $1)
+            return result
+        }
+
+        func reduce(_ plan: CpuReductionPlan) -> E.Value {
+            guard plan.chunks > 1 else { return reduce(0..<count) }
+            let chunkSize = (count + plan.chunks - 1) / plan.chunks
+            let chunks = (count + chunkSize - 1) / chunkSize
+            var partials = [E.Value?](repeating: nil, count: chunks)
+            partials.withUnsafeMutableBufferPointer { partials in
+                DispatchQueue.concurrentPerform(iterations: chunks) { c in
+                    let start = c * chunkSize
+                    partials[c] = reduce(
+                        start..<Swift.min(start + chunkSize, count))
                 }
             }
+            return partials.dropFirst().reduce(partials[0]!) { op($0, $1!) }
+        }
+
+        // the plan is tuned on the first call with the real data
+        func execute() {
+            let planner = CpuReductionPlanner(operands: key, count: count) {
+                let start = DispatchTime.now().uptimeNanoseconds
+                _ = reduce($0)
+                return Double(DispatchTime.now().uptimeNanoseconds - start)
+            }
+            let result = reduce(planner.plan(key.key))
+            out[out.startIndex] = opFinal?(result) ?? result
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
         }
     }
     
@@ -49,7 +101,8 @@ extension CpuFunctions where Self: DeviceQueue {
         _ x: Tensor<S,Bool>,
         _ out: inout Tensor<S,Bool>
     ) {
-        mapReduce(x, &out, "all(\(x.name))") { $0 && $1 }
+        mapReduce(x, &out, "all(\(x.name))", .min,
+                  { $0 && $1 }, nil)
     }
     
     //--------------------------------------------------------------------------
@@ -57,7 +110,8 @@ extension CpuFunctions where Self: DeviceQueue {
         _ x: Tensor<S,Bool>,
         _ out: inout Tensor<S,Bool>
     ) {
-        mapReduce(x, &out, "any(\(x.name))") { $0 || $1 }
+        mapReduce(x, &out, "any(\(x.name))", .max,
+                  { $0 || $1 }, nil)
     }
     
     //--------------------------------------------------------------------------
@@ -65,33 +119,18 @@ extension CpuFunctions where Self: DeviceQueue {
         _ x: Tensor<S,E>,
         _ out: inout Tensor<S,E>
     ) where E.Value: AdditiveArithmetic {
-        mapReduce(x, &out, "sum(\(x.name))") { $0 + $1 }
+        mapReduce(x, &out, "sum(\(x.name))", .add,
+                  { $0 + $1 }, nil)
     }
     
     //--------------------------------------------------------------------------
-    // this doesn't use `mapReduce` because it has to do a final op on
-    // the reduction result inside the async closure
-    //
     @inlinable public func cpu_reduceMean<S,E>(
         _ x: Tensor<S,E>,
         _ out: inout Tensor<S,E>
     ) where E.Value: AlgebraicField {
-        let a = x.buffer
-        var out = out.mutableBuffer
         let count = E.Value(exactly: x.count)!
-        let start = out.startIndex
-        
-        if mode == .sync {
-            let sum = a.reduce(into: a[a.startIndex]) { $0 += $1 }
-            out[start] = sum / count
-        } else {
-            diagnostic(.queueCpu, "mean(\(x.name)) on \(name)",
-                       categories: .queueCpu)
-            queue.async(group: group) {
-                let sum = a.reduce(into: a[a.startIndex]) { $0 += $1 }
-                out[start] = sum / count
-            }
-        }
+        mapReduce(x, &out, "mean(\(x.name))", .mean, { $0 + $1 },
+                  { $0 / count })
     }
     
     //--------------------------------------------------------------------------
@@ -99,7 +138,8 @@ extension CpuFunctions where Self: DeviceQueue {
         _ x: Tensor<S,E>,
         _ out: inout Tensor<S,E>
     ) where E.Value: Comparable {
-        mapReduce(x, &out, "min(\(x.name))") { Swift.min($0, $1) }
+        mapReduce(x, &out, "min(\(x.name))", .min,
+                  { Swift.min($0, $1) }, nil)
     }
     
     //--------------------------------------------------------------------------
@@ -107,7 +147,8 @@ extension CpuFunctions where Self: DeviceQueue {
         _ x: Tensor<S,E>,
         _ out: inout Tensor<S,E>
     ) where E.Value: Comparable {
-        mapReduce(x, &out, "max(\(x.name))") { $0 > $1 ? $0 : $1 }
+        mapReduce(x, &out, "max(\(x.name))", .max,
+                  { $0 > $1 ? $0 : $1 }, nil)
     }
     
     //--------------------------------------------------------------------------
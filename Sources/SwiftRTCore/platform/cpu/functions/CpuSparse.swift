@@ -0,0 +1,406 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// _csrRowChunks
+/// splits the rows of a CSR matrix into contiguous chunks with about the
+/// same number of nonzeros, so rows of very different lengths are still
+/// balanced across the available cores
+/// - Parameters:
+///  - rowOffsets: the CSR row offsets
+///  - work: the number of multiply adds, used to decide if the work is
+///    large enough to run in parallel
+/// - Returns: the row range of each chunk
+@inlinable func _csrRowChunks(_ rowOffsets: [Int], _ work: Int) -> [Range<Int>] {
+    let rows = rowOffsets.count - 1
+    let nonzeros = rowOffsets[rows]
+    let chunks = work < _gemmParallelThreshold ? 1 : Swift.max(1, Swift.min(
+        ProcessInfo.processInfo.activeProcessorCount, rows))
+    guard chunks > 1 else { return [0..<rows] }
+
+    var ranges = [Range<Int>]()
+    var start = 0
+    for c in 1...chunks {
+        // find the first row that starts at or after the target
+        let target = nonzeros * c / chunks
+        var lo = start, hi = rows
+        while lo < hi {
+            let mid = (lo + hi) / 2
+            if rowOffsets[mid] < target { lo = mid + 1 } else { hi = mid }
+        }
+        let end = c == chunks ? rows : lo
+        if end > start { ranges.append(start..<end) }
+        start = end
+    }
+    return ranges
+}
+
+//==============================================================================
+// cpu sparse conversion kernels
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_nonzeros
+    /// finds the nonzero elements of a contiguous row major tensor. The
+    /// elements are counted and then copied in parallel chunks, so the
+    /// result is in row major order. This function blocks until the
+    /// result is available.
+    /// - Returns: the linear position and value of each nonzero
+    @inlinable func cpu_nonzeros<S,E>(
+        _ x: Tensor<S,E>
+    ) -> (positions: [Int], values: TensorR1<E>) where E.Value: Numeric {
+        diagnostic(.queueCpu, "nonzeros(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(x.isContiguous && x.order == .row,
+               "sparse conversion requires contiguous row major data")
+        waitForCompletion()
+        let count = x.count
+        let xBase = E.alignment(x.storageBase)
+        let src = x.read(using: currentQueue)
+        let chunks = Swift.max(1, Swift.min(
+            ProcessInfo.processInfo.activeProcessorCount,
+            count / _parallelMinimumElements))
+        let chunkSize = (count + chunks - 1) / chunks
+
+        @inline(__always) func value(_ i: Int) -> E.Value {
+            let xi = xBase &+ i
+            return E.value(at: xi, from: src[E.storedIndex(xi)])
+        }
+
+        // count the nonzeros in each chunk
+        var counts = [Int](repeating: 0, count: chunks + 1)
+        counts.withUnsafeMutableBufferPointer { counts in
+            DispatchQueue.concurrentPerform(iterations: chunks) { c in
+                var n = 0
+                for i in (c * chunkSize)..<Swift.min((c + 1) * chunkSize, count) {
+                    if value(i) != E.Value.zero { n += 1 }
+                }
+                counts[c + 1] = n
+            }
+        }
+        for c in 0..<chunks { counts[c + 1] += counts[c] }
+
+        // copy the nonzeros
+        var positions = [Int](repeating: 0, count: counts[chunks])
+        var values = TensorR1<E>(shape: Shape1(counts[chunks]), order: .row)
+        let v = CpuMatrix(mutating: &values)
+        positions.withUnsafeMutableBufferPointer { positions in
+            DispatchQueue.concurrentPerform(iterations: chunks) { c in
+                var n = counts[c]
+                for i in (c * chunkSize)..<Swift.min((c + 1) * chunkSize, count) {
+                    let x = value(i)
+                    if x != E.Value.zero {
+                        positions[n] = i
+                        v[0, 0, n] = x
+                        n += 1
+                    }
+                }
+            }
+        }
+        return (positions, values)
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_scatter
+    /// fills a contiguous row major tensor with zeros and then adds
+    /// `values` at the corresponding linear `positions`, which must be
+    /// in increasing order. The values of repeated positions are summed.
+    @inlinable func cpu_scatter<S,E>(
+        _ values: TensorR1<E>,
+        _ positions: [Int],
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "scatter(\(values.name)) on \(name)",
+                   categories: .queueCpu)
+        assert(out.isContiguous && out.order == .row,
+               "sparse conversion requires contiguous row major data")
+        let count = out.count
+        let outBase = E.alignment(out.storageBase)
+        let v = CpuMatrix(values)
+        let dst = out.readWrite(using: currentQueue)
+
+        // positions are in increasing order, so each chunk of the output
+        // is zeroed and then filled by the same thread
+        cpu_parallel(count: count) { range in
+            for i in range {
+                let oi = outBase &+ i
+                E.store(value: E.Value.zero, at: oi, to: &dst[E.storedIndex(oi)])
+            }
+            var lo = 0, hi = positions.count
+            while lo < hi {
+                let mid = (lo + hi) / 2
+                if positions[mid] < range.lowerBound { lo = mid + 1 } else { hi = mid }
+            }
+            var p = lo
+            while p < positions.count && positions[p] < range.upperBound {
+                let oi = outBase &+ positions[p]
+                let si = E.storedIndex(oi)
+                let sum = E.value(at: oi, from: dst[si]) + v[0, 0, p]
+                E.store(value: sum, at: oi, to: &dst[si])
+                p += 1
+            }
+        }
+    }
+}
+
+//==============================================================================
+// cpu sparse math kernels
+extension DeviceQueue {
+    //--------------------------------------------------------------------------
+    /// cpu_matmul
+    /// sparse x dense matrix multiply. The rows of `lhs` are split into
+    /// chunks with balanced nonzero counts that are distributed across the
+    /// available cores. For each nonzero the corresponding `rhs` row is
+    /// scaled and accumulated into the output row, so both dense
+    /// matrices are read and written sequentially.
+    @inlinable func cpu_matmul<E>(
+        _ lhs: CsrMatrix<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "matmul(\(lhs.name), \(rhs.name)) on \(name)",
+                   categories: .queueCpu)
+        typealias T = E.Value
+        let N = rhs.shape[1]
+        let rowOffsets = lhs.rowOffsets, columns = lhs.columns
+        let a = CpuMatrix(lhs.values)
+        let b = CpuMatrix(rhs)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = _csrRowChunks(rowOffsets, lhs.nonzeroCount &* N)
+
+        cpu_parallel(chunks.count) { c in
+            let acc = UnsafeMutableBufferPointer<T>.allocate(capacity: N)
+            defer { acc.deallocate() }
+            for r in chunks[c] {
+                for j in 0..<N { acc[j] = T.zero }
+                for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                    let av = a[0, 0, p], k = columns[p]
+                    for j in 0..<N { acc[j] += av * b[0, k, j] }
+                }
+                for j in 0..<N { o[0, r, j] = acc[j] }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_matmulTransposed
+    /// computes `lhs^T x rhs`, which is the `rhs` gradient of a sparse
+    /// matmul. Each thread owns a range of output columns and scatters
+    /// every nonzero into it, so there are no write conflicts and the
+    /// result is deterministic.
+    @inlinable func cpu_matmulTransposed<E>(
+        _ lhs: CsrMatrix<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "matmulTransposed(\(lhs.name), \(rhs.name)) " +
+                   "on \(name)", categories: .queueCpu)
+        let rows = lhs.shape[0], cols = lhs.shape[1], N = rhs.shape[1]
+        let rowOffsets = lhs.rowOffsets, columns = lhs.columns
+        let a = CpuMatrix(lhs.values)
+        let g = CpuMatrix(rhs)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = lhs.nonzeroCount &* N < _gemmParallelThreshold ? 1 :
+            Swift.max(1, Swift.min(ProcessInfo.processInfo.activeProcessorCount,
+                                   N / 16))
+        let chunkSize = (N + chunks - 1) / chunks
+
+        cpu_parallel(chunks) { c in
+            let j0 = c * chunkSize, j1 = Swift.min(j0 + chunkSize, N)
+            guard j0 < j1 else { return }
+            for k in 0..<cols {
+                for j in j0..<j1 { o[0, k, j] = E.Value.zero }
+            }
+            for r in 0..<rows {
+                for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                    let av = a[0, 0, p], k = columns[p]
+                    for j in j0..<j1 { o[0, k, j] += av * g[0, r, j] }
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_sampledMatmul
+    /// computes `dot(lhs[row], rhs[col])` for the row and column of each
+    /// nonzero in `x`, which is the gradient of the sparse values of a
+    /// sparse matmul when `lhs` is the output gradient and `rhs` is the
+    /// dense operand
+    @inlinable func cpu_sampledMatmul<E>(
+        _ x: CsrMatrix<E>,
+        _ lhs: TensorR2<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR1<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "sampledMatmul(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        let N = lhs.shape[1]
+        let rowOffsets = x.rowOffsets, columns = x.columns
+        let g = CpuMatrix(lhs)
+        let b = CpuMatrix(rhs)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = _csrRowChunks(rowOffsets, x.nonzeroCount &* N)
+
+        cpu_parallel(chunks.count) { c in
+            for r in chunks[c] {
+                for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                    let k = columns[p]
+                    var sum = E.Value.zero
+                    for j in 0..<N { sum += g[0, r, j] * b[0, k, j] }
+                    o[0, 0, p] = sum
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_sample
+    /// gathers the elements of a dense matrix at the nonzero positions of `x`
+    @inlinable func cpu_sample<E>(
+        _ x: CsrMatrix<E>,
+        _ dense: TensorR2<E>,
+        _ out: inout TensorR1<E>
+    ) {
+        diagnostic(.queueCpu, "sample(\(dense.name)) on \(name)",
+                   categories: .queueCpu)
+        let rowOffsets = x.rowOffsets, columns = x.columns
+        let d = CpuMatrix(dense)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = _csrRowChunks(rowOffsets, x.nonzeroCount &* 64)
+
+        cpu_parallel(chunks.count) { c in
+            for r in chunks[c] {
+                for p in rowOffsets[r]..<rowOffsets[r + 1] {
+                    o[0, 0, p] = d[0, r, columns[p]]
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_rowSum
+    /// sums the nonzeros of each row
+    @inlinable func cpu_rowSum<E>(
+        _ x: CsrMatrix<E>,
+        _ out: inout TensorR1<E>
+    ) where E.Value: Numeric {
+        diagnostic(.queueCpu, "rowSum(\(x.name)) on \(name)",
+                   categories: .queueCpu)
+        let rowOffsets = x.rowOffsets
+        let v = CpuMatrix(x.values)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = _csrRowChunks(rowOffsets, x.nonzeroCount &* 64)
+
+        cpu_parallel(chunks.count) { c in
+            for r in chunks[c] {
+                var sum = E.Value.zero
+                for p in rowOffsets[r]..<rowOffsets[r + 1] { sum += v[0, 0, p] }
+                o[0, 0, r] = sum
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// cpu_expandRows
+    /// copies the value for each row to every nonzero in the row, which
+    /// is the gradient of a row reduction
+    @inlinable func cpu_expandRows<E>(
+        _ x: CsrMatrix<E>,
+        _ rowValues: TensorR1<E>,
+        _ out: inout TensorR1<E>
+    ) {
+        diagnostic(.queueCpu, "expandRows(\(rowValues.name)) on \(name)",
+                   categories: .queueCpu)
+        let rowOffsets = x.rowOffsets
+        let g = CpuMatrix(rowValues)
+        let o = CpuMatrix(mutating: &out)
+        let chunks = _csrRowChunks(rowOffsets, x.nonzeroCount &* 64)
+
+        cpu_parallel(chunks.count) { c in
+            for r in chunks[c] {
+                let value = g[0, 0, r]
+                for p in rowOffsets[r]..<rowOffsets[r + 1] { o[0, 0, p] = value }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// DeviceQueue sparse delegation
+extension DeviceQueue where Self: CpuFunctions {
+    //--------------------------------------------------------------------------
+    @inlinable func nonzeros<S,E>(
+        _ x: Tensor<S,E>
+    ) -> (positions: [Int], values: TensorR1<E>) where E.Value: Numeric {
+        cpu_nonzeros(x)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func scatter<S,E>(
+        _ values: TensorR1<E>,
+        _ positions: [Int],
+        _ out: inout Tensor<S,E>
+    ) where E.Value: Numeric {
+        cpu_scatter(values, positions, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func matmul<E>(
+        _ lhs: CsrMatrix<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        cpu_matmul(lhs, rhs, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func matmulTransposed<E>(
+        _ lhs: CsrMatrix<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR2<E>
+    ) where E.Value: Numeric {
+        cpu_matmulTransposed(lhs, rhs, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func sampledMatmul<E>(
+        _ x: CsrMatrix<E>,
+        _ lhs: TensorR2<E>,
+        _ rhs: TensorR2<E>,
+        _ out: inout TensorR1<E>
+    ) where E.Value: Numeric {
+        cpu_sampledMatmul(x, lhs, rhs, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func sample<E>(
+        _ x: CsrMatrix<E>,
+        _ dense: TensorR2<E>,
+        _ out: inout TensorR1<E>
+    ) {
+        cpu_sample(x, dense, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func rowSum<E>(
+        _ x: CsrMatrix<E>,
+        _ out: inout TensorR1<E>
+    ) where E.Value: Numeric {
+        cpu_rowSum(x, &out)
+    }
+    //--------------------------------------------------------------------------
+    @inlinable func expandRows<E>(
+        _ x: CsrMatrix<E>,
+        _ rowValues: TensorR1<E>,
+        _ out: inout TensorR1<E>
+    ) {
+        cpu_expandRows(x, rowValues, &out)
+    }
+}
@@ -0,0 +1,389 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+
+//==============================================================================
+/// WinogradTransform
+/// The transform matrices of the minimal filtering algorithm
+/// F(m x m, 3 x 3), which computes an `m x m` output tile from an
+/// `(m + 2) x (m + 2)` input tile with `(m + 2)^2` multiplies per channel
+/// pair instead of `9 m^2`. F(2x2, 3x3) uses 2.25x fewer multiplies, and
+/// F(4x4, 3x3) uses 4x fewer but is less accurate.
+public struct WinogradTransform<T: BinaryFloatingPoint> {
+    /// the output tile size
+    public let m: Int
+    /// the input tile size `m + 2`
+    public let alpha: Int
+    /// the input transform `B^T`, `alpha x alpha`
+    public let bt: [T]
+    /// the filter transform `G`, `alpha x 3`
+    public let g: [T]
+    /// the output transform `A^T`, `m x alpha`
+    public let at: [T]
+
+    //--------------------------------------------------------------------------
+    /// init(tileSize:
+    /// - Parameter m: the output tile size, 2 or 4
+    @inlinable public init(tileSize m: Int) {
+        self.m = m
+        self.alpha = m + 2
+        switch m {
+        case 2:
+            bt = [1,  0, -1,  0,
+                  0,  1,  1,  0,
+                  0, -1,  1,  0,
+                  0,  1,  0, -1]
+            g = [1,    0,   0,
+                 0.5,  0.5, 0.5,
+                 0.5, -0.5, 0.5,
+                 0,    0,   1]
+            at = [1, 1,  1,  0,
+                  0, 1, -1, -1]
+
+        case 4:
+            bt = [4,  0, -5,  0, 1, 0,
+                  0, -4, -4,  1, 1, 0,
+                  0,  4, -4, -1, 1, 0,
+                  0, -2, -1,  2, 1, 0,
+                  0,  2, -1, -2, 1, 0,
+                  0,  4,  0, -5, 0, 1]
+            g = [T(1) / 4,  0,         0,
+                 -T(1) / 6, -T(1) / 6,  -T(1) / 6,
+                 -T(1) / 6,  T(1) / 6,  -T(1) / 6,
+                 T(1) / 24,  T(1) / 12,  T(1) / 6,
+                 T(1) / 24, -T(1) / 12,  T(1) / 6,
+                 0,          0,          1]
+            at = [1, 1,  1, 1,  1, 0,
+                  0, 1, -1, 2, -2, 0,
+                  0, 1,  1, 4,  4, 0,
+                  0, 1, -1, 8, -8, 1]
+
+        default: fatalError("only F(2x2, 3x3) and F(4x4, 3x3) are supported")
+        }
+    }
+}
+
+//==============================================================================
+/// CpuWinogradFilter
+/// A cache of a transformed filter. The transform is repeated when the
+/// filter storage or the tile size changes. It is only used for inference
+/// with a constant filter, because in place updates keep the storage id.
+/// The cache is updated under `mutex`, and each call keeps a reference to
+/// the values it uses, so concurrent calls can share it.
+public final class CpuWinogradFilter<T: BinaryFloatingPoint> {
+    /// serializes the updates of the cache
+    public let mutex = Mutex()
+    /// the id of the transformed filter storage
+    public var storageId = -1
+    /// the storage base of the transformed filter
+    public var storageBase = -1
+    /// the tile size of the transform
+    public var tileSize = 0
+    /// the transformed filter, `alpha^2 x inChannels x outChannels`
+    public var values = [T]()
+    /// the transform matrices of the last tile size
+    public var transforms: WinogradTransform<T>?
+
+    @inlinable public init() {}
+
+    /// transform(tileSize:
+    /// - Returns: the transform matrices for `tileSize`, which are kept
+    ///   so a call does not build them again
+    @inlinable public func transform(_ tileSize: Int) -> WinogradTransform<T> {
+        mutex.access {
+            if let t = transforms, t.m == tileSize { return t }
+            let t = WinogradTransform<T>(tileSize: tileSize)
+            transforms = t
+            return t
+        }
+    }
+}
+
+//==============================================================================
+// ConvolutionGeometry winograd support
+extension ConvolutionGeometry {
+    /// `true` if the convolution is an ungrouped 3x3 stride 1 convolution
+    /// without dilation over the height and width, which Winograd can
+    /// compute. 3D convolutions are supported when the filter depth is 1.
+    @inlinable public var isWinogradCompatible: Bool {
+        groups == 1 && fD == 1 && fH == 3 && fW == 3 && sH == 1 && sW == 1 &&
+            dH == 1 && dW == 1
+    }
+
+    /// - Returns: the output tile size used for these outputs. Larger
+    ///   tiles need fewer multiplies, but waste work on small outputs.
+    @inlinable public var winogradTileSize: Int {
+        outH >= 8 && outW >= 8 ? 4 : 2
+    }
+
+    /// - Returns: the number of output tiles
+    @inlinable public func winogradTiles(_ m: Int) -> Int {
+        batchCount * outD * ((outH + m - 1) / m) * ((outW + m - 1) / m)
+    }
+}
+
+//==============================================================================
+/// cpu_winogradConvolution
+/// A 3x3 stride 1 convolution computed with F(m x m, 3 x 3).
+///
+/// The filter is transformed once to `alpha^2` matrices of
+/// `inChannels x outChannels`. The output tiles are split into blocks
+/// that are distributed across the available cores. For each block
+/// - the input tiles are transformed to `alpha^2` matrices of
+///   `tiles x inChannels`
+/// - each of them is multiplied by the matching filter matrix, which is
+///   a batch of `alpha^2` gemms in the transformed domain
+/// - the products are transformed back to output tiles and the bias
+///   and activation are applied before they are stored
+/// The block workspaces are kept in the `scratch` between calls when it
+/// is specified.
+extension DeviceQueue {
+    @inlinable func cpu_winogradConvolution<S,E,FE>(
+        _ x: Tensor<S,E>,
+        _ filter: Tensor<S,FE>,
+        _ bias: TensorR1<FE>,
+        _ geometry: ConvolutionGeometry,
+        tileSize: Int,
+        blockTiles: Int,
+        cache: CpuWinogradFilter<E.Value>?,
+        scratch: CpuScratch? = nil,
+        activation: ActivationType,
+        reluCeiling: E.Value,
+        nan: NanPropagation = .noPropagate,
+        _ y: inout Tensor<S,E>
+    ) where E.Value: Real & BinaryFloatingPoint, FE.Value == E.Value {
+        typealias T = E.Value
+        diagnostic(.queueCpu, "convolution(\(x.name), \(filter.name)) " +
+                    "winograd F(\(tileSize)x\(tileSize), 3x3) on \(name)",
+                   categories: .queueCpu)
+        let g = geometry
+        assert(g.isWinogradCompatible)
+        let Cin = g.inChannels, Cout = g.outChannels
+        let xs = CpuMatrix(dense: x, g.batchCount, g.inputCount, Cin)
+        let fs = CpuMatrix(dense: filter, 1, g.filterCount, Cout)
+        let bs = CpuMatrix(bias)
+        let ys = CpuMatrix(mutatingDense: &y, g.batchCount, g.outputCount, Cout)
+        let filterId = filter.storage.id, filterBase = filter.storageBase
+
+        let wt = cache?.transform(tileSize) ??
+            WinogradTransform<T>(tileSize: tileSize)
+        let m = wt.m, alpha = wt.alpha, alpha2 = alpha * alpha
+        let tilesH = (g.outH + m - 1) / m, tilesW = (g.outW + m - 1) / m
+        let tileCount = g.winogradTiles(m)
+        let blocks = (tileCount + blockTiles - 1) / blockTiles
+
+        //----------------------------------
+        // transforms the filter to `alpha^2 x Cin x Cout`
+        func transformFilter(_ u: UnsafeMutableBufferPointer<T>) {
+            var kernel = [T](repeating: 0, count: 9)
+            var gk = [T](repeating: 0, count: alpha * 3)
+            for ci in 0..<Cin {
+                for co in 0..<Cout {
+                    for tap in 0..<9 {
+                        let src = g.isFlipped ? 8 - tap : tap
+                        kernel[tap] = fs[0, src * Cin + ci, co]
+                    }
+                    // G k
+                    for i in 0..<alpha {
+                        for j in 0..<3 {
+                            var sum = T.zero
+                            for k in 0..<3 {
+                                sum += wt.g[i * 3 + k] * kernel[k * 3 + j]
+                            }
+                            gk[i * 3 + j] = sum
+                        }
+                    }
+                    // (G k) G^T
+                    for i in 0..<alpha {
+                        for j in 0..<alpha {
+                            var sum = T.zero
+                            for k in 0..<3 {
+                                sum += gk[i * 3 + k] * wt.g[j * 3 + k]
+                            }
+                            u[((i * alpha + j) * Cin + ci) * Cout + co] = sum
+                        }
+                    }
+                }
+            }
+        }
+
+        //----------------------------------
+        // computes one block of output tiles
+        // the workspace values of a block
+        let vSize = alpha2 * blockTiles * Cin
+        let pSize = alpha2 * blockTiles * Cout
+        let size = vSize + pSize + 2 * alpha2 + m * m * Cout
+
+        func block(_ index: Int, _ u: UnsafeBufferPointer<T>,
+                   _ memory: UnsafeMutableBufferPointer<T>) {
+            let tileStart = index * blockTiles
+            let count = Swift.min(blockTiles, tileCount - tileStart)
+            guard count > 0 else { return }
+
+            // workspaces
+            var offset = 0
+            func take(_ n: Int) -> UnsafeMutableBufferPointer<T> {
+                defer { offset += n }
+                return UnsafeMutableBufferPointer(
+                    rebasing: memory[offset..<(offset + n)])
+            }
+            let v = take(vSize), p = take(pSize)
+            let d = take(alpha2), tmp = take(alpha2)
+            let out = take(m * m * Cout)
+
+            // the batch, output plane, and origin of a tile
+            func origin(_ b: Int) -> (n: Int, od: Int, oh: Int, ow: Int) {
+                let t = tileStart + b
+                let tw = t % tilesW
+                var r = t / tilesW
+                let th = r % tilesH
+                r /= tilesH
+                return (r / g.outD, r % g.outD, th * m, tw * m)
+            }
+
+            // input transform V = B^T d B
+            for b in 0..<count {
+                let (n, od, oh, ow) = origin(b)
+                let id = od * g.sD - g.pD
+                let h0 = oh - g.pH, w0 = ow - g.pW
+                for ci in 0..<Cin {
+                    for i in 0..<alpha {
+                        let ih = h0 + i
+                        for j in 0..<alpha {
+                            let iw = w0 + j
+                            let inside = id >= 0 && id < g.inD &&
+                                ih >= 0 && ih < g.inH && iw >= 0 && iw < g.inW
+                            d[i * alpha + j] = inside ?
+                                xs[n, (id * g.inH + ih) * g.inW + iw, ci] : 0
+                        }
+                    }
+                    for i in 0..<alpha {
+                        for j in 0..<alpha {
+                            var sum = T.zero
+                            for k in 0..<alpha {
+                                sum += wt.bt[i * alpha + k] * d[k * alpha + j]
+                            }
+                            tmp[i * alpha + j] = sum
+                        }
+                    }
+                    for i in 0..<alpha {
+                        for j in 0..<alpha {
+                            var sum = T.zero
+                            for k in 0..<alpha {
+                                sum += tmp[i * alpha + k] * wt.bt[j * alpha + k]
+                            }
+                            v[((i * alpha + j) * count + b) * Cin + ci] = sum
+                        }
+                    }
+                }
+            }
+
+            // a batch of alpha^2 gemms, P[e] = V[e] x U[e]
+            for e in 0..<alpha2 {
+                for b in 0..<count {
+                    let pb = (e * count + b) * Cout
+                    let vb = (e * count + b) * Cin
+                    for co in 0..<Cout { p[pb &+ co] = 0 }
+                    for ci in 0..<Cin {
+                        let a = v[vb &+ ci]
+                        let ub = (e * Cin + ci) * Cout
+                        for co in 0..<Cout { p[pb &+ co] += a * u[ub &+ co] }
+                    }
+                }
+            }
+
+            // output transform Y = A^T P A
+            for b in 0..<count {
+                for co in 0..<Cout {
+                    for e in 0..<alpha2 { d[e] = p[(e * count + b) * Cout + co] }
+                    for i in 0..<m {
+                        for j in 0..<alpha {
+                            var sum = T.zero
+                            for k in 0..<alpha {
+                                sum += wt.at[i * alpha + k] * d[k * alpha + j]
+                            }
+                            tmp[i * alpha + j] = sum
+                        }
+                    }
+                    for i in 0..<m {
+                        for j in 0..<m {
+                            var sum = T.zero
+                            for k in 0..<alpha {
+                                sum += tmp[i * alpha + k] * wt.at[j * alpha + k]
+                            }
+                            out[(i * m + j) * Cout + co] = sum
+                        }
+                    }
+                }
+
+                // apply the epilogue and store the outputs inside the image
+                let (n, od, oh0, ow0) = origin(b)
+                for i in 0..<Swift.min(m, g.outH - oh0) {
+                    for j in 0..<Swift.min(m, g.outW - ow0) {
+                        let start = (i * m + j) * Cout
+                        let acc = UnsafeMutableBufferPointer(
+                            rebasing: out[start..<(start + Cout)])
+                        for co in 0..<Cout { acc[co] += bs[0, 0, co] }
+                        activation.apply(acc, ceiling: reluCeiling, nan: nan)
+                        let pos = (od * g.outH + oh0 + i) * g.outW + ow0 + j
+                        for co in 0..<Cout { ys[n, pos, co] = acc[co] }
+                    }
+                }
+            }
+        }
+
+        //----------------------------------
+        func execute() {
+            func run(_ u: UnsafeBufferPointer<T>) {
+                _withScratch(scratch, T.self,
+                             count: _workerCount(blocks) * size) { memory in
+                    _forEachWorker(blocks, size: size, memory) {
+                        block($0, u, $1)
+                    }
+                }
+            }
+
+            let count = alpha2 * Cin * Cout
+            if let cache = cache {
+                let values: [T] = cache.mutex.access {
+                    if cache.storageId != filterId ||
+                        cache.storageBase != filterBase || cache.tileSize != m {
+                        var values = [T](repeating: 0, count: count)
+                        values.withUnsafeMutableBufferPointer(transformFilter)
+                        cache.values = values
+                        cache.storageId = filterId
+                        cache.storageBase = filterBase
+                        cache.tileSize = m
+                    }
+                    return cache.values
+                }
+                values.withUnsafeBufferPointer(run)
+            } else {
+                let u = UnsafeMutableBufferPointer<T>.allocate(capacity: count)
+                defer { u.deallocate() }
+                transformFilter(u)
+                run(UnsafeBufferPointer(u))
+            }
+        }
+
+        if mode == .sync {
+            execute()
+        } else {
+            queue.async(group: group) { execute() }
+        }
+    }
+}
@@ -14,6 +14,7 @@
 // limitations under the License.
 //
 import SwiftRTCuda
+import Numerics
 
 //==============================================================================
 // CudaQueue `convolution` implementation
@@ -30,7 +31,9 @@ extension CudaQueue
     ) -> DeviceConvolution<Shape, Element, FilterElement>
     where Shape: TensorShape,
           Element: StorageElement,
-          FilterElement: StorageElement
+          Element.Value: Real & BinaryFloatingPoint,
+          FilterElement: StorageElement,
+          FilterElement.Value == Element.Value
     {
         if useGpu {
             return CudaConvolution<Shape,Element,FilterElement>(
@@ -58,7 +61,11 @@ extension CudaQueue
 // CudaConvolution
 public final class CudaConvolution<Shape, Element, FilterElement>:
     DeviceConvolution<Shape, Element, FilterElement>
-where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint,
+      FilterElement: StorageElement,
+      FilterElement.Value == Element.Value
 {
     // descriptors
     public let activationDescriptor: ActivationDescriptor
@@ -90,7 +97,6 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
     public var bwdFilterAlgo: cudnnConvolutionBwdFilterAlgo_t
     public var bwdFilterWorkspaceSize = 0
     public var bwdFilterWorkspace: DeviceMemory?
-    public let logCategories: LogCategories = [.setup]
     
     //--------------------------------------------------------------------------
     // initializer
@@ -289,7 +295,8 @@ where Shape: TensorShape, Element: StorageElement, FilterElement: StorageElement
             padding: pad,
             strides: strides,
             dilations: dilations,
-            mode: properties.mode)
+            mode: properties.mode,
+            groups: properties.groups)
 
         //----------------------------------
         // get the extents for the output
@@ -827,7 +834,8 @@ public final class ConvolutionDescriptor<Shape: TensorShape> {
         padding: Shape,
         strides: Shape,
         dilations: Shape,
-        mode: ConvolutionMode
+        mode: ConvolutionMode,
+        groups: Int = 1
     ) {
         // create the descriptor
         var temp: cudnnConvolutionDescriptor_t?
@@ -843,6 +851,10 @@ public final class ConvolutionDescriptor<Shape: TensorShape> {
             dilations.asInt32,
             mode.cudnn,
             scalarType))
+
+        if groups > 1 {
+            cudaCheck(cudnnSetConvolutionGroupCount(desc, Int32(groups)))
+        }
     }
 
     @inlinable deinit {
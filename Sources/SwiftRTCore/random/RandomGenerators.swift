@@ -346,13 +346,18 @@ public struct PhiloxRandomNumberGenerator: SeedableRandomNumberGenerator {
     private var useNextValue = false
     private var nextValue: UInt64 = 0
 
-    private func bump(key: UInt32x2) -> UInt32x2 {
+    @inlinable static func bump(
+        key: (UInt32, UInt32)
+    ) -> (UInt32, UInt32) {
         let bumpConstantHi: UInt32 = 0x9E3779B9
         let bumpConstantLo: UInt32 = 0xBB67AE85
         return (key.0 &+ bumpConstantHi, key.1 &+ bumpConstantLo)
     }
 
-    private func round(ctr: UInt32x4, key: UInt32x2) -> UInt32x4 {
+    @inlinable static func round(
+        ctr: (UInt32, UInt32, UInt32, UInt32),
+        key: (UInt32, UInt32)
+    ) -> (UInt32, UInt32, UInt32, UInt32) {
         let roundConstant0: UInt64 = 0xD2511F53
         let roundConstant1: UInt64 = 0xCD9E8D57
 
@@ -367,7 +372,10 @@ public struct PhiloxRandomNumberGenerator: SeedableRandomNumberGenerator {
         return (hi1 ^ ctr.1 ^ key.0, lo1, hi0 ^ ctr.3 ^ key.1, lo0)
     }
 
-    private func random(forCtr initialCtr: UInt32x4, key initialKey: UInt32x2) -> UInt32x4 {
+    @inlinable static func random(
+        forCtr initialCtr: (UInt32, UInt32, UInt32, UInt32),
+        key initialKey: (UInt32, UInt32)
+    ) -> (UInt32, UInt32, UInt32, UInt32) {
         var ctr = initialCtr
         var key = initialKey
         // 10 rounds
@@ -404,6 +412,25 @@ public struct PhiloxRandomNumberGenerator: SeedableRandomNumberGenerator {
         return ctr
     }
 
+    //--------------------------------------------------------------------------
+    /// block(counter:key:
+    /// evaluates the generator without any state. The block of a counter
+    /// depends only on the counter and the key, so parallel kernels can
+    /// generate any part of the stream independently, and the values do
+    /// not depend on the number of threads. A generator seeded with `key`
+    /// returns the same block from `next()` for the same counter.
+    /// - Parameters:
+    ///  - counter: the position of the block in the stream
+    ///  - key: the 64-bit seed
+    /// - Returns: four uniformly distributed 32-bit values
+    @inlinable public static func block(
+        counter: UInt64,
+        key: UInt64
+    ) -> (UInt32, UInt32, UInt32, UInt32) {
+        let c = counter.split, k = key.split
+        return random(forCtr: (0, 0, c.msb, c.lsb), key: (k.msb, k.lsb))
+    }
+
     public init(uint64Seed seed: UInt64) {
         key = seed.vector2
     }
@@ -423,7 +450,8 @@ public struct PhiloxRandomNumberGenerator: SeedableRandomNumberGenerator {
             useNextValue = false
             return nextValue
         }
-        let (this, next) = makeUInt64Pair(random(forCtr: ctr.vector4, key: key))
+        let (this, next) = makeUInt64Pair(
+            Self.random(forCtr: ctr.vector4, key: key))
         useNextValue = true
         nextValue = next
         ctr += 1
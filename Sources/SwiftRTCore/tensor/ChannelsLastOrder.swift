@@ -0,0 +1,120 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// channels last order index math
+/// The `NHWC` and `NDHWC` orders store a tensor with the logical shape
+/// (N, C, H, W) or (N, C, D, H, W) with the channels innermost, so the
+/// channels of each spatial position are contiguous. The elements are
+/// strided, so they are indexed in the same way as the `row` and `col`
+/// orders, and dense channels last tensors are contiguous.
+public extension Order {
+    /// `true` if the order is `NHWC` or `NDHWC`
+    @inlinable var isChannelsLast: Bool {
+        self == .NHWC || self == .NDHWC
+    }
+
+    //--------------------------------------------------------------------------
+    /// channelsLast(rank:
+    /// - Returns: the channels last order for a tensor rank
+    @inlinable static func channelsLast(rank: Int) -> Order {
+        assert(rank == 4 || rank == 5, "channels last orders are rank 4 or 5")
+        return rank == 4 ? .NHWC : .NDHWC
+    }
+}
+
+//==============================================================================
+// channels last shape extensions
+public extension TensorShape {
+    //--------------------------------------------------------------------------
+    /// channelsLastStrides
+    /// - Returns: the strides of a dense channels last tensor, where this
+    ///   is the logical (N, C, spatial...) shape
+    @inlinable func channelsLastStrides() -> Self {
+        var strides = self
+        var stride = self[1]
+        strides[1] = 1
+        var dim = Self.rank - 1
+        while dim >= 2 {
+            strides[dim] = stride
+            stride &*= self[dim]
+            dim &-= 1
+        }
+        strides[0] = stride
+        return strides
+    }
+
+    //--------------------------------------------------------------------------
+    /// the (N, spatial..., C) shape of a logical (N, C, spatial...) shape
+    @inlinable var channelsLast: Self {
+        var shape = self
+        for i in 1..<(Self.rank - 1) { shape[i] = self[i + 1] }
+        shape[Self.rank - 1] = self[1]
+        return shape
+    }
+
+    /// the logical (N, C, spatial...) shape of a (N, spatial..., C) shape
+    @inlinable var channelsFirst: Self {
+        var shape = self
+        shape[1] = self[Self.rank - 1]
+        for i in 2..<Self.rank { shape[i] = self[i - 1] }
+        return shape
+    }
+}
+
+//==============================================================================
+// channels last tensor extensions
+// Kernels that index channels last data, such as convolution, use a `row`
+// order view of the (N, spatial..., C) storage, so a channels last tensor
+// is used in place and the result is viewed in the same order.
+public extension Tensor {
+    //--------------------------------------------------------------------------
+    /// init(channelsLast:
+    /// creates a `row` order (N, spatial..., C) view of a dense channels
+    /// last tensor that shares its storage
+    @inlinable init(channelsLast other: Self) {
+        assert(other.order.isChannelsLast && other.isContiguous)
+        let shape = other.shape.channelsLast
+        self.init(shape: shape,
+                  strides: shape.strides(for: .row),
+                  count: other.count,
+                  storage: other.storage,
+                  storageBase: other.storageBase,
+                  spanCount: other.spanCount,
+                  order: .row,
+                  shared: other.isShared)
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(channelsFirst:order:
+    /// creates a channels last view of a dense `row` order
+    /// (N, spatial..., C) tensor with the logical (N, C, spatial...) shape,
+    /// that shares its storage
+    @inlinable init(channelsFirst other: Self, order: Order) {
+        assert(other.order == .row && other.isContiguous &&
+                order.isChannelsLast)
+        let shape = other.shape.channelsFirst
+        self.init(shape: shape,
+                  strides: shape.channelsLastStrides(),
+                  count: other.count,
+                  storage: other.storage,
+                  storageBase: other.storageBase,
+                  spanCount: other.spanCount,
+                  order: order,
+                  shared: other.isShared)
+    }
+}
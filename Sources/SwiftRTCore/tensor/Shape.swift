@@ -211,7 +211,12 @@ public extension TensorShape {
             var strides = computeStrides(for: shape)
             strides.swapAt(Self.rank - 1, Self.rank - 2)
             return strides
-        default: fatalError("not implemented yet")
+        case .colTiled32, .colTiledTC32x8, .colTiledTC32x32:
+            // tiled elements are not strided, so these are the logical
+            // strides and storage is indexed with `tiledOffset`
+            return computeStrides(for: self)
+        case .NHWC, .NDHWC:
+            return channelsLastStrides()
         }
     }
 
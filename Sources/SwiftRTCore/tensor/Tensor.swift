@@ -66,8 +66,11 @@ where Shape: TensorShape, TensorElement: StorageElement
         set { storage.name = newValue }
     }
 
-    /// `true` if the tensor elements are densely packed
-    @inlinable public var isContiguous: Bool { spanCount == count }
+    /// `true` if the tensor elements are densely packed in logical order.
+    /// Tiled orders are never contiguous, even without padding
+    @inlinable public var isContiguous: Bool {
+        spanCount == count && !order.isTiled
+    }
 
     /// `true` if the tensor value is zero
     @inlinable public var isZero: Bool { storage.isZero }
@@ -492,6 +495,8 @@ public extension Tensor {
         _ share: Bool
     ) -> Self {
         let shape = upper &- lower
+        assert(!order.isTiled || shape == self.shape,
+               "sub views of tiled tensors are not supported")
         let count = shape.elementCount()
         let spanCount = strides.areSequential(for: shape) ? count :
                 shape.spanCount(stridedBy: strides)
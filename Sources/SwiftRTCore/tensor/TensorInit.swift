@@ -68,15 +68,16 @@ public extension Tensor {
         name: String = defaultTensorName
     ) {
         let count = shape.elementCount()
+        let spanCount = shape.spanCount(for: order)
         let storage = Platform.Storage(type: TensorElement.self,
-                                           count: count, name: name)
+                                           count: spanCount, name: name)
         
         self.init(shape: shape,
                   strides: shape.strides(for: order),
                   count: count,
                   storage: storage,
                   storageBase: 0,
-                  spanCount: count,
+                  spanCount: spanCount,
                   order: order,
                   shared: false)
     }
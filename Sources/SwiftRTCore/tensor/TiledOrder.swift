@@ -0,0 +1,153 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+
+//==============================================================================
+/// tiled order index math
+/// The tiled orders apply to the last two dimensions of a tensor. Each
+/// group of 32 columns is stored as a separate tile spanning all of the
+/// rows, and the tiles are stored one after another. Rows are padded
+/// to a multiple of the inner tile height, so a tiled tensor spans more
+/// storage elements than it has logical elements and is not contiguous.
+/// Any leading dimensions are stored as a dense batch of tiled matrices.
+public extension Order {
+    /// `true` if the order is one of the column tiled orders
+    @inlinable var isTiled: Bool {
+        self == .colTiled32 || self == .colTiledTC32x8 ||
+            self == .colTiledTC32x32
+    }
+
+    /// the multiple that the number of rows is padded to
+    @inlinable var tileRowMultiple: Int {
+        switch self {
+        case .colTiledTC32x8: return 8
+        case .colTiledTC32x32: return 32
+        default: return 1
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// tiledRows(rows:
+    /// - Returns: the number of rows in storage after padding
+    @inlinable func tiledRows(_ rows: Int) -> Int {
+        roundUp(rows, multiple: tileRowMultiple)
+    }
+
+    //--------------------------------------------------------------------------
+    /// tiledSpan(rows:cols:
+    /// - Returns: the number of storage elements of one tiled matrix
+    @inlinable func tiledSpan(rows: Int, cols: Int) -> Int {
+        roundUp(cols, multiple: 32) &* tiledRows(rows)
+    }
+
+    //--------------------------------------------------------------------------
+    /// tiledOffset(row:col:rows:
+    /// - Parameters:
+    ///  - row: the logical row
+    ///  - col: the logical column
+    ///  - tiledRows: the padded number of rows, which is the height of
+    ///    each 32 column tile
+    /// - Returns: the storage offset of the element within the matrix
+    @inlinable func tiledOffset(_ row: Int, _ col: Int, tiledRows: Int) -> Int {
+        let tile = (col >> 5) &* (tiledRows << 5)
+        let c = col & 31
+        switch self {
+        case .colTiled32:
+            // rows of 32 values
+            return tile &+ (row << 5) &+ c
+
+        case .colTiledTC32x8:
+            // 8 row tiles, where each 8x8 block interleaves 4 column groups
+            // of the even and odd rows
+            let inner = ((((row >> 3) << 3) &+ ((row & 1) << 2) &+ (c >> 3)) << 5)
+                &+ (((((c & 7) >= 4) ? 4 : 0) &+ ((row & 7) >> 1)) << 2)
+                &+ (c & 3)
+            return tile &+ inner
+
+        case .colTiledTC32x32:
+            // 32 row tiles, with rows ordered as
+            // (((row % 8) / 2 * 4 + row / 8) * 2 + row % 2) * 32 + col
+            let r = row & 31
+            let inner = ((row >> 5) << 10)
+                &+ (((((r & 7) >> 1) << 2) &+ (r >> 3)) << 6)
+                &+ ((r & 1) << 5) &+ c
+            return tile &+ inner
+
+        default: fatalError("\(self) is not a tiled order")
+        }
+    }
+}
+
+//==============================================================================
+// tiled shape extensions
+public extension TensorShape {
+    //--------------------------------------------------------------------------
+    /// spanCount(order:
+    /// - Returns: the number of storage elements needed to store a dense
+    ///   tensor of this shape in the specified order
+    @inlinable func spanCount(for order: Order) -> Int {
+        guard order.isTiled else { return elementCount() }
+        assert(Self.rank >= 2, "tiled orders require rank 2 or higher")
+        let rows = self[Self.rank - 2], cols = self[Self.rank - 1]
+        return elementCount() / Swift.max(1, rows &* cols) &*
+            order.tiledSpan(rows: rows, cols: cols)
+    }
+
+    //--------------------------------------------------------------------------
+    /// tiledOffset(position:order:
+    /// - Parameters:
+    ///  - position: the logical position of an element in a tensor
+    ///    of this shape
+    ///  - order: the tiled storage order
+    /// - Returns: the storage offset of the element
+    @inlinable func tiledOffset(_ position: Self, _ order: Order) -> Int {
+        let rows = self[Self.rank - 2], cols = self[Self.rank - 1]
+        var batch = 0
+        for i in 0..<(Self.rank - 2) { batch = batch &* self[i] &+ position[i] }
+        return batch &* order.tiledSpan(rows: rows, cols: cols) &+
+            order.tiledOffset(position[Self.rank - 2], position[Self.rank - 1],
+                              tiledRows: order.tiledRows(rows))
+    }
+}
+
+//==============================================================================
+// tiled tensor extensions
+public extension Tensor {
+    //--------------------------------------------------------------------------
+    /// hasSameTiledLayout(other:
+    /// - Returns: `true` if both tensors are dense tiled tensors with the
+    ///   same shape and order, so their storage elements correspond one to
+    ///   one and element wise operations can process the storage directly
+    @inlinable func hasSameTiledLayout<E>(as other: Tensor<Shape,E>) -> Bool {
+        order.isTiled && order == other.order && shape == other.shape &&
+            spanCount == shape.spanCount(for: order) &&
+            other.spanCount == spanCount
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(copying:order:
+    /// creates a copy of `other` stored in the specified order. Conversions
+    /// between row or column order and the tiled orders are done by blocks
+    /// of 32 columns in parallel. This is typically used to convert
+    /// weights to a tiled order once when they are loaded.
+    /// - Parameters:
+    ///  - other: the tensor to copy
+    ///  - order: the storage order of the result
+    @inlinable init(copying other: Self, order: Order) {
+        self.init(shape: other.shape, order: order, name: other.name)
+        copy(from: other, to: &self)
+    }
+}
@@ -19,26 +19,33 @@ import SwiftRTCore
 
 //==============================================================================
 // convenience types
-public typealias Conv1 = Convolution<Shape1,Float,Float>
-public typealias Conv2 = Convolution<Shape2,Float,Float>
-public typealias Conv3 = Convolution<Shape3,Float,Float>
+// The data shapes are NWC, NHWC, and NDHWC. Rank 4 and 5 tensors in the
+// `NHWC` and `NDHWC` orders with the logical shape (N, C, spatial...) are
+// also accepted, and produce outputs in the same order.
+public typealias Conv1 = Convolution<Shape3,Float,Float>
+public typealias Conv2 = Convolution<Shape4,Float,Float>
+public typealias Conv3 = Convolution<Shape5,Float,Float>
 
-public typealias ConvR1<E,FE> = Convolution<Shape1,E,FE>
-    where E: StorageElement, FE: StorageElement, FE.Value: BinaryFloatingPoint
+public typealias ConvR1<E,FE> = Convolution<Shape3,E,FE>
+    where E: StorageElement, E.Value: Real & BinaryFloatingPoint,
+          FE: StorageElement, FE.Value == E.Value
 
-public typealias ConvR2<E,FE> = Convolution<Shape2,E,FE>
-    where E: StorageElement, FE: StorageElement, FE.Value: BinaryFloatingPoint
+public typealias ConvR2<E,FE> = Convolution<Shape4,E,FE>
+    where E: StorageElement, E.Value: Real & BinaryFloatingPoint,
+          FE: StorageElement, FE.Value == E.Value
     
-public typealias ConvR3<E,FE> = Convolution<Shape3,E,FE>
-    where E: StorageElement, FE: StorageElement, FE.Value: BinaryFloatingPoint
+public typealias ConvR3<E,FE> = Convolution<Shape5,E,FE>
+    where E: StorageElement, E.Value: Real & BinaryFloatingPoint,
+          FE: StorageElement, FE.Value == E.Value
 
 //==============================================================================
 /// Convolution
 public struct Convolution<Shape, Element, FilterElement>: Logging
 where Shape: TensorShape,
       Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint,
       FilterElement: StorageElement,
-      FilterElement.Value: BinaryFloatingPoint
+      FilterElement.Value == Element.Value
 {
     // types
     public typealias Data = Tensor<Shape,Element>
@@ -58,6 +65,8 @@ where Shape: TensorShape,
     @noDerivative public let padding: Padding
     /// The dilation factor for spatial dimensions.
     @noDerivative public let dilations: Shape
+    /// The number of channel groups.
+    @noDerivative public let groups: Int
     /// device specific convolution operator
     @noDerivative public let convolutionOp: Op
 
@@ -67,12 +76,17 @@ where Shape: TensorShape,
     ///
     /// - Parameters:
     ///   - filter: The convolution filter of shape
-    ///     [filter width, input channel count, output channel count].
+    ///     [filter spatial dimensions..., input channel count / groups,
+    ///     output channel count].
     ///   - bias: The bias vector of shape [output channel count].
     ///   - activation: The element-wise activation function.
     ///   - strides: The stride of the sliding window for the temporal dimension.
     ///   - padding: The padding algorithm for convolution.
     ///   - dilation: The dilation factor for the temporal dimension.
+    ///   - groups: The number of channel groups. Each group of output
+    ///     channels is connected to one group of input channels, and
+    ///     setting it to the input channel count makes a depthwise
+    ///     convolution. When it is 1, `properties.groups` is used.
     @inlinable public init(
         filter: Filter,
         bias: Bias? = nil,
@@ -80,16 +94,20 @@ where Shape: TensorShape,
         strides: Shape = Shape.one,
         padding: Padding = .valid,
         dilations: Shape = Shape.one,
+        groups: Int = 1,
         properties: ConvolutionProperties = ConvolutionProperties())
     {
+        var properties = properties
+        if groups != 1 { properties.groups = groups }
         self.filter = filter
         self.activation = activation
         self.strides = strides
         self.padding = padding
         self.dilations = dilations
+        self.groups = properties.groups
 
         self.bias = bias ??
-            TensorR1<FilterElement>(zeros: [filter.shape[1]],
+            TensorR1<FilterElement>(zeros: [filter.shape[Shape.rank - 1]],
                                     order: filter.order)
 
         // create the device op and save the output shape
@@ -123,6 +141,7 @@ extension Convolution where FilterElement.Value: Real & BinaryFloatingPoint {
     ///   - stride: The stride of the sliding window for the temporal dimension.
     ///   - padding: The padding algorithm for convolution.
     ///   - dilation: The dilation factor for the temporal dimension.
+    ///   - groups: The number of channel groups.
     ///   - activation: The element-wise activation function.
     ///   - filterInitializer: Initializer to use for the filter parameters.
     ///   - biasInitializer: Initializer to use for the bias parameters.
@@ -131,6 +150,7 @@ extension Convolution where FilterElement.Value: Real & BinaryFloatingPoint {
         stride: Int = 1,
         padding: Padding = .valid,
         dilation: Int = 1,
+        groups: Int = 1,
         activation: ActivationType = .identity,
         filterInitializer: ParameterInitializer<Shape,FilterElement> = glorotUniform(),
         biasInitializer: ParameterInitializer<Shape1,FilterElement> = zeros()
@@ -141,7 +161,8 @@ extension Convolution where FilterElement.Value: Real & BinaryFloatingPoint {
                   activation: activation,
                   strides: Shape(repeating: stride),
                   padding: padding,
-                  dilations: Shape(repeating: dilation))
+                  dilations: Shape(repeating: dilation),
+                  groups: groups)
     }
 }
 
@@ -16,81 +16,114 @@
 import SwiftRTCore
 
 //==============================================================================
-///
+/// Dense
+/// A fully connected layer computing `activation(input x weight + bias)`
+/// as a single gemm with the bias and activation fused into the output
+/// tiles. Rank 2 inputs are `[batch, input size]`. Rank 3 inputs are
+/// `[batch, sequence, input size]` and share the weights, so all rows of
+/// the batch are multiplied by one gemm.
 public struct Dense<S,E> : Layer
 where S: TensorShape,
       E: StorageElement,
-      E.Value: DifferentiableNumeric & BinaryFloatingPoint
+      E.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
 {
     /// The element-wise activation function.
     @noDerivative public let activation: ActivationType
-    /// The execution plan key
+    /// The execution plan key, computed once from the weights
     @noDerivative public var plan: Int?
-    /// The weights
+    /// The weights `[input size, output size]`, with a leading batch
+    /// dimension of 1 for rank 3
     public var weight: Tensor<S,E>
-    /// The bias
+    /// The bias, reshaped to a single row of `weight` rank
     public var bias: Tensor<S,E>
-    
+
     //--------------------------------------------------------------------------
     @differentiable
     public func callAsFunction(_ input: Tensor<S,E>) -> Tensor<S,E> {
-        input
+        let inputs = weight.shape[S.rank - 2]
+        let outputs = weight.shape[S.rank - 1]
+        assert(input.shape[S.rank - 1] == inputs,
+               "input size must match the weight rows")
+
+        // the input rows are multiplied as one matrix
+        let y = dense(TensorR2<E>(reshaping: input, to: Shape2(-1, inputs)),
+                      TensorR2<E>(reshaping: weight,
+                                  to: Shape2(inputs, outputs)),
+                      bias: TensorR1<E>(reshaping: bias, to: Shape1(outputs)),
+                      activation: activation,
+                      plan: plan)
+        var shape = input.shape
+        shape[S.rank - 1] = outputs
+        return Tensor<S,E>(reshaping: y, to: shape)
     }
 }
 
 public extension Dense where S == Shape2 {
+    /// Creates a `Dense` layer
+    /// - Parameters:
+    ///   - weight: The weights of shape `[input size, output size]`.
+    ///   - bias: The bias of shape `[output size]`, zeros if `nil`.
+    ///   - activation: The element-wise activation function.
     @inlinable init(
         weight: TensorR2<E>,
-        bias: TensorR1<E>,
-        activation: ActivationType
+        bias: TensorR1<E>? = nil,
+        activation: ActivationType = .identity
     ) {
-        assert(weight.order == bias.order &&
-                bias.shape[0] == weight.shape[1])
+        let bias = bias ?? TensorR1<E>(zeros: [weight.shape[1]],
+                                       order: weight.order)
+        assert(bias.shape[0] == weight.shape[1])
         self.activation = activation
         self.weight = weight
-        self.bias = Tensor<S,E>(reshaping: bias, to: weight.shape,
+        self.bias = Tensor<S,E>(reshaping: bias, to: Shape2(1, bias.count),
                                 order: weight.order)
+        self.plan = denseExecutionPlan(weight, activation)
+    }
+
+    /// Creates a `Dense` layer with the specified input size, output size,
+    /// and element-wise activation function.
+    ///
+    /// - Parameters:
+    ///   - inputSize: The dimensionality of the input space.
+    ///   - outputSize: The dimensionality of the output space.
+    ///   - activation: The activation function to use.
+    ///   - weightInitializer: Initializer to use for `weight`.
+    ///   - biasInitializer: Initializer to use for `bias`.
+    @inlinable init(
+        inputSize: Int,
+        outputSize: Int,
+        activation: ActivationType = .identity,
+        weightInitializer: ParameterInitializer<Shape2,E> = glorotUniform(),
+        biasInitializer: ParameterInitializer<Shape1,E> = zeros()
+    ) {
+        self.init(weight: weightInitializer(Shape2(inputSize, outputSize)),
+                  bias: biasInitializer(Shape1(outputSize)),
+                  activation: activation)
     }
 }
-public extension Dense where S == Shape3 {
 
+public extension Dense where S == Shape3 {
+    /// Creates a `Dense` layer for sequences
+    /// - Parameters:
+    ///   - weight: The weights of shape `[1, input size, output size]`,
+    ///     which are shared by every sequence of the batch.
+    ///   - bias: The bias of shape `[output size]`, zeros if `nil`.
+    ///   - activation: The element-wise activation function.
     @inlinable init(
         weight: TensorR3<E>,
-        bias: TensorR2<E>,
-        activation: ActivationType
+        bias: TensorR1<E>? = nil,
+        activation: ActivationType = .identity
     ) {
-        assert(weight.order == bias.order &&
-                bias.shape[0] == weight.shape[1] &&
-                bias.shape[1] == weight.shape[2])
+        assert(weight.shape[0] == 1, "the weights are shared by the batch")
+        let bias = bias ?? TensorR1<E>(zeros: [weight.shape[2]],
+                                       order: weight.order)
+        assert(bias.shape[0] == weight.shape[2])
         self.activation = activation
         self.weight = weight
-        self.bias = Tensor<S,E>(reshaping: bias, to: weight.shape,
+        self.bias = Tensor<S,E>(reshaping: bias, to: Shape3(1, 1, bias.count),
                                 order: weight.order)
+        self.plan = denseExecutionPlan(
+            TensorR2<E>(reshaping: weight,
+                        to: Shape2(weight.shape[1], weight.shape[2])),
+            activation)
     }
 }
-
-//extension Dense {
-//    /// Creates a `Dense` layer with the specified input size, output size, and element-wise
-//    /// activation function. The weight matrix is created with shape `[inputSize, outputSize]` and
-//    /// the bias vector is created with shape `[outputSize]`.
-//    ///
-//    /// - Parameters:
-//    ///   - inputSize: The dimensionality of the input space.
-//    ///   - outputSize: The dimensionality of the output space.
-//    ///   - activation: The activation function to use. The default value is `identity(_:)`.
-//    ///   - weightInitializer: Initializer to use for `weight`.
-//    ///   - biasInitializer: Initializer to use for `bias`.
-//    public init(
-//        inputSize: Int,
-//        outputSize: Int,
-//        activation: @escaping Activation = identity,
-//        useBias: Bool = true,
-//        weightInitializer: ParameterInitializer<Scalar> = glorotUniform(),
-//        biasInitializer: ParameterInitializer<Scalar> = zeros()
-//    ) {
-//        self.init(
-//            weight: weightInitializer([inputSize, outputSize]),
-//            bias: useBias ? biasInitializer([outputSize]) : nil,
-//            activation: activation)
-//    }
-//}
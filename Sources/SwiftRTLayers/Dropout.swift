@@ -0,0 +1,62 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import SwiftRTCore
+
+//==============================================================================
+/// Dropout
+/// Sets each input element to zero with `probability` in `.training`
+/// mode, and scales the kept elements by `1 / (1 - probability)` so the
+/// expected value is unchanged. The mask is generated inside the multiply
+/// loop from a new random seed for each call, and is regenerated by the
+/// backward pass instead of being stored. In `.inferring` mode the input
+/// is returned unchanged.
+public struct Dropout<S,E>: ParameterlessLayer
+where S: TensorShape,
+      E: StorageElement,
+      E.Value: DifferentiableNumeric & BinaryFloatingPoint
+{
+    public typealias TangentVector = EmptyTangentVector
+
+    /// The probability of dropping an element
+    @noDerivative public let probability: Double
+    /// Selects dropout or the identity
+    @noDerivative public var mode: EvaluationMode
+
+    //--------------------------------------------------------------------------
+    /// Creates a dropout layer.
+    ///
+    /// - Parameters:
+    ///   - probability: The probability of dropping an element in `0..<1`.
+    ///   - mode: Selects dropout or the identity.
+    @inlinable public init(
+        probability: Double,
+        mode: EvaluationMode = .training
+    ) {
+        precondition(probability >= 0 && probability < 1,
+                     "the dropout probability must be in 0..<1")
+        self.probability = probability
+        self.mode = mode
+    }
+
+    //--------------------------------------------------------------------------
+    @differentiable
+    public func callAsFunction(_ input: Tensor<S,E>) -> Tensor<S,E> {
+        switch mode {
+        case .training: return dropout(input, probability: probability)
+        case .inferring: return input
+        }
+    }
+}
@@ -17,12 +17,34 @@ import SwiftRTCore
 
 //==============================================================================
 /// Embedding
+/// Maps indices to rows of a lookup table. Only the rows selected by a
+/// batch receive gradients, so the gradient is a `SparseRows` value that
+/// stores the output gradient with the looked up indices. Moving along
+/// a gradient adds only those rows to the table.
 public struct Embedding<Element> : Module
 where Element: StorageElement,
       Element.Value: DifferentiableNumeric & BinaryFloatingPoint
 {
     /// A learnable lookup table that maps vocabulary indices to their dense vector representations.
     public var embeddings: TensorR2<Element>
+
+    /// The row sparse gradient of the embeddings
+    public struct TangentVector: Differentiable, AdditiveArithmetic,
+                                 KeyPathIterable
+    {
+        public typealias TangentVector = Self
+        /// The gradient of the looked up rows
+        public var embeddings: SparseRows<Element>
+
+        @inlinable public init(embeddings: SparseRows<Element>) {
+            self.embeddings = embeddings
+        }
+    }
+
+    /// Adds the stored rows of `direction` to the embeddings
+    public mutating func move(along direction: TangentVector) {
+        direction.embeddings.add(to: &embeddings)
+    }
     
     /// Creates an `Embedding` layer with randomly initialized embeddings of shape
     /// `(vocabularySize, embeddingSize)` so that each vocabulary index is given a vector
@@ -60,4 +82,21 @@ where Element: StorageElement,
     public func callAsFunction(_ input: TensorR1<DeviceIndex>) -> TensorR2<Element> {
         embeddings.gathering(indices: input)
     }
+
+    @derivative(of: callAsFunction, wrt: self)
+    @usableFromInline func _vjpCallAsFunction(
+        _ input: TensorR1<DeviceIndex>
+    ) -> (value: TensorR2<Element>,
+          pullback: (TensorR2<Element>) -> TangentVector)
+    {
+        let rowCount = embeddings.shape[0]
+        let indices = input.map { Int($0) }
+        let value = embeddings.gathering(indices: input)
+        return (value, {
+            let rows = $0.shape == value.shape ? $0 :
+                TensorR2(repeating: $0, to: value.shape)
+            return TangentVector(embeddings: SparseRows(
+                rowCount: rowCount, indices: indices, values: rows))
+        })
+    }
 }
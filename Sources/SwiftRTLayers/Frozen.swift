@@ -0,0 +1,547 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import SwiftRTCore
+
+//==============================================================================
+// Frozen inference layers
+// `frozen()` returns an inference only copy of a layer. The weights are
+// copied once into the layout the kernels read directly, any constant
+// folding is done ahead of time, and no differentiation state is kept.
+// Each frozen layer has `into:` calls that reuse the storage of an
+// existing output, so repeated calls with the same input shape do not
+// allocate their outputs or weight packings.
+//
+// Each layer also keeps the kernel scratch memory and the selected gemm
+// plan, and the recurrent cells keep their gate workspace and next
+// states, so synchronous calls with an unchanged shape do not allocate.
+// The first call of each new shape allocates the scratch and tunes the
+// gemm by timing the candidate partitions, unless tuning is disabled or
+// the plan is preloaded from `SWIFTRT_PLAN_CACHE`. The closures of an
+// asynchronous queue are still allocated on every call.
+
+//==============================================================================
+/// FrozenDense
+/// An inference only dense layer. The weights are stored in the
+/// `colTiled32` order, which the gemm reads in place as its column panels,
+/// so they are not packed on each call.
+public struct FrozenDense<E>
+where E: StorageElement, E.Value: StorageElement & Real
+{
+    /// The element-wise activation function.
+    public let activation: ActivationType
+    /// The `[input size, output size]` weights in `colTiled32` order
+    public let weight: TensorR2<E>
+    /// The bias
+    public let bias: TensorR1<E>
+    /// The execution plan key of the tiled weights
+    public let plan: Int
+    /// The gemm scratch and plan kept between calls
+    public let scratch: CpuScratch
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        weight: TensorR2<E>,
+        bias: TensorR1<E>,
+        activation: ActivationType
+    ) {
+        assert(bias.count == weight.shape[1])
+        self.weight = TensorR2(copying: weight, order: .colTiled32)
+        self.bias = TensorR1(copying: bias, order: .row)
+        self.activation = activation
+        self.plan = denseExecutionPlan(self.weight, activation)
+        self.scratch = CpuScratch()
+    }
+
+    //--------------------------------------------------------------------------
+    /// callAsFunction(input:
+    /// - Parameter input: the input, where the last dimension is the
+    ///   input size
+    /// - Returns: the output, where the last dimension is the output size
+    @inlinable public func callAsFunction<S>(
+        _ input: Tensor<S,E>
+    ) -> Tensor<S,E> {
+        let inputs = weight.shape[0]
+        var y = TensorR2<E>()
+        self(TensorR2<E>(reshaping: input, to: Shape2(-1, inputs)), into: &y)
+        var shape = input.shape
+        shape[S.rank - 1] = weight.shape[1]
+        return Tensor<S,E>(reshaping: y, to: shape)
+    }
+
+    /// callAsFunction(input:into:
+    /// - Parameters:
+    ///  - input: the `[batch, input size]` input
+    ///  - output: the `[batch, output size]` output, which is reused
+    ///    when it already has the output shape
+    @inlinable public func callAsFunction(
+        _ input: TensorR2<E>,
+        into output: inout TensorR2<E>
+    ) {
+        assert(input.shape[1] == weight.shape[0],
+               "input size must match the weight rows")
+        dense(input, weight, bias: bias, activation: activation,
+              plan: plan, scratch: scratch, into: &output)
+    }
+}
+
+//==============================================================================
+// Dense freezing
+public extension Dense {
+    /// frozen()
+    /// - Returns: an inference only copy of the layer with prepacked weights
+    @inlinable func frozen() -> FrozenDense<E> {
+        let inputs = weight.shape[S.rank - 2]
+        let outputs = weight.shape[S.rank - 1]
+        return FrozenDense(
+            weight: TensorR2<E>(reshaping: weight, to: Shape2(inputs, outputs)),
+            bias: TensorR1<E>(reshaping: bias, to: Shape1(outputs)),
+            activation: activation)
+    }
+}
+
+public extension Dense where S == Shape2 {
+    /// frozen(folding:
+    /// - Parameter norm: a batch normalization applied to the output of
+    ///   this layer, which must have an identity activation
+    /// - Returns: an inference only layer equivalent to this layer
+    ///   followed by `norm` in `.inferring` mode
+    @inlinable func frozen(folding norm: BatchNorm<Shape2,E>) -> FrozenDense<E> {
+        norm.folded(into: self).frozen()
+    }
+}
+
+//==============================================================================
+/// FrozenConvolution
+/// An inference only convolution. The filter is packed into the layout
+/// of the selected algorithm by the first call and the packing is kept,
+/// so later calls only read the input and write the output.
+public struct FrozenConvolution<Shape, Element, FilterElement>
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: Real & BinaryFloatingPoint,
+      FilterElement: StorageElement,
+      FilterElement.Value == Element.Value
+{
+    // types
+    public typealias Data = Tensor<Shape,Element>
+    public typealias Filter = Tensor<Shape,FilterElement>
+    public typealias Bias = TensorR1<FilterElement>
+    public typealias Op = DeviceConvolution<Shape, Element, FilterElement>
+
+    /// The dense row major convolution filter
+    public let filter: Filter
+    /// The bias vector
+    public let bias: Bias
+    /// device specific convolution operator, which caches the packed filter
+    public let convolutionOp: Op
+
+    //--------------------------------------------------------------------------
+    /// init(layer:
+    /// - Parameter layer: the convolution to freeze. The filter and bias
+    ///   are copied, so later updates of `layer` do not change the cached
+    ///   filter packing.
+    @inlinable public init(
+        _ layer: Convolution<Shape, Element, FilterElement>
+    ) {
+        let op = layer.convolutionOp
+        self.filter = Filter(copying: layer.filter, order: .row)
+        self.bias = Bias(copying: layer.bias, order: .row)
+        self.convolutionOp = currentQueue.convolution(
+            activation: op.activation,
+            strides: op.strides,
+            padding: op.padding,
+            dilations: op.dilations,
+            properties: op.properties,
+            deviceId: currentQueue.deviceIndex,
+            filterBiasBackpropQueueIndex: 2)
+        self.convolutionOp.filterIsConstant = true
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public func callAsFunction(_ input: Data) -> Data {
+        convolutionOp.forward(x: input, filter: filter, bias: bias,
+                              mode: .inferring)
+    }
+
+    /// callAsFunction(input:into:
+    /// - Parameters:
+    ///  - input: the input
+    ///  - output: the output, which is reused when it already has the
+    ///    output shape and layout
+    @inlinable public func callAsFunction(
+        _ input: Data,
+        into output: inout Data
+    ) {
+        convolutionOp.forward(x: input, filter: filter, bias: bias,
+                              mode: .inferring, into: &output)
+    }
+}
+
+//==============================================================================
+// Convolution freezing
+public extension Convolution {
+    /// frozen()
+    /// - Returns: an inference only copy of the layer that caches its
+    ///   packed filter
+    @inlinable func frozen() -> FrozenConvolution<Shape,Element,FilterElement> {
+        FrozenConvolution(self)
+    }
+}
+
+public extension Convolution where FilterElement == Element,
+                                   Element.Value: DifferentiableNumeric {
+    /// frozen(folding:
+    /// - Parameter norm: a batch normalization applied to the output of
+    ///   this layer, which must have an identity activation
+    /// - Returns: an inference only layer equivalent to this layer
+    ///   followed by `norm` in `.inferring` mode
+    @inlinable func frozen(
+        folding norm: BatchNorm<Shape,Element>
+    ) -> FrozenConvolution<Shape,Element,Element> {
+        norm.folded(into: self).frozen()
+    }
+}
+
+//==============================================================================
+/// FrozenLSTMCell
+/// An inference only LSTM cell. The fused weights are split into the
+/// input and state weights, which are stored in the `colTiled32` order,
+/// so a step is two gemms without concatenating the input and state.
+/// The input projection is added to the state gemm output tiles as a
+/// residual, followed by the fused pointwise pass.
+public struct FrozenLSTMCell<Element>
+where Element: StorageElement,
+      Element.Value: StorageElement & DifferentiableNumeric &
+        Real & BinaryFloatingPoint
+{
+    // types
+    public typealias State = LSTMCell<Element>.State
+
+    /// The `[input size, 4 * hidden size]` weights in `colTiled32` order
+    public let inputWeight: TensorR2<Element>
+    /// The `[hidden size, 4 * hidden size]` weights in `colTiled32` order
+    public let stateWeight: TensorR2<Element>
+    /// The `[4 * hidden size]` biases
+    public let bias: TensorR1<Element>
+    public let inputPlan: Int
+    public let statePlan: Int
+    public let hiddenSize: Int
+    /// The gemm scratch and plans of the input and state projections
+    public let inputScratch: CpuScratch
+    public let stateScratch: CpuScratch
+    /// The workspace and next states of `callAsFunction`
+    public let buffers: Buffers
+
+    /// The intermediate gate values of a step, which are reused
+    /// across steps
+    public struct Workspace {
+        public var inputGates = TensorR2<Element>()
+        public var gates = TensorR2<Element>()
+        @inlinable public init() {}
+
+        /// init(batchSize:hiddenSize:
+        /// creates the gate values of a batch
+        @inlinable public init(batchSize: Int, hiddenSize: Int) {
+            let shape = Shape2(batchSize, 4 * hiddenSize)
+            inputGates = TensorR2(shape: shape, order: .row)
+            gates = TensorR2(shape: shape, order: .row)
+        }
+    }
+
+    /// The workspace and the two next states that `callAsFunction`
+    /// alternates, which are allocated for the batch size given when
+    /// the cell is frozen. Alternating the states lets a caller pass the
+    /// previous result back as the state without it being overwritten.
+    public final class Buffers {
+        public let mutex = Mutex()
+        public var workspace: Workspace
+        public var states: [State]
+        public var next = 0
+
+        @inlinable public init(batchSize: Int, hiddenSize: Int) {
+            let shape = Shape2(batchSize, hiddenSize)
+            workspace = Workspace(batchSize: batchSize, hiddenSize: hiddenSize)
+            states = (0..<2).map { _ in
+                State(cell: TensorR2(shape: shape, order: .row),
+                      hidden: TensorR2(shape: shape, order: .row))
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(cell:batchSize:
+    /// - Parameters:
+    ///  - cell: the cell to freeze
+    ///  - batchSize: the batch size the buffers of `callAsFunction` are
+    ///    allocated for
+    @inlinable public init(_ cell: LSTMCell<Element>, batchSize: Int = 1) {
+        let inputSize = cell.fusedWeight.shape[0] - cell.hiddenSize
+        hiddenSize = cell.hiddenSize
+        inputWeight = TensorR2(copying: cell.fusedWeight[0..<inputSize, 0...],
+                               order: .colTiled32)
+        stateWeight = TensorR2(copying: cell.fusedWeight[inputSize..., 0...],
+                               order: .colTiled32)
+        bias = TensorR1(copying: cell.fusedBias, order: .row)
+        inputPlan = denseExecutionPlan(inputWeight, .identity)
+        statePlan = denseExecutionPlan(stateWeight, .identity)
+        inputScratch = CpuScratch()
+        stateScratch = CpuScratch()
+        buffers = Buffers(batchSize: batchSize, hiddenSize: hiddenSize)
+    }
+
+    //--------------------------------------------------------------------------
+    /// callAsFunction(input:state:
+    /// computes the next state into the kept buffers. The storage of a
+    /// returned state is written again two calls later, so it is copied
+    /// then if the caller still holds it.
+    /// - Returns: the next state
+    @inlinable public func callAsFunction(
+        _ input: TensorR2<Element>,
+        state: State
+    ) -> State {
+        buffers.mutex.access {
+            let i = buffers.next
+            buffers.next = 1 - i
+            step(input, state, into: &buffers.states[i],
+                 workspace: &buffers.workspace)
+            return buffers.states[i]
+        }
+    }
+
+    /// step(input:state:into:workspace:
+    /// computes the next state. When the batch size does not change, the
+    /// storage of `next` and `workspace` is reused.
+    /// - Parameters:
+    ///  - input: the `[batch, input size]` input
+    ///  - state: the current state, which must not share storage with
+    ///    `next`. Alternating two states avoids this.
+    ///  - next: the next state
+    ///  - workspace: the gate values
+    @inlinable public func step(
+        _ input: TensorR2<Element>,
+        _ state: State,
+        into next: inout State,
+        workspace: inout Workspace
+    ) {
+        dense(input, inputWeight, bias: bias, plan: inputPlan,
+              scratch: inputScratch, into: &workspace.inputGates)
+        dense(state.hidden, stateWeight, residual: workspace.inputGates,
+              plan: statePlan, scratch: stateScratch,
+              into: &workspace.gates)
+        lstmPointwise(gates: workspace.gates, cell: state.cell,
+                      newCell: &next.cell, hidden: &next.hidden)
+    }
+}
+
+public extension LSTMCell {
+    /// frozen(batchSize:
+    /// - Parameter batchSize: the batch size the buffers of the frozen
+    ///   cell are allocated for
+    /// - Returns: an inference only copy of the cell with prepacked weights
+    @inlinable func frozen(batchSize: Int = 1) -> FrozenLSTMCell<Element> {
+        FrozenLSTMCell(self, batchSize: batchSize)
+    }
+}
+
+//==============================================================================
+/// FrozenGRUCell
+/// An inference only GRU cell with the input and state weights stored in
+/// the `colTiled32` order, so a step is two gemms followed by the fused
+/// pointwise pass.
+public struct FrozenGRUCell<Element>
+where Element: StorageElement,
+      Element.Value: StorageElement & DifferentiableNumeric &
+        Real & BinaryFloatingPoint
+{
+    // types
+    public typealias State = TensorR2<Element>
+
+    /// The `[input size, 3 * hidden size]` weights in `colTiled32` order
+    public let inputWeight: TensorR2<Element>
+    /// The `[hidden size, 3 * hidden size]` weights in `colTiled32` order
+    public let stateWeight: TensorR2<Element>
+    /// The `[3 * hidden size]` biases
+    public let bias: TensorR1<Element>
+    public let inputPlan: Int
+    public let statePlan: Int
+    public let hiddenSize: Int
+    /// The gemm scratch and plans of the input and state projections
+    public let inputScratch: CpuScratch
+    public let stateScratch: CpuScratch
+    /// The workspace and next states of `callAsFunction`
+    public let buffers: Buffers
+
+    /// The projections of a step, which are reused across steps
+    public struct Workspace {
+        public var inputGates = TensorR2<Element>()
+        public var stateGates = TensorR2<Element>()
+        @inlinable public init() {}
+
+        /// init(batchSize:hiddenSize:
+        /// creates the projections of a batch
+        @inlinable public init(batchSize: Int, hiddenSize: Int) {
+            let shape = Shape2(batchSize, 3 * hiddenSize)
+            inputGates = TensorR2(shape: shape, order: .row)
+            stateGates = TensorR2(shape: shape, order: .row)
+        }
+    }
+
+    /// The workspace and the two next states that `callAsFunction`
+    /// alternates, which are allocated for the batch size given when
+    /// the cell is frozen
+    public final class Buffers {
+        public let mutex = Mutex()
+        public var workspace: Workspace
+        public var states: [State]
+        public var next = 0
+
+        @inlinable public init(batchSize: Int, hiddenSize: Int) {
+            let shape = Shape2(batchSize, hiddenSize)
+            workspace = Workspace(batchSize: batchSize, hiddenSize: hiddenSize)
+            states = (0..<2).map { _ in State(shape: shape, order: .row) }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// init(cell:batchSize:
+    /// - Parameters:
+    ///  - cell: the cell to freeze
+    ///  - batchSize: the batch size the buffers of `callAsFunction` are
+    ///    allocated for
+    @inlinable public init(_ cell: GRUCell<Element>, batchSize: Int = 1) {
+        hiddenSize = cell.hiddenSize
+        inputWeight = TensorR2(copying: cell.fusedInputWeight,
+                               order: .colTiled32)
+        stateWeight = TensorR2(copying: cell.fusedStateWeight,
+                               order: .colTiled32)
+        bias = TensorR1(copying: cell.fusedBias, order: .row)
+        inputPlan = denseExecutionPlan(inputWeight, .identity)
+        statePlan = denseExecutionPlan(stateWeight, .identity)
+        inputScratch = CpuScratch()
+        stateScratch = CpuScratch()
+        buffers = Buffers(batchSize: batchSize, hiddenSize: hiddenSize)
+    }
+
+    //--------------------------------------------------------------------------
+    /// callAsFunction(input:state:
+    /// computes the next state into the kept buffers. The storage of a
+    /// returned state is written again two calls later, so it is copied
+    /// then if the caller still holds it.
+    /// - Returns: the next state
+    @inlinable public func callAsFunction(
+        _ input: TensorR2<Element>,
+        state: State
+    ) -> State {
+        buffers.mutex.access {
+            let i = buffers.next
+            buffers.next = 1 - i
+            step(input, state, into: &buffers.states[i],
+                 workspace: &buffers.workspace)
+            return buffers.states[i]
+        }
+    }
+
+    /// step(input:state:into:workspace:
+    /// computes the next state. When the batch size does not change, the
+    /// storage of `next` and `workspace` is reused.
+    /// - Parameters:
+    ///  - input: the `[batch, input size]` input
+    ///  - state: the current state, which must not share storage with
+    ///    `next`. Alternating two states avoids this.
+    ///  - next: the next state
+    ///  - workspace: the projections
+    @inlinable public func step(
+        _ input: TensorR2<Element>,
+        _ state: State,
+        into next: inout State,
+        workspace: inout Workspace
+    ) {
+        dense(input, inputWeight, bias: bias, plan: inputPlan,
+              scratch: inputScratch, into: &workspace.inputGates)
+        dense(state, stateWeight, plan: statePlan, scratch: stateScratch,
+              into: &workspace.stateGates)
+        gruPointwise(inputGates: workspace.inputGates,
+                     stateGates: workspace.stateGates,
+                     state: state, newState: &next)
+    }
+}
+
+public extension GRUCell {
+    /// frozen(batchSize:
+    /// - Parameter batchSize: the batch size the buffers of the frozen
+    ///   cell are allocated for
+    /// - Returns: an inference only copy of the cell with prepacked weights
+    @inlinable func frozen(batchSize: Int = 1) -> FrozenGRUCell<Element> {
+        FrozenGRUCell(self, batchSize: batchSize)
+    }
+}
+
+//==============================================================================
+/// FrozenEmbedding
+/// An inference only embedding with a dense row major table, so each
+/// looked up row is copied as one contiguous span.
+public struct FrozenEmbedding<Element>
+where Element: StorageElement
+{
+    /// The `[vocabulary size, embedding size]` table
+    public let embeddings: TensorR2<Element>
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(embeddings: TensorR2<Element>) {
+        self.embeddings = TensorR2(copying: embeddings, order: .row)
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public func callAsFunction(
+        _ input: TensorR1<DeviceIndex>
+    ) -> TensorR2<Element> {
+        var output = TensorR2<Element>()
+        self(input, into: &output)
+        return output
+    }
+
+    /// callAsFunction(indices:into:
+    /// - Parameters:
+    ///  - indices: the rows to look up, which are read in place
+    ///  - output: the `[indices, embedding size]` rows, which are reused
+    ///    when the number of indices does not change
+    @inlinable public func callAsFunction(
+        _ indices: TensorR1<DeviceIndex>,
+        into output: inout TensorR2<Element>
+    ) {
+        gather(from: embeddings, indices: indices, into: &output)
+    }
+
+    /// callAsFunction(indices:into:
+    /// - Parameters:
+    ///  - indices: the rows to look up
+    ///  - output: the `[indices, embedding size]` rows, which are reused
+    ///    when the number of indices does not change
+    @inlinable public func callAsFunction(
+        _ indices: [Int],
+        into output: inout TensorR2<Element>
+    ) {
+        gather(from: embeddings, indices: indices, into: &output)
+    }
+}
+
+public extension Embedding {
+    /// frozen()
+    /// - Returns: an inference only copy of the embedding
+    @inlinable func frozen() -> FrozenEmbedding<Element> {
+        FrozenEmbedding(embeddings: embeddings)
+    }
+}
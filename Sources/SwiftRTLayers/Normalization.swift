@@ -1,5 +1,5 @@
 //******************************************************************************
-// Copyright 2019 Google LLC
+// Copyright 2020 Google LLC
 //
 // Licensed under the Apache License, Version 2.0 (the "License");
 // you may not use this file except in compliance with the License.
@@ -15,111 +15,288 @@
 //
 import Foundation
 import Numerics
+import SwiftRTCore
 
-////==============================================================================
-///// BatchNorm
-//public struct BatchNorm<T> where
-//    T: DifferentiableTensorView, T.Element: ScalarElement & BinaryFloatingPoint
-//{
-//    /// The feature dimension.
-//    @noDerivative public let axis: Int
-//    /// The momentum for the running mean and running variance.
-//    @noDerivative public let momentum: T.Element
-//    /// The offset value, also known as beta.
-//    public var offset: Vector<T.Element>
-//    /// The scale value, also known as gamma.
-//    public var scale: Vector<T.Element>
-//    /// The variance epsilon value.
-//    @noDerivative public let epsilon: T.Element
-//    /// The running mean.
-//    @noDerivative public var runningMean: Parameter<Vector<T.Element>>
-//    /// The running variance.
-//    @noDerivative public var runningVariance: Parameter<Vector<T.Element>>
-//
-//    //--------------------------------------------------------------------------
-//    /// Creates a batch normalization layer.
-//    ///
-//    /// - Parameters:
-//    ///   - axis: The axis that should not be normalized (typically the feature axis).
-//    ///   - momentum: The momentum for the moving average.
-//    ///   - offset: The offset to be added to the normalized tensor.
-//    ///   - scale: The scale to multiply the normalized tensor by.
-//    ///   - epsilon: A small scalar added to the denominator to improve numerical stability.
-//    ///   - runningMean: The running mean.
-//    ///   - runningVariance: The running variance.
-//    public init(
-//        axis: Int,
-//        momentum: T.Element,
-//        offset: Vector<T.Element>,
-//        scale: Vector<T.Element>,
-//        epsilon: T.Element,
-//        runningMean: Vector<T.Element>,
-//        runningVariance: Vector<T.Element>
-//    ) {
-//        precondition(offset.count == scale.count,
-//                     "The offset and the scale must have same count")
-//        self.axis = axis
-//        self.momentum = momentum
-//        self.offset = offset
-//        self.scale = scale
-//        self.epsilon = epsilon
-//        self.runningMean = Parameter(runningMean)
-//        self.runningVariance = Parameter(runningVariance)
-//    }
-//
-//    /// Creates a batch normalization layer.
-//    ///
-//    /// - Parameters:
-//    ///   - featureCount: The number of features.
-//    ///   - axis: The axis that should be normalized (typically the features axis).
-//    ///   - momentum: The momentum for the moving average.
-//    ///   - epsilon: A small scalar added to the denominator to improve numerical stability.
-//    public init(
-//        featureCount: Int,
-//        axis: Int = -1,
-//        momentum: T.Element = 0.99,
-//        epsilon: T.Element = 0.001
-//    ) {
-//        self.init(
-//            axis: axis,
-//            momentum: momentum,
-//            offset: Vector<T.Element>(zeros: (featureCount)),
-//            scale: Vector<T.Element>(ones: (featureCount)),
-//            epsilon: epsilon,
-//            runningMean: Vector(T.Element.zero),
-//            runningVariance: Vector(T.Element.one))
-//    }
-//    /// Returns the output obtained from applying the layer to the given input.
-//    ///
-//    /// - Parameter input: The input to the layer.
-//    /// - Returns: The output.
-//    @differentiable
-//    public func callAsFunction(_ input: T) -> T {
-//        input
-////        let positiveAxis = (input.rank + axis) % input.rank
-////        precondition(input.shape[positiveAxis] == offset.shape[0],
-////                     "The number of features of the input and the offset doesn't match.")
-////        var offset = self.offset
-////        var scale = self.scale
-////        if positiveAxis != input.rank - 1 {
-////            var broadcastShape = TensorShape([Int](repeating: 1, count: input.rank))
-////            broadcastShape[positiveAxis] = input.shape[positiveAxis]
-////            offset = offset.reshaped(to: broadcastShape)
-////            scale = scale.reshaped(to: broadcastShape)
-////        }
-////        switch platform.learningPhase {
-////        case .training:
-////          var normalizedAxes = Array(0..<input.rank)
-////          normalizedAxes.remove(at: positiveAxis)
-////          let moments = input.moments(alongAxes: normalizedAxes)
-////          let decayMomentum = Tensor(1 - momentum, on: input.device)
-////          runningMean.value += (moments.mean - runningMean.value) * decayMomentum
-////          runningVariance.value += (moments.variance - runningVariance.value) * decayMomentum
-////          let inv = rsqrt(moments.variance + Tensor(epsilon, on: input.device)) * scale
-////          return (input - moments.mean) * inv + offset
-////        case .inference:
-////          let inv = rsqrt(runningVariance.value + Tensor(epsilon, on: input.device)) * scale
-////          return (input - runningMean.value) * inv + offset
-////        }
-//    }
-//}
+//==============================================================================
+/// BatchNorm
+/// Normalizes each feature with the statistics of the batch, including
+/// the spatial positions of rank 3 or higher inputs. The features are the
+/// last dimension, or the channels of the `NHWC` and `NDHWC` orders.
+/// In `.training` mode the batch statistics are used and the running
+/// averages are updated. In `.inferring` mode the running averages are
+/// used, and the layer can be folded into a preceding `Dense` or
+/// `Convolution` layer.
+public struct BatchNorm<S,E>: Layer
+where S: TensorShape,
+      E: StorageElement,
+      E.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    /// The scale value, also known as gamma.
+    public var scale: TensorR1<E>
+    /// The offset value, also known as beta.
+    public var offset: TensorR1<E>
+    /// The momentum for the running mean and running variance.
+    @noDerivative public let momentum: E.Value
+    /// The variance epsilon value.
+    @noDerivative public let epsilon: E.Value
+    /// The element-wise activation function applied to the output.
+    @noDerivative public let activation: ActivationType
+    /// The running mean.
+    @noDerivative public let runningMean: Parameter<Shape1,E>
+    /// The running variance.
+    @noDerivative public let runningVariance: Parameter<Shape1,E>
+    /// Selects the batch statistics or the running averages
+    @noDerivative public var mode: EvaluationMode
+
+    //--------------------------------------------------------------------------
+    /// Creates a batch normalization layer.
+    ///
+    /// - Parameters:
+    ///   - scale: The initial scale value.
+    ///   - offset: The initial offset value.
+    ///   - runningMean: The initial running mean.
+    ///   - runningVariance: The initial running variance.
+    ///   - momentum: The momentum for the running averages.
+    ///   - epsilon: A small scalar added to the variance.
+    ///   - activation: The element-wise activation function.
+    ///   - mode: Selects the batch statistics or the running averages.
+    @inlinable public init(
+        scale: TensorR1<E>,
+        offset: TensorR1<E>,
+        runningMean: TensorR1<E>,
+        runningVariance: TensorR1<E>,
+        momentum: E.Value = 0.99,
+        epsilon: E.Value = 0.001,
+        activation: ActivationType = .identity,
+        mode: EvaluationMode = .training
+    ) {
+        assert(offset.count == scale.count && runningMean.count == scale.count
+                && runningVariance.count == scale.count,
+               "the parameters must have one value per feature")
+        self.scale = scale
+        self.offset = offset
+        self.runningMean = Parameter(runningMean)
+        self.runningVariance = Parameter(runningVariance)
+        self.momentum = momentum
+        self.epsilon = epsilon
+        self.activation = activation
+        self.mode = mode
+    }
+
+    /// Creates a batch normalization layer with a unit scale, a zero
+    /// offset, and running averages for a zero mean and unit variance.
+    ///
+    /// - Parameters:
+    ///   - featureCount: The number of features.
+    ///   - momentum: The momentum for the running averages.
+    ///   - epsilon: A small scalar added to the variance.
+    ///   - activation: The element-wise activation function.
+    ///   - mode: Selects the batch statistics or the running averages.
+    @inlinable public init(
+        featureCount: Int,
+        momentum: E.Value = 0.99,
+        epsilon: E.Value = 0.001,
+        activation: ActivationType = .identity,
+        mode: EvaluationMode = .training
+    ) {
+        self.init(scale: TensorR1(ones: Shape1(featureCount)),
+                  offset: TensorR1(zeros: Shape1(featureCount)),
+                  runningMean: TensorR1(zeros: Shape1(featureCount)),
+                  runningVariance: TensorR1(ones: Shape1(featureCount)),
+                  momentum: momentum, epsilon: epsilon,
+                  activation: activation, mode: mode)
+    }
+
+    //--------------------------------------------------------------------------
+    @differentiable
+    public func callAsFunction(_ input: Tensor<S,E>) -> Tensor<S,E> {
+        forward(input).y
+    }
+
+    @derivative(of: callAsFunction)
+    @usableFromInline func _vjpCallAsFunction(_ input: Tensor<S,E>) -> (
+        value: Tensor<S,E>,
+        pullback: (Tensor<S,E>) -> (TangentVector, Tensor<S,E>)
+    ) {
+        // the normalized values are recomputed from the saved statistics
+        let (y, mean, variance) = forward(input)
+        return (y, { [self] in
+            let diff = batchNormGradient(
+                input, y, $0, scale: scale, mean: mean, variance: variance,
+                epsilon: epsilon, activation: activation,
+                usesBatchStatistics: mode == .training)
+            return (TangentVector(scale: diff.scale, offset: diff.offset),
+                    diff.x)
+        })
+    }
+
+    //--------------------------------------------------------------------------
+    /// forward
+    /// - Returns: the output and the statistics used to compute it
+    @inlinable func forward(_ input: Tensor<S,E>)
+        -> (y: Tensor<S,E>, mean: TensorR1<E>, variance: TensorR1<E>)
+    {
+        switch mode {
+        case .training:
+            let result = batchNormTraining(
+                input, scale: scale, offset: offset, epsilon: epsilon,
+                activation: activation)
+            updateRunningStatistics(result.mean, result.variance,
+                                    input.count / scale.count)
+            return result
+
+        case .inferring:
+            let mean = runningMean.value, variance = runningVariance.value
+            let y = batchNormInference(
+                input, scale: scale, offset: offset, mean: mean,
+                variance: variance, epsilon: epsilon, activation: activation)
+            return (y, mean, variance)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    /// updateRunningStatistics
+    /// updates the running averages with the batch statistics. The batch
+    /// variance is corrected for the number of values per feature.
+    @inlinable func updateRunningStatistics(
+        _ mean: TensorR1<E>,
+        _ variance: TensorR1<E>,
+        _ count: Int
+    ) {
+        let unbiased = variance * (E.Value(count) / E.Value(Swift.max(1, count - 1)))
+        runningMean.value = runningMean.value * momentum + mean * (1 - momentum)
+        runningVariance.value = runningVariance.value * momentum +
+            unbiased * (1 - momentum)
+    }
+
+    //--------------------------------------------------------------------------
+    /// the per feature scale and shift of the inference transform
+    /// `y = x * scale + shift`
+    @inlinable public var inferenceTransform:
+        (scale: TensorR1<E>, shift: TensorR1<E>)
+    {
+        batchNormFolding(scale: scale, offset: offset,
+                         mean: runningMean.value,
+                         variance: runningVariance.value, epsilon: epsilon)
+    }
+
+    //--------------------------------------------------------------------------
+    /// folded(into:
+    /// - Parameter layer: a convolution with an identity activation, whose
+    ///   output is the input of this layer
+    /// - Returns: a `Convolution` that is equivalent to `layer` followed
+    ///   by this layer in `.inferring` mode
+    public func folded(
+        into layer: Convolution<S,E,E>
+    ) -> Convolution<S,E,E> {
+        precondition(layer.activation == .identity,
+                     "the folded layer activation must be identity")
+        let (a, shift) = inferenceTransform
+        return Convolution(filter: scaledColumns(layer.filter, a),
+                           bias: layer.bias * a + shift,
+                           activation: activation,
+                           strides: layer.strides,
+                           padding: layer.padding,
+                           dilations: layer.dilations,
+                           groups: layer.groups)
+    }
+}
+
+public extension BatchNorm where S == Shape2 {
+    //--------------------------------------------------------------------------
+    /// folded(into:
+    /// - Parameter layer: a dense layer with an identity activation, whose
+    ///   output is the input of this layer
+    /// - Returns: a `Dense` layer that is equivalent to `layer` followed
+    ///   by this layer in `.inferring` mode
+    func folded(into layer: Dense<Shape2,E>) -> Dense<Shape2,E> {
+        precondition(layer.activation == .identity,
+                     "the folded layer activation must be identity")
+        let (a, shift) = inferenceTransform
+        let bias = TensorR1<E>(reshaping: layer.bias, to: a.shape)
+        return Dense(weight: scaledColumns(layer.weight, a),
+                     bias: bias * a + shift,
+                     activation: activation)
+    }
+}
+
+//==============================================================================
+/// scaledColumns
+/// - Returns: `weight` with each output feature of its last dimension
+///   multiplied by the corresponding value of `a`
+@inlinable func scaledColumns<S,E>(
+    _ weight: Tensor<S,E>,
+    _ a: TensorR1<E>
+) -> Tensor<S,E> where E.Value: Real {
+    let weight = weight.isContiguous && weight.order == .row ? weight :
+        Tensor(copying: weight, order: .row)
+    let w = TensorR2<E>(reshaping: weight, to: Shape2(-1, a.count))
+    let row = TensorR2<E>(reshaping: a, to: Shape2(1, a.count))
+    return Tensor<S,E>(reshaping: w * TensorR2(repeating: row, to: w.shape),
+                       to: weight.shape)
+}
+
+//==============================================================================
+/// LayerNorm
+/// Normalizes the features of each item, which are the last dimension,
+/// or the channels of the `NHWC` and `NDHWC` orders.
+public struct LayerNorm<S,E>: Layer
+where S: TensorShape,
+      E: StorageElement,
+      E.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    /// The scale value, also known as gamma.
+    public var scale: TensorR1<E>
+    /// The offset value, also known as beta.
+    public var offset: TensorR1<E>
+    /// The variance epsilon value.
+    @noDerivative public let epsilon: E.Value
+    /// The element-wise activation function applied to the output.
+    @noDerivative public let activation: ActivationType
+
+    //--------------------------------------------------------------------------
+    /// Creates a layer normalization layer.
+    ///
+    /// - Parameters:
+    ///   - scale: The initial scale value.
+    ///   - offset: The initial offset value.
+    ///   - epsilon: A small scalar added to the variance.
+    ///   - activation: The element-wise activation function.
+    @inlinable public init(
+        scale: TensorR1<E>,
+        offset: TensorR1<E>,
+        epsilon: E.Value = 0.00001,
+        activation: ActivationType = .identity
+    ) {
+        assert(offset.count == scale.count,
+               "the parameters must have one value per feature")
+        self.scale = scale
+        self.offset = offset
+        self.epsilon = epsilon
+        self.activation = activation
+    }
+
+    /// Creates a layer normalization layer with a unit scale and a zero
+    /// offset.
+    ///
+    /// - Parameters:
+    ///   - featureCount: The number of features.
+    ///   - epsilon: A small scalar added to the variance.
+    ///   - activation: The element-wise activation function.
+    @inlinable public init(
+        featureCount: Int,
+        epsilon: E.Value = 0.00001,
+        activation: ActivationType = .identity
+    ) {
+        self.init(scale: TensorR1(ones: Shape1(featureCount)),
+                  offset: TensorR1(zeros: Shape1(featureCount)),
+                  epsilon: epsilon, activation: activation)
+    }
+
+    //--------------------------------------------------------------------------
+    @differentiable
+    public func callAsFunction(_ input: Tensor<S,E>) -> Tensor<S,E> {
+        layerNorm(input, scale: scale, offset: offset, epsilon: epsilon,
+                  activation: activation)
+    }
+}
@@ -0,0 +1,422 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import SwiftRTCore
+
+//==============================================================================
+/// Optimizer
+/// Updates the differentiable parameters of a model along a gradient.
+/// The optimizers apply one fused element wise kernel to each parameter,
+/// which reads the weights, the gradient and the moments once and writes
+/// them once. All parameters of the model are updated by a single
+/// multi tensor launch that balances the elements across the cores.
+public protocol Optimizer {
+    /// The type of the model to optimize.
+    associatedtype Model: Module
+
+    /// Updates the model along the specified direction.
+    ///
+    /// - Parameters:
+    ///   - model: The model to update.
+    ///   - direction: The direction, typically the gradient of the loss.
+    func update(_ model: inout Model, along direction: Model.TangentVector)
+}
+
+//==============================================================================
+/// SGD
+/// Stochastic gradient descent, with optional momentum and nesterov
+/// momentum. The momentum is kept for each parameter in the storage
+/// order of its weights.
+public final class SGD<Model, E>: Optimizer
+where Model: Module, E: StorageElement, E.Value: BinaryFloatingPoint
+{
+    /// The learning rate.
+    public var learningRate: E.Value
+    /// The momentum factor, where zero is plain gradient descent.
+    public var momentum: E.Value
+    /// Use nesterov momentum.
+    public var nesterov: Bool
+    /// The parameters and their momentum
+    var parameters = _OptimizerParameters<Model,E>()
+
+    //--------------------------------------------------------------------------
+    /// Creates a stochastic gradient descent optimizer.
+    ///
+    /// - Parameters:
+    ///   - model: The model to optimize.
+    ///   - learningRate: The learning rate.
+    ///   - momentum: The momentum factor.
+    ///   - nesterov: Use nesterov momentum.
+    public init(
+        for model: __shared Model,
+        learningRate: E.Value = 0.01,
+        momentum: E.Value = 0,
+        nesterov: Bool = false
+    ) {
+        precondition(learningRate >= 0, "learning rate must be non-negative")
+        precondition(momentum >= 0, "momentum must be non-negative")
+        self.learningRate = learningRate
+        self.momentum = momentum
+        self.nesterov = nesterov
+    }
+
+    //--------------------------------------------------------------------------
+    public func update(
+        _ model: inout Model,
+        along direction: Model.TangentVector
+    ) {
+        let rule: OptimizerRule<E.Value> = momentum == 0 ?
+            .sgd(learningRate: learningRate) :
+            .momentum(learningRate: learningRate, momentum: momentum,
+                      nesterov: nesterov)
+        parameters.update(&model, along: direction, rule: rule)
+    }
+}
+
+//==============================================================================
+/// Adam
+/// Adam optimizer, Kingma and Ba, 2014. The first and second moments are
+/// kept for each parameter in the storage order of its weights, and the
+/// bias correction is folded into the step size of each step.
+/// `SparseRows` gradients update only the moments and weights of their
+/// stored rows, which is the lazy variant of Adam.
+public final class Adam<Model, E>: Optimizer
+where Model: Module, E: StorageElement, E.Value: BinaryFloatingPoint
+{
+    /// The learning rate.
+    public var learningRate: E.Value
+    /// The exponential decay rate of the first moment.
+    public var beta1: E.Value
+    /// The exponential decay rate of the second moment.
+    public var beta2: E.Value
+    /// A small scalar added to the denominator for numerical stability.
+    public var epsilon: E.Value
+    /// The number of steps taken.
+    public var step: Int = 0
+    /// The parameters and their moments
+    var parameters = _OptimizerParameters<Model,E>()
+
+    //--------------------------------------------------------------------------
+    /// Creates an Adam optimizer.
+    ///
+    /// - Parameters:
+    ///   - model: The model to optimize.
+    ///   - learningRate: The learning rate.
+    ///   - beta1: The exponential decay rate of the first moment.
+    ///   - beta2: The exponential decay rate of the second moment.
+    ///   - epsilon: A small scalar added to the denominator.
+    public init(
+        for model: __shared Model,
+        learningRate: E.Value = 1e-3,
+        beta1: E.Value = 0.9,
+        beta2: E.Value = 0.999,
+        epsilon: E.Value = 1e-8
+    ) {
+        precondition(learningRate >= 0, "learning rate must be non-negative")
+        precondition(0 <= beta1 && beta1 < 1, "beta1 must be in 0..<1")
+        precondition(0 <= beta2 && beta2 < 1, "beta2 must be in 0..<1")
+        self.learningRate = learningRate
+        self.beta1 = beta1
+        self.beta2 = beta2
+        self.epsilon = epsilon
+    }
+
+    //--------------------------------------------------------------------------
+    public func update(
+        _ model: inout Model,
+        along direction: Model.TangentVector
+    ) {
+        step += 1
+        let t = Double(step)
+        let correction = (1 - pow(Double(beta2), t)).squareRoot() /
+            (1 - pow(Double(beta1), t))
+        let rule = OptimizerRule<E.Value>.adam(
+            stepSize: learningRate * E.Value(correction),
+            beta1: beta1, beta2: beta2, epsilon: epsilon)
+        parameters.update(&model, along: direction, rule: rule)
+    }
+}
+
+//==============================================================================
+/// _OptimizerParameters
+/// Finds the tensors of a model and of its gradient, and updates all of
+/// them with one `optimizerUpdate` launch. The model tensors and the
+/// gradients are matched by their property paths, such as
+/// `layers.0.weight`, so model tensors that are `@noDerivative` and
+/// tangent vectors that declare their properties in a different order are
+/// handled. A parameter with a zero gradient is not updated. Each weight
+/// is taken out of the model while it is updated, so its storage is
+/// uniquely referenced and is updated in place.
+struct _OptimizerParameters<Model, E>
+where Model: Module, E: StorageElement, E.Value: BinaryFloatingPoint
+{
+    /// the key paths of the model tensors that have a gradient
+    var weights: [PartialKeyPath<Model>]?
+    /// the key paths of the matching gradient tensors
+    var gradients: [PartialKeyPath<Model.TangentVector>]?
+    /// the moments of each parameter
+    var moments: [[TensorR1<E>]] = []
+
+    init() {}
+
+    //--------------------------------------------------------------------------
+    /// update(model:direction:rule:
+    mutating func update(
+        _ model: inout Model,
+        along direction: Model.TangentVector,
+        rule: OptimizerRule<E.Value>
+    ) {
+        if weights == nil {
+            var modelPaths = [String: AnyKeyPath]()
+            _labeledKeyPaths(of: model, "", nil, &modelPaths) {
+                ($0 as? _OptimizerWeight.Type)?._element == E.self
+            }
+            var gradientPaths = [String: AnyKeyPath]()
+            _labeledKeyPaths(of: direction, "", nil, &gradientPaths) {
+                ($0 as? _OptimizerGradient.Type)?._element == E.self
+            }
+            weights = []
+            gradients = []
+            for name in gradientPaths.keys.sorted() {
+                guard let weight = modelPaths[name] else {
+                    preconditionFailure(
+                        "the gradient \(name) has no model tensor")
+                }
+                weights!.append(weight as! PartialKeyPath<Model>)
+                gradients!.append(gradientPaths[name]
+                                    as! PartialKeyPath<Model.TangentVector>)
+            }
+            moments = Array(repeating: [], count: weights!.count)
+        }
+
+        // collect the parameters that have a gradient
+        var views = [_OptimizerWeightView<Model,E>]()
+        var indices = [Int]()
+        var parameters = [OptimizerParameter<E>]()
+        for (i, keyPath) in weights!.enumerated() {
+            let gradient = direction[keyPath: gradients![i]]
+                as! _OptimizerGradient
+            guard let weightType =
+                    type(of: model[keyPath: keyPath]) as? _OptimizerWeight.Type,
+                  let taken: (TensorR1<E>, _OptimizerWeightView<Model,E>) =
+                    weightType._take(keyPath, from: &model) else { continue }
+            let (weight, view) = taken
+            guard let grad: _OptimizerGradientValues<E> =
+                    gradient._values(order: view.order,
+                                     count: weight.count) else {
+                view.restore(weight, &model)
+                continue
+            }
+
+            // the moments are created on first use
+            let count = weight.count
+            while moments[i].count < rule.momentCount {
+                moments[i].append(TensorR1<E>(zeros: Shape1(count)))
+            }
+            var first = TensorR1<E>(), second = TensorR1<E>()
+            if rule.momentCount > 0 { swap(&first, &moments[i][0]) }
+            if rule.momentCount > 1 { swap(&second, &moments[i][1]) }
+
+            parameters.append(OptimizerParameter(
+                weight: weight, gradient: grad.values, rows: grad.rows,
+                rowSize: grad.rowSize, first: first, second: second))
+            views.append(view)
+            indices.append(i)
+        }
+
+        optimizerUpdate(rule, &parameters)
+
+        // return the weights to the model and keep the moments
+        for (p, i) in indices.enumerated() {
+            views[p].restore(parameters[p].weight, &model)
+            if rule.momentCount > 0 { moments[i][0] = parameters[p].first }
+            if rule.momentCount > 1 { moments[i][1] = parameters[p].second }
+        }
+    }
+}
+
+//==============================================================================
+/// _OptimizerWeightView
+/// the layout of a weight taken out of a model, and a function that
+/// returns the updated elements to the model
+struct _OptimizerWeightView<Root, E: StorageElement> {
+    /// the storage order of the weight
+    let order: Order
+    /// stores the updated elements in the model
+    let restore: (TensorR1<E>, inout Root) -> Void
+}
+
+/// _OptimizerGradientValues
+/// a gradient in the storage order of its weight
+struct _OptimizerGradientValues<E: StorageElement> {
+    /// the dense gradient, or the stored rows of a sparse gradient
+    let values: TensorR1<E>
+    /// the distinct rows of a sparse gradient
+    let rows: [Int]?
+    /// the number of elements in each sparse row
+    let rowSize: Int
+}
+
+//==============================================================================
+/// _OptimizerWeight
+/// a model property that is updated by an optimizer
+protocol _OptimizerWeight {
+    /// the storage element type
+    static var _element: Any.Type { get }
+    /// takes the weight at `keyPath` out of `root`, leaving an empty
+    /// tensor, so the weight storage is uniquely referenced
+    /// - Returns: the stored elements of the weight and its view, or `nil`
+    ///   if the element type is not `E`
+    static func _take<Root, E>(
+        _ keyPath: PartialKeyPath<Root>,
+        from root: inout Root
+    ) -> (TensorR1<E>, _OptimizerWeightView<Root,E>)?
+}
+
+extension Tensor: _OptimizerWeight {
+    static var _element: Any.Type { TensorElement.self }
+
+    static func _take<Root, E>(
+        _ keyPath: PartialKeyPath<Root>,
+        from root: inout Root
+    ) -> (TensorR1<E>, _OptimizerWeightView<Root,E>)? {
+        guard TensorElement.self == E.self,
+              let keyPath = keyPath as? WritableKeyPath<Root, Self>
+        else { return nil }
+
+        // repeated or strided weights are stored densely
+        if !root[keyPath: keyPath].isContiguous {
+            let order: Order =
+                root[keyPath: keyPath].order == .col ? .col : .row
+            root[keyPath: keyPath] = Self(copying: root[keyPath: keyPath],
+                                          order: order)
+        }
+        let weight = TensorR1<TensorElement>(storageOf: root[keyPath: keyPath])
+        let shape = root[keyPath: keyPath].shape
+        let strides = root[keyPath: keyPath].strides
+        let order = root[keyPath: keyPath].order
+        root[keyPath: keyPath] = Self()
+
+        let view = _OptimizerWeightView<Root,E>(order: order) { flat, root in
+            root[keyPath: keyPath] = Self(
+                storageOf: flat as! TensorR1<TensorElement>,
+                shape: shape, strides: strides, order: order)
+        }
+        return (weight as! TensorR1<E>, view)
+    }
+}
+
+//==============================================================================
+/// _OptimizerGradient
+/// a gradient property that is applied by an optimizer
+protocol _OptimizerGradient {
+    /// the storage element type
+    static var _element: Any.Type { get }
+    /// - Parameters:
+    ///  - order: the storage order of the weight
+    ///  - count: the number of weight elements
+    /// - Returns: the gradient in the storage `order` of its weight, or
+    ///   `nil` if it is a zero gradient or the element type is not `E`
+    func _values<E>(order: Order, count: Int) -> _OptimizerGradientValues<E>?
+}
+
+extension Tensor: _OptimizerGradient {
+    func _values<E>(
+        order: Order,
+        count weightCount: Int
+    ) -> _OptimizerGradientValues<E>? {
+        // `Tensor.zero` is a single element stored in the zero storage
+        guard !isZero, TensorElement.self == E.self else { return nil }
+        let values: TensorR1<TensorElement>
+        if count == 1 && weightCount != 1 {
+            // a scalar gradient is repeated to every weight element
+            let scalar = isContiguous ? self : Self(copying: self, order: .row)
+            values = TensorR1(copying: TensorR1(
+                repeating: TensorR1(storageOf: scalar),
+                to: Shape1(weightCount)), order: .row)
+        } else {
+            let dense = isContiguous && self.order == order ? self :
+                Self(copying: self, order: order)
+            values = TensorR1(storageOf: dense)
+        }
+        precondition(values.count == weightCount,
+                     "the gradient must have the weight element count")
+        return _OptimizerGradientValues(
+            values: values as! TensorR1<E>, rows: nil, rowSize: 1)
+    }
+}
+
+extension SparseRows: _OptimizerGradient where E.Value: Numeric {
+    static var _element: Any.Type { E.self }
+
+    func _values<T>(
+        order: Order,
+        count: Int
+    ) -> _OptimizerGradientValues<T>? {
+        guard !isEmpty, E.self == T.self else { return nil }
+        precondition(rowCount * values.shape[1] == count,
+                     "the gradient must have the weight element count")
+        // the rows of a row major weight are contiguous spans
+        guard order == .row else {
+            return dense()._values(order: order, count: count)
+        }
+        let rows = coalesced()
+        precondition(rows.indices.allSatisfy { $0 >= 0 && $0 < rowCount },
+                     "sparse gradient row is out of range")
+        return _OptimizerGradientValues(
+            values: TensorR1(storageOf: rows.values) as! TensorR1<T>,
+            rows: rows.indices, rowSize: rows.values.shape[1])
+    }
+}
+
+//==============================================================================
+/// _labeledKeyPaths
+/// finds the leaves of `root` that satisfy `isLeaf`, labeled with their
+/// property path. The key paths of each `KeyPathIterable` value are in the
+/// order of its stored properties, which is the order of its mirror
+/// children, so each key path is labeled with the matching property name,
+/// or with its index for collections.
+/// - Parameters:
+///  - root: the value to search
+///  - prefix: the property path of `root`
+///  - path: the key path of `root` from the top level value
+///  - result: the key paths of the leaves by property path
+///  - isLeaf: selects the leaf types
+func _labeledKeyPaths(
+    of root: Any,
+    _ prefix: String,
+    _ path: AnyKeyPath?,
+    _ result: inout [String: AnyKeyPath],
+    _ isLeaf: (Any.Type) -> Bool
+) {
+    guard let node = root as? _KeyPathIterableBase else { return }
+    let labels = Mirror(reflecting: root).children.map { $0.label }
+    let keyPaths = node._allKeyPathsTypeErased
+    for (i, keyPath) in keyPaths.enumerated() {
+        let label = keyPaths.count == labels.count ?
+            labels[i] ?? "\(i)" : "\(i)"
+        let name = prefix.isEmpty ? label : prefix + "." + label
+        let appended: AnyKeyPath? = path == nil ? keyPath :
+            path!.appending(path: keyPath)
+        guard let value = root[keyPath: keyPath],
+              let fullPath = appended else { continue }
+        if isLeaf(type(of: value)) {
+            result[name] = fullPath
+        } else {
+            _labeledKeyPaths(of: value, name, fullPath, &result, isLeaf)
+        }
+    }
+}
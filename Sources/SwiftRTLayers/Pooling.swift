@@ -0,0 +1,295 @@
+//******************************************************************************
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import Foundation
+import Numerics
+import SwiftRTCore
+
+//==============================================================================
+// convenience types
+// The data shapes are NWC, NHWC, and NDHWC, or the `NHWC` and `NDHWC`
+// channels last orders in the same way as `Convolution`
+public typealias MaxPool1 = MaxPool<Shape3,Float>
+public typealias MaxPool2 = MaxPool<Shape4,Float>
+public typealias MaxPool3 = MaxPool<Shape5,Float>
+
+public typealias AvgPool1 = AvgPool<Shape3,Float>
+public typealias AvgPool2 = AvgPool<Shape4,Float>
+public typealias AvgPool3 = AvgPool<Shape5,Float>
+
+public typealias GlobalAvgPool1 = GlobalAvgPool<Shape3,Float>
+public typealias GlobalAvgPool2 = GlobalAvgPool<Shape4,Float>
+public typealias GlobalAvgPool3 = GlobalAvgPool<Shape5,Float>
+
+//==============================================================================
+/// MaxPool
+/// A max pooling layer for spatial or spatio-temporal data.
+public struct MaxPool<Shape, Element>: ParameterlessLayer, Logging
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    // types
+    public typealias Data = Tensor<Shape,Element>
+    public typealias Op = DevicePooling<Shape,Element>
+    public typealias TangentVector = EmptyTangentVector
+
+    /// The size of the sliding reduction window for spatial dimensions.
+    @noDerivative public let windowSize: Shape
+    /// The strides of the sliding window for spatial dimensions.
+    @noDerivative public let strides: Shape
+    /// The padding algorithm for pooling.
+    @noDerivative public let padding: Padding
+    /// device specific pooling operator
+    @noDerivative public let poolingOp: Op
+    /// `.training` saves the window maximum positions of each
+    /// differentiated call for its pullback, and `.inferring` finds them
+    /// again in the pullback
+    @noDerivative public var mode: EvaluationMode
+
+    //--------------------------------------------------------------------------
+    /// Creates a max pooling layer.
+    ///
+    /// - Parameters:
+    ///   - windowSize: The size of the sliding reduction window for
+    ///     spatial dimensions.
+    ///   - strides: The strides of the sliding window for spatial dimensions.
+    ///   - padding: The padding algorithm for pooling.
+    ///   - mode: `.training` to save the window maximum positions for
+    ///     the pullback.
+    @inlinable public init(
+        windowSize: Shape,
+        strides: Shape,
+        padding: Padding = .valid,
+        mode: EvaluationMode = .training
+    ) {
+        self.windowSize = windowSize
+        self.strides = strides
+        self.padding = padding
+        self.mode = mode
+        self.poolingOp = currentQueue.pooling(
+            mode: .max,
+            windowSize: windowSize,
+            strides: strides,
+            padding: padding)
+    }
+
+    //--------------------------------------------------------------------------
+    /// Creates a max pooling layer with the same size and stride for
+    /// every spatial dimension.
+    ///
+    /// - Parameters:
+    ///   - poolSize: The size of the sliding reduction window.
+    ///   - stride: The stride of the sliding window, which is the pool
+    ///     size when it is `nil`.
+    ///   - padding: The padding algorithm for pooling.
+    ///   - mode: `.training` to save the window maximum positions for
+    ///     the pullback.
+    @inlinable public init(
+        poolSize: Int,
+        stride: Int? = nil,
+        padding: Padding = .valid,
+        mode: EvaluationMode = .training
+    ) {
+        self.init(windowSize: Shape(repeating: poolSize),
+                  strides: Shape(repeating: stride ?? poolSize),
+                  padding: padding,
+                  mode: mode)
+    }
+
+    //--------------------------------------------------------------------------
+    ///
+    @differentiable
+    @inlinable public func callAsFunction(_ input: Data) -> Data {
+        poolingOp.forward(x: input, mode: .inferring).y
+    }
+
+    @derivative(of: callAsFunction)
+    @usableFromInline func _vjpCallAsFunction(_ input: Data) -> (
+        value: Data, pullback: (Data) -> (EmptyTangentVector, Data)
+    ) {
+        _vjpPooling(poolingOp, input, mode)
+    }
+}
+
+//==============================================================================
+/// AvgPool
+/// An average pooling layer for spatial or spatio-temporal data.
+public struct AvgPool<Shape, Element>: ParameterlessLayer, Logging
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    // types
+    public typealias Data = Tensor<Shape,Element>
+    public typealias Op = DevicePooling<Shape,Element>
+    public typealias TangentVector = EmptyTangentVector
+
+    /// The size of the sliding reduction window for spatial dimensions.
+    @noDerivative public let windowSize: Shape
+    /// The strides of the sliding window for spatial dimensions.
+    @noDerivative public let strides: Shape
+    /// The padding algorithm for pooling.
+    @noDerivative public let padding: Padding
+    /// `true` if padding elements are counted in the averages.
+    @noDerivative public let includePadding: Bool
+    /// device specific pooling operator
+    @noDerivative public let poolingOp: Op
+    /// The evaluation mode. Average pooling pullbacks need no saved
+    /// state, so both modes have the same cost.
+    @noDerivative public var mode: EvaluationMode
+
+    //--------------------------------------------------------------------------
+    /// Creates an average pooling layer.
+    ///
+    /// - Parameters:
+    ///   - windowSize: The size of the sliding reduction window for
+    ///     spatial dimensions.
+    ///   - strides: The strides of the sliding window for spatial dimensions.
+    ///   - padding: The padding algorithm for pooling.
+    ///   - includePadding: `true` to divide every window by its full size,
+    ///     counting the padding elements as zeros.
+    ///   - mode: The evaluation mode.
+    @inlinable public init(
+        windowSize: Shape,
+        strides: Shape,
+        padding: Padding = .valid,
+        includePadding: Bool = false,
+        mode: EvaluationMode = .training
+    ) {
+        self.windowSize = windowSize
+        self.strides = strides
+        self.padding = padding
+        self.includePadding = includePadding
+        self.mode = mode
+        self.poolingOp = currentQueue.pooling(
+            mode: includePadding ? .averageIncludePadding :
+                .averageExcludePadding,
+            windowSize: windowSize,
+            strides: strides,
+            padding: padding)
+    }
+
+    //--------------------------------------------------------------------------
+    /// Creates an average pooling layer with the same size and stride for
+    /// every spatial dimension.
+    ///
+    /// - Parameters:
+    ///   - poolSize: The size of the sliding reduction window.
+    ///   - stride: The stride of the sliding window, which is the pool
+    ///     size when it is `nil`.
+    ///   - padding: The padding algorithm for pooling.
+    ///   - includePadding: `true` to count padding elements in the averages.
+    ///   - mode: The evaluation mode.
+    @inlinable public init(
+        poolSize: Int,
+        stride: Int? = nil,
+        padding: Padding = .valid,
+        includePadding: Bool = false,
+        mode: EvaluationMode = .training
+    ) {
+        self.init(windowSize: Shape(repeating: poolSize),
+                  strides: Shape(repeating: stride ?? poolSize),
+                  padding: padding,
+                  includePadding: includePadding,
+                  mode: mode)
+    }
+
+    //--------------------------------------------------------------------------
+    ///
+    @differentiable
+    @inlinable public func callAsFunction(_ input: Data) -> Data {
+        poolingOp.forward(x: input, mode: .inferring).y
+    }
+
+    @derivative(of: callAsFunction)
+    @usableFromInline func _vjpCallAsFunction(_ input: Data) -> (
+        value: Data, pullback: (Data) -> (EmptyTangentVector, Data)
+    ) {
+        _vjpPooling(poolingOp, input, mode)
+    }
+}
+
+//==============================================================================
+/// GlobalAvgPool
+/// A global average pooling layer, which averages all spatial positions
+/// of each channel. The output keeps the rank of the input with spatial
+/// dimensions of 1, for example NHWC to N11C.
+public struct GlobalAvgPool<Shape, Element>: ParameterlessLayer, Logging
+where Shape: TensorShape,
+      Element: StorageElement,
+      Element.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    // types
+    public typealias Data = Tensor<Shape,Element>
+    public typealias Op = DevicePooling<Shape,Element>
+    public typealias TangentVector = EmptyTangentVector
+
+    /// device specific pooling operator
+    @noDerivative public let poolingOp: Op
+    /// The evaluation mode. Average pooling pullbacks need no saved
+    /// state, so both modes have the same cost.
+    @noDerivative public var mode: EvaluationMode
+
+    //--------------------------------------------------------------------------
+    /// Creates a global average pooling layer.
+    ///
+    /// - Parameter mode: The evaluation mode.
+    @inlinable public init(mode: EvaluationMode = .training) {
+        self.mode = mode
+        self.poolingOp = currentQueue.pooling(
+            mode: .averageExcludePadding,
+            windowSize: nil,
+            strides: Shape.one,
+            padding: .valid)
+    }
+
+    //--------------------------------------------------------------------------
+    ///
+    @differentiable
+    @inlinable public func callAsFunction(_ input: Data) -> Data {
+        poolingOp.forward(x: input, mode: .inferring).y
+    }
+
+    @derivative(of: callAsFunction)
+    @usableFromInline func _vjpCallAsFunction(_ input: Data) -> (
+        value: Data, pullback: (Data) -> (EmptyTangentVector, Data)
+    ) {
+        _vjpPooling(poolingOp, input, mode)
+    }
+}
+
+//==============================================================================
+/// _vjpPooling
+/// the pooling layer derivative. The forward pass returns the max pooling
+/// indices of a `.training` call, and they are held by the pullback of
+/// that call, so several forward passes can run before their backward
+/// passes on the same layer.
+@usableFromInline func _vjpPooling<S,E>(
+    _ op: DevicePooling<S,E>,
+    _ x: Tensor<S,E>,
+    _ mode: EvaluationMode
+) -> (value: Tensor<S,E>,
+      pullback: (Tensor<S,E>) -> (EmptyTangentVector, Tensor<S,E>))
+where E.Value: DifferentiableNumeric & Real & BinaryFloatingPoint
+{
+    let (y, indices) = op.forward(x: x, mode: mode)
+    return (y, {
+        let dy = $0.shape == y.shape ? $0 : Tensor(repeating: $0, to: y.shape)
+        var dx = Tensor(like: x)
+        op.backward(y: y, yDiff: dy, x: x, indices: indices, xDiff: &dx)
+        return (EmptyTangentVector(), dx)
+    })
+}
@@ -0,0 +1,220 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import SwiftRTCore
+
+//==============================================================================
+/// QuantizedDense
+/// An inference only dense layer with integer weights quantized per output
+/// column. The input is quantized per tensor to `UInt8` on each call, the
+/// products are accumulated as `Int32`, and the bias and activation are
+/// applied as the result is converted back to `Float`.
+public struct QuantizedDense<Q>
+where Q: StorageElement, Q.Value: FixedWidthInteger
+{
+    /// The element-wise activation function.
+    public let activation: ActivationType
+    /// The quantized weights
+    public let weight: QuantizedTensor<Shape2,Q>
+    /// The bias
+    public let bias: TensorR1<Float>
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        weight: TensorR2<Float>,
+        bias: TensorR1<Float>,
+        activation: ActivationType,
+        type: Q.Type = Q.self
+    ) {
+        assert(bias.count == weight.shape[1])
+        self.weight = QuantizedTensor(quantizing: weight, axis: 1)
+        self.bias = bias
+        self.activation = activation
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public func callAsFunction(
+        _ input: TensorR2<Float>
+    ) -> TensorR2<Float> {
+        let x = QuantizedTensor<Shape2,UInt8>(quantizing: input)
+        return matmul(x, weight, bias: bias, activation: activation)
+    }
+}
+
+//==============================================================================
+// Dense quantization
+public extension Dense where S == Shape2, E == Float {
+    /// quantized(type:
+    /// - Parameter type: the quantized weight storage type
+    /// - Returns: an inference only copy of the layer with quantized weights
+    @inlinable func quantized<Q>(type: Q.Type) -> QuantizedDense<Q> {
+        let outputs = weight.shape[1]
+        let row = bias[0, ...]
+        return QuantizedDense(
+            weight: weight,
+            bias: TensorR1<Float>(reshaping: row, to: Shape1(outputs)),
+            activation: activation,
+            type: Q.self)
+    }
+}
+
+//==============================================================================
+/// QuantizedConvolution
+/// An inference only convolution layer with integer filters quantized per
+/// output channel. The input windows are gathered as the rows of a matrix
+/// and quantized per tensor to `UInt8` on each call, so the convolution
+/// uses the same quantized gemm as `QuantizedDense`.
+public struct QuantizedConvolution<Shape, Q>
+where Shape: TensorShape, Q: StorageElement, Q.Value: FixedWidthInteger
+{
+    /// The element-wise activation function.
+    public let activation: ActivationType
+    /// The quantized filter stored as `[filterCount, outputs]`
+    public let filter: QuantizedTensor<Shape2,Q>
+    /// The shape of the real valued filter
+    public let filterShape: Shape
+    /// The bias
+    public let bias: TensorR1<Float>
+    /// The strides of the sliding window for spatial dimensions.
+    public let strides: Shape
+    /// The padding algorithm for convolution.
+    public let padding: Padding
+    /// The dilation factor for spatial dimensions.
+    public let dilations: Shape
+    /// convolution or cross correlation
+    public let mode: ConvolutionMode
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        filter: Tensor<Shape,Float>,
+        bias: TensorR1<Float>,
+        activation: ActivationType,
+        strides: Shape = Shape.one,
+        padding: Padding = .valid,
+        dilations: Shape = Shape.one,
+        mode: ConvolutionMode = .crossCorrelation,
+        type: Q.Type = Q.self
+    ) {
+        assert(bias.count == filter.shape[Shape.rank - 1])
+        self.filter = QuantizedTensor(quantizingFilter: filter, mode: mode)
+        self.filterShape = filter.shape
+        self.bias = bias
+        self.activation = activation
+        self.strides = strides
+        self.padding = padding
+        self.dilations = dilations
+        self.mode = mode
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public func callAsFunction(
+        _ input: Tensor<Shape,Float>
+    ) -> Tensor<Shape,Float> {
+        let geometry = ConvolutionGeometry(
+            input: input.shape, filter: filterShape, strides: strides,
+            padding: padding, dilations: dilations, mode: mode)
+        return convolution(input, filter, geometry,
+                           bias: bias, activation: activation)
+    }
+}
+
+//==============================================================================
+// Convolution quantization
+public extension Convolution where Element == Float, FilterElement == Float {
+    /// quantized(type:
+    /// - Parameter type: the quantized filter storage type
+    /// - Returns: an inference only copy of the layer with a quantized
+    ///   filter. Grouped convolutions are not supported.
+    @inlinable func quantized<Q>(
+        type: Q.Type
+    ) -> QuantizedConvolution<Shape,Q> {
+        precondition(groups == 1, "grouped convolutions cannot be quantized")
+        return QuantizedConvolution(
+            filter: filter,
+            bias: bias,
+            activation: activation,
+            strides: strides,
+            padding: padding,
+            dilations: dilations,
+            mode: convolutionOp.properties.mode,
+            type: Q.self)
+    }
+}
+
+//==============================================================================
+/// GroupQuantizedDense
+/// An inference only dense layer with 4 bit weights quantized in groups
+/// along the input dimension. The weights are dequantized on the fly by
+/// the matmul kernel, so they use about an eighth of the `Float` memory.
+public struct GroupQuantizedDense {
+    /// The element-wise activation function.
+    public let activation: ActivationType
+    /// The quantized weights stored as `[outputs, inputs]`
+    public let weight: GroupQuantizedTensor
+    /// The bias
+    public let bias: TensorR1<Float>
+
+    //--------------------------------------------------------------------------
+    @inlinable public init(
+        weight: TensorR2<Float>,
+        bias: TensorR1<Float>,
+        activation: ActivationType,
+        groupSize: Int = 64
+    ) {
+        assert(bias.count == weight.shape[1])
+        self.weight = GroupQuantizedTensor(quantizing: weight.t,
+                                           groupSize: groupSize)
+        self.bias = bias
+        self.activation = activation
+    }
+
+    //--------------------------------------------------------------------------
+    @inlinable public func callAsFunction(
+        _ input: TensorR2<Float>
+    ) -> TensorR2<Float> {
+        matmul(input, weight, bias: bias, activation: activation)
+    }
+}
+
+//==============================================================================
+// Dense 4 bit quantization
+public extension Dense where S == Shape2, E == Float {
+    /// groupQuantized(groupSize:
+    /// - Parameter groupSize: the number of inputs sharing a scale and offset
+    /// - Returns: an inference only copy of the layer with 4 bit weights
+    @inlinable func groupQuantized(groupSize: Int = 64) -> GroupQuantizedDense {
+        let outputs = weight.shape[1]
+        let row = bias[0, ...]
+        return GroupQuantizedDense(
+            weight: weight,
+            bias: TensorR1<Float>(reshaping: row, to: Shape1(outputs)),
+            activation: activation,
+            groupSize: groupSize)
+    }
+}
+
+//==============================================================================
+// Embedding 4 bit quantization
+public extension Embedding where Element == Float {
+    /// groupQuantizedEmbeddings(groupSize:
+    /// - Parameter groupSize: the number of values sharing a scale and offset
+    /// - Returns: the embedding table quantized to 4 bits. Use
+    ///   `gathering(indices:)` to look up dequantized rows.
+    @inlinable func groupQuantizedEmbeddings(
+        groupSize: Int = 64
+    ) -> GroupQuantizedTensor {
+        GroupQuantizedTensor(quantizing: embeddings, groupSize: groupSize)
+    }
+}
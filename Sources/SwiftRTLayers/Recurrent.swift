@@ -103,9 +103,113 @@ extension RecurrentLayerCell {
     }
 }
 
+//==============================================================================
+/// RecurrentSequenceCell
+/// A recurrent cell that can be applied to a whole `[T, batch, features]`
+/// sequence in one call. The input projections of all time steps are
+/// computed up front with one large gemm, so only the recurrent gemm of
+/// each step remains in the loop, and the hidden states are written to a
+/// preallocated `[T, batch, hidden]` tensor.
+public protocol RecurrentSequenceCell: RecurrentLayerCell {
+    /// A `[T, batch, features]` sequence of time steps
+    associatedtype SequenceTensor: Differentiable
+
+    /// Returns the hidden states obtained from applying the cell to each
+    /// time step of the input.
+    ///
+    /// - Parameters:
+    ///   - input: The `[T, batch, features]` input sequence.
+    ///   - initialState: The state before the first time step.
+    /// - Returns: The `[T, batch, hidden]` hidden states.
+    @differentiable
+    func sequence(_ input: SequenceTensor, initialState: State) -> SequenceTensor
+}
+
+//==============================================================================
+/// recurrentSequence
+/// applies a recurrent step function to each time step of a sequence
+/// - Parameters:
+///  - projection: the `[T, batch, gates]` input projections, including
+///    the biases
+///  - weight: the `[hidden, gates]` recurrent weight
+///  - initialState: the state before the first time step
+///  - step: computes the next state from the projection of a time step,
+///    the previous state, and the recurrent weight
+///  - hidden: returns the hidden state of a state
+/// - Returns: the `[T, batch, hidden]` hidden states
+@inlinable func recurrentSequence<E, State>(
+    _ projection: TensorR3<E>,
+    _ weight: TensorR2<E>,
+    _ initialState: State,
+    _ step: (TensorR2<E>, State, TensorR2<E>) -> State,
+    _ hidden: (State) -> TensorR2<E>
+) -> TensorR3<E> {
+    let shape = Shape3(projection.shape[0], projection.shape[1], weight.shape[0])
+    var output = TensorR3<E>(shape: shape, order: .row)
+    var state = initialState
+    for t in 0..<shape[0] {
+        let x = TensorR2<E>(squeezing: projection[t, 0..., 0...], axes: 0)
+        state = step(x, state, weight)
+        output[t, 0..., 0...] = TensorR3(expanding: hidden(state), axes: 0)
+    }
+    return output
+}
+
+//==============================================================================
+/// recurrentSequenceWithPullback
+/// applies a recurrent step function to each time step of a sequence
+/// and returns the pullback. The projection gradients of all time steps
+/// are written to a single tensor, so the caller can compute the input
+/// and input weight gradients with one gemm each.
+/// - Parameters:
+///  - hiddenTangent: returns a state tangent from a hidden state gradient
+/// - Returns: the `[T, batch, hidden]` hidden states and a pullback that
+///   returns the projection, recurrent weight, and initial state gradients
+@inlinable func recurrentSequenceWithPullback<E, State: Differentiable>(
+    _ projection: TensorR3<E>,
+    _ weight: TensorR2<E>,
+    _ initialState: State,
+    _ step: @escaping @differentiable (TensorR2<E>, State, TensorR2<E>) -> State,
+    _ hidden: (State) -> TensorR2<E>,
+    _ hiddenTangent: @escaping (TensorR2<E>) -> State.TangentVector
+) -> (value: TensorR3<E>,
+      pullback: (TensorR3<E>) -> (TensorR3<E>, TensorR2<E>, State.TangentVector))
+where E.Value: DifferentiableNumeric
+{
+    typealias StepPullback = (State.TangentVector)
+        -> (TensorR2<E>, State.TangentVector, TensorR2<E>)
+    let shape = Shape3(projection.shape[0], projection.shape[1], weight.shape[0])
+    var output = TensorR3<E>(shape: shape, order: .row)
+    var state = initialState
+    var pullbacks: [StepPullback] = []
+    pullbacks.reserveCapacity(shape[0])
+    for t in 0..<shape[0] {
+        let x = TensorR2<E>(squeezing: projection[t, 0..., 0...], axes: 0)
+        let (next, pullback) = valueWithPullback(at: x, state, weight, of: step)
+        output[t, 0..., 0...] = TensorR3(expanding: hidden(next), axes: 0)
+        pullbacks.append(pullback)
+        state = next
+    }
+
+    return (output, { outputDiff in
+        var projectionDiff = TensorR3<E>(shape: projection.shape, order: .row)
+        var weightDiff = TensorR2<E>.zero
+        var stateDiff = State.TangentVector.zero
+        for t in (0..<shape[0]).reversed() {
+            stateDiff += hiddenTangent(
+                TensorR2(squeezing: outputDiff[t, 0..., 0...], axes: 0))
+            let (x, s, w) = pullbacks[t](stateDiff)
+            projectionDiff[t, 0..., 0...] = TensorR3(expanding: x, axes: 0)
+            weightDiff += w
+            stateDiff = s
+        }
+        return (projectionDiff, weightDiff, stateDiff)
+    })
+}
+
 //==============================================================================
 /// A basic RNN cell.
-public struct BasicRNNCell<Element>: RecurrentLayerCell
+public struct BasicRNNCell<Element>: RecurrentSequenceCell
 where Element: StorageElement,
       Element.Value: StorageElement & DifferentiableNumeric &
         Real & BinaryFloatingPoint
@@ -118,6 +222,7 @@ where Element: StorageElement,
     public typealias TimeStepOutput = State
     public typealias Input = RNNCellInput<TimeStepInput, State>
     public typealias Output = RNNCellOutput<TimeStepOutput, State>
+    public typealias SequenceTensor = TensorR3<Element>
 
     //--------------------------------------------------------------------------
     /// Creates a `BasicRNNCell` with the specified input size and
@@ -155,14 +260,79 @@ where Element: StorageElement,
     @inlinable public func callAsFunction(_ input: Input) -> Output {
         let concatenatedInput = input.input
                 .concatenated(with: input.state, alongAxis: 1)
-        let newState = tanh(matmul(concatenatedInput, weight) + bias)
+        let newState = tanh(matmul(concatenatedInput, weight, bias: rowBias))
         return Output(output: newState, state: newState)
     }
+
+    /// the bias as a vector that is added to each row
+    @differentiable
+    @inlinable public var rowBias: TensorR1<Element> {
+        TensorR1(reshaping: bias, to: Shape1(bias.count))
+    }
+
+    //--------------------------------------------------------------------------
+    /// step
+    /// computes the next state from the input projection of a time step
+    @differentiable
+    @inlinable public static func step(
+        _ projection: TensorR2<Element>,
+        _ state: State,
+        _ weight: TensorR2<Element>
+    ) -> State {
+        tanh(projection + matmul(state, weight))
+    }
+
+    //--------------------------------------------------------------------------
+    /// Returns the hidden states obtained from applying the cell to each
+    /// time step of a `[T, batch, features]` input.
+    @differentiable
+    @inlinable public func sequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> TensorR3<Element> {
+        let x = TensorR2<Element>(reshaping: input,
+                                  to: Shape2(-1, input.shape[2]))
+        let inputSize = input.shape[2]
+        let projection = matmul(x, weight[0..<inputSize, 0...], bias: rowBias)
+        return recurrentSequence(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       weight.shape[1])),
+            weight[inputSize..., 0...], initialState, Self.step, { $0 })
+    }
+
+    @derivative(of: sequence)
+    @inlinable func _vjpSequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> (value: TensorR3<Element>,
+          pullback: (TensorR3<Element>) -> (TangentVector, TensorR3<Element>, State))
+    {
+        let inputSize = input.shape[2], hiddenSize = weight.shape[1]
+        let x = TensorR2<Element>(reshaping: input, to: Shape2(-1, inputSize))
+        let (projection, projectionPullback) = valueWithPullback(
+            at: x, weight[0..<inputSize, 0...], rowBias) {
+                matmul($0, $1, bias: $2)
+            }
+        let (output, sequencePullback) = recurrentSequenceWithPullback(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       hiddenSize)),
+            weight[inputSize..., 0...], initialState, Self.step, { $0 }, { $0 })
+
+        return (output, {
+            let (projectionDiff, weightDiff, stateDiff) = sequencePullback($0)
+            let (xDiff, inputWeightDiff, biasDiff) = projectionPullback(
+                TensorR2(reshaping: projectionDiff, to: Shape2(-1, hiddenSize)))
+            return (TangentVector(
+                        weight: concatenate(inputWeightDiff, weightDiff),
+                        bias: TensorR2(reshaping: biasDiff, to: bias.shape)),
+                    TensorR3(reshaping: xDiff, to: input.shape), stateDiff)
+        })
+    }
 }
 
 //==============================================================================
 /// An LSTM cell.
-public struct LSTMCell<Element>: RecurrentLayerCell
+public struct LSTMCell<Element>: RecurrentSequenceCell
 where Element: StorageElement,
       Element.Value: StorageElement & DifferentiableNumeric &
         Real & BinaryFloatingPoint
@@ -172,6 +342,7 @@ where Element: StorageElement,
     public typealias TimeStepOutput = State
     public typealias Input = RNNCellInput<TimeStepInput, State>
     public typealias Output = RNNCellOutput<TimeStepOutput, State>
+    public typealias SequenceTensor = TensorR3<Element>
     public enum Part: Int, CaseIterable { case input, update, forget, output }
 
     // properties
@@ -254,47 +425,149 @@ where Element: StorageElement,
     @inlinable public func callAsFunction(_ input: Input) -> Output {
         let gateInput = concatenate(input.input, input.state.hidden, axis: 1)
         let fused = matmul(gateInput, fusedWeight, bias: fusedBias)
-        let inputGate = sigmoid(part(.input, of: fused))
-        let updateGate = tanh(part(.update, of: fused))
-        let forgetGate = sigmoid(part(.forget, of: fused))
-        let outputGate = sigmoid(part(.output, of: fused))
-        let newCellState = input.state.cell * forgetGate + inputGate * updateGate
-        let newHiddenState = tanh(newCellState) * outputGate
-        let newState = State(cell: newCellState, hidden: newHiddenState)
+        let newState = Self.pointwise(gates: fused, cell: input.state.cell)
         return Output(output: newState, state: newState)
     }
+
+    //--------------------------------------------------------------------------
+    /// pointwise(gates:cell:
+    /// computes the new state from the fused gate pre-activations and the
+    /// previous cell state in a single pass
+    /// - Parameters:
+    ///  - gates: the `[batch, 4 * hiddenSize]` gate pre-activations
+    ///  - cell: the previous cell state
+    /// - Returns: the new state
+    @differentiable
+    @inlinable public static func pointwise(
+        gates: TensorR2<Element>,
+        cell: TensorR2<Element>
+    ) -> State {
+        let (newCell, hidden) = lstmPointwise(gates: gates, cell: cell)
+        return State(cell: newCell, hidden: hidden)
+    }
+
+    @derivative(of: pointwise)
+    @inlinable static func _vjpPointwise(
+        gates: TensorR2<Element>,
+        cell: TensorR2<Element>
+    ) -> (value: State, pullback: (State.TangentVector)
+            -> (TensorR2<Element>, TensorR2<Element>))
+    {
+        // only the inputs and the new cell state are saved
+        let (newCell, hidden) = lstmPointwise(gates: gates, cell: cell)
+        return (State(cell: newCell, hidden: hidden), {
+            let diff = lstmPointwiseGradient(
+                gates: gates, cell: cell, newCell: newCell,
+                hiddenDiff: $0.hidden, cellDiff: $0.cell)
+            return (diff.gates, diff.cell)
+        })
+    }
+
+    //--------------------------------------------------------------------------
+    /// step
+    /// computes the next state from the input projection of a time step
+    @differentiable
+    @inlinable public static func step(
+        _ projection: TensorR2<Element>,
+        _ state: State,
+        _ weight: TensorR2<Element>
+    ) -> State {
+        pointwise(gates: projection + matmul(state.hidden, weight),
+                  cell: state.cell)
+    }
+
+    //--------------------------------------------------------------------------
+    /// Returns the hidden states obtained from applying the cell to each
+    /// time step of a `[T, batch, features]` input.
+    @differentiable
+    @inlinable public func sequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> TensorR3<Element> {
+        let inputSize = input.shape[2]
+        let x = TensorR2<Element>(reshaping: input, to: Shape2(-1, inputSize))
+        let projection = matmul(x, fusedWeight[0..<inputSize, 0...],
+                                bias: fusedBias)
+        return recurrentSequence(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       4 * hiddenSize)),
+            fusedWeight[inputSize..., 0...], initialState,
+            Self.step, { $0.hidden })
+    }
+
+    @derivative(of: sequence)
+    @inlinable func _vjpSequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> (value: TensorR3<Element>,
+          pullback: (TensorR3<Element>)
+            -> (TangentVector, TensorR3<Element>, State.TangentVector))
+    {
+        let inputSize = input.shape[2], gateCount = 4 * hiddenSize
+        let x = TensorR2<Element>(reshaping: input, to: Shape2(-1, inputSize))
+        let (projection, projectionPullback) = valueWithPullback(
+            at: x, fusedWeight[0..<inputSize, 0...], fusedBias) {
+                matmul($0, $1, bias: $2)
+            }
+        let (output, sequencePullback) = recurrentSequenceWithPullback(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       gateCount)),
+            fusedWeight[inputSize..., 0...], initialState,
+            Self.step, { $0.hidden },
+            { State.TangentVector(cell: .zero, hidden: $0) })
+
+        return (output, {
+            let (projectionDiff, weightDiff, stateDiff) = sequencePullback($0)
+            let (xDiff, inputWeightDiff, biasDiff) = projectionPullback(
+                TensorR2(reshaping: projectionDiff, to: Shape2(-1, gateCount)))
+            return (TangentVector(
+                        fusedWeight: concatenate(inputWeightDiff, weightDiff),
+                        fusedBias: biasDiff),
+                    TensorR3(reshaping: xDiff, to: input.shape), stateDiff)
+        })
+    }
 }
 
 //==============================================================================
 /// An GRU cell.
-public struct GRUCell<Element>: RecurrentLayerCell
+/// The update, reset, and output gate weights are stored concatenated, so
+/// each step needs one gemm for the input and one for the state, followed
+/// by a single fused pointwise pass. The reset gate is applied to the state
+/// projection, `n = tanh(x W_o1 + b_o + r * (h W_o2))`, which allows all
+/// of the state projections to be computed together.
+public struct GRUCell<Element>: RecurrentSequenceCell
 where Element: StorageElement,
       Element.Value: StorageElement & DifferentiableNumeric &
         Real & BinaryFloatingPoint
 {
-    public var updateWeight1, updateWeight2: TensorR2<Element>
-    public var resetWeight1, resetWeight2: TensorR2<Element>
-    public var outputWeight1, outputWeight2: TensorR2<Element>
-    public var updateBias, outputBias, resetBias: TensorR1<Element>
+    // types
+    public typealias State = TensorR2<Element>
+    public typealias TimeStepInput = State
+    public typealias TimeStepOutput = State
+    public typealias Input = RNNCellInput<TimeStepInput, State>
+    public typealias Output = RNNCellOutput<TimeStepOutput, State>
+    public typealias SequenceTensor = TensorR3<Element>
+    public enum Part: Int, CaseIterable { case update, reset, output }
 
-    @noDerivative public var stateShape: Shape2 {
-        Shape2(1, updateWeight1.shape[0])
-    }
+    // properties
+    /// the `[input, 3 * hidden]` input weights
+    public var fusedInputWeight: TensorR2<Element>
+    /// the `[hidden, 3 * hidden]` state weights
+    public var fusedStateWeight: TensorR2<Element>
+    /// the `[3 * hidden]` biases, which are added to the input projection
+    public var fusedBias: TensorR1<Element>
+    @noDerivative public let hiddenSize: Int
+
+    @noDerivative public var stateShape: Shape2 { Shape2(1, hiddenSize) }
 
     //--------------------------------------------------------------------------
     /// Returns a zero-valued state with shape compatible with the provided input.
     public func zeroState(
         for input: TensorR2<Element>
     ) -> State {
-        TensorR2<Element>(zeros: stateShape)
+        TensorR2<Element>(zeros: Shape2(input.shape[0], hiddenSize))
     }
 
-    public typealias State = TensorR2<Element>
-    public typealias TimeStepInput = State
-    public typealias TimeStepOutput = State
-    public typealias Input = RNNCellInput<TimeStepInput, State>
-    public typealias Output = RNNCellOutput<TimeStepOutput, State>
-
     /// Creates a `GRUCell` with the specified input size and hidden state size.
     ///
     /// - Parameters:
@@ -306,39 +579,154 @@ where Element: StorageElement,
         weightInitializer: ParameterInitializer<Shape2,Element> = glorotUniform(),
         biasInitializer: ParameterInitializer<Shape1,Element> = zeros()
     ) {
-        let gateWeightShape = Shape2(inputSize, 1)
+        // each gate is initialized separately
+        let inputWeightShape = Shape2(inputSize, hiddenSize)
+        let stateWeightShape = Shape2(hiddenSize, hiddenSize)
         let gateBiasShape = Shape1(hiddenSize)
-        self.updateWeight1 = weightInitializer(gateWeightShape)
-        self.updateWeight2 = weightInitializer(gateWeightShape)
-        self.updateBias = biasInitializer(gateBiasShape)
-        self.resetWeight1 = weightInitializer(gateWeightShape)
-        self.resetWeight2 = weightInitializer(gateWeightShape)
-        self.resetBias = biasInitializer(gateBiasShape)
-        self.outputWeight1 = weightInitializer(gateWeightShape)
-        self.outputWeight2 = weightInitializer(gateWeightShape)
-        self.outputBias = biasInitializer(gateBiasShape)
+        let gates = Part.allCases
+        self.hiddenSize = hiddenSize
+        self.fusedInputWeight = concatenate(
+            gates.map { _ in weightInitializer(inputWeightShape) }, axis: 1)
+        self.fusedStateWeight = concatenate(
+            gates.map { _ in weightInitializer(stateWeightShape) }, axis: 1)
+        self.fusedBias = concatenate(
+            gates.map { _ in biasInitializer(gateBiasShape) })
+    }
+
+    //--------------------------------------------------------------------------
+    /// part
+    /// used to access parts of the fused weights
+    @differentiable
+    @inlinable public func part(_ i: Part, of fused: TensorR2<Element>)
+    -> TensorR2<Element>
+    {
+        fused[0..., (i.rawValue * hiddenSize)..<((i.rawValue + 1) * hiddenSize)]
+    }
+
+    /// part
+    /// used to access parts of the fused bias
+    @differentiable
+    @inlinable public func part(_ i: Part, of fused: TensorR1<Element>)
+    -> TensorR1<Element>
+    {
+        fused[(i.rawValue * hiddenSize)..<((i.rawValue + 1) * hiddenSize)]
+    }
+
+    //--------------------------------------------------------------------------
+    // gate views of the fused weights
+    @inlinable func columns(_ i: Part) -> Range<Int> {
+        (i.rawValue * hiddenSize)..<((i.rawValue + 1) * hiddenSize)
+    }
+
+    public var updateWeight1: TensorR2<Element> {
+        get { part(.update, of: fusedInputWeight) }
+        set { fusedInputWeight[0..., columns(.update)] = newValue }
+    }
+    public var updateWeight2: TensorR2<Element> {
+        get { part(.update, of: fusedStateWeight) }
+        set { fusedStateWeight[0..., columns(.update)] = newValue }
+    }
+    public var resetWeight1: TensorR2<Element> {
+        get { part(.reset, of: fusedInputWeight) }
+        set { fusedInputWeight[0..., columns(.reset)] = newValue }
+    }
+    public var resetWeight2: TensorR2<Element> {
+        get { part(.reset, of: fusedStateWeight) }
+        set { fusedStateWeight[0..., columns(.reset)] = newValue }
+    }
+    public var outputWeight1: TensorR2<Element> {
+        get { part(.output, of: fusedInputWeight) }
+        set { fusedInputWeight[0..., columns(.output)] = newValue }
+    }
+    public var outputWeight2: TensorR2<Element> {
+        get { part(.output, of: fusedStateWeight) }
+        set { fusedStateWeight[0..., columns(.output)] = newValue }
+    }
+    public var updateBias: TensorR1<Element> {
+        get { part(.update, of: fusedBias) }
+        set { fusedBias[columns(.update)] = newValue }
+    }
+    public var resetBias: TensorR1<Element> {
+        get { part(.reset, of: fusedBias) }
+        set { fusedBias[columns(.reset)] = newValue }
+    }
+    public var outputBias: TensorR1<Element> {
+        get { part(.output, of: fusedBias) }
+        set { fusedBias[columns(.output)] = newValue }
     }
 
+    //--------------------------------------------------------------------------
     /// Returns the output obtained from applying the layer to the given input.
     ///
     /// - Parameter input: The input to the layer.
     /// - Returns: The hidden state.
     @differentiable
-    public func callAsFunction(_ input: Input) -> Output {
-        let resetGate = sigmoid(
-            matmul(input.input, resetWeight1) +
-                matmul(input.state, resetWeight2, bias: resetBias))
-        let updateGate = sigmoid(
-                matmul(input.input, updateWeight1) +
-                    matmul(input.state, updateWeight2, bias: updateBias))
-        let outputGate = tanh(
-                matmul(input.input, outputWeight1, bias: outputBias) +
-                    matmul(resetGate * input.state, outputWeight2))
-        let updateHidden = (1 - updateGate) * input.state
-        let updateOutput = (1 - updateGate) * outputGate
-        let newState = updateHidden + updateOutput
+    @inlinable public func callAsFunction(_ input: Input) -> Output {
+        let projection = matmul(input.input, fusedInputWeight, bias: fusedBias)
+        let newState = Self.step(projection, input.state, fusedStateWeight)
         return Output(output: newState, state: newState)
     }
+
+    //--------------------------------------------------------------------------
+    /// step
+    /// computes the next state from the `[batch, 3 * hidden]` input
+    /// projection of a time step with one state gemm and a fused
+    /// pointwise pass
+    @differentiable
+    @inlinable public static func step(
+        _ projection: TensorR2<Element>,
+        _ state: State,
+        _ weight: TensorR2<Element>
+    ) -> State {
+        gruPointwise(inputGates: projection,
+                     stateGates: matmul(state, weight),
+                     state: state)
+    }
+
+    //--------------------------------------------------------------------------
+    /// Returns the hidden states obtained from applying the cell to each
+    /// time step of a `[T, batch, features]` input.
+    @differentiable
+    @inlinable public func sequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> TensorR3<Element> {
+        let x = TensorR2<Element>(reshaping: input,
+                                  to: Shape2(-1, input.shape[2]))
+        let projection = matmul(x, fusedInputWeight, bias: fusedBias)
+        return recurrentSequence(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       3 * hiddenSize)),
+            fusedStateWeight, initialState, Self.step, { $0 })
+    }
+
+    @derivative(of: sequence)
+    @inlinable func _vjpSequence(
+        _ input: TensorR3<Element>,
+        initialState: State
+    ) -> (value: TensorR3<Element>,
+          pullback: (TensorR3<Element>) -> (TangentVector, TensorR3<Element>, State))
+    {
+        let gateCount = 3 * hiddenSize
+        let x = TensorR2<Element>(reshaping: input,
+                                  to: Shape2(-1, input.shape[2]))
+        let (projection, projectionPullback) = valueWithPullback(
+            at: x, fusedInputWeight, fusedBias) { matmul($0, $1, bias: $2) }
+        let (output, sequencePullback) = recurrentSequenceWithPullback(
+            TensorR3(reshaping: projection, to: Shape3(input.shape[0], -1,
+                                                       gateCount)),
+            fusedStateWeight, initialState, Self.step, { $0 }, { $0 })
+
+        return (output, {
+            let (projectionDiff, weightDiff, stateDiff) = sequencePullback($0)
+            let (xDiff, inputWeightDiff, biasDiff) = projectionPullback(
+                TensorR2(reshaping: projectionDiff, to: Shape2(-1, gateCount)))
+            return (TangentVector(fusedInputWeight: inputWeightDiff,
+                                  fusedStateWeight: weightDiff,
+                                  fusedBias: biasDiff),
+                    TensorR3(reshaping: xDiff, to: input.shape), stateDiff)
+        })
+    }
 }
 
 //==============================================================================
@@ -442,6 +830,19 @@ public struct RecurrentLayer<Cell: RecurrentLayerCell>: Layer {
     }
 }
 
+//==============================================================================
+extension RecurrentLayer where Cell: RecurrentSequenceCell {
+    /// Returns the hidden states obtained from applying the cell to each
+    /// time step of a `[T, batch, features]` input in one call.
+    @differentiable(wrt: (self, input, initialState))
+    public func callAsFunction(
+        _ input: Cell.SequenceTensor,
+        initialState: Cell.State
+    ) -> Cell.SequenceTensor {
+        cell.sequence(input, initialState: initialState)
+    }
+}
+
 //==============================================================================
 extension RecurrentLayer: Equatable where Cell: Equatable {}
 extension RecurrentLayer: AdditiveArithmetic where Cell: AdditiveArithmetic {}
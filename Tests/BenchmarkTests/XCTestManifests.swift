@@ -19,6 +19,8 @@ import XCTest
 public func allTests() -> [XCTestCaseEntry] {
     return [
         testCase(test_Fractals.allTests),
+        testCase(test_Matmul.allTests),
+        testCase(test_MLP.allTests),
     ]
 }
 #endif
@@ -0,0 +1,106 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+final class test_MLP: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_mlpInference", test_mlpInference),
+        ("test_mlpInferenceBatch1", test_mlpInferenceBatch1),
+        ("test_mlpTraining", test_mlpTraining),
+    ]
+
+    override func setUpWithError() throws {
+    //    log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+    //    log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    // a 784-1024-1024-10 relu MLP
+    func makeMLP() -> [Dense<Shape2,Float>] {
+        [Dense(inputSize: 784, outputSize: 1024, activation: .relu),
+         Dense(inputSize: 1024, outputSize: 1024, activation: .relu),
+         Dense(inputSize: 1024, outputSize: 10)]
+    }
+
+    func forward(_ layers: [Dense<Shape2,Float>],
+                 _ x: TensorR2<Float>) -> TensorR2<Float> {
+        layers.reduce(x) { $1($0) }
+    }
+
+    //--------------------------------------------------------------------------
+    // throughput of batch 128 inference
+    func test_mlpInference() {
+        let batches = 20
+        let layers = makeMLP()
+        let x = TensorR2<Float>(randomNormal: Shape2(128, 784))
+        var y = forward(layers, x)
+
+        measure {
+            for _ in 0..<batches {
+                y = forward(layers, x)
+            }
+            currentQueue.waitForCompletion()
+        }
+        XCTAssert(y.shape == Shape2(128, 10))
+    }
+
+    //--------------------------------------------------------------------------
+    // latency of batch 1 inference, where each layer is a matrix vector
+    // product
+    func test_mlpInferenceBatch1() {
+        let steps = 100
+        let layers = makeMLP()
+        let x = TensorR2<Float>(randomNormal: Shape2(1, 784))
+        var y = forward(layers, x)
+
+        measure {
+            for _ in 0..<steps {
+                y = forward(layers, x)
+            }
+            currentQueue.waitForCompletion()
+        }
+        XCTAssert(y.shape == Shape2(1, 10))
+    }
+
+    //--------------------------------------------------------------------------
+    // throughput of batch 128 forward and backward passes of the first two
+    // layers
+    func test_mlpTraining() {
+        let batches = 10
+        let l1 = Dense<Shape2,Float>(inputSize: 784, outputSize: 1024,
+                                     activation: .relu)
+        let l2 = Dense<Shape2,Float>(inputSize: 1024, outputSize: 1024,
+                                     activation: .relu)
+        let x = TensorR2<Float>(randomNormal: Shape2(128, 784))
+        let outGrad = TensorR2<Float>(ones: Shape2(128, 1024))
+        var grads = pullback(at: l1, l2) { l1, l2 in l2(l1(x)) }(outGrad)
+
+        measure {
+            for _ in 0..<batches {
+                grads = pullback(at: l1, l2) { l1, l2 in l2(l1(x)) }(outGrad)
+            }
+            currentQueue.waitForCompletion()
+        }
+        XCTAssert(grads.0.weight.shape == Shape2(784, 1024))
+    }
+}
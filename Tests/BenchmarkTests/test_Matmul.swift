@@ -0,0 +1,53 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+final class test_Matmul: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_lstmStepLatency", test_lstmStepLatency),
+    ]
+
+    override func setUpWithError() throws {
+    //    log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+    //    log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    // the gate projections of a batch 1 LSTM step with 1024 hidden units,
+    // which is a 1x1024 x 1024x4096 matrix vector product plus bias
+    func test_lstmStepLatency() {
+        let steps = 100
+        let x = TensorR2<Float>(randomNormal: Shape2(1, 1024))
+        let w = TensorR2<Float>(randomNormal: Shape2(1024, 4096))
+        let bias = TensorR1<Float>(zeros: Shape1(4096))
+        var gates = matmul(x, w, bias: bias)
+
+        measure {
+            for _ in 0..<steps {
+                gates = matmul(x, w, bias: bias)
+            }
+            currentQueue.waitForCompletion()
+        }
+        XCTAssert(gates.shape == Shape2(1, 4096))
+    }
+}
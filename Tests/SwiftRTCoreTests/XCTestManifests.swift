@@ -18,19 +18,25 @@ import XCTest
 #if !canImport(ObjectiveC)
 public func allTests() -> [XCTestCaseEntry] {
     return [
+        testCase(test_Activation.allTests),
         testCase(test_AlgebraicField.allTests),
         testCase(test_arraySyntax.allTests),
         testCase(test_Async.allTests),
+        testCase(test_ChannelsLastOrder.allTests),
         testCase(test_Codable.allTests),
         testCase(test_Comparative.allTests),
+        testCase(test_ExecutionPlanner.allTests),
         testCase(test_Initialize.allTests),
         testCase(test_Math.allTests),
         testCase(test_PackedElements.allTests),
+        testCase(test_Quantize.allTests),
         testCase(test_Random.allTests),
         testCase(test_Reductions.allTests),
         testCase(test_Shape.allTests),
+        testCase(test_Sparse.allTests),
         testCase(test_StorageElement.allTests),
         testCase(test_Subscripting.allTests),
+        testCase(test_TiledOrder.allTests),
         testCase(test_VectorElement.allTests),
         testCase(test_Vectorizing.allTests),
     ]
@@ -0,0 +1,137 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import Numerics
+import SwiftRT
+
+class test_Activation: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_activation", test_activation),
+        ("test_activationInPlace", test_activationInPlace),
+        ("test_activationStrided", test_activationStrided),
+        ("test_activationGradient", test_activationGradient),
+        ("test_activationNan", test_activationNan),
+    ]
+
+    static let types: [ActivationType] =
+        [.identity, .sigmoid, .relu, .tanh, .clippedRelu, .elu]
+
+    //--------------------------------------------------------------------------
+    func test_activation() {
+        // more elements than a single parallel chunk
+        for count in [10, 40_000] {
+            let x = array(from: Float(-8), to: Float(8), count: count)
+            for type in Self.types {
+                let expected = x.flatArray.map { reference(type, $0) }
+                let y = activation(x, type)
+                XCTAssert(absmax(y - array(expected)).element < 1e-6,
+                          "\(type)")
+            }
+        }
+        let x = array([-2, -0.5, 0, 3, 8], (1, 5))
+        XCTAssert(relu(x) == [[0, 0, 0, 3, 8]])
+        XCTAssert(clippedRelu(x, ceiling: 4) == [[0, 0, 0, 3, 4]])
+        XCTAssert(absmax(elu(x) - array([[Foundation.expm1(-2),
+                                         Foundation.expm1(-0.5), 0, 3, 8]]))
+                    .element < 1e-12)
+    }
+
+    //--------------------------------------------------------------------------
+    // a uniquely referenced tensor is transformed in its own storage
+    func test_activationInPlace() {
+        var x = array(from: Float(-2), to: Float(2), (4, 5))
+        let expected = activation(x, .tanh)
+        let id = x.storage.id
+        applyActivation(.tanh, to: &x)
+        XCTAssert(x.storage.id == id)
+        XCTAssert(x == expected)
+    }
+
+    //--------------------------------------------------------------------------
+    // views that are not dense are mapped one element at a time
+    func test_activationStrided() {
+        let x = array(from: Float(-2), to: Float(2), (4, 5))
+        let view = x[1..<3, 1..<4]
+        let expected = activation(Tensor(copying: view, order: .row), .elu)
+        XCTAssert(absmax(activation(view, .elu) - expected).element < 1e-6)
+    }
+
+    //--------------------------------------------------------------------------
+    // the derivatives are computed from the saved output
+    func test_activationGradient() {
+        let x = array([-2.0, -0.5, 0.25, 3, 8])
+        let yDiff = array([1.0, -2.0, 0.5, 1.5, -1.0])
+        for type in Self.types {
+            let g = pullback(at: x, in: { activation($0, type) })(yDiff)
+            let expected = zip(x.flatArray, yDiff.flatArray).map {
+                derivative(type, $0) * $1
+            }
+            XCTAssert(absmax(g - array(expected)).element < 1e-12, "\(type)")
+        }
+        let g = pullback(at: x, in: { sigmoid($0) })(yDiff)
+        let expected = pullback(at: x, in: { activation($0, .sigmoid) })(yDiff)
+        XCTAssert(absmax(g - expected).element < 1e-12)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_activationNan() {
+        let x = array([Float.nan, -1, 2, 9])
+        for type in [ActivationType.relu, .clippedRelu] {
+            let clamped = activation(x, type, nan: .noPropagate)
+            XCTAssert(clamped.flatArray[0] == 0, "\(type)")
+            let propagated = activation(x, type, nan: .propagate)
+            XCTAssert(propagated.flatArray[0].isNaN, "\(type)")
+            XCTAssert(propagated.flatArray[1...] == clamped.flatArray[1...],
+                      "\(type)")
+
+            let yDiff = array([Float(1), 1, 1, 1])
+            XCTAssert(activationGradient(propagated, yDiff, type,
+                                         nan: .noPropagate).flatArray[0] == 0)
+            XCTAssert(activationGradient(propagated, yDiff, type,
+                                         nan: .propagate).flatArray[0].isNaN)
+        }
+        // arithmetic activations always propagate
+        XCTAssert(activation(x, .tanh, nan: .noPropagate).flatArray[0].isNaN)
+    }
+
+    //--------------------------------------------------------------------------
+    func reference<T: Real>(_ type: ActivationType, _ x: T) -> T {
+        switch type {
+        case .identity: return x
+        case .sigmoid: return 1 / (1 + .exp(-x))
+        case .relu: return Swift.max(0, x)
+        case .tanh: return .tanh(x)
+        case .clippedRelu: return Swift.min(T(defaultReluCeiling), Swift.max(0, x))
+        case .elu: return x < 0 ? .exp(x) - 1 : x
+        }
+    }
+
+    func derivative(_ type: ActivationType, _ x: Double) -> Double {
+        switch type {
+        case .identity: return 1
+        case .sigmoid:
+            let s = 1 / (1 + Foundation.exp(-x))
+            return s * (1 - s)
+        case .relu: return x > 0 ? 1 : 0
+        case .tanh: return 1 - Foundation.tanh(x) * Foundation.tanh(x)
+        case .clippedRelu: return x > 0 && x < Double(defaultReluCeiling) ? 1 : 0
+        case .elu: return x < 0 ? Foundation.exp(x) : 1
+        }
+    }
+}
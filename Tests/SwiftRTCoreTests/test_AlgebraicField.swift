@@ -29,9 +29,15 @@ class test_AlgebraicField: XCTestCase {
         ("test_minimalAddVJP", test_minimalAddVJP),
         
         ("test_matmul", test_matmul),
+        ("test_matmulFloat16", test_matmulFloat16),
+        ("test_matmulBFloat16", test_matmulBFloat16),
+        ("test_matmulBias", test_matmulBias),
+        ("test_matmulVector", test_matmulVector),
+        ("test_matmulBiasActivation", test_matmulBiasActivation),
         ("test_batchMatmul", test_batchMatmul),
         ("test_leftBatchMatmul", test_leftBatchMatmul),
         ("test_rightBatchMatmul", test_rightBatchMatmul),
+        ("test_parallelBatchMatmul", test_parallelBatchMatmul),
         
         ("test_perfAdd", test_perfAdd),
         ("test_add", test_add),
@@ -153,80 +159,247 @@ class test_AlgebraicField: XCTestCase {
         //                  [9, 9, 9, 9]])
     }
     
+    //--------------------------------------------------------------------------
+    func test_matmulFloat16() {
+        let a = array(0..<6, (3, 2), type: Float16.self)
+        let b = array(0..<8, (2, 4), type: Float16.self)
+        let c = matmul(a, b)
+        XCTAssert(c == [[ 4,  5,  6,  7],
+                        [12, 17, 22, 27],
+                        [20, 29, 38, 47]])
+
+        // half precision weights with single precision data
+        let x = array(0..<6, (3, 2))
+        let y = matmul(x, b)
+        XCTAssert(y == [[ 4,  5,  6,  7],
+                        [12, 17, 22, 27],
+                        [20, 29, 38, 47]])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulBFloat16() {
+        let a = array(0..<6, (3, 2), type: BFloat16.self)
+        let b = array(0..<8, (2, 4), type: BFloat16.self)
+        let c = matmul(a, b)
+        XCTAssert(c == [[ 4,  5,  6,  7],
+                        [12, 17, 22, 27],
+                        [20, 29, 38, 47]])
+
+        // accumulation is in Float, so the sum of many small products
+        // is not lost to rounding of the partial sums
+        let ones = full((1, 4096), 1, type: BFloat16.self)
+        let small = full((4096, 1), 0.001, type: BFloat16.self)
+        let sum = matmul(ones, small)
+        XCTAssert(abs(sum[0, 0] - 4096 * Float(BFloat16(0.001))) < 0.05)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulVector() {
+        // row vector with dot product and axpy layouts
+        let a = array([0, 1, 2], (1, 3))
+        let b = array(0..<12, (3, 4))
+        let bt = array(0..<12, (4, 3))
+        XCTAssert(matmul(a, b) == [[20, 23, 26, 29]])
+        XCTAssert(matmul(a, bt, transposed: true) == [[5, 14, 23, 32]])
+
+        // column vector with dot product and axpy layouts
+        let v = array([0, 1, 2], (3, 1))
+        XCTAssert(matmul(bt, v) == [[5], [14], [23], [32]])
+        XCTAssert(matmul(b, transposed: true, v) == [[20], [23], [26], [29]])
+
+        // split across threads with a fused bias
+        let x = ones((1, 1024))
+        let w = ones((1024, 4096))
+        let c = matmul(x, w, bias: ones((4096)))
+        XCTAssert(c == full((1, 4096), 1025))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulBias() {
+        let a = array([0, 1, 2, 3, 4, 5], (3, 2))
+        let b = array([0, 1, 2, 3, 4, 5, 6, 7], (2, 4))
+        let bias = array([1, 2, 3, 4])
+        let c = matmul(a, b, bias: bias)
+        XCTAssert(c == [[ 5,  7,  9, 11],
+                        [13, 19, 25, 31],
+                        [21, 31, 41, 51]])
+
+        let (g0, g1) = pullback(at: a, bias, in: {
+            matmul($0, b, bias: $1)
+        })(ones(like: c))
+        XCTAssert(g0 == [[6, 22], [6, 22], [6, 22]])
+        XCTAssert(g1 == [3, 3, 3, 3])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulBiasActivation() {
+        let a = array([0, 1, 2, 3, 4, 5], (3, 2))
+        let b = array([0, 1, 2, 3, 4, 5, 6, 7], (2, 4))
+        let bias = array([0, -6, -20, -50])
+        let c = matmul(a, b, bias: bias, activation: .relu)
+        XCTAssert(c == [[ 4,  0,  0, 0],
+                        [12, 11,  2, 0],
+                        [20, 23, 18, 0]])
+
+        let (g0, g1) = pullback(at: a, bias, in: {
+            matmul($0, b, bias: $1, activation: .relu)
+        })(ones(like: c))
+        XCTAssert(g0 == [[0, 4], [3, 15], [3, 15]])
+        XCTAssert(g1 == [3, 2, 2, 0])
+
+        let g2 = pullback(at: b, in: {
+            matmul(a, $0, bias: bias, activation: .relu)
+        })(ones(like: c))
+        XCTAssert(g2 == [[6, 6, 6, 0], [9, 8, 8, 0]])
+
+        // residual and clipped relu
+        let r = ones(like: c)
+        let d = matmul(a, b, bias: bias, residual: r, activation: .clippedRelu)
+        XCTAssert(d == [[5, 0, 0, 0],
+                        [6, 6, 3, 0],
+                        [6, 6, 6, 0]])
+    }
+
     //--------------------------------------------------------------------------
     func test_batchMatmul() {
-//        let a = array(0..<12, (2, 3, 2))
-//        let b = array(0..<16, (2, 2, 4))
-//        let c = matmul(a, b)
-//        XCTAssert(c == [[[  4.0,   5.0,   6.0,   7.0],
-//                         [ 12.0,  17.0,  22.0,  27.0],
-//                         [ 20.0,  29.0,  38.0,  47.0]],
-//
-//                        [[132.0, 145.0, 158.0, 171.0],
-//                         [172.0, 189.0, 206.0, 223.0],
-//                         [212.0, 233.0, 254.0, 275.0]]])
-//
-//        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
-//        XCTAssert(g0 == [[[ 6.0, 22.0],
-//                          [ 6.0, 22.0],
-//                          [ 6.0, 22.0]],
-//
-//                         [[38.0, 54.0],
-//                          [38.0, 54.0],
-//                          [38.0, 54.0]]])
-//
-//        XCTAssert(g1 == [[[ 6.0,  6.0,  6.0,  6.0],
-//                          [ 9.0,  9.0,  9.0,  9.0]],
-//
-//                         [[24.0, 24.0, 24.0, 24.0],
-//                          [27.0, 27.0, 27.0, 27.0]]])
+        let a = array(0..<12, (2, 3, 2))
+        let b = array(0..<16, (2, 2, 4))
+        let c = matmul(a, b)
+        XCTAssert(c == [[[  4.0,   5.0,   6.0,   7.0],
+                         [ 12.0,  17.0,  22.0,  27.0],
+                         [ 20.0,  29.0,  38.0,  47.0]],
+
+                        [[132.0, 145.0, 158.0, 171.0],
+                         [172.0, 189.0, 206.0, 223.0],
+                         [212.0, 233.0, 254.0, 275.0]]])
+
+        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
+        XCTAssert(g0 == [[[ 6.0, 22.0],
+                          [ 6.0, 22.0],
+                          [ 6.0, 22.0]],
+
+                         [[38.0, 54.0],
+                          [38.0, 54.0],
+                          [38.0, 54.0]]])
+
+        XCTAssert(g1 == [[[ 6.0,  6.0,  6.0,  6.0],
+                          [ 9.0,  9.0,  9.0,  9.0]],
+
+                         [[24.0, 24.0, 24.0, 24.0],
+                          [27.0, 27.0, 27.0, 27.0]]])
     }
 
     //--------------------------------------------------------------------------
     func test_leftBatchMatmul() {
-//        let a = array(0..<12, (2, 3, 2))
-//        let b = array(0..<8, (2, 4))
-//        let c = matmul(a, b)
-//        XCTAssert(c == [[[ 4,  5,  6,  7],
-//                         [12, 17, 22, 27],
-//                         [20, 29, 38, 47]]])
-//
-//        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
-//        XCTAssert(g0 == [[[ 6.0, 22.0],
-//                          [ 6.0, 22.0],
-//                          [ 6.0, 22.0]],
-//
-//                         [[ 6.0, 22.0],
-//                          [ 6.0, 22.0],
-//                          [ 6.0, 22.0]]])
-//
-//        XCTAssert(g1 == [[30.0, 30.0, 30.0, 30.0],
-//                         [36.0, 36.0, 36.0, 36.0]])
+        let a = array(0..<12, (2, 3, 2))
+        let b = array(0..<8, (2, 4))
+        let c = matmul(a, b)
+        XCTAssert(c == [[[ 4,  5,  6,  7],
+                         [12, 17, 22, 27],
+                         [20, 29, 38, 47]],
+
+                        [[28, 41, 54, 67],
+                         [36, 53, 70, 87],
+                         [44, 65, 86, 107]]])
+
+        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
+        XCTAssert(g0 == [[[ 6.0, 22.0],
+                          [ 6.0, 22.0],
+                          [ 6.0, 22.0]],
+
+                         [[ 6.0, 22.0],
+                          [ 6.0, 22.0],
+                          [ 6.0, 22.0]]])
+
+        XCTAssert(g1 == [[30.0, 30.0, 30.0, 30.0],
+                         [36.0, 36.0, 36.0, 36.0]])
     }
 
     //--------------------------------------------------------------------------
     func test_rightBatchMatmul() {
-//        let a = array(0..<6, (3, 2))
-//        let b = array(0..<16, (2, 2, 4))
-//        let c = matmul(a, b)
-//        XCTAssert(c == [[[  4.0,   5.0,   6.0,   7.0],
-//                         [ 12.0,  17.0,  22.0,  27.0],
-//                         [ 20.0,  29.0,  38.0,  47.0]],
-//                        
-//                        [[ 12.0,  13.0,  14.0,  15.0],
-//                         [ 52.0,  57.0,  62.0,  67.0],
-//                         [ 92.0, 101.0, 110.0, 119.0]]])
-//        
-//        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
-//        XCTAssert(g0 == [[44.0, 76.0],
-//                         [44.0, 76.0],
-//                         [44.0, 76.0]])
-//        
-//        XCTAssert(g1 == [[[6.0, 6.0, 6.0, 6.0],
-//                          [9.0, 9.0, 9.0, 9.0]],
-//                         
-//                         [[6.0, 6.0, 6.0, 6.0],
-//                          [9.0, 9.0, 9.0, 9.0]]])
+        let a = array(0..<6, (3, 2))
+        let b = array(0..<16, (2, 2, 4))
+        let c = matmul(a, b)
+        XCTAssert(c == [[[  4.0,   5.0,   6.0,   7.0],
+                         [ 12.0,  17.0,  22.0,  27.0],
+                         [ 20.0,  29.0,  38.0,  47.0]],
+                        
+                        [[ 12.0,  13.0,  14.0,  15.0],
+                         [ 52.0,  57.0,  62.0,  67.0],
+                         [ 92.0, 101.0, 110.0, 119.0]]])
+        
+        let (g0, g1) = pullback(at: a, b, in: { matmul($0, $1) } )(ones(like: c))
+        XCTAssert(g0 == [[44.0, 76.0],
+                         [44.0, 76.0],
+                         [44.0, 76.0]])
+        
+        XCTAssert(g1 == [[[6.0, 6.0, 6.0, 6.0],
+                          [9.0, 9.0, 9.0, 9.0]],
+                         
+                         [[6.0, 6.0, 6.0, 6.0],
+                          [9.0, 9.0, 9.0, 9.0]]])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_parallelBatchMatmul() {
+        // large enough to split each batch item into row tiles, and
+        // checked against a naive triple loop. Small integer values keep
+        // the Float sums exact.
+        let av = (0..<(4 * 96 * 80)).map { Float($0 % 7) }
+        let bv = (0..<(80 * 72)).map { Float($0 % 5) }
+        let tv = (0..<(72 * 80)).map { Float($0 % 3) }
+        let a = array(av, (4, 96, 80))
+        let b = array(bv, (1, 80, 72))
+        let t = array(tv, (1, 72, 80))
+
+        // a[n, r, k] and its transpose
+        func A(_ n: Int, _ r: Int, _ k: Int) -> Float {
+            av[(n * 96 + r) * 80 + k]
+        }
+        func At(_ n: Int, _ r: Int, _ k: Int) -> Float { A(n, k, r) }
+        // the broadcast single batch items
+        func B(_ n: Int, _ k: Int, _ c: Int) -> Float { bv[k * 72 + c] }
+        func T(_ n: Int, _ r: Int, _ k: Int) -> Float { tv[r * 80 + k] }
+        func Tt(_ n: Int, _ k: Int, _ c: Int) -> Float { T(n, c, k) }
+
+        let c = matmul(a, b)
+        XCTAssert(c.shape == Shape3(4, 96, 72))
+        XCTAssert(c.flatArray == referenceBatchMatmul(4, 96, 72, 80, A, B))
+
+        // transposed operands are read in place, and a broadcast batch
+        // item is used with every batch item of the other operand
+        let d = matmul(a, transposed: true, a)
+        XCTAssert(d.shape == Shape3(4, 80, 80))
+        XCTAssert(d.flatArray == referenceBatchMatmul(4, 80, 80, 96, At, A))
+
+        let e = matmul(a, t, transposed: true)
+        XCTAssert(e.shape == Shape3(4, 96, 72))
+        XCTAssert(e.flatArray == referenceBatchMatmul(4, 96, 72, 80, A, Tt))
+
+        let f = matmul(t, a, transposed: true)
+        XCTAssert(f.shape == Shape3(4, 72, 96))
+        XCTAssert(f.flatArray == referenceBatchMatmul(4, 72, 96, 80, T, At))
+    }
+
+    //--------------------------------------------------------------------------
+    // referenceBatchMatmul
+    // a naive row major batch matmul of `lhs(n, row, k)` and `rhs(n, k, col)`
+    func referenceBatchMatmul(
+        _ batch: Int, _ M: Int, _ N: Int, _ K: Int,
+        _ lhs: (Int, Int, Int) -> Float,
+        _ rhs: (Int, Int, Int) -> Float
+    ) -> [Float] {
+        var result = [Float](repeating: 0, count: batch * M * N)
+        for n in 0..<batch {
+            for r in 0..<M {
+                for col in 0..<N {
+                    var sum: Float = 0
+                    for k in 0..<K { sum += lhs(n, r, k) * rhs(n, k, col) }
+                    result[(n * M + r) * N + col] = sum
+                }
+            }
+        }
+        return result
     }
 
     //--------------------------------------------------------------------------
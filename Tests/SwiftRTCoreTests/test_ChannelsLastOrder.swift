@@ -0,0 +1,94 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_ChannelsLastOrder: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_channelsLastStrides", test_channelsLastStrides),
+        ("test_channelsLastIndexing", test_channelsLastIndexing),
+        ("test_channelsLastConversion", test_channelsLastConversion),
+        ("test_channelsLastMapOps", test_channelsLastMapOps),
+    ]
+
+    override func setUpWithError() throws {
+//         log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+//         log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    func test_channelsLastStrides() {
+        XCTAssert(Shape4(2, 3, 4, 5).strides(for: .NHWC) == Shape4(60, 1, 15, 3))
+        XCTAssert(Shape5(2, 3, 4, 5, 6).strides(for: .NDHWC) ==
+                    Shape5(360, 1, 90, 18, 3))
+        XCTAssert(Shape4(2, 3, 4, 5).channelsLast == Shape4(2, 4, 5, 3))
+        XCTAssert(Shape4(2, 4, 5, 3).channelsFirst == Shape4(2, 3, 4, 5))
+        XCTAssert(Order.channelsLast(rank: 5) == .NDHWC)
+    }
+
+    //--------------------------------------------------------------------------
+    // a channels last tensor indexes the same storage as a row order
+    // tensor with the channels moved to the last dimension
+    func test_channelsLastIndexing() {
+        let nhwc = array(from: Float(0), to: Float(2 * 4 * 5 * 3 - 1),
+                         (2, 4, 5, 3))
+        let a = Tensor(channelsFirst: nhwc, order: .NHWC)
+        XCTAssert(a.order == .NHWC && a.isContiguous)
+        XCTAssert(a.shape == Shape4(2, 3, 4, 5))
+        XCTAssert(a[1, 2, 3, 4] == nhwc[1, 3, 4, 2])
+        XCTAssert(a[0, 1, 2, 0] == nhwc[0, 2, 0, 1])
+        XCTAssert(Tensor(channelsLast: a) == nhwc)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_channelsLastConversion() {
+        let a = array(from: Float(0), to: Float(2 * 3 * 4 * 5 - 1),
+                      (2, 3, 4, 5))
+        let c = Tensor(copying: a, order: .NHWC)
+        XCTAssert(c.order == .NHWC && c.isContiguous)
+        XCTAssert(c[1, 2, 3, 4] == a[1, 2, 3, 4])
+        XCTAssert(c.flatArray == a.flatArray)
+        XCTAssert(Tensor(copying: c, order: .row) == a)
+
+        // the storage has the channels innermost
+        let nhwc = Tensor(channelsLast: c)
+        XCTAssert(nhwc[1, 3, 4, 2] == a[1, 2, 3, 4])
+
+        // larger than the conversion blocks
+        let b = array(0..<(2 * 40 * 3 * 3 * 12), (2, 40, 3, 3, 12))
+        let d = Tensor(copying: b, order: .NDHWC)
+        XCTAssert(d.flatArray == b.flatArray)
+        XCTAssert(Tensor(copying: d, order: .row) == b)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_channelsLastMapOps() {
+        let a = array(from: Float(0), to: Float(2 * 3 * 4 * 5 - 1),
+                      (2, 3, 4, 5))
+        let b = array(from: Float(1), to: Float(2 * 3 * 4 * 5), (2, 3, 4, 5))
+        let expected = (a + b * 2).flatArray
+        let ca = Tensor(copying: a, order: .NHWC)
+        let cb = Tensor(copying: b, order: .NHWC)
+        XCTAssert((ca + cb * 2).flatArray == expected)
+        XCTAssert((ca + b * 2).flatArray == expected)
+    }
+}
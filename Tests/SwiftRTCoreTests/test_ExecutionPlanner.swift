@@ -0,0 +1,154 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_ExecutionPlanner: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_planKey", test_planKey),
+        ("test_planCache", test_planCache),
+        ("test_planCachePersistence", test_planCachePersistence),
+        ("test_gemmPlan", test_gemmPlan),
+        ("test_tuneOnce", test_tuneOnce),
+        ("test_gemmPlanResidual", test_gemmPlanResidual),
+        ("test_reductionPlan", test_reductionPlan),
+    ]
+
+    override func setUpWithError() throws {
+//         log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+//         log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    func test_planKey() {
+        var a = ExecutionPlanKey("gemm")
+        a.combine(empty((4, 8)))
+        var b = ExecutionPlanKey("gemm")
+        b.combine(empty((4, 8)))
+        var c = ExecutionPlanKey("gemm")
+        c.combine(empty((8, 4)))
+        XCTAssert(a.key == b.key)
+        XCTAssert(a.key != c.key)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_planCache() {
+        let cache = CpuExecutionPlanCache()
+        let plan = CpuGemmPlan(tilesPerBatch: 2, tileRows: 32, tileCols: 64)
+        XCTAssert(cache.query(CpuGemmPlan.self, key: 1) == nil)
+        cache.add(plan: plan, CpuGemmPlan.self, key: 1)
+        XCTAssert(cache.query(CpuGemmPlan.self, key: 1) == plan)
+        XCTAssert(cache.query(Int.self, key: 1) == nil)
+
+        // concurrent access
+        DispatchQueue.concurrentPerform(iterations: 64) { i in
+            cache.add(plan: i, Int.self, key: i)
+            XCTAssert(cache.query(Int.self, key: i) == i)
+        }
+        XCTAssert(cache.count == 65)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_planCachePersistence() throws {
+        let url = FileManager.default.temporaryDirectory
+            .appendingPathComponent("test_planCache.json")
+        defer { try? FileManager.default.removeItem(at: url) }
+
+        let plan = CpuGemmPlan(tilesPerBatch: 4, tileRows: 16, tileCols: 128)
+        let cache = CpuExecutionPlanCache()
+        cache.add(plan: plan, CpuGemmPlan.self, key: 42)
+        try cache.save(to: url)
+
+        let preloaded = CpuExecutionPlanCache()
+        try preloaded.load(from: url)
+        XCTAssert(preloaded.query(CpuGemmPlan.self, key: 42) == plan)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_gemmPlan() {
+        // the first call tunes and caches the plan, the second uses it
+        CpuExecutionPlanCache.shared.removeAll()
+        let a = ones((128, 96))
+        let b = ones((96, 160))
+        let c0 = matmul(a, b)
+        let tuned = CpuExecutionPlanCache.shared.count
+        XCTAssert(tuned == 1)
+        let c1 = matmul(a, b)
+        XCTAssert(CpuExecutionPlanCache.shared.count == tuned)
+        XCTAssert(c0 == full((128, 160), 96))
+        XCTAssert(c1 == c0)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_tuneOnce() {
+        // concurrent first calls wait for a single tuning of the key
+        let cache = CpuExecutionPlanCache()
+        var tuned = 0
+        DispatchQueue.concurrentPerform(iterations: 16) { _ in
+            let plan = cache.plan(Int.self, key: 7) { () -> Int in
+                tuned += 1
+                return 3
+            }
+            XCTAssert(plan == 3)
+        }
+        XCTAssert(tuned == 1)
+
+        cache.isTuningEnabled = false
+        XCTAssert(cache.plan(Int.self, key: 8) { 4 } == nil)
+        XCTAssert(cache.plan(Int.self, key: 7) { 4 } == 3)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_gemmPlanResidual() {
+        // the residual is added once by the call that tunes the plan,
+        // including when it is the output
+        CpuExecutionPlanCache.shared.removeAll()
+        let x = ones((128, 96))
+        let w = ones((96, 160))
+        var y = full((128, 160), 1)
+        dense(x, w, residual: y, into: &y)
+        XCTAssert(CpuExecutionPlanCache.shared.count == 1)
+        XCTAssert(y == full((128, 160), 97))
+
+        var z = TensorR2<Float>()
+        dense(x, w, residual: full((128, 160), 2), into: &z)
+        XCTAssert(z == full((128, 160), 98))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_reductionPlan() {
+        // a reduction large enough to split is planned once per layout
+        let cores = ProcessInfo.processInfo.activeProcessorCount
+        let x = ones((256, 512))
+        CpuExecutionPlanCache.shared.removeAll()
+        XCTAssert(x.sum().element == 256 * 512)
+        let planned = CpuExecutionPlanCache.shared.count
+        XCTAssert(planned == (cores > 1 ? 1 : 0))
+        XCTAssert(x.sum().element == 256 * 512)
+        XCTAssert(x.mean().element == 1)
+        XCTAssert(CpuExecutionPlanCache.shared.count == planned * 2)
+
+        // small reductions are serial and are not planned
+        XCTAssert(array([1, 2, 3]).sum().element == 6)
+        XCTAssert(CpuExecutionPlanCache.shared.count == planned * 2)
+    }
+}
@@ -0,0 +1,165 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Quantize: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_quantizeInt8", test_quantizeInt8),
+        ("test_quantizeUInt8", test_quantizeUInt8),
+        ("test_quantizePerChannel", test_quantizePerChannel),
+        ("test_matmulInt8", test_matmulInt8),
+        ("test_matmulRequantize", test_matmulRequantize),
+        ("test_matmulLargeDepth", test_matmulLargeDepth),
+        ("test_groupQuantize", test_groupQuantize),
+        ("test_groupQuantizePartial", test_groupQuantizePartial),
+        ("test_groupMatmul", test_groupMatmul),
+    ]
+
+    override func setUpWithError() throws {
+//         log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+//         log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    func test_quantizeInt8() {
+        let a = array([-1.27, -0.5, 0, 0.5, 1.27], (1, 5))
+        let q = QuantizedTensor(quantizing: a, type: Int8.self)
+        XCTAssert(q.zeroPoints == [0])
+        XCTAssert(abs(q.scales[0] - 0.01) < 1e-6)
+        XCTAssert(q.values == [[-127, -50, 0, 50, 127]])
+        XCTAssert(absmax(q.dequantized() - a).element < 0.005)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_quantizeUInt8() {
+        let a = array([0, 0.5, 1, 1.5, 2.55], (1, 5))
+        let q = QuantizedTensor(quantizing: a, type: UInt8.self)
+        XCTAssert(q.zeroPoints == [0])
+        XCTAssert(q.values == [[0, 50, 100, 150, 255]])
+        XCTAssert(absmax(q.dequantized() - a).element < 0.005)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_quantizePerChannel() {
+        // columns with very different ranges keep their precision
+        let a = array([2, 200, -2, 0, 0, -200], (3, 2))
+        let q = QuantizedTensor(quantizing: a, axis: 1, type: Int8.self)
+        XCTAssert(q.scales.count == 2)
+        XCTAssert(abs(q.scales[0] - 2 / 127) < 1e-6)
+        XCTAssert(abs(q.scales[1] - 200 / 127) < 1e-6)
+        XCTAssert(q.values == [[127, 127], [-127, 0], [0, -127]])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulInt8() {
+        let a = array(0..<24, (4, 6)) / 24
+        let w = array(0..<18, (6, 3)) / 9 - 1
+        let bias = array([0.5, -0.5, 0.25])
+        let expected = matmul(a, w, bias: bias, activation: .relu)
+
+        let qa = QuantizedTensor(quantizing: a, type: UInt8.self)
+        let qw = QuantizedTensor(quantizing: w, axis: 1, type: Int8.self)
+        let c = matmul(qa, qw, bias: bias, activation: .relu)
+        XCTAssert(c.shape == expected.shape)
+        XCTAssert(absmax(c - expected).element < 0.05)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_matmulRequantize() {
+        let a = array(0..<24, (4, 6)) / 24
+        let w = array(0..<18, (6, 3)) / 9 - 1
+        let expected = matmul(a, w)
+
+        let qa = QuantizedTensor(quantizing: a, type: UInt8.self)
+        let qw = QuantizedTensor(quantizing: w, type: Int8.self)
+        let c = matmul(qa, qw, scale: 0.05, zeroPoint: 0, type: Int8.self)
+        XCTAssert(c.scales == [0.05] && c.zeroPoints == [0])
+        XCTAssert(absmax(c.dequantized() - expected).element < 0.1)
+    }
+
+    //--------------------------------------------------------------------------
+    // the sum of 70,000 products of 255 * 127 does not fit in an Int32, so
+    // it is accumulated in blocks
+    func test_matmulLargeDepth() {
+        let K = 70_000
+        let a = array([Float](repeating: 1, count: K), (1, K))
+        let w = array([Float](repeating: 1, count: K), (K, 1))
+        let qa = QuantizedTensor(quantizing: a, type: UInt8.self)
+        let qw = QuantizedTensor(quantizing: w, type: Int8.self)
+        let c = matmul(qa, qw)
+        XCTAssert(abs(c.element - Float(K)) < 1)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_groupQuantize() {
+        // each group of 32 has its own range, so the error is bounded
+        // by half a step of the group
+        let a = array(0..<128, (2, 64)) / 8 - 8
+        let q = GroupQuantizedTensor(quantizing: a, groupSize: 32)
+        XCTAssert(q.groupsPerRow == 2 && q.scales.count == 4)
+        XCTAssert(abs(q.offsets[1] - (-4)) < 1e-6)
+        XCTAssert(absmax(q.dequantized() - a).element <= q.scales[0] / 2)
+
+        // gathered rows match the dequantized rows
+        let rows = q.gathering(indices: array([1, 0], type: DeviceIndex.self))
+        let all = q.dequantized()
+        XCTAssert(rows[0, ...] == all[1, ...] && rows[1, ...] == all[0, ...])
+    }
+
+    //--------------------------------------------------------------------------
+    // a row size that is not a multiple of the group size has a shorter
+    // last group with its own scale and offset
+    func test_groupQuantizePartial() {
+        // values 0...15 in each group quantize exactly. The short last
+        // group, columns 64..<80, uses steps of 0.5, and the second row
+        // is offset by 1.
+        let av = (0..<160).map { i -> Float in
+            let c = i % 80
+            return Float(c % 16) * (c < 64 ? 1 : 0.5) + Float(i / 80)
+        }
+        let a = array(av, (2, 80))
+        let q = GroupQuantizedTensor(quantizing: a, groupSize: 32)
+        XCTAssert(q.groupsPerRow == 3 && q.scales.count == 6)
+        XCTAssert(q.scales == [1, 1, 0.5, 1, 1, 0.5])
+        XCTAssert(q.offsets == [0, 0, 0, 1, 1, 1])
+        XCTAssert(q.dequantized() == a)
+
+        // the last group is included in the products, which are exact
+        let x = array((0..<160).map { Float($0 % 3) }, (2, 80))
+        XCTAssert(matmul(x, q) == matmul(x, a, transposed: true))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_groupMatmul() {
+        let a = array(0..<256, (2, 128)) / 256
+        let w = array(0..<1024, (128, 8)) / 512 - 1
+        let expected = matmul(a, w)
+
+        // weights are stored as [outputs, inputs]
+        let qw = GroupQuantizedTensor(quantizing: w.t, groupSize: 64)
+        let dw = qw.dequantized()
+        XCTAssert(absmax(matmul(a, qw) - matmul(a, dw, transposed: true))
+                    .element < 1e-4)
+        XCTAssert(absmax(matmul(a, qw) - expected).element < 0.2)
+    }
+}
@@ -22,6 +22,8 @@ class test_Reductions: XCTestCase {
     // support terminal test run
     static var allTests = [
         ("test_gather", test_gather),
+        ("test_gatherAxes", test_gatherAxes),
+        ("test_scatterAdd", test_scatterAdd),
         ("test_sumTensor3AlongAxes", test_sumTensor3AlongAxes),
         ("test_minTensor3AlongAxes", test_minTensor3AlongAxes),
         ("test_maxTensor3AlongAxes", test_maxTensor3AlongAxes),
@@ -88,6 +90,63 @@ class test_Reductions: XCTestCase {
         ])
     }
     
+    //--------------------------------------------------------------------------
+    // each axis of a rank 3 tensor is gathered as contiguous spans, and the
+    // gradients of repeated indices are summed
+    func test_gatherAxes() {
+        let a = array(0..<24, (2, 3, 4))
+        let ai = array([2, 0, 2], type: DeviceIndex.self)
+        let b = gather(from: a, indices: ai, axis: 1)
+        XCTAssert(b == [
+            [[8, 9, 10, 11], [0, 1, 2, 3], [8, 9, 10, 11]],
+            [[20, 21, 22, 23], [12, 13, 14, 15], [20, 21, 22, 23]]
+        ])
+
+        let c = gather(from: a, indices: ai, axis: -1)
+        XCTAssert(c == [
+            [[2, 0, 2], [6, 4, 6], [10, 8, 10]],
+            [[14, 12, 14], [18, 16, 18], [22, 20, 22]]
+        ])
+
+        let g = gradient(at: ones(like: a)) {
+            gather(from: $0, indices: ai, axis: 1).sum().element
+        }
+        XCTAssert(g == [
+            [[1, 1, 1, 1], [0, 0, 0, 0], [2, 2, 2, 2]],
+            [[1, 1, 1, 1], [0, 0, 0, 0], [2, 2, 2, 2]]
+        ])
+    }
+
+    //--------------------------------------------------------------------------
+    // repeated indices are added in order
+    func test_scatterAdd() {
+        let values = array([
+            [1, 2],
+            [3, 4],
+            [5, 6]
+        ])
+        let a = scatterAdd(values, indices: [2, 0, 2], into: ones(like: array([
+            [0, 0],
+            [0, 0],
+            [0, 0],
+            [0, 0]
+        ])))
+        XCTAssert(a == [
+            [4, 5],
+            [1, 1],
+            [7, 9],
+            [1, 1]
+        ])
+
+        let b = scatterAdd(values, indices: [1, 1], axis: 1,
+                           into: array([[0, 0], [0, 0], [0, 0]]))
+        XCTAssert(b == [
+            [0, 3],
+            [0, 7],
+            [0, 11]
+        ])
+    }
+
     //--------------------------------------------------------------------------
     // test_sumTensor3AlongAxes
     func test_sumTensor3AlongAxes() {
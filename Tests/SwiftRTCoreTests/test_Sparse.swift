@@ -0,0 +1,174 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Sparse: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_csrConversion", test_csrConversion),
+        ("test_cooConversion", test_cooConversion),
+        ("test_duplicateCoordinates", test_duplicateCoordinates),
+        ("test_spmm", test_spmm),
+        ("test_spmmGradient", test_spmmGradient),
+        ("test_spmv", test_spmv),
+        ("test_sparseMultiply", test_sparseMultiply),
+        ("test_rowReductions", test_rowReductions),
+        ("test_sparseRows", test_sparseRows),
+    ]
+
+    override func setUpWithError() throws {
+//         log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+//         log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    func test_csrConversion() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let s = CsrMatrix(a)
+        XCTAssert(s.rowOffsets == [0, 1, 1, 3])
+        XCTAssert(s.columns == [1, 0, 2])
+        XCTAssert(s.values == [2, 1, 3])
+        XCTAssert(s.dense() == a)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_cooConversion() {
+        let a = array([[[0, 1], [0, 0]], [[2, 0], [0, 3]]])
+        let coo = CooTensor(a)
+        XCTAssert(coo.indices == [Shape3(0, 0, 1), Shape3(1, 0, 0),
+                                  Shape3(1, 1, 1)])
+        XCTAssert(coo.dense() == a)
+
+        // unordered rank 2 coordinates
+        let m = CooTensor(shape: Shape2(2, 3),
+                          indices: [Shape2(1, 2), Shape2(0, 1), Shape2(1, 0)],
+                          values: array([3, 1, 2]))
+        let csr = CsrMatrix(m)
+        XCTAssert(csr.rowOffsets == [0, 1, 3])
+        XCTAssert(csr.columns == [1, 0, 2])
+        XCTAssert(csr.values == [1, 2, 3])
+        XCTAssert(CooTensor(csr).dense() == m.dense())
+    }
+
+    //--------------------------------------------------------------------------
+    // duplicate coordinates are summed by the dense conversions, in the
+    // same way as by the sparse matmul
+    func test_duplicateCoordinates() {
+        let coo = CooTensor(shape: Shape2(2, 3),
+                            indices: [Shape2(1, 2), Shape2(0, 1),
+                                      Shape2(1, 2), Shape2(1, 0)],
+                            values: array([3, 1, 4, 2]))
+        let expected = array([[0, 1, 0], [2, 0, 7]])
+        XCTAssert(coo.dense() == expected)
+
+        let csr = CsrMatrix(coo)
+        XCTAssert(csr.columns == [1, 0, 2, 2])
+        XCTAssert(csr.dense() == expected)
+        let b = array(0..<6, (3, 2))
+        XCTAssert(matmul(csr, b) == matmul(expected, b))
+
+        // the zero tangent leaves the values unchanged
+        var moved = csr
+        moved.move(along: TensorR1<Float>())
+        XCTAssert(moved.values == csr.values)
+        moved.move(along: ones((4)))
+        XCTAssert(moved.dense() == expected + array([[0, 1, 0], [1, 0, 2]]))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_spmm() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let b = array(0..<6, (3, 2))
+        XCTAssert(matmul(CsrMatrix(a), b) == matmul(a, b))
+
+        // large enough to run in parallel
+        let dense = array((0..<(256 * 256)).map { $0 % 7 == 0 ? Float(1) : 0 },
+                          (256, 256))
+        let w = ones((256, 64))
+        XCTAssert(matmul(CsrMatrix(dense), w) == matmul(dense, w))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_spmmGradient() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let b = array(0..<6, (3, 2))
+        let s = CsrMatrix(a)
+        let (sg, bg) = pullback(at: s, b, in: { matmul($0, $1) })(ones((3, 2)))
+        let (ag, dbg) = pullback(at: a, b, in: { matmul($0, $1) })(ones((3, 2)))
+        XCTAssert(bg == dbg)
+        XCTAssert(sg == s.sampling(ag))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_spmv() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let v = array([1, 2, 3])
+        XCTAssert(matmul(CsrMatrix(a), v) == [4, 0, 10])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_sparseMultiply() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let b = array(0..<9, (3, 3))
+        let s = CsrMatrix(a)
+        let c = multiply(s, b)
+        XCTAssert(c.values == [2, 6, 24])
+        XCTAssert(c.dense() == a * b)
+
+        let g = pullback(at: b, in: { sum(rowsOf: multiply(s, $0)) })(
+            ones((3)))
+        XCTAssert(g == a)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_rowReductions() {
+        let a = array([[0, 2, 0], [0, 0, 0], [1, 0, 3]])
+        let s = CsrMatrix(a)
+        XCTAssert(sum(rowsOf: s) == [2, 0, 4])
+        let expected = array([2.0 / 3, 0, 4.0 / 3])
+        XCTAssert(absmax(mean(rowsOf: s) - expected).element < 1e-6)
+        let g = pullback(at: s, in: { sum(rowsOf: $0) })(array([1, 2, 3]))
+        XCTAssert(g == [1, 3, 3])
+    }
+
+    //--------------------------------------------------------------------------
+    // sums concatenate the stored rows, and repeated indices are added
+    func test_sparseRows() {
+        let a = SparseRows(rowCount: 4, indices: [3, 1],
+                           values: array([[1, 2], [3, 4]]))
+        let b = SparseRows(rowCount: 4, indices: [1],
+                           values: array([[5, 6]]))
+        let sum = a + b
+        XCTAssert(sum.indices == [3, 1, 1])
+        XCTAssert(sum.dense() == [[0, 0], [8, 10], [0, 0], [1, 2]])
+        XCTAssert(a + .zero == a && .zero + a == a)
+
+        let c = sum.coalesced()
+        XCTAssert(c.indices == [1, 3])
+        XCTAssert(c.values == [[8, 10], [1, 2]])
+        XCTAssert((sum - b).dense() == a.dense())
+
+        var table = array([[1, 1], [1, 1], [1, 1], [1, 1]])
+        sum.add(to: &table)
+        XCTAssert(table == [[1, 1], [9, 11], [1, 1], [2, 3]])
+    }
+}
@@ -0,0 +1,116 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_TiledOrder: XCTestCase {
+    //==========================================================================
+    // support terminal test run
+    static var allTests = [
+        ("test_tiledOffsets", test_tiledOffsets),
+        ("test_tiledConversion", test_tiledConversion),
+        ("test_tiledBatchConversion", test_tiledBatchConversion),
+        ("test_tiledMapOps", test_tiledMapOps),
+        ("test_tiledMatmul", test_tiledMatmul),
+    ]
+
+    static let orders: [Order] = [.colTiled32, .colTiledTC32x8, .colTiledTC32x32]
+
+    override func setUpWithError() throws {
+//         log.level = .diagnostic
+    }
+
+    override func tearDownWithError() throws {
+//         log.level = .error
+    }
+
+    //--------------------------------------------------------------------------
+    // every element maps to a unique storage offset within the span
+    func test_tiledOffsets() {
+        let shape = Shape2(37, 70)
+        for order in Self.orders {
+            let span = shape.spanCount(for: order)
+            XCTAssert(span == 96 * order.tiledRows(37))
+            var used = [Bool](repeating: false, count: span)
+            for r in 0..<37 {
+                for c in 0..<70 {
+                    let i = shape.tiledOffset(Shape2(r, c), order)
+                    XCTAssert(i < span && !used[i])
+                    used[i] = true
+                }
+            }
+        }
+        XCTAssert(Order.colTiled32.tiledOffset(2, 33, tiledRows: 37) ==
+                    37 * 32 + 2 * 32 + 1)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_tiledConversion() {
+        let a = array(from: Float(0), to: Float(37 * 70 - 1), (37, 70))
+        for order in Self.orders {
+            let tiled = Tensor(copying: a, order: order)
+            XCTAssert(tiled.order == order)
+            XCTAssert(tiled.spanCount == a.shape.spanCount(for: order))
+            XCTAssert(tiled[36, 69] == a[36, 69])
+            XCTAssert(tiled.flatArray == a.flatArray)
+
+            let row = Tensor(copying: tiled, order: .row)
+            XCTAssert(row == a)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_tiledBatchConversion() {
+        let a = array(from: Float(0), to: Float(3 * 9 * 40 - 1), (3, 9, 40))
+        for order in Self.orders {
+            let tiled = Tensor(copying: a, order: order)
+            XCTAssert(tiled.flatArray == a.flatArray)
+            XCTAssert(Tensor(copying: tiled, order: .row) == a)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_tiledMapOps() {
+        let a = array(from: Float(0), to: Float(9 * 40 - 1), (9, 40))
+        let b = array(from: Float(1), to: Float(9 * 40), (9, 40))
+        let expected = (a + b * 2).flatArray
+        for order in Self.orders {
+            let ta = Tensor(copying: a, order: order)
+            let tb = Tensor(copying: b, order: order)
+            let result = ta + tb * 2
+            XCTAssert(result.order == order)
+            XCTAssert(result.flatArray == expected)
+            XCTAssert(neg(ta).flatArray == neg(a).flatArray)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // pre-tiled weights are used directly as gemm panels
+    func test_tiledMatmul() {
+        let x = array(from: Float(-1), to: Float(1), (70, 64))
+        let w = array(from: Float(1), to: Float(-1), (64, 70))
+        let expected = matmul(x, w)
+        for order in Self.orders {
+            let tw = Tensor(copying: w, order: order)
+            XCTAssert(matmul(x, tw) == expected)
+        }
+
+        // transposed tiled weights
+        let wt = Tensor(copying: w.t, order: .colTiled32)
+        XCTAssert(matmul(x, wt, transposed: true) == expected)
+    }
+}
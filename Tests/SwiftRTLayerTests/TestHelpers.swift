@@ -59,4 +59,25 @@ func assertEqual<Shape, T: FloatingPoint>(
     assertEqual(x.flatArray, y.flatArray, accuracy: accuracy,
                 message, file: file, line: line)
 }
-#endif
\ No newline at end of file
+#endif
+
+//==============================================================================
+/// values
+/// - Returns: a tensor of deterministic values in `-1.5...1.5`, which
+///   vary along every axis and differ with `seed`
+func values<S: TensorShape>(
+    _ count: Int, _ shape: S.Tuple, seed: Int = 0
+) -> Tensor<S,Float> {
+    Tensor<S,Float>((0..<count).map { Float(($0 * 7 + seed) % 13) / 4 - 1.5 },
+                    S(shape))
+}
+
+/// values(like:
+/// - Returns: deterministic values with the shape of `other`
+func values<S: TensorShape>(
+    like other: Tensor<S,Float>, seed: Int = 0
+) -> Tensor<S,Float> {
+    Tensor<S,Float>(
+        (0..<other.count).map { Float(($0 * 7 + seed) % 13) / 4 - 1.5 },
+        other.shape)
+}
@@ -21,6 +21,11 @@ public func allTests() -> [XCTestCaseEntry] {
         testCase(test_Convolution.allTests),
         testCase(test_Recurrent.allTests),
         testCase(test_Dense.allTests),
+        testCase(test_Pooling.allTests),
+        testCase(test_Normalization.allTests),
+        testCase(test_Frozen.allTests),
+        testCase(test_Dropout.allTests),
+        testCase(test_Optimizer.allTests),
     ]
 }
 #endif
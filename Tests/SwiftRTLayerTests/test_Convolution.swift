@@ -31,6 +31,17 @@ class test_Convolution: XCTestCase {
     static var allTests = [
         ("test_Tensor2", test_Tensor2),
         ("test_Image", test_Image),
+        ("test_conv1D", test_conv1D),
+        ("test_conv2D", test_conv2D),
+        ("test_conv3D", test_conv3D),
+        ("test_convAlgorithmSelection", test_convAlgorithmSelection),
+        ("test_convPlanCache", test_convPlanCache),
+        ("test_convTinyWorkspace", test_convTinyWorkspace),
+        ("test_convWinograd", test_convWinograd),
+        ("test_convBackward", test_convBackward),
+        ("test_convGroups", test_convGroups),
+        ("test_convChannelsLast", test_convChannelsLast),
+        ("test_convQuantized", test_convQuantized),
     ]
 
     //--------------------------------------------------------------------------
@@ -56,4 +67,667 @@ class test_Convolution: XCTestCase {
     //    let conv = ConvR2<Pixel, Float>(filterShape: [3, 3])
     //    let a = conv(image)
     }
+
+    //--------------------------------------------------------------------------
+    func test_conv1D() {
+        // hand computed
+        let x = array([1, 2, 3, 4, 5], (1, 5, 1))
+        let conv = Conv1(filter: array([1, 0, -1], (3, 1, 1)),
+                         bias: array([1]))
+        let y = conv(x)
+        XCTAssert(y.shape == Shape3(1, 3, 1))
+        XCTAssert(y.flatArray == [-1, -1, -1])
+
+        // flipped filter
+        var props = ConvolutionProperties()
+        props.mode = .convolution
+        let flipped = Conv1(filter: array([1, 0, -1], (3, 1, 1)),
+                            properties: props)
+        XCTAssert(flipped(x).flatArray == [2, 2, 2])
+
+        for algorithm in Self.algorithms {
+            for (stride, dilation, padding) in Self.windows {
+                let x = values(2 * 9 * 3, (2, 9, 3))
+                let filter = values(3 * 3 * 4, (3, 3, 4), seed: 3)
+                let bias = values(4, (4), seed: 5)
+                let expected = referenceConvolution(
+                    x.flatArray, [2, 1, 1, 9, 3],
+                    filter.flatArray, [1, 1, 3, 3, 4], bias.flatArray,
+                    strides: [1, 1, stride], dilations: [1, 1, dilation],
+                    same: padding == .same, flip: false)
+                let conv = Conv1(
+                    filter: filter, bias: bias,
+                    strides: Shape3(1, stride, 1), padding: padding,
+                    dilations: Shape3(1, dilation, 1),
+                    properties: properties(algorithm))
+                let y = conv(x)
+                XCTAssert(y.shape == Shape3(2, expected.shape[3], 4))
+                assertEqual(y.flatArray, expected.values, accuracy: 1e-4)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_conv2D() {
+        let x = values(2 * 7 * 6 * 3, (2, 7, 6, 3))
+        let filter = values(3 * 3 * 3 * 5, (3, 3, 3, 5), seed: 3)
+        let bias = values(5, (5), seed: 5)
+
+        for algorithm in Self.algorithms {
+            for (stride, dilation, padding) in Self.windows {
+                for mode in [ConvolutionMode.crossCorrelation, .convolution] {
+                    var props = properties(algorithm)
+                    props.mode = mode
+                    let expected = referenceConvolution(
+                        x.flatArray, [2, 1, 7, 6, 3],
+                        filter.flatArray, [1, 3, 3, 3, 5], bias.flatArray,
+                        strides: [1, stride, stride],
+                        dilations: [1, dilation, dilation],
+                        same: padding == .same, flip: mode == .convolution)
+                    let conv = Conv2(
+                        filter: filter, bias: bias,
+                        strides: Shape4(1, stride, stride, 1),
+                        padding: padding,
+                        dilations: Shape4(1, dilation, dilation, 1),
+                        properties: props)
+                    let y = conv(x)
+                    XCTAssert(y.shape == Shape4(2, expected.shape[2],
+                                                expected.shape[3], 5))
+                    assertEqual(y.flatArray, expected.values, accuracy: 1e-4)
+                }
+            }
+        }
+
+        // fused activation
+        let relu = Conv2(filter: filter, bias: bias, activation: .relu,
+                         padding: .same)
+        let expected = referenceConvolution(
+            x.flatArray, [2, 1, 7, 6, 3],
+            filter.flatArray, [1, 3, 3, 3, 5], bias.flatArray,
+            strides: [1, 1, 1], dilations: [1, 1, 1],
+            same: true, flip: false)
+        assertEqual(relu(x).flatArray, expected.values.map { max(0, $0) },
+                    accuracy: 1e-4)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_conv3D() {
+        let x = values(1 * 4 * 5 * 5 * 2, (1, 4, 5, 5, 2))
+        let filter = values(2 * 3 * 3 * 2 * 3, (2, 3, 3, 2, 3), seed: 3)
+        let bias = values(3, (3), seed: 5)
+
+        for algorithm in Self.algorithms {
+            for (stride, dilation, padding) in Self.windows {
+                let expected = referenceConvolution(
+                    x.flatArray, [1, 4, 5, 5, 2],
+                    filter.flatArray, [2, 3, 3, 2, 3], bias.flatArray,
+                    strides: [stride, stride, stride],
+                    dilations: [1, dilation, dilation],
+                    same: padding == .same, flip: false)
+                let conv = Conv3(
+                    filter: filter, bias: bias,
+                    strides: Shape5(1, stride, stride, stride, 1),
+                    padding: padding,
+                    dilations: Shape5(1, 1, dilation, dilation, 1),
+                    properties: properties(algorithm))
+                let y = conv(x)
+                XCTAssert(y.shape == Shape5(1, expected.shape[1],
+                                            expected.shape[2],
+                                            expected.shape[3], 3))
+                assertEqual(y.flatArray, expected.values, accuracy: 1e-4)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_convAlgorithmSelection() {
+        let x = values(1 * 8 * 8 * 16, (1, 8, 8, 16))
+        let filter = values(3 * 3 * 16 * 8, (3, 3, 16, 8), seed: 3)
+
+        // large 3x3 stride 1 filters use winograd
+        let winograd = Conv2(filter: filter, padding: .same)
+        _ = winograd(x)
+        XCTAssert(winograd.convolutionOp.forwardAlgorithm == .winograd)
+
+        // other large filters use im2col when the workspace fits
+        let fastest = Conv2(filter: filter, strides: Shape4(1, 2, 2, 1),
+                            padding: .same)
+        _ = fastest(x)
+        XCTAssert(fastest.convolutionOp.forwardAlgorithm == .gemm)
+
+        var props = properties(.workspaceLimit)
+        props.forwardWorkspaceLimit = 0
+        let limited = Conv2(filter: filter, strides: Shape4(1, 2, 2, 1),
+                            padding: .same, properties: props)
+        assertEqual(limited(x).flatArray, fastest(x).flatArray, accuracy: 1e-4)
+        XCTAssert(limited.convolutionOp.forwardAlgorithm == .direct)
+        XCTAssert(limited.convolutionOp.forwardWorkspaceSize == 0)
+
+        // small filters are computed directly
+        let pointwise = Conv2(filter: values(16 * 4, (1, 1, 16, 4)))
+        _ = pointwise(x)
+        XCTAssert(pointwise.convolutionOp.forwardAlgorithm == .direct)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_convPlanCache() {
+        let x = values(1 * 8 * 8 * 16, (1, 8, 8, 16))
+        let filter = values(3 * 3 * 16 * 8, (3, 3, 16, 8), seed: 3)
+        let cache = CpuExecutionPlanCache.shared
+        cache.removeAll()
+
+        // the first layer caches its selection, and a layer with the same
+        // geometry and properties reuses it
+        let conv = Conv2(filter: filter, strides: Shape4(1, 2, 2, 1),
+                         padding: .same)
+        _ = conv(x)
+        XCTAssert(cache.count == 1)
+        let other = Conv2(filter: filter, strides: Shape4(1, 2, 2, 1),
+                          padding: .same)
+        _ = other(x)
+        XCTAssert(cache.count == 1)
+        XCTAssert(other.convolutionOp.forwardAlgorithm ==
+                    conv.convolutionOp.forwardAlgorithm)
+
+        // without tuning the heuristic selection is used and not cached
+        cache.isTuningEnabled = false
+        defer { cache.isTuningEnabled = true }
+        let winograd = Conv2(filter: filter, padding: .same)
+        _ = winograd(x)
+        XCTAssert(winograd.convolutionOp.forwardAlgorithm == .winograd)
+        XCTAssert(cache.count == 1)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_convTinyWorkspace() {
+        // requested algorithms that can't fit one tile in the workspace
+        // limit fall back to the algorithms that need no workspace
+        let x = values(1 * 8 * 8 * 16, (1, 8, 8, 16))
+        let filter = values(3 * 3 * 16 * 8, (3, 3, 16, 8), seed: 3)
+        let bias = values(8, (8), seed: 5)
+        let expected = Conv2(filter: filter, bias: bias, padding: .same,
+                             properties: properties(.direct))(x)
+
+        for algorithm in [ConvolutionFwdAlgorithm.gemm, .winograd] {
+            var props = properties(algorithm)
+            props.forwardWorkspaceLimit = 1
+            let conv = Conv2(filter: filter, bias: bias, padding: .same,
+                             properties: props)
+            assertEqual(conv(x).flatArray, expected.flatArray,
+                        accuracy: 1e-4)
+            XCTAssert(conv.convolutionOp.forwardAlgorithm == .direct)
+            XCTAssert(conv.convolutionOp.forwardWorkspaceSize == 0)
+        }
+
+        let yDiff = values(like: expected, seed: 7)
+        let reference = referenceConvolutionBackward(
+            x.flatArray, [1, 1, 8, 8, 16],
+            filter.flatArray, [1, 3, 3, 16, 8], yDiff.flatArray,
+            strides: [1, 1, 1], dilations: [1, 1, 1],
+            same: true, flip: false)
+
+        for filterAlgorithm in [ConvolutionBwdFilterAlgorithm.algo1, .algo3] {
+            var props = ConvolutionProperties()
+            props.backwardDataAlgorithm = .algo1
+            props.backwardDataWorkspaceLimit = 1
+            props.backwardFilterAlgorithm = filterAlgorithm
+            props.backwardFilterWorkspaceLimit = 1
+            let conv = Conv2(filter: filter, bias: bias, padding: .same,
+                             properties: props)
+            let y = conv(x)
+            var xDiff = Tensor(like: x)
+            var filterDiff = Tensor(like: filter)
+            var biasDiff = Tensor(like: conv.bias)
+            conv.convolutionOp.backward(
+                y: y, yDiff: yDiff, filter: filter, filterDiff: &filterDiff,
+                bias: conv.bias, biasDiff: &biasDiff,
+                x: x, xDiff: &xDiff, mode: .training)
+            assertEqual(xDiff.flatArray, reference.x, accuracy: 1e-3)
+            assertEqual(filterDiff.flatArray, reference.filter, accuracy: 1e-3)
+            assertEqual(biasDiff.flatArray, reference.bias, accuracy: 1e-3)
+            XCTAssert(conv.convolutionOp.backwardDataAlgorithm == .algo0)
+            XCTAssert(conv.convolutionOp.backwardFilterAlgorithm == .algo0)
+            XCTAssert(conv.convolutionOp.backwardDataWorkspaceSize == 0)
+            XCTAssert(conv.convolutionOp.backwardFilterWorkspaceSize == 0)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // helpers
+    //--------------------------------------------------------------------------
+    func test_convWinograd() {
+        // small outputs use F(2x2, 3x3) and larger outputs use F(4x4, 3x3)
+        for size in [5, 11] {
+            let x = values(2 * size * (size + 1) * 9,
+                           (2, size, size + 1, 9))
+            let filter = values(3 * 3 * 9 * 6, (3, 3, 9, 6), seed: 3)
+            let bias = values(6, (6), seed: 5)
+
+            for padding in [Padding.valid, .same] {
+                for mode in [ConvolutionMode.crossCorrelation, .convolution] {
+                    var props = properties(.winograd)
+                    props.mode = mode
+                    let expected = referenceConvolution(
+                        x.flatArray, [2, 1, size, size + 1, 9],
+                        filter.flatArray, [1, 3, 3, 9, 6], bias.flatArray,
+                        strides: [1, 1, 1], dilations: [1, 1, 1],
+                        same: padding == .same, flip: mode == .convolution)
+                    let conv = Conv2(filter: filter, bias: bias,
+                                     padding: padding, properties: props)
+                    let y = conv(x)
+                    XCTAssert(conv.convolutionOp.forwardAlgorithm == .winograd)
+                    XCTAssert(y.shape == Shape4(2, expected.shape[2],
+                                                expected.shape[3], 6))
+                    assertEqual(y.flatArray, expected.values, accuracy: 1e-3)
+                }
+            }
+        }
+
+        // a trainable filter is updated in place, so it is not cached
+        let x = values(1 * 9 * 9 * 9, (1, 9, 9, 9))
+        let conv = Conv2(filter: values(3 * 3 * 9 * 6, (3, 3, 9, 6), seed: 3),
+                         padding: .same, properties: properties(.winograd))
+        let op = conv.convolutionOp
+        let training = op.forward(x: x, filter: conv.filter, bias: conv.bias,
+                                  mode: .training)
+        assertEqual(conv(x).flatArray, training.flatArray, accuracy: 1e-4)
+        XCTAssert(op.winogradFilter.values.isEmpty)
+
+        // the transformed filter of a constant filter is reused
+        op.filterIsConstant = true
+        assertEqual(conv(x).flatArray, training.flatArray, accuracy: 1e-4)
+        let transformed = op.winogradFilter.values
+        XCTAssert(!transformed.isEmpty)
+        assertEqual(conv(x).flatArray, training.flatArray, accuracy: 1e-4)
+        XCTAssert(op.winogradFilter.values == transformed)
+
+        // filters that are not 3x3 stride 1 fall back
+        let strided = Conv2(filter: values(3 * 3 * 9 * 6, (3, 3, 9, 6)),
+                            strides: Shape4(1, 2, 2, 1),
+                            properties: properties(.winograd))
+        _ = strided(x)
+        XCTAssert(strided.convolutionOp.forwardAlgorithm != .winograd)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_convBackward() {
+        let x = values(2 * 6 * 5 * 3, (2, 6, 5, 3))
+        let filter = values(3 * 3 * 3 * 4, (3, 3, 3, 4), seed: 3)
+        let bias = values(4, (4), seed: 5)
+        let algorithms: [(ConvolutionBwdDataAlgorithm,
+                          ConvolutionBwdFilterAlgorithm)] = [
+            (.algo0, .algo0), (.algo1, .algo1), (.algo0, .algo3),
+            (.fastest, .fastest),
+        ]
+
+        for (dataAlgorithm, filterAlgorithm) in algorithms {
+            for (stride, dilation, padding) in Self.windows {
+                for mode in [ConvolutionMode.crossCorrelation, .convolution] {
+                    var props = ConvolutionProperties()
+                    props.backwardDataAlgorithm = dataAlgorithm
+                    props.backwardFilterAlgorithm = filterAlgorithm
+                    props.mode = mode
+                    let conv = Conv2(
+                        filter: filter, bias: bias,
+                        strides: Shape4(1, stride, stride, 1),
+                        padding: padding,
+                        dilations: Shape4(1, dilation, dilation, 1),
+                        properties: props)
+                    let y = conv(x)
+                    let yDiff = values(like: y, seed: 7)
+                    let expected = referenceConvolutionBackward(
+                        x.flatArray, [2, 1, 6, 5, 3],
+                        filter.flatArray, [1, 3, 3, 3, 4], yDiff.flatArray,
+                        strides: [1, stride, stride],
+                        dilations: [1, dilation, dilation],
+                        same: padding == .same, flip: mode == .convolution)
+
+                    var xDiff = Tensor(like: x)
+                    var filterDiff = Tensor(like: filter)
+                    var biasDiff = Tensor(like: conv.bias)
+                    conv.convolutionOp.backward(
+                        y: y, yDiff: yDiff,
+                        filter: filter, filterDiff: &filterDiff,
+                        bias: conv.bias, biasDiff: &biasDiff,
+                        x: x, xDiff: &xDiff, mode: .training)
+                    assertEqual(xDiff.flatArray, expected.x, accuracy: 1e-3)
+                    assertEqual(filterDiff.flatArray, expected.filter,
+                                accuracy: 1e-3)
+                    assertEqual(biasDiff.flatArray, expected.bias,
+                                accuracy: 1e-3)
+                }
+            }
+        }
+
+        // the output gradient is masked by the fused activation
+        let relu = Conv2(filter: filter, bias: bias, activation: .relu,
+                         padding: .same)
+        let y = relu(x)
+        let yDiff = values(like: y, seed: 7)
+        let masked = zip(y.flatArray, yDiff.flatArray).map { $0 > 0 ? $1 : 0 }
+        let expected = referenceConvolutionBackward(
+            x.flatArray, [2, 1, 6, 5, 3],
+            filter.flatArray, [1, 3, 3, 3, 4], masked,
+            strides: [1, 1, 1], dilations: [1, 1, 1], same: true, flip: false)
+        var xDiff = Tensor(like: x)
+        var filterDiff = Tensor(like: filter)
+        var biasDiff = Tensor(like: relu.bias)
+        relu.convolutionOp.backward(
+            y: y, yDiff: yDiff, filter: filter, filterDiff: &filterDiff,
+            bias: relu.bias, biasDiff: &biasDiff,
+            x: x, xDiff: &xDiff, mode: .training)
+        assertEqual(xDiff.flatArray, expected.x, accuracy: 1e-3)
+        assertEqual(filterDiff.flatArray, expected.filter, accuracy: 1e-3)
+        assertEqual(biasDiff.flatArray, expected.bias, accuracy: 1e-3)
+
+        // without workspace both gradients use algo0
+        var props = ConvolutionProperties()
+        props.backwardDataAlgorithm = .workspaceLimit
+        props.backwardDataWorkspaceLimit = 0
+        props.backwardFilterAlgorithm = .workspaceLimit
+        props.backwardFilterWorkspaceLimit = 0
+        let limited = Conv2(filter: filter, bias: bias, padding: .same,
+                            properties: props)
+        let yl = limited(x)
+        limited.convolutionOp.backward(
+            y: yl, yDiff: yl, filter: filter, filterDiff: &filterDiff,
+            bias: limited.bias, biasDiff: &biasDiff,
+            x: x, xDiff: &xDiff, mode: .training)
+        XCTAssert(limited.convolutionOp.backwardDataAlgorithm == .algo0)
+        XCTAssert(limited.convolutionOp.backwardFilterAlgorithm == .algo0)
+        XCTAssert(limited.convolutionOp.backwardFilterWorkspaceSize == 0)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_convGroups() {
+        let x = values(2 * 6 * 5 * 4, (2, 6, 5, 4))
+        // (groups, filter input channels, output channels), where the
+        // last two are depthwise with channel multipliers of 1 and 2
+        let configurations = [(2, 2, 6), (4, 1, 4), (4, 1, 8)]
+
+        for (groups, ci, co) in configurations {
+            let filter = values(3 * 3 * ci * co, (3, 3, ci, co), seed: 3)
+            let bias = values(co, (co), seed: 5)
+            for algorithm in Self.algorithms {
+                for (stride, dilation, padding) in Self.windows {
+                    let expected = referenceConvolution(
+                        x.flatArray, [2, 1, 6, 5, 4],
+                        filter.flatArray, [1, 3, 3, ci, co], bias.flatArray,
+                        strides: [1, stride, stride],
+                        dilations: [1, dilation, dilation],
+                        same: padding == .same, flip: false, groups: groups)
+                    let conv = Conv2(
+                        filter: filter, bias: bias,
+                        strides: Shape4(1, stride, stride, 1),
+                        padding: padding,
+                        dilations: Shape4(1, dilation, dilation, 1),
+                        groups: groups,
+                        properties: properties(algorithm))
+                    let y = conv(x)
+                    XCTAssert(y.shape == Shape4(2, expected.shape[2],
+                                                expected.shape[3], co))
+                    assertEqual(y.flatArray, expected.values, accuracy: 1e-4)
+                }
+            }
+
+            // gradients
+            for mode in [ConvolutionMode.crossCorrelation, .convolution] {
+                var props = ConvolutionProperties()
+                props.mode = mode
+                for (dataAlgorithm, filterAlgorithm) in [
+                    (ConvolutionBwdDataAlgorithm.algo0,
+                     ConvolutionBwdFilterAlgorithm.algo0),
+                    (.algo1, .algo1), (.algo0, .algo3)
+                ] {
+                    props.backwardDataAlgorithm = dataAlgorithm
+                    props.backwardFilterAlgorithm = filterAlgorithm
+                    let conv = Conv2(filter: filter, bias: bias,
+                                     padding: .same, groups: groups,
+                                     properties: props)
+                    let y = conv(x)
+                    let yDiff = values(like: y, seed: 7)
+                    let expected = referenceConvolutionBackward(
+                        x.flatArray, [2, 1, 6, 5, 4],
+                        filter.flatArray, [1, 3, 3, ci, co], yDiff.flatArray,
+                        strides: [1, 1, 1], dilations: [1, 1, 1], same: true,
+                        flip: mode == .convolution, groups: groups)
+                    var xDiff = Tensor(like: x)
+                    var filterDiff = Tensor(like: filter)
+                    var biasDiff = Tensor(like: conv.bias)
+                    conv.convolutionOp.backward(
+                        y: y, yDiff: yDiff,
+                        filter: filter, filterDiff: &filterDiff,
+                        bias: conv.bias, biasDiff: &biasDiff,
+                        x: x, xDiff: &xDiff, mode: .training)
+                    assertEqual(xDiff.flatArray, expected.x, accuracy: 1e-3)
+                    assertEqual(filterDiff.flatArray, expected.filter,
+                                accuracy: 1e-3)
+                    assertEqual(biasDiff.flatArray, expected.bias,
+                                accuracy: 1e-3)
+                }
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // channels last inputs give the same results as row order NHWC inputs
+    func test_convChannelsLast() {
+        let x = values(2 * 6 * 5 * 4, (2, 6, 5, 4))
+        let filter = values(3 * 3 * 4 * 3, (3, 3, 4, 3), seed: 3)
+        let bias = values(3, (3), seed: 5)
+        let conv = Conv2(filter: filter, bias: bias, activation: .relu,
+                         padding: .same)
+        let expected = conv(x)
+
+        // a logical NCHW view of the row order data, and a converted copy
+        let view = Tensor(channelsFirst: x, order: .NHWC)
+        XCTAssert(view.shape == Shape4(2, 4, 6, 5))
+        let nchw = Tensor(copying: view, order: .row)
+        for xc in [view, Tensor(copying: nchw, order: .NHWC)] {
+            let y = conv(xc)
+            XCTAssert(y.order == .NHWC && y.shape == Shape4(2, 3, 6, 5))
+            XCTAssert(Tensor(channelsLast: y) == expected)
+        }
+
+        // gradients
+        let yDiff = values(like: expected, seed: 7)
+        var xDiff = Tensor(like: x)
+        var filterDiff = Tensor(like: filter)
+        var biasDiff = Tensor(like: conv.bias)
+        conv.convolutionOp.backward(
+            y: expected, yDiff: yDiff,
+            filter: filter, filterDiff: &filterDiff,
+            bias: conv.bias, biasDiff: &biasDiff,
+            x: x, xDiff: &xDiff, mode: .training)
+
+        var xcDiff = Tensor(like: view)
+        var fcDiff = Tensor(like: filter)
+        var bcDiff = Tensor(like: conv.bias)
+        conv.convolutionOp.backward(
+            y: Tensor(channelsFirst: expected, order: .NHWC),
+            yDiff: Tensor(channelsFirst: yDiff, order: .NHWC),
+            filter: filter, filterDiff: &fcDiff,
+            bias: conv.bias, biasDiff: &bcDiff,
+            x: view, xDiff: &xcDiff, mode: .training)
+        XCTAssert(xcDiff.order == .NHWC)
+        assertEqual(Tensor(channelsLast: xcDiff).flatArray, xDiff.flatArray,
+                    accuracy: 1e-5)
+        assertEqual(fcDiff.flatArray, filterDiff.flatArray, accuracy: 1e-5)
+        assertEqual(bcDiff.flatArray, biasDiff.flatArray, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    // the quantized filter is multiplied by the im2col windows with the
+    // int8 gemm, so the result is close to the real valued convolution
+    func test_convQuantized() {
+        let x = values(2 * 7 * 6 * 3, (2, 7, 6, 3))
+        let filter = values(3 * 3 * 3 * 5, (3, 3, 3, 5), seed: 3)
+        let bias = values(5, (5), seed: 5)
+
+        for (stride, dilation, padding) in Self.windows {
+            for mode in [ConvolutionMode.crossCorrelation, .convolution] {
+                var props = ConvolutionProperties()
+                props.mode = mode
+                let conv = Conv2(
+                    filter: filter, bias: bias, activation: .relu,
+                    strides: Shape4(1, stride, stride, 1),
+                    padding: padding,
+                    dilations: Shape4(1, dilation, dilation, 1),
+                    properties: props)
+                let quantized = conv.quantized(type: Int8.self)
+                let real = conv(x), y = quantized(x)
+                XCTAssert(y.shape == real.shape)
+                let expected = real.flatArray
+                let range = expected.map { abs($0) }.max() ?? 1
+                assertEqual(y.flatArray, expected, accuracy: 0.03 * range)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    static let algorithms: [ConvolutionFwdAlgorithm] = [.direct, .gemm, .fastest]
+
+    // (stride, dilation, padding)
+    static let windows: [(Int, Int, Padding)] = [
+        (1, 1, .valid), (1, 1, .same), (2, 1, .same), (2, 1, .valid),
+        (1, 2, .valid), (1, 2, .same),
+    ]
+
+    func properties(_ algorithm: ConvolutionFwdAlgorithm) -> ConvolutionProperties {
+        var properties = ConvolutionProperties()
+        properties.forwardAlgorithm = algorithm
+        return properties
+    }
+}
+
+//==============================================================================
+/// referenceConvolution
+/// A direct convolution of NDHWC `x` with a DHWIO filter, where the
+/// filter input channels are the input channels of each group
+func referenceConvolution(
+    _ x: [Float], _ xs: [Int],
+    _ f: [Float], _ fs: [Int],
+    _ bias: [Float],
+    strides s: [Int], dilations d: [Int], same: Bool, flip: Bool,
+    groups: Int = 1
+) -> (values: [Float], shape: [Int]) {
+    var o = [Int](), p = [Int]()
+    for i in 0..<3 {
+        let window = (fs[i] - 1) * d[i] + 1
+        if same {
+            let out = (xs[i + 1] + s[i] - 1) / s[i]
+            o.append(out)
+            p.append(max(0, (out - 1) * s[i] + window - xs[i + 1]) / 2)
+        } else {
+            o.append((xs[i + 1] - window) / s[i] + 1)
+            p.append(0)
+        }
+    }
+    let ci = fs[3], co = fs[4], cog = co / groups
+    var y = [Float]()
+    for n in 0..<xs[0] {
+        for od in 0..<o[0] {
+            for oh in 0..<o[1] {
+                for ow in 0..<o[2] {
+                    for c in 0..<co {
+                        var sum = bias[c]
+                        for a in 0..<fs[0] {
+                            for b in 0..<fs[1] {
+                                for e in 0..<fs[2] {
+                                    let id = od * s[0] - p[0] + a * d[0]
+                                    let ih = oh * s[1] - p[1] + b * d[1]
+                                    let iw = ow * s[2] - p[2] + e * d[2]
+                                    guard (0..<xs[1]).contains(id) &&
+                                          (0..<xs[2]).contains(ih) &&
+                                          (0..<xs[3]).contains(iw)
+                                    else { continue }
+                                    let (fa, fb, fe) = flip ?
+                                        (fs[0] - 1 - a, fs[1] - 1 - b,
+                                         fs[2] - 1 - e) : (a, b, e)
+                                    for k in 0..<ci {
+                                        let xi = (((n * xs[1] + id) * xs[2] +
+                                                    ih) * xs[3] + iw) * xs[4] +
+                                            c / cog * ci + k
+                                        let fi = (((fa * fs[1] + fb) * fs[2] +
+                                                    fe) * ci + k) * co + c
+                                        sum += x[xi] * f[fi]
+                                    }
+                                }
+                            }
+                        }
+                        y.append(sum)
+                    }
+                }
+            }
+        }
+    }
+    return (y, [xs[0], o[0], o[1], o[2], co])
+}
+
+//==============================================================================
+/// referenceConvolutionBackward
+/// The input, filter, and bias gradients of `referenceConvolution`
+func referenceConvolutionBackward(
+    _ x: [Float], _ xs: [Int],
+    _ f: [Float], _ fs: [Int],
+    _ yDiff: [Float],
+    strides s: [Int], dilations d: [Int], same: Bool, flip: Bool,
+    groups: Int = 1
+) -> (x: [Float], filter: [Float], bias: [Float]) {
+    var o = [Int](), p = [Int]()
+    for i in 0..<3 {
+        let window = (fs[i] - 1) * d[i] + 1
+        if same {
+            let out = (xs[i + 1] + s[i] - 1) / s[i]
+            o.append(out)
+            p.append(max(0, (out - 1) * s[i] + window - xs[i + 1]) / 2)
+        } else {
+            o.append((xs[i + 1] - window) / s[i] + 1)
+            p.append(0)
+        }
+    }
+    let ci = fs[3], co = fs[4], cog = co / groups
+    var dx = [Float](repeating: 0, count: x.count)
+    var df = [Float](repeating: 0, count: f.count)
+    var db = [Float](repeating: 0, count: co)
+    var yi = 0
+    for n in 0..<xs[0] {
+        for od in 0..<o[0] {
+            for oh in 0..<o[1] {
+                for ow in 0..<o[2] {
+                    for c in 0..<co {
+                        let dy = yDiff[yi]
+                        yi += 1
+                        db[c] += dy
+                        for a in 0..<fs[0] {
+                            for b in 0..<fs[1] {
+                                for e in 0..<fs[2] {
+                                    let id = od * s[0] - p[0] + a * d[0]
+                                    let ih = oh * s[1] - p[1] + b * d[1]
+                                    let iw = ow * s[2] - p[2] + e * d[2]
+                                    guard (0..<xs[1]).contains(id) &&
+                                          (0..<xs[2]).contains(ih) &&
+                                          (0..<xs[3]).contains(iw)
+                                    else { continue }
+                                    let (fa, fb, fe) = flip ?
+                                        (fs[0] - 1 - a, fs[1] - 1 - b,
+                                         fs[2] - 1 - e) : (a, b, e)
+                                    for k in 0..<ci {
+                                        let xi = (((n * xs[1] + id) * xs[2] +
+                                                    ih) * xs[3] + iw) * xs[4] +
+                                            c / cog * ci + k
+                                        let fi = (((fa * fs[1] + fb) * fs[2] +
+                                                    fe) * ci + k) * co + c
+                                        dx[xi] += dy * f[fi]
+                                        df[fi] += dy * x[xi]
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return (dx, df, db)
 }
@@ -15,17 +15,79 @@
 //
 import XCTest
 import Foundation
-import SwiftRTLayers
+import SwiftRT
 
 class test_Dense: XCTestCase {
     //==========================================================================
     // support terminal test run
     static var allTests = [
-        ("test_Tensor1", test_Tensor1),
+        ("test_denseForward", test_denseForward),
+        ("test_denseSequence", test_denseSequence),
+        ("test_denseGradients", test_denseGradients),
+        ("test_densePlan", test_densePlan),
     ]
-    
-    //==========================================================================
-    // test_Tensor1
-    func test_Tensor1() {
+
+    //--------------------------------------------------------------------------
+    func test_denseForward() {
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let w = array(from: Float(1), to: Float(-1), (5, 4))
+        let b: TensorR1<Float> = array([0.5, -0.5, 0.25, 0])
+        for activation in [ActivationType.identity, .relu, .sigmoid, .tanh] {
+            let layer = Dense<Shape2,Float>(weight: w, bias: b,
+                                            activation: activation)
+            let expected = matmul(x, w, bias: b, activation: activation)
+            assertEqual(layer(x), expected, accuracy: 1e-6)
+        }
+
+        // default zero bias
+        let layer = Dense<Shape2,Float>(weight: w)
+        assertEqual(layer(x), matmul(x, w), accuracy: 1e-6)
+        XCTAssert(Dense<Shape2,Float>(inputSize: 5, outputSize: 3)(x).shape ==
+                    Shape2(6, 3))
+    }
+
+    //--------------------------------------------------------------------------
+    // the rows of every sequence are multiplied by the shared weights
+    func test_denseSequence() {
+        let x = array(from: Float(-1), to: Float(1), (2, 3, 5))
+        let w = array(from: Float(1), to: Float(-1), (1, 5, 4))
+        let b: TensorR1<Float> = array([0.5, -0.5, 0.25, 0])
+        let layer = Dense<Shape3,Float>(weight: w, bias: b, activation: .relu)
+        let y = layer(x)
+        XCTAssert(y.shape == Shape3(2, 3, 4))
+
+        let rows = TensorR2<Float>(reshaping: x, to: Shape2(6, 5))
+        let w2 = TensorR2<Float>(reshaping: w, to: Shape2(5, 4))
+        let expected = matmul(rows, w2, bias: b, activation: .relu)
+        assertEqual(TensorR2<Float>(reshaping: y, to: Shape2(6, 4)), expected,
+                    accuracy: 1e-6)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_denseGradients() {
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let w = array(from: Float(1), to: Float(-1), (5, 4))
+        let b: TensorR1<Float> = array([0.5, -0.5, 0.25, 0])
+        let layer = Dense<Shape2,Float>(weight: w, bias: b, activation: .tanh)
+        let outGrad = array(from: Float(0.5), to: Float(-0.5), (6, 4))
+
+        let (g, xGrad) = pullback(at: layer, x) { $0($1) }(outGrad)
+        let expected = pullback(at: x, w, b) {
+            matmul($0, $1, bias: $2, activation: .tanh)
+        }(outGrad)
+        assertEqual(xGrad, expected.0, accuracy: 1e-5)
+        assertEqual(g.weight, expected.1, accuracy: 1e-5)
+        assertEqual(TensorR1<Float>(reshaping: g.bias, to: Shape1(4)),
+                    expected.2, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    // the plan key is computed once from the weights and activation
+    func test_densePlan() {
+        let w = array(from: Float(1), to: Float(-1), (5, 4))
+        let a = Dense<Shape2,Float>(weight: w, activation: .relu)
+        let b = Dense<Shape2,Float>(weight: w, activation: .relu)
+        let c = Dense<Shape2,Float>(weight: w, activation: .tanh)
+        XCTAssert(a.plan != nil && a.plan == b.plan && a.plan != c.plan)
     }
 }
@@ -0,0 +1,95 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Dropout: XCTestCase {
+    static var allTests = [
+        ("test_dropoutMask", test_dropoutMask),
+        ("test_dropoutOffset", test_dropoutOffset),
+        ("test_dropoutGradient", test_dropoutGradient),
+        ("test_dropoutLayer", test_dropoutLayer),
+    ]
+
+    //--------------------------------------------------------------------------
+    func test_dropoutMask() {
+        // the kept elements are scaled to keep the expected value
+        let n = 100_000
+        let x = TensorR1<Float>(ones: Shape1(n))
+        let y = dropout(x, probability: 0.25, seed: (1, 2))
+        let values = y.flatArray
+        XCTAssert(values.allSatisfy { $0 == 0 || abs($0 - 4 / 3) < 1e-6 })
+        let kept = Double(values.filter { $0 != 0 }.count) / Double(n)
+        XCTAssert(abs(kept - 0.75) < 0.01)
+
+        // the mask depends only on the seed
+        XCTAssert(dropout(x, probability: 0.25, seed: (1, 2)) == y)
+        XCTAssert(dropout(x, probability: 0.25, seed: (1, 3)) != y)
+
+        // the mask is the stream of the generator
+        let key = UInt64(msb: Int32(2), lsb: Int32(1))
+        var generator = PhiloxRandomNumberGenerator(uint64Seed: key)
+        let block = PhiloxRandomNumberGenerator.block(counter: 0, key: key)
+        XCTAssert(generator.next() ==
+                    UInt64(msb: block.0, lsb: block.1))
+        XCTAssert(generator.next() ==
+                    UInt64(msb: block.2, lsb: block.3))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_dropoutOffset() {
+        // a part of the stream selected with an offset that is not block
+        // aligned matches the whole tensor, which is split differently
+        // across the threads
+        let n = 100_000, start = 40_001
+        let x = array(from: Float(-1), to: Float(1), count: n)
+        let y = dropout(x, probability: 0.5, seed: (3, 4))
+        let part = dropout(x[start...], probability: 0.5, seed: (3, 4),
+                           offset: UInt64(start))
+        XCTAssert(part.flatArray == Array(y.flatArray[start...]))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_dropoutGradient() {
+        // the pullback regenerates the mask of the forward pass
+        let x = array(from: Float(1), to: Float(2), (100, 30))
+        let outGrad = array(from: Float(-1), to: Float(1), (100, 30))
+        let (y, pb) = valueWithPullback(at: x) {
+            dropout($0, probability: 0.3, seed: (5, 6))
+        }
+        let grad = pb(outGrad).flatArray
+        let xs = x.flatArray, ys = y.flatArray, dys = outGrad.flatArray
+        for i in 0..<xs.count {
+            XCTAssert(abs(grad[i] - dys[i] * ys[i] / xs[i]) < 1e-5)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_dropoutLayer() {
+        let x = array(from: Float(1), to: Float(2), (8, 16))
+        var layer = Dropout<Shape2,Float>(probability: 0.5)
+        let y = layer(x)
+        XCTAssert(y.flatArray.contains(0))
+
+        // each call draws a new mask
+        XCTAssert(layer(x) != y)
+
+        // inference is the identity
+        layer.mode = .inferring
+        XCTAssert(layer(x) == x)
+    }
+}
@@ -0,0 +1,252 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Frozen: XCTestCase {
+    static var allTests = [
+        ("test_frozenDense", test_frozenDense),
+        ("test_frozenDenseFolding", test_frozenDenseFolding),
+        ("test_frozenConvolution", test_frozenConvolution),
+        ("test_frozenLSTMCell", test_frozenLSTMCell),
+        ("test_frozenGRUCell", test_frozenGRUCell),
+        ("test_frozenEmbedding", test_frozenEmbedding),
+        ("test_frozenNoAllocations", test_frozenNoAllocations),
+    ]
+
+    //--------------------------------------------------------------------------
+    func test_frozenDense() {
+        // more than one 32 column tile
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let w = array(from: Float(1), to: Float(-1), (5, 40))
+        let b = array(from: Float(-0.5), to: Float(0.5), count: 40)
+        let layer = Dense<Shape2,Float>(weight: w, bias: b, activation: .relu)
+        let frozen = layer.frozen()
+        XCTAssert(frozen.weight.order == .colTiled32)
+        assertEqual(frozen(x), layer(x), accuracy: 1e-5)
+
+        // the output storage is reused
+        var y = TensorR2<Float>()
+        frozen(x, into: &y)
+        let id = y.storage.id
+        frozen(x, into: &y)
+        XCTAssert(y.storage.id == id)
+        assertEqual(y, layer(x), accuracy: 1e-5)
+
+        // sequences share the weights
+        let xs = array(from: Float(-1), to: Float(1), (2, 3, 5))
+        let sequence = Dense<Shape3,Float>(
+            weight: TensorR3(reshaping: w, to: Shape3(1, 5, 40)), bias: b)
+        assertEqual(sequence.frozen()(xs), sequence(xs), accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_frozenDenseFolding() {
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let layer = Dense<Shape2,Float>(
+            weight: array(from: Float(1), to: Float(-1), (5, 4)),
+            bias: array([0.5, -0.5, 0.25, 0]))
+        let norm = BatchNorm<Shape2,Float>(
+            scale: array([1, 2, 0.5, -1]), offset: array([0, 1, -1, 0.5]),
+            runningMean: array([0.5, -0.25, 0, 1]),
+            runningVariance: array([1, 0.5, 2, 0.25]),
+            activation: .relu, mode: .inferring)
+        assertEqual(layer.frozen(folding: norm)(x), norm(layer(x)),
+                    accuracy: 1e-4)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_frozenConvolution() {
+        let x = values(2 * 6 * 6 * 3, (2, 6, 6, 3))
+        let filter = values(3 * 3 * 3 * 4, (3, 3, 3, 4), seed: 2)
+        let bias: TensorR1<Float> = array([0.5, -0.5, 0.25, 0])
+        for algorithm in [ConvolutionFwdAlgorithm.direct, .gemm, .winograd] {
+            var properties = ConvolutionProperties()
+            properties.forwardAlgorithm = algorithm
+            let conv = Conv2(filter: filter, bias: bias, activation: .relu,
+                             padding: .same, properties: properties)
+            let frozen = conv.frozen()
+            assertEqual(frozen(x), conv(x), accuracy: 1e-4)
+
+            // the second call uses the cached filter and output
+            var y = Tensor<Shape4,Float>()
+            frozen(x, into: &y)
+            let id = y.storage.id
+            frozen(x, into: &y)
+            XCTAssert(y.storage.id == id)
+            assertEqual(y, conv(x), accuracy: 1e-4)
+        }
+
+        // channels last data
+        let nhwc = Tensor<Shape4,Float>(
+            copying: values(2 * 3 * 6 * 6, (2, 3, 6, 6)), order: .NHWC)
+        let conv = Conv2(filter: filter, bias: bias, padding: .same)
+        var y = Tensor<Shape4,Float>()
+        conv.frozen()(nhwc, into: &y)
+        XCTAssert(y.order == .NHWC)
+        assertEqual(y, conv(nhwc), accuracy: 1e-4)
+    }
+
+    //--------------------------------------------------------------------------
+    // alternating two states reuses their storage on every step
+    func test_frozenLSTMCell() {
+        let cell = LSTMCell<Float>(inputSize: 3, hiddenSize: 10)
+        let frozen = cell.frozen()
+        let x = array(from: Float(-1), to: Float(1), (4, 2, 3))
+        var expected = LSTMCell<Float>.State(
+            cell: array(from: Float(0.5), to: Float(-0.5), (2, 10)),
+            hidden: array(from: Float(-0.5), to: Float(0.5), (2, 10)))
+        var state = expected
+        var next = LSTMCell<Float>.State(cell: TensorR2(), hidden: TensorR2())
+        var workspace = FrozenLSTMCell<Float>.Workspace()
+        for t in 0..<4 {
+            let input = TensorR2<Float>(squeezing: x[t, 0..., 0...], axes: 0)
+            expected = cell(input: input, state: expected).state
+            frozen.step(input, state, into: &next, workspace: &workspace)
+            swap(&state, &next)
+            assertEqual(state.cell, expected.cell, accuracy: 1e-5)
+            assertEqual(state.hidden, expected.hidden, accuracy: 1e-5)
+        }
+        let input = TensorR2<Float>(squeezing: x[0, 0..., 0...], axes: 0)
+        assertEqual(frozen(input, state: state).hidden,
+                    cell(input: input, state: state).state.hidden,
+                    accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_frozenGRUCell() {
+        let cell = GRUCell<Float>(inputSize: 3, hiddenSize: 10)
+        let frozen = cell.frozen()
+        let x = array(from: Float(-1), to: Float(1), (4, 2, 3))
+        var expected = array(from: Float(0.5), to: Float(-0.5), (2, 10))
+        var state = expected
+        var next = TensorR2<Float>()
+        var workspace = FrozenGRUCell<Float>.Workspace()
+        for t in 0..<4 {
+            let input = TensorR2<Float>(squeezing: x[t, 0..., 0...], axes: 0)
+            expected = cell(input: input, state: expected).state
+            frozen.step(input, state, into: &next, workspace: &workspace)
+            swap(&state, &next)
+            assertEqual(state, expected, accuracy: 1e-5)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_frozenEmbedding() {
+        let embedding = Embedding<Float>(
+            embeddings: array(from: Float(0), to: Float(11), (6, 2)))
+        let frozen = embedding.frozen()
+        let indices: TensorR1<DeviceIndex> = array([3, 0, 5, 3])
+        XCTAssert(frozen(indices) == embedding(indices))
+
+        var y = TensorR2<Float>()
+        frozen([3, 0, 5, 3], into: &y)
+        let id = y.storage.id
+        frozen([1, 1, 2, 4], into: &y)
+        XCTAssert(y.storage.id == id)
+        XCTAssert(y.flatArray == [2, 3, 2, 3, 4, 5, 8, 9])
+    }
+
+    //--------------------------------------------------------------------------
+    // after the first call, calls with the same shapes reuse the outputs,
+    // the kernel scratch and plans, and the recurrent buffers
+    func test_frozenNoAllocations() {
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let dense = Dense<Shape2,Float>(
+            weight: array(from: Float(1), to: Float(-1), (5, 40)),
+            bias: array(from: Float(-0.5), to: Float(0.5), count: 40),
+            activation: .relu).frozen()
+        var y = TensorR2<Float>()
+        dense(x, into: &y)
+        let id = y.storage.id
+        let count = dense.scratch.allocationCount
+        for _ in 0..<3 { dense(x, into: &y) }
+        XCTAssert(y.storage.id == id)
+        XCTAssert(dense.scratch.allocationCount == count)
+
+        // convolutions
+        let image = values(2 * 6 * 6 * 3, (2, 6, 6, 3))
+        let filter = values(3 * 3 * 3 * 4, (3, 3, 3, 4), seed: 2)
+        for algorithm in [ConvolutionFwdAlgorithm.direct, .gemm, .winograd] {
+            var properties = ConvolutionProperties()
+            properties.forwardAlgorithm = algorithm
+            let conv = Conv2(filter: filter, padding: .same,
+                             properties: properties).frozen()
+            let scratch = conv.convolutionOp.scratch
+            var y = Tensor<Shape4,Float>()
+            conv(image, into: &y)
+            let id = y.storage.id
+            let count = scratch.allocationCount
+            for _ in 0..<3 { conv(image, into: &y) }
+            XCTAssert(y.storage.id == id)
+            XCTAssert(scratch.allocationCount == count)
+        }
+
+        // the recurrent cells alternate the two kept states
+        let input = array(from: Float(-1), to: Float(1), (2, 3))
+        let lstmCell = LSTMCell<Float>(inputSize: 3, hiddenSize: 10)
+        let lstm = lstmCell.frozen(batchSize: 2)
+        var expected = LSTMCell<Float>.State(
+            cell: array(from: Float(0.5), to: Float(-0.5), (2, 10)),
+            hidden: array(from: Float(-0.5), to: Float(0.5), (2, 10)))
+        var state = expected
+        var ids = [Int](), counts = [Int]()
+        for t in 0..<6 {
+            expected = lstmCell(input: input, state: expected).state
+            state = lstm(input, state: state)
+            ids.append(state.hidden.storage.id)
+            if t == 0 {
+                counts = [lstm.inputScratch.allocationCount,
+                          lstm.stateScratch.allocationCount]
+            }
+        }
+        XCTAssert(ids[0] != ids[1] && ids[2...] == ids[..<4])
+        XCTAssert(counts == [lstm.inputScratch.allocationCount,
+                             lstm.stateScratch.allocationCount])
+        assertEqual(state.hidden, expected.hidden, accuracy: 1e-5)
+
+        let gruCell = GRUCell<Float>(inputSize: 3, hiddenSize: 10)
+        let gru = gruCell.frozen(batchSize: 2)
+        var gruExpected = array(from: Float(0.5), to: Float(-0.5), (2, 10))
+        var gruState = gruExpected
+        ids = []
+        for t in 0..<6 {
+            gruExpected = gruCell(input: input, state: gruExpected).state
+            gruState = gru(input, state: gruState)
+            ids.append(gruState.storage.id)
+            if t == 0 {
+                counts = [gru.inputScratch.allocationCount,
+                          gru.stateScratch.allocationCount]
+            }
+        }
+        XCTAssert(ids[0] != ids[1] && ids[2...] == ids[..<4])
+        XCTAssert(counts == [gru.inputScratch.allocationCount,
+                             gru.stateScratch.allocationCount])
+        assertEqual(gruState, gruExpected, accuracy: 1e-5)
+
+        // the embedding reads the indices in place
+        let embedding = Embedding<Float>(
+            embeddings: array(from: Float(0), to: Float(11), (6, 2))).frozen()
+        let indices: TensorR1<DeviceIndex> = array([3, 0, 5, 3])
+        var rows = TensorR2<Float>()
+        embedding(indices, into: &rows)
+        let rowsId = rows.storage.id
+        embedding(indices, into: &rows)
+        XCTAssert(rows.storage.id == rowsId)
+        XCTAssert(rows.flatArray == [6, 7, 0, 1, 10, 11, 6, 7])
+    }
+}
@@ -0,0 +1,300 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import Numerics
+import SwiftRT
+
+class test_Normalization: XCTestCase {
+    static var allTests = [
+        ("test_batchNormTraining", test_batchNormTraining),
+        ("test_batchNormInference", test_batchNormInference),
+        ("test_batchNormRunningStatistics", test_batchNormRunningStatistics),
+        ("test_batchNormGradients", test_batchNormGradients),
+        ("test_batchNormChannelsLast", test_batchNormChannelsLast),
+        ("test_layerNorm", test_layerNorm),
+        ("test_layerNormGradients", test_layerNormGradients),
+        ("test_foldDense", test_foldDense),
+        ("test_foldConvolution", test_foldConvolution),
+    ]
+
+    static let scale: [Float] = [1, 2, 0.5, -1]
+    static let offset: [Float] = [0, 1, -1, 0.5]
+
+    //--------------------------------------------------------------------------
+    func test_batchNormTraining() {
+        // more rows than a single part
+        for rows in [8, 5000] {
+            let x = values(rows * 4, (rows, 4))
+            let r = batchNormTraining(x, scale: array(Self.scale),
+                                      offset: array(Self.offset),
+                                      epsilon: 0.001)
+            let stats = referenceStatistics(x.flatArray.map { Double($0) },
+                                            rows, 4, byRow: false)
+            assertEqual(r.mean.flatArray, stats.mean.map { Float($0) },
+                        accuracy: 1e-4)
+            assertEqual(r.variance.flatArray, stats.variance.map { Float($0) },
+                        accuracy: 1e-4)
+            let expected = expectedNormalization(
+                x.flatArray, rows, 4, epsilon: 0.001, byRow: false)
+            assertEqual(r.y.flatArray, expected, accuracy: 1e-4)
+
+            // the activation is applied in the same pass
+            let relu = batchNormTraining(x, scale: array(Self.scale),
+                                         offset: array(Self.offset),
+                                         epsilon: 0.001, activation: .relu)
+            assertEqual(relu.y.flatArray, expected.map { Swift.max(0, $0) },
+                        accuracy: 1e-4)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_batchNormInference() {
+        let x = values(8 * 4, (8, 4))
+        let mean: [Float] = [0.5, -0.25, 0, 1]
+        let variance: [Float] = [1, 0.5, 2, 0.25]
+        let layer = BatchNorm<Shape2,Float>(
+            scale: array(Self.scale), offset: array(Self.offset),
+            runningMean: array(mean), runningVariance: array(variance),
+            activation: .tanh, mode: .inferring)
+        let expected = expectedNormalization(
+            x.flatArray, 8, 4, epsilon: 0.001, byRow: false,
+            mean: mean, variance: variance)
+        assertEqual(layer(x).flatArray, expected.map { Float.tanh($0) },
+                    accuracy: 1e-5)
+
+        // the running averages are not changed
+        XCTAssert(layer.runningMean.value.flatArray == mean)
+        XCTAssert(layer.runningVariance.value.flatArray == variance)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_batchNormRunningStatistics() {
+        let x = values(8 * 4, (8, 4))
+        let layer = BatchNorm<Shape2,Float>(featureCount: 4, momentum: 0.9)
+        _ = layer(x)
+        let stats = referenceStatistics(x.flatArray.map { Double($0) },
+                                        8, 4, byRow: false)
+        assertEqual(layer.runningMean.value.flatArray,
+                    stats.mean.map { Float(0.1 * $0) }, accuracy: 1e-5)
+        // the unbiased batch variance is used
+        assertEqual(layer.runningVariance.value.flatArray,
+                    stats.variance.map { Float(0.9 + 0.1 * $0 * 8 / 7) },
+                    accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_batchNormGradients() {
+        let x = values(6 * 4, (6, 4))
+        let outGrad = values(6 * 4, (6, 4), seed: 5)
+        let mean: [Double] = [0.5, -0.25, 0, 1]
+        let variance: [Double] = [1, 0.5, 2, 0.25]
+        for mode in [EvaluationMode.training, .inferring] {
+            let layer = BatchNorm<Shape2,Float>(
+                scale: array(Self.scale), offset: array(Self.offset),
+                runningMean: array(mean.map { Float($0) }),
+                runningVariance: array(variance.map { Float($0) }),
+                activation: .tanh, mode: mode)
+            let (g, xGrad) = pullback(at: layer, x) { $0($1) }(outGrad)
+
+            let batch = mode == .training
+            func f(_ x: [Double], _ scale: [Double], _ offset: [Double])
+                -> [Double]
+            {
+                referenceNormalization(
+                    x, 6, 4, scale, offset, epsilon: 0.001, byRow: false,
+                    mean: batch ? nil : mean,
+                    variance: batch ? nil : variance).map { .tanh($0) }
+            }
+            let expected = numericalGradients(
+                f, x.flatArray, outGrad.flatArray)
+            assertEqual(xGrad.flatArray, expected.x, accuracy: 1e-3)
+            assertEqual(g.scale.flatArray, expected.scale, accuracy: 1e-3)
+            assertEqual(g.offset.flatArray, expected.offset, accuracy: 1e-3)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // the channels of a NHWC tensor are normalized in place
+    func test_batchNormChannelsLast() {
+        let x = values(2 * 3 * 2 * 4, (2, 3, 2, 4))
+        let view = Tensor(channelsFirst: x, order: .NHWC)
+        let layer = BatchNorm<Shape4,Float>(
+            scale: array(Self.scale), offset: array(Self.offset),
+            runningMean: array([0, 0, 0, 0]),
+            runningVariance: array([1, 1, 1, 1]))
+        let expected = layer(x)
+        let y = layer(view)
+        XCTAssert(y.order == .NHWC && y.shape == Shape4(2, 4, 3, 2))
+        assertEqual(Tensor(channelsLast: y), expected, accuracy: 1e-6)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_layerNorm() {
+        for rows in [6, 5000] {
+            let x = values(rows * 4, (rows, 4))
+            let layer = LayerNorm<Shape2,Float>(
+                scale: array(Self.scale), offset: array(Self.offset),
+                activation: .relu)
+            let expected = expectedNormalization(
+                x.flatArray, rows, 4, epsilon: 0.00001, byRow: true)
+            assertEqual(layer(x).flatArray, expected.map { Swift.max(0, $0) },
+                        accuracy: 1e-4)
+        }
+
+        // the features of each sequence item are normalized
+        let x = values(2 * 3 * 4, (2, 3, 4))
+        let layer = LayerNorm<Shape3,Float>(featureCount: 4)
+        let expected = referenceNormalization(
+            x.flatArray.map { Double($0) }, 6, 4, [1, 1, 1, 1], [0, 0, 0, 0],
+            epsilon: 0.00001, byRow: true)
+        assertEqual(layer(x).flatArray, expected.map { Float($0) },
+                    accuracy: 1e-4)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_layerNormGradients() {
+        let x = values(6 * 4, (6, 4))
+        let outGrad = values(6 * 4, (6, 4), seed: 5)
+        let layer = LayerNorm<Shape2,Float>(
+            scale: array(Self.scale), offset: array(Self.offset),
+            activation: .sigmoid)
+        let (g, xGrad) = pullback(at: layer, x) { $0($1) }(outGrad)
+
+        func f(_ x: [Double], _ scale: [Double], _ offset: [Double])
+            -> [Double]
+        {
+            referenceNormalization(x, 6, 4, scale, offset, epsilon: 0.00001,
+                                   byRow: true).map { 1 / (1 + .exp(-$0)) }
+        }
+        let expected = numericalGradients(f, x.flatArray, outGrad.flatArray)
+        assertEqual(xGrad.flatArray, expected.x, accuracy: 1e-3)
+        assertEqual(g.scale.flatArray, expected.scale, accuracy: 1e-3)
+        assertEqual(g.offset.flatArray, expected.offset, accuracy: 1e-3)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_foldDense() {
+        let x = array(from: Float(-1), to: Float(1), (6, 5))
+        let dense = Dense<Shape2,Float>(
+            weight: array(from: Float(1), to: Float(-1), (5, 4)),
+            bias: array([0.5, -0.5, 0.25, 0]))
+        let norm = BatchNorm<Shape2,Float>(
+            scale: array(Self.scale), offset: array(Self.offset),
+            runningMean: array([0.5, -0.25, 0, 1]),
+            runningVariance: array([1, 0.5, 2, 0.25]),
+            activation: .relu, mode: .inferring)
+        let folded = norm.folded(into: dense)
+        XCTAssert(folded.activation == .relu)
+        assertEqual(folded(x), norm(dense(x)), accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_foldConvolution() {
+        let x = values(2 * 5 * 5 * 3, (2, 5, 5, 3))
+        let conv = Conv2(filter: values(3 * 3 * 3 * 4, (3, 3, 3, 4), seed: 2),
+                         bias: array([0.5, -0.5, 0.25, 0]), padding: .same)
+        let norm = BatchNorm<Shape4,Float>(
+            scale: array(Self.scale), offset: array(Self.offset),
+            runningMean: array([0.5, -0.25, 0, 1]),
+            runningVariance: array([1, 0.5, 2, 0.25]),
+            activation: .clippedRelu, mode: .inferring)
+        let folded = norm.folded(into: conv)
+        assertEqual(folded(x), norm(conv(x)), accuracy: 1e-4)
+    }
+
+    //--------------------------------------------------------------------------
+    func expectedNormalization(
+        _ x: [Float], _ rows: Int, _ cols: Int,
+        epsilon: Double, byRow: Bool,
+        mean: [Float]? = nil, variance: [Float]? = nil
+    ) -> [Float] {
+        referenceNormalization(
+            x.map { Double($0) }, rows, cols, Self.scale.map { Double($0) },
+            Self.offset.map { Double($0) }, epsilon: epsilon, byRow: byRow,
+            mean: mean?.map { Double($0) },
+            variance: variance?.map { Double($0) }).map { Float($0) }
+    }
+}
+
+//==============================================================================
+/// referenceStatistics
+/// - Returns: the mean and biased variance of each column of a
+///   `[rows, cols]` matrix, or of each row when `byRow` is `true`
+func referenceStatistics(
+    _ x: [Double], _ rows: Int, _ cols: Int, byRow: Bool
+) -> (mean: [Double], variance: [Double]) {
+    let groups = byRow ? rows : cols, n = byRow ? cols : rows
+    func index(_ g: Int, _ i: Int) -> Int { byRow ? g * cols + i : i * cols + g }
+    var mean = [Double](repeating: 0, count: groups)
+    var variance = [Double](repeating: 0, count: groups)
+    for g in 0..<groups {
+        mean[g] = (0..<n).reduce(0) { $0 + x[index(g, $1)] } / Double(n)
+        variance[g] = (0..<n).reduce(0) {
+            let d = x[index(g, $1)] - mean[g]
+            return $0 + d * d
+        } / Double(n)
+    }
+    return (mean, variance)
+}
+
+/// referenceNormalization
+/// normalizes the columns of a `[rows, cols]` matrix, or the rows when
+/// `byRow` is `true`, with the specified or computed statistics
+func referenceNormalization(
+    _ x: [Double], _ rows: Int, _ cols: Int,
+    _ scale: [Double], _ offset: [Double],
+    epsilon: Double, byRow: Bool,
+    mean: [Double]? = nil, variance: [Double]? = nil
+) -> [Double] {
+    let stats = referenceStatistics(x, rows, cols, byRow: byRow)
+    let mean = mean ?? stats.mean, variance = variance ?? stats.variance
+    var y = [Double](repeating: 0, count: x.count)
+    for r in 0..<rows {
+        for c in 0..<cols {
+            let g = byRow ? r : c
+            y[r * cols + c] = (x[r * cols + c] - mean[g]) /
+                (variance[g] + epsilon).squareRoot() * scale[c] + offset[c]
+        }
+    }
+    return y
+}
+
+/// numericalGradients
+/// - Returns: the central difference gradients of `sum(f(x) * yDiff)`
+///   with respect to `x` and the test scale and offset
+func numericalGradients(
+    _ f: ([Double], [Double], [Double]) -> [Double],
+    _ x: [Float], _ yDiff: [Float]
+) -> (x: [Float], scale: [Float], offset: [Float]) {
+    let h = 1e-4
+    let args = [x.map { Double($0) },
+                test_Normalization.scale.map { Double($0) },
+                test_Normalization.offset.map { Double($0) }]
+    let g = yDiff.map { Double($0) }
+    func loss(_ a: [[Double]]) -> Double {
+        zip(f(a[0], a[1], a[2]), g).reduce(0) { $0 + $1.0 * $1.1 }
+    }
+    let grads = (0..<3).map { arg in
+        args[arg].indices.map { i -> Float in
+            var plus = args, minus = args
+            plus[arg][i] += h
+            minus[arg][i] -= h
+            return Float((loss(plus) - loss(minus)) / (2 * h))
+        }
+    }
+    return (grads[0], grads[1], grads[2])
+}
@@ -0,0 +1,214 @@
+//******************************************************************************
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Optimizer: XCTestCase {
+    static var allTests = [
+        ("test_sgd", test_sgd),
+        ("test_momentum", test_momentum),
+        ("test_adam", test_adam),
+        ("test_sparseSgd", test_sparseSgd),
+        ("test_sparseAdam", test_sparseAdam),
+        ("test_optimizerUpdate", test_optimizerUpdate),
+        ("test_unusedParameter", test_unusedParameter),
+    ]
+
+    //--------------------------------------------------------------------------
+    func denseLayer() -> Dense<Shape2,Float> {
+        Dense<Shape2,Float>(
+            weight: array(from: Float(-1), to: Float(1), (4, 3)),
+            bias: array([0.5, -0.5, 0.25]))
+    }
+
+    func gradient(
+        _ layer: Dense<Shape2,Float>
+    ) -> Dense<Shape2,Float>.TangentVector {
+        let x = array(from: Float(1), to: Float(-1), (5, 4))
+        let outGrad = array(from: Float(-0.5), to: Float(1), (5, 3))
+        return pullback(at: layer) { $0(x) }(outGrad)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_sgd() {
+        var layer = denseLayer()
+        let g = gradient(layer)
+        let w = layer.weight.flatArray, b = layer.bias.flatArray
+        let id = layer.weight.storage.id
+        let optimizer = SGD(for: layer, learningRate: Float(0.1))
+        optimizer.update(&layer, along: g)
+
+        // the weights are updated in place
+        XCTAssert(layer.weight.storage.id == id)
+        assertEqual(layer.weight.flatArray,
+                    zip(w, g.weight.flatArray).map { $0 - 0.1 * $1 },
+                    accuracy: 1e-6)
+        assertEqual(layer.bias.flatArray,
+                    zip(b, g.bias.flatArray).map { $0 - 0.1 * $1 },
+                    accuracy: 1e-6)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_momentum() {
+        for nesterov in [false, true] {
+            var layer = denseLayer()
+        let g = gradient(layer)
+            var w = layer.weight.flatArray
+            let grad = g.weight.flatArray
+            var m = [Float](repeating: 0, count: w.count)
+            let optimizer = SGD(for: layer, learningRate: Float(0.1),
+                                momentum: 0.9, nesterov: nesterov)
+            for _ in 0..<3 {
+                optimizer.update(&layer, along: g)
+                for i in 0..<w.count {
+                    m[i] = 0.9 * m[i] + grad[i]
+                    w[i] -= 0.1 * (nesterov ? grad[i] + 0.9 * m[i] : m[i])
+                }
+            }
+            assertEqual(layer.weight.flatArray, w, accuracy: 1e-5)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_adam() {
+        var layer = denseLayer()
+        let g = gradient(layer)
+        var w = layer.weight.flatArray
+        let grad = g.weight.flatArray
+        var m = [Float](repeating: 0, count: w.count), v = m
+        let optimizer = Adam(for: layer, learningRate: Float(0.01))
+        for t in 1...3 {
+            optimizer.update(&layer, along: g)
+            let stepSize = 0.01 * (1 - pow(0.999, Float(t))).squareRoot() /
+                (1 - pow(0.9, Float(t)))
+            for i in 0..<w.count {
+                m[i] = 0.9 * m[i] + 0.1 * grad[i]
+                v[i] = 0.999 * v[i] + 0.001 * grad[i] * grad[i]
+                w[i] -= stepSize * m[i] / (v[i].squareRoot() + 1e-8)
+            }
+        }
+        XCTAssert(optimizer.step == 3)
+        assertEqual(layer.weight.flatArray, w, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    // only the rows selected by a sparse gradient are updated
+    func test_sparseSgd() {
+        var encoder = Embedding<Float>(
+            vocabularySize: 5,
+            embeddingSize: 2,
+            embeddingsInitializer: {
+                array(0..<($0[0] * $0[1]), ($0[0], $0[1]))
+            })
+        let sequence = array([3, 1, 3], type: DeviceIndex.self)
+        let outGrad = array([[1, 2], [3, 4], [5, 6]])
+        let g = pullback(at: encoder) { $0(sequence) }(outGrad)
+        let optimizer = SGD(for: encoder, learningRate: Float(0.5))
+        optimizer.update(&encoder, along: g)
+        XCTAssert(encoder.embeddings ==
+                    [[0, 1], [0.5, 1], [4, 5], [3, 3], [8, 9]])
+    }
+
+    //--------------------------------------------------------------------------
+    func test_sparseAdam() {
+        var encoder = Embedding<Float>(
+            vocabularySize: 5,
+            embeddingSize: 2,
+            embeddingsInitializer: {
+                array(0..<($0[0] * $0[1]), ($0[0], $0[1]))
+            })
+        let optimizer = Adam(for: encoder, learningRate: Float(0.1))
+        let outGrad = array([[1, -2], [3, 4]])
+        for indices in [[3, 1], [1, 2]] {
+            let sequence = array(indices, type: DeviceIndex.self)
+            let g = pullback(at: encoder) { $0(sequence) }(outGrad)
+            optimizer.update(&encoder, along: g)
+        }
+        // the rows that were never selected are unchanged, and the first
+        // step of Adam moves each element by the learning rate
+        let e = encoder.embeddings.flatArray
+        XCTAssert(e[0] == 0 && e[1] == 1 && e[8] == 8 && e[9] == 9)
+        assertEqual([e[6], e[7]], [5.9, 7.1], accuracy: 1e-5)
+        XCTAssert(e[4] < 4 && e[5] < 5)
+    }
+
+    //--------------------------------------------------------------------------
+    // the work list is split across tensors of different sizes
+    func test_optimizerUpdate() {
+        let sizes = [3, 70_000, 17, 40_000]
+        var parameters = sizes.map {
+            OptimizerParameter(
+                weight: array(from: Float(0), to: Float(1), count: $0),
+                gradient: array(from: Float(1), to: Float(0), count: $0))
+        }
+        optimizerUpdate(.sgd(learningRate: Float(2)), &parameters)
+        for (p, n) in sizes.enumerated() {
+            let w = array(from: Float(0), to: Float(1), count: n).flatArray
+            let g = array(from: Float(1), to: Float(0), count: n).flatArray
+            assertEqual(parameters[p].weight.flatArray,
+                        zip(w, g).map { $0 - 2 * $1 }, accuracy: 1e-6)
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // a parameter that is not used has a zero gradient and is not updated,
+    // and a tensor that is not differentiable does not shift the matching
+    // of the model tensors and the gradients
+    func test_unusedParameter() {
+        var model = TwoLayers(
+            statistics: array([1, 2, 3, 4]),
+            used: denseLayer(),
+            unused: Dense<Shape2,Float>(
+                weight: array(from: Float(0), to: Float(1), (3, 2))))
+        let x = array(from: Float(1), to: Float(-1), (5, 4))
+        let outGrad = array(from: Float(-0.5), to: Float(1), (5, 3))
+        let g = pullback(at: model) { $0(x) }(outGrad)
+        let expected = gradient(model.used)
+        let w = model.used.weight.flatArray
+        let unused = model.unused.weight.flatArray
+
+        for optimizer in [SGD(for: model, learningRate: Float(0.1)),
+                          SGD(for: model, learningRate: Float(0.1),
+                              momentum: 0.5)] {
+            var m = model
+            optimizer.update(&m, along: g)
+            assertEqual(m.used.weight.flatArray,
+                        zip(w, expected.weight.flatArray)
+                            .map { $0 - 0.1 * $1 }, accuracy: 1e-6)
+            XCTAssert(m.unused.weight.flatArray == unused)
+            XCTAssert(m.statistics.flatArray == [1, 2, 3, 4])
+        }
+
+        let adam = Adam(for: model, learningRate: Float(0.01))
+        adam.update(&model, along: g)
+        XCTAssert(model.unused.weight.flatArray == unused)
+        XCTAssert(model.statistics.flatArray == [1, 2, 3, 4])
+    }
+}
+
+//==============================================================================
+/// a model with a non differentiable tensor and an unused layer
+struct TwoLayers: Layer {
+    @noDerivative var statistics: TensorR1<Float>
+    var used: Dense<Shape2,Float>
+    var unused: Dense<Shape2,Float>
+
+    @differentiable
+    func callAsFunction(_ input: TensorR2<Float>) -> TensorR2<Float> {
+        used(input)
+    }
+}
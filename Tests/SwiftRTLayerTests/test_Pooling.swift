@@ -0,0 +1,305 @@
+//******************************************************************************
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+import XCTest
+import Foundation
+import SwiftRT
+
+class test_Pooling: XCTestCase {
+    static var allTests = [
+        ("test_maxPool", test_maxPool),
+        ("test_avgPool", test_avgPool),
+        ("test_pool1D3D", test_pool1D3D),
+        ("test_globalAvgPool", test_globalAvgPool),
+        ("test_poolingBackward", test_poolingBackward),
+        ("test_poolingChannelsLast", test_poolingChannelsLast),
+        ("test_poolingPullbacks", test_poolingPullbacks),
+    ]
+
+    // (window, stride, padding)
+    static let windows: [(Int, Int, Padding)] = [
+        (2, 2, .valid), (3, 2, .valid), (3, 2, .same), (3, 1, .same),
+        (2, 1, .valid),
+    ]
+
+    //--------------------------------------------------------------------------
+    func test_maxPool() {
+        // more channels than a channel block
+        for channels in [3, 70] {
+            let x = values(2 * 7 * 6 * channels, (2, 7, 6, channels))
+            for (window, stride, padding) in Self.windows {
+                let expected = referencePooling(
+                    x.flatArray, [2, 1, 7, 6, channels], [1, window, window],
+                    [1, stride, stride], same: padding == .same, max: true)
+                let pool = MaxPool2(poolSize: window, stride: stride,
+                                    padding: padding)
+                let y = pool(x)
+                XCTAssert(y.shape == Shape4(2, expected.shape[2],
+                                            expected.shape[3], channels))
+                XCTAssert(y.flatArray == expected.values)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_avgPool() {
+        let x = values(2 * 7 * 6 * 5, (2, 7, 6, 5))
+        for includePadding in [false, true] {
+            for (window, stride, padding) in Self.windows {
+                let expected = referencePooling(
+                    x.flatArray, [2, 1, 7, 6, 5], [1, window, window],
+                    [1, stride, stride], same: padding == .same, max: false,
+                    includePadding: includePadding)
+                let pool = AvgPool2(poolSize: window, stride: stride,
+                                    padding: padding,
+                                    includePadding: includePadding)
+                let y = pool(x)
+                XCTAssert(y.shape == Shape4(2, expected.shape[2],
+                                            expected.shape[3], 5))
+                assertEqual(y.flatArray, expected.values, accuracy: 1e-5)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    func test_pool1D3D() {
+        let x1 = values(2 * 9 * 4, (2, 9, 4))
+        let e1 = referencePooling(x1.flatArray, [2, 1, 1, 9, 4], [1, 1, 3],
+                                  [1, 1, 2], same: true, max: true)
+        let y1 = MaxPool1(poolSize: 3, stride: 2, padding: .same)(x1)
+        XCTAssert(y1.shape == Shape3(2, 5, 4))
+        XCTAssert(y1.flatArray == e1.values)
+
+        let x3 = values(2 * 4 * 5 * 6 * 3, (2, 4, 5, 6, 3))
+        let e3 = referencePooling(x3.flatArray, [2, 4, 5, 6, 3], [2, 2, 2],
+                                  [2, 2, 2], same: false, max: false)
+        let y3 = AvgPool3(poolSize: 2)(x3)
+        XCTAssert(y3.shape == Shape5(2, 2, 2, 3, 3))
+        assertEqual(y3.flatArray, e3.values, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_globalAvgPool() {
+        let x = values(3 * 5 * 4 * 6, (3, 5, 4, 6))
+        let y = GlobalAvgPool2()(x)
+        XCTAssert(y.shape == Shape4(3, 1, 1, 6))
+        let expected = referencePooling(
+            x.flatArray, [3, 1, 5, 4, 6], [1, 5, 4], [1, 1, 1],
+            same: false, max: false)
+        assertEqual(y.flatArray, expected.values, accuracy: 1e-5)
+
+        // the window follows the input shape
+        let x3 = values(2 * 3 * 2 * 2 * 4, (2, 3, 2, 2, 4))
+        XCTAssert(GlobalAvgPool3()(x3).shape == Shape5(2, 1, 1, 1, 4))
+    }
+
+    //--------------------------------------------------------------------------
+    func test_poolingBackward() {
+        let x = values(2 * 7 * 6 * 5, (2, 7, 6, 5))
+        for (window, stride, padding) in Self.windows {
+            // max pooling with saved and recomputed indices
+            let expected = referencePooling(
+                x.flatArray, [2, 1, 7, 6, 5], [1, window, window],
+                [1, stride, stride], same: padding == .same, max: true)
+            let pool = MaxPool2(poolSize: window, stride: stride,
+                                padding: padding)
+            let (y, indices) = pool.poolingOp.forward(x: x, mode: .training)
+            XCTAssert(indices?.shape == y.shape)
+            XCTAssert(pool.poolingOp.forward(x: x, mode: .inferring)
+                        .indices == nil)
+            let yDiff = values(like: y, seed: 7)
+            let expectedDiff = expected.backward(yDiff.flatArray)
+
+            var xDiff = Tensor(like: x)
+            pool.poolingOp.backward(y: y, yDiff: yDiff, x: x,
+                                    indices: indices, xDiff: &xDiff)
+            assertEqual(xDiff.flatArray, expectedDiff, accuracy: 1e-5)
+
+            var xDiff2 = Tensor(like: x)
+            pool.poolingOp.backward(y: y, yDiff: yDiff, x: x, xDiff: &xDiff2)
+            assertEqual(xDiff2.flatArray, expectedDiff, accuracy: 1e-5)
+
+            // average pooling
+            for includePadding in [false, true] {
+                let avgExpected = referencePooling(
+                    x.flatArray, [2, 1, 7, 6, 5], [1, window, window],
+                    [1, stride, stride], same: padding == .same, max: false,
+                    includePadding: includePadding)
+                let avg = AvgPool2(poolSize: window, stride: stride,
+                                   padding: padding,
+                                   includePadding: includePadding)
+                let ya = avg(x)
+                var xaDiff = Tensor(like: x)
+                avg.poolingOp.backward(y: ya, yDiff: yDiff, x: x,
+                                       xDiff: &xaDiff)
+                assertEqual(xaDiff.flatArray,
+                            avgExpected.backward(yDiff.flatArray),
+                            accuracy: 1e-5)
+            }
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    // channels last inputs give the same results as row order NHWC inputs
+    func test_poolingChannelsLast() {
+        let x = values(2 * 6 * 5 * 4, (2, 6, 5, 4))
+        let view = Tensor(channelsFirst: x, order: .NHWC)
+        let pool = MaxPool2(poolSize: 3, stride: 2, padding: .same)
+        let expected = pool(x)
+        let (y, indices) = pool.poolingOp.forward(x: view, mode: .training)
+        XCTAssert(y.order == .NHWC && y.shape == Shape4(2, 4, 3, 3))
+        XCTAssert(Tensor(channelsLast: y) == expected)
+
+        let yDiff = values(like: expected, seed: 3)
+        var xDiff = Tensor(like: x)
+        pool.poolingOp.backward(y: expected, yDiff: yDiff, x: x,
+                                xDiff: &xDiff)
+        var xcDiff = Tensor(like: view)
+        pool.poolingOp.backward(
+            y: y, yDiff: Tensor(channelsFirst: yDiff, order: .NHWC),
+            x: view, indices: indices, xDiff: &xcDiff)
+        XCTAssert(Tensor(channelsLast: xcDiff) == xDiff)
+        XCTAssert(GlobalAvgPool2()(view).shape == Shape4(2, 4, 1, 1))
+    }
+
+    //--------------------------------------------------------------------------
+    // each differentiated call holds its own max pooling indices, so two
+    // forward passes can run before their backward passes
+    func test_poolingPullbacks() {
+        let x1 = values(2 * 7 * 6 * 5, (2, 7, 6, 5))
+        let x2 = values(2 * 7 * 6 * 5, (2, 7, 6, 5), seed: 5)
+        for mode in [EvaluationMode.training, .inferring] {
+            let pool = MaxPool2(poolSize: 3, stride: 2, padding: .same,
+                                mode: mode)
+            let (y1, pb1) = valueWithPullback(at: x1) { pool($0) }
+            let (y2, pb2) = valueWithPullback(at: x2) { pool($0) }
+            XCTAssert(y1 == pool(x1) && y2 == pool(x2))
+
+            let yDiff = values(like: y1, seed: 7)
+            for (x, pb) in [(x1, pb1), (x2, pb2)] {
+                let expected = referencePooling(
+                    x.flatArray, [2, 1, 7, 6, 5], [1, 3, 3], [1, 2, 2],
+                    same: true, max: true)
+                assertEqual(pb(yDiff).flatArray,
+                            expected.backward(yDiff.flatArray),
+                            accuracy: 1e-5)
+            }
+        }
+
+        // average pooling pullback
+        let avg = AvgPool2(poolSize: 3, stride: 2, padding: .same)
+        let (ya, pba) = valueWithPullback(at: x1) { avg($0) }
+        let yaDiff = values(like: ya, seed: 7)
+        let expected = referencePooling(
+            x1.flatArray, [2, 1, 7, 6, 5], [1, 3, 3], [1, 2, 2],
+            same: true, max: false)
+        assertEqual(pba(yaDiff).flatArray,
+                    expected.backward(yaDiff.flatArray), accuracy: 1e-5)
+    }
+}
+
+//==============================================================================
+/// referencePooling
+/// a direct pooling of NDHWC data, where the window of each output element
+/// is the list of input indices it reads and their divisor
+struct ReferencePooling {
+    var values: [Float]
+    var shape: [Int]
+    var inputCount: Int
+    var windows: [[Int]]
+    var divisors: [Float]
+    var isMax: Bool
+
+    /// scatters the output gradient to the window maximums, or evenly to
+    /// the averaged elements
+    func backward(_ yDiff: [Float]) -> [Float] {
+        var xDiff = [Float](repeating: 0, count: inputCount)
+        for (o, window) in windows.enumerated() where !window.isEmpty {
+            if isMax {
+                xDiff[window[0]] += yDiff[o]
+            } else {
+                for i in window { xDiff[i] += yDiff[o] / divisors[o] }
+            }
+        }
+        return xDiff
+    }
+}
+
+func referencePooling(
+    _ x: [Float], _ xs: [Int],
+    _ window: [Int], _ strides: [Int],
+    same: Bool, max: Bool, includePadding: Bool = false
+) -> ReferencePooling {
+    var outSize = [Int](repeating: 0, count: 3)
+    var pad = [Int](repeating: 0, count: 3)
+    for d in 0..<3 {
+        let i = xs[d + 1], f = window[d], s = strides[d]
+        if same {
+            outSize[d] = (i + s - 1) / s
+            pad[d] = Swift.max(0, (outSize[d] - 1) * s + f - i) / 2
+        } else {
+            outSize[d] = (i - f) / s + 1
+        }
+    }
+    let C = xs[4]
+    var result = ReferencePooling(
+        values: [], shape: [xs[0]] + outSize + [C],
+        inputCount: x.count, windows: [], divisors: [], isMax: max)
+
+    for n in 0..<xs[0] {
+        for od in 0..<outSize[0] {
+            for oh in 0..<outSize[1] {
+                for ow in 0..<outSize[2] {
+                    for c in 0..<C {
+                        var indices = [Int]()
+                        for a in 0..<window[0] {
+                            let id = od * strides[0] - pad[0] + a
+                            for b in 0..<window[1] {
+                                let ih = oh * strides[1] - pad[1] + b
+                                for e in 0..<window[2] {
+                                    let iw = ow * strides[2] - pad[2] + e
+                                    guard id >= 0 && id < xs[1] &&
+                                            ih >= 0 && ih < xs[2] &&
+                                            iw >= 0 && iw < xs[3] else {
+                                        continue
+                                    }
+                                    indices.append(
+                                        (((n * xs[1] + id) * xs[2] + ih) *
+                                            xs[3] + iw) * C + c)
+                                }
+                            }
+                        }
+                        if max {
+                            // the first maximum
+                            var best = indices[0]
+                            for i in indices where x[i] > x[best] { best = i }
+                            result.values.append(x[best])
+                            result.windows.append([best])
+                            result.divisors.append(1)
+                        } else {
+                            let divisor = Float(includePadding ?
+                                window.reduce(1, *) : indices.count)
+                            result.values.append(
+                                indices.reduce(0) { $0 + x[$1] } / divisor)
+                            result.windows.append(indices)
+                            result.divisors.append(divisor)
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return result
+}
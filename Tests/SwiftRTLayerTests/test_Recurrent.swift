@@ -21,6 +21,15 @@ class test_Recurrent: XCTestCase {
     // support terminal test run
     static var allTests = [
         ("test_LSTMEncoder", test_LSTMEncoder),
+        ("test_embeddingGradient", test_embeddingGradient),
+        ("test_lstmPointwise", test_lstmPointwise),
+        ("test_lstmPointwiseGradients", test_lstmPointwiseGradients),
+        ("test_lstmSequence", test_lstmSequence),
+        ("test_lstmSequenceGradients", test_lstmSequenceGradients),
+        ("test_gruCell", test_gruCell),
+        ("test_gruCellGradients", test_gruCellGradients),
+        ("test_gruSequence", test_gruSequence),
+        ("test_basicRNNSequence", test_basicRNNSequence),
     ]
 
     //--------------------------------------------------------------------------
@@ -40,6 +49,157 @@ class test_Recurrent: XCTestCase {
         ])
     }
     
+    //--------------------------------------------------------------------------
+    // the gradient stores only the looked up rows
+    func test_embeddingGradient() {
+        var encoder = Embedding<Float>(
+                vocabularySize: 5,
+                embeddingSize: 2,
+                embeddingsInitializer: {
+                    array(0..<($0[0] * $0[1]), ($0[0], $0[1]))
+                })
+        let sequence = array([3, 1, 3], type: DeviceIndex.self)
+        let outGrad = array([[1, 2], [3, 4], [5, 6]])
+        let g = pullback(at: encoder) { $0(sequence) }(outGrad)
+        XCTAssert(g.embeddings.indices == [3, 1, 3])
+        XCTAssert(g.embeddings.rowCount == 5)
+        XCTAssert(g.embeddings.dense() ==
+                    [[0, 0], [3, 4], [0, 0], [6, 8], [0, 0]])
+
+        // only the stored rows are updated
+        encoder.move(along: g)
+        XCTAssert(encoder.embeddings ==
+                    [[0, 1], [5, 7], [4, 5], [12, 15], [8, 9]])
+    }
+
+    //--------------------------------------------------------------------------
+    // the fused pointwise kernel matches the unfused cell equations
+    func test_lstmPointwise() {
+        let gates = array(from: Float(-2), to: Float(2), (3, 20))
+        let cell = array(from: Float(1), to: Float(-1), (3, 5))
+        let state = LSTMCell<Float>.pointwise(gates: gates, cell: cell)
+        let expected = referenceLSTMPointwise(gates, cell)
+        assertEqual(state.cell, expected.cell, accuracy: 1e-6)
+        assertEqual(state.hidden, expected.hidden, accuracy: 1e-6)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_lstmPointwiseGradients() {
+        typealias State = LSTMCell<Float>.State
+        let gates = array(from: Float(-2), to: Float(2), (3, 20))
+        let cell = array(from: Float(1), to: Float(-1), (3, 5))
+        let stateGrad = State.TangentVector(
+            cell: array(from: Float(0.5), to: Float(-0.5), (3, 5)),
+            hidden: array(from: Float(-1), to: Float(1), (3, 5)))
+
+        let (gatesGrad, cellGrad) = pullback(at: gates, cell) {
+            LSTMCell<Float>.pointwise(gates: $0, cell: $1)
+        }(stateGrad)
+        let expected = pullback(at: gates, cell) {
+            referenceLSTMPointwise($0, $1)
+        }(stateGrad)
+        assertEqual(gatesGrad, expected.0, accuracy: 1e-5)
+        assertEqual(cellGrad, expected.1, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    // the sequence mode matches applying the cell to each time step
+    func test_lstmSequence() {
+        let cell = LSTMCell<Float>(inputSize: 3, hiddenSize: 4)
+        let x = array(from: Float(-1), to: Float(1), (5, 2, 3))
+        let state = LSTMCell<Float>.State(
+            cell: array(from: Float(0.5), to: Float(-0.5), (2, 4)),
+            hidden: array(from: Float(-0.5), to: Float(0.5), (2, 4)))
+        let y = LSTM<Float>(cell)(x, initialState: state)
+        XCTAssert(y.shape == Shape3(5, 2, 4))
+        let expected = referenceSequence(cell, x, state) { $0.hidden }
+        assertEqual(y, expected, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_lstmSequenceGradients() {
+        let cell = LSTMCell<Float>(inputSize: 3, hiddenSize: 4)
+        let x = array(from: Float(-1), to: Float(1), (3, 2, 3))
+        let state = cell.zeroState(for: TensorR2<Float>(zeros: Shape2(2, 3)))
+        let outGrad = array(from: Float(0.5), to: Float(-0.5), (3, 2, 4))
+
+        let (g, xGrad, stateGrad) = pullback(at: cell, x, state) {
+            $0.sequence($1, initialState: $2)
+        }(outGrad)
+
+        // unrolled reference
+        let expected = pullback(at: cell, x, state) { c, x, s0 in
+            let s1 = c(input: TensorR2(squeezing: x[0, 0..., 0...], axes: 0),
+                       state: s0).state
+            let s2 = c(input: TensorR2(squeezing: x[1, 0..., 0...], axes: 0),
+                       state: s1).state
+            let s3 = c(input: TensorR2(squeezing: x[2, 0..., 0...], axes: 0),
+                       state: s2).state
+            return TensorR3(stacking: s1.hidden, s2.hidden, s3.hidden)
+        }(outGrad)
+        assertEqual(g.fusedWeight, expected.0.fusedWeight, accuracy: 1e-5)
+        assertEqual(g.fusedBias, expected.0.fusedBias, accuracy: 1e-5)
+        assertEqual(xGrad, expected.1, accuracy: 1e-5)
+        assertEqual(stateGrad.cell, expected.2.cell, accuracy: 1e-5)
+        assertEqual(stateGrad.hidden, expected.2.hidden, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    // the fused gates match the per gate equations
+    func test_gruCell() {
+        var cell = GRUCell<Float>(inputSize: 3, hiddenSize: 4)
+        cell.resetBias = array([0.1, -0.2, 0.3, -0.4])
+        cell.outputBias = array([-0.5, 0.5, 0.25, 0])
+        XCTAssert(cell.fusedBias[4..<8] == cell.resetBias)
+        let x = array(from: Float(-1), to: Float(1), (2, 3))
+        let state = array(from: Float(0.5), to: Float(-0.5), (2, 4))
+        let y = cell(input: x, state: state).state
+        assertEqual(y, referenceGRU(cell, x, state), accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_gruCellGradients() {
+        var cell = GRUCell<Float>(inputSize: 3, hiddenSize: 4)
+        cell.updateBias = array([0.1, -0.2, 0.3, -0.4])
+        let x = array(from: Float(-1), to: Float(1), (2, 3))
+        let state = array(from: Float(0.5), to: Float(-0.5), (2, 4))
+        let outGrad = array(from: Float(-1), to: Float(1), (2, 4))
+
+        let (g, xGrad, stateGrad) = pullback(at: cell, x, state) {
+            $0(input: $1, state: $2).state
+        }(outGrad)
+        let expected = pullback(at: cell, x, state) {
+            referenceGRU($0, $1, $2)
+        }(outGrad)
+        assertEqual(g.fusedInputWeight, expected.0.fusedInputWeight,
+                    accuracy: 1e-5)
+        assertEqual(g.fusedStateWeight, expected.0.fusedStateWeight,
+                    accuracy: 1e-5)
+        assertEqual(g.fusedBias, expected.0.fusedBias, accuracy: 1e-5)
+        assertEqual(xGrad, expected.1, accuracy: 1e-5)
+        assertEqual(stateGrad, expected.2, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_gruSequence() {
+        let cell = GRUCell<Float>(inputSize: 3, hiddenSize: 4)
+        let x = array(from: Float(-1), to: Float(1), (5, 2, 3))
+        let state = array(from: Float(-0.5), to: Float(0.5), (2, 4))
+        let y = cell.sequence(x, initialState: state)
+        let expected = referenceSequence(cell, x, state) { $0 }
+        assertEqual(y, expected, accuracy: 1e-5)
+    }
+
+    //--------------------------------------------------------------------------
+    func test_basicRNNSequence() {
+        let cell = BasicRNNCell<Float>(inputSize: 3, hiddenSize: 4)
+        let x = array(from: Float(-1), to: Float(1), (5, 2, 3))
+        let state = array(from: Float(-0.5), to: Float(0.5), (2, 4))
+        let y = cell.sequence(x, initialState: state)
+        let expected = referenceSequence(cell, x, state) { $0 }
+        assertEqual(y, expected, accuracy: 1e-5)
+    }
+
     //--------------------------------------------------------------------------
     func test_LSTMEncoder() {
 //        var lstm = LSTM<Float>(LSTMCell(inputSize: 4, hiddenSize: 4))
@@ -92,6 +252,67 @@ class test_Recurrent: XCTestCase {
     }
 }
 
+//==============================================================================
+/// referenceSequence
+/// applies a cell to each time step of a `[T, batch, features]` sequence
+func referenceSequence<Cell: RecurrentLayerCell>(
+    _ cell: Cell,
+    _ x: TensorR3<Float>,
+    _ initialState: Cell.State,
+    _ hidden: (Cell.State) -> TensorR2<Float>
+) -> TensorR3<Float> where Cell.TimeStepInput == TensorR2<Float> {
+    var state = initialState
+    var outputs = [TensorR2<Float>]()
+    for t in 0..<x.shape[0] {
+        let input = TensorR2<Float>(squeezing: x[t, 0..., 0...], axes: 0)
+        state = cell(input: input, state: state).state
+        outputs.append(hidden(state))
+    }
+    return TensorR3(stacking: outputs)
+}
+
+//==============================================================================
+/// referenceGRU
+/// the GRU cell equations computed with separate gemms and element
+/// wise operators
+@differentiable
+func referenceGRU(
+    _ cell: GRUCell<Float>,
+    _ x: TensorR2<Float>,
+    _ state: TensorR2<Float>
+) -> TensorR2<Float> {
+    let w1 = cell.fusedInputWeight, w2 = cell.fusedStateWeight
+    let b = cell.fusedBias
+    let updateGate = sigmoid(
+        matmul(x, cell.part(.update, of: w1), bias: cell.part(.update, of: b)) +
+            matmul(state, cell.part(.update, of: w2)))
+    let resetGate = sigmoid(
+        matmul(x, cell.part(.reset, of: w1), bias: cell.part(.reset, of: b)) +
+            matmul(state, cell.part(.reset, of: w2)))
+    let outputGate = tanh(
+        matmul(x, cell.part(.output, of: w1), bias: cell.part(.output, of: b)) +
+            resetGate * matmul(state, cell.part(.output, of: w2)))
+    return (1 - updateGate) * state + updateGate * outputGate
+}
+
+//==============================================================================
+/// referenceLSTMPointwise
+/// the LSTM cell equations computed with separate element wise operators
+@differentiable
+func referenceLSTMPointwise(
+    _ gates: TensorR2<Float>,
+    _ cell: TensorR2<Float>
+) -> LSTMCell<Float>.State {
+    let h = cell.shape[1]
+    let inputGate = sigmoid(gates[0..., 0..<h])
+    let updateGate = tanh(gates[0..., h..<(2 * h)])
+    let forgetGate = sigmoid(gates[0..., (2 * h)..<(3 * h)])
+    let outputGate = sigmoid(gates[0..., (3 * h)..<(4 * h)])
+    let newCell = cell * forgetGate + inputGate * updateGate
+    return LSTMCell<Float>.State(cell: newCell,
+                                 hidden: tanh(newCell) * outputGate)
+}
+
 //==============================================================================
 // test data
 let lstmInputs =